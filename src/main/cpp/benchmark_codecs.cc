@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <sys/stat.h>
+#include <kchashdb.h>
+#include <util/StopWatch.hpp>
+
+#include "../../main/cpp/controller/controller.h"
+#include "../../main/cpp/patch/tree_codec.h"
+
+#define BENCHMARK_FILE "./.benchmark_codec"
+// The number of keys that are looked up in each tree
+#define BENCHMARK_LOOKUPS 1000
+
+long long file_size(const std::string& file_name) {
+    struct stat sb;
+    return stat(file_name.c_str(), &sb) == 0 ? sb.st_size : 0;
+}
+
+// Open a tree with the given codec, the compressor must be deleted after the tree is closed.
+bool open_tree(kyotocabinet::TreeDB* db, PatchTreeKeyComparator* comparator, const TreeCodec& codec,
+               const std::string& file_name, std::unique_ptr<kyotocabinet::Compressor>* compressor) {
+    db->tune_comparator(comparator);
+    compressor->reset(codec.tune(db, file_name, kyotocabinet::TreeDB::TCOMPRESS));
+    if (!db->open(file_name, kyotocabinet::TreeDB::OREADER | kyotocabinet::TreeDB::ONOLOCK)) {
+        std::cerr << "open " << file_name << " error: " << db->error().name() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "ERROR: Codec benchmark command must be invoked as 'codec_1 [codec_2 [...]]' " << std::endl;
+        return 1;
+    }
+
+    std::vector<TreeCodec> codecs;
+    try {
+        for (int i = 1; i < argc; i++) {
+            codecs.push_back(TreeCodec::parse(argv[i]));
+        }
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Load the store
+    Controller controller("./", kyotocabinet::TreeDB::TCOMPRESS, true);
+
+    std::cout << "codec,tree,size,scanms,lookupus" << std::endl;
+    for (int patch_tree_id : controller.get_patch_tree_manager()->get_patch_trees_ids()) {
+        std::shared_ptr<DictionaryManager> dict = controller.get_dictionary_manager(patch_tree_id);
+        std::vector<std::pair<std::string, std::unique_ptr<PatchTreeKeyComparator>>> trees;
+        trees.emplace_back("spo", std::unique_ptr<PatchTreeKeyComparator>(new PatchTreeKeyComparator(comp_s, comp_p, comp_o, dict)));
+        trees.emplace_back("pos", std::unique_ptr<PatchTreeKeyComparator>(new PatchTreeKeyComparator(comp_p, comp_o, comp_s, dict)));
+        trees.emplace_back("osp", std::unique_ptr<PatchTreeKeyComparator>(new PatchTreeKeyComparator(comp_o, comp_s, comp_p, dict)));
+        for (std::string family : {"additions", "deletions"}) {
+            TreeCodec source_codec;
+            TreeCodec::read("./" + PATCHTREE_FILENAME(patch_tree_id, family + "_codec"), &source_codec);
+            for (auto& tree : trees) {
+                std::string tree_name = PATCHTREE_FILENAME(patch_tree_id, tree.first + "_" + family);
+                std::unique_ptr<kyotocabinet::Compressor> source_compressor;
+                kyotocabinet::TreeDB source;
+                if (!open_tree(&source, tree.second.get(), source_codec, "./" + tree_name, &source_compressor)) {
+                    continue;
+                }
+
+                // Sample keys evenly over the tree
+                std::vector<std::string> keys;
+                int64_t step = std::max((int64_t) 1, source.count() / BENCHMARK_LOOKUPS);
+                kyotocabinet::DB::Cursor* cursor = source.cursor();
+                cursor->jump();
+                std::string key;
+                for (int64_t i = 0; cursor->get_key(&key, true); i++) {
+                    if (i % step == 0) {
+                        keys.push_back(key);
+                    }
+                }
+                delete cursor;
+
+                for (const TreeCodec& codec : codecs) {
+                    if (!codec.copy_tree(&source, tree.second.get(), BENCHMARK_FILE, FROZEN_PAGE_SIZE)) {
+                        continue;
+                    }
+                    long long size = file_size(BENCHMARK_FILE) + file_size(BENCHMARK_FILE "_dict");
+
+                    std::unique_ptr<kyotocabinet::Compressor> compressor;
+                    kyotocabinet::TreeDB copy;
+                    if (!open_tree(&copy, tree.second.get(), codec, BENCHMARK_FILE, &compressor)) {
+                        continue;
+                    }
+                    StopWatch st;
+                    cursor = copy.cursor();
+                    cursor->jump();
+                    while (cursor->step());
+                    delete cursor;
+                    long long scan_duration = st.stopReal() / 1000;
+
+                    st.reset();
+                    std::string value;
+                    for (const std::string& lookup_key : keys) {
+                        copy.get(lookup_key, &value);
+                    }
+                    long long lookup_duration = keys.empty() ? 0 : st.stopReal() / keys.size();
+                    copy.close();
+
+                    std::cout << codec.to_string() << "," << tree_name << "," << size << "," << scan_duration << "," << lookup_duration << std::endl;
+                    std::remove(BENCHMARK_FILE);
+                    std::remove(BENCHMARK_FILE "_dict");
+                }
+                source.close();
+            }
+        }
+    }
+
+    return 0;
+}
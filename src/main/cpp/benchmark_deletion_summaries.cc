@@ -0,0 +1,163 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <kchashdb.h>
+#include <util/StopWatch.hpp>
+
+#include "../../main/cpp/controller/controller.h"
+#include "../../main/cpp/patch/tree_codec.h"
+
+#define BENCHMARK_FILE "./.benchmark_deletion_summaries"
+
+long long file_size(const std::string& file_name) {
+    struct stat sb;
+    return stat(file_name.c_str(), &sb) == 0 ? sb.st_size : 0;
+}
+
+// Open a tree with the given codec, the compressor must be deleted after the tree is closed.
+bool open_tree(kyotocabinet::TreeDB* db, PatchTreeKeyComparator* comparator, const TreeCodec& codec,
+               const std::string& file_name, uint32_t mode, std::unique_ptr<kyotocabinet::Compressor>* compressor) {
+    db->tune_comparator(comparator);
+    compressor->reset(codec.tune(db, file_name, kyotocabinet::TreeDB::TCOMPRESS));
+    if (!db->open(file_name, mode)) {
+        std::cerr << "open " << file_name << " error: " << db->error().name() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Build a secondary deletion tree in the given layout from the values of the SPO deletion tree.
+bool build_tree(kyotocabinet::TreeDB* spo, PatchTreeKeyComparator* comparator, const TreeCodec& codec,
+                bool summaries, int max_patch_id) {
+    std::unique_ptr<kyotocabinet::Compressor> compressor;
+    kyotocabinet::TreeDB db;
+    if (!open_tree(&db, comparator, codec, BENCHMARK_FILE, kyotocabinet::TreeDB::OWRITER | kyotocabinet::TreeDB::OCREATE
+                   | kyotocabinet::TreeDB::OTRUNCATE | kyotocabinet::TreeDB::ONOLOCK, &compressor)) {
+        return false;
+    }
+    kyotocabinet::DB::Cursor* cursor = spo->cursor();
+    cursor->jump();
+    const char *kbp, *vbp;
+    size_t ksp, vsp;
+    while ((kbp = cursor->get(&ksp, &vbp, &vsp, true)) != nullptr) {
+#ifdef COMPRESSED_DEL_VALUES
+        PatchTreeDeletionValue value(max_patch_id);
+#else
+        PatchTreeDeletionValue value;
+#endif
+        value.deserialize(vbp, vsp);
+        size_t size;
+        const char* data;
+        if (summaries) {
+            char* summary_data = new char[PatchTreeDeletionSummary::max_serialization_size()];
+            size = value.get_summary().serialize(summary_data);
+            data = summary_data;
+        } else {
+            data = value.to_reduced().serialize(&size);
+        }
+        db.set(kbp, ksp, data, size);
+        delete[] data;
+        delete[] kbp;
+    }
+    delete cursor;
+    return db.close();
+}
+
+// Find the deletions of the given patch with an exact patch filter, by scanning the secondary tree.
+long long scan_tree(kyotocabinet::TreeDB* spo, PatchTreeKeyComparator* comparator, const TreeCodec& codec,
+                    bool summaries, int patch_id, int max_patch_id, long long* matches) {
+    std::unique_ptr<kyotocabinet::Compressor> compressor;
+    kyotocabinet::TreeDB db;
+    if (!open_tree(&db, comparator, codec, BENCHMARK_FILE, kyotocabinet::TreeDB::OREADER | kyotocabinet::TreeDB::ONOLOCK, &compressor)) {
+        return -1;
+    }
+#ifdef COMPRESSED_DEL_VALUES
+    PatchTreeDeletionValueView value(max_patch_id);
+    PatchTreeDeletionValueViewReduced value_reduced(max_patch_id);
+#else
+    PatchTreeDeletionValueView value;
+    PatchTreeDeletionValueViewReduced value_reduced;
+#endif
+    *matches = 0;
+    StopWatch st;
+    kyotocabinet::DB::Cursor* cursor = db.cursor();
+    cursor->jump();
+    const char *kbp, *vbp;
+    size_t ksp, vsp;
+    while ((kbp = cursor->get(&ksp, &vbp, &vsp, true)) != nullptr) {
+        if (summaries) {
+            // Only candidates are resolved in the SPO tree
+            PatchTreeDeletionSummary summary;
+            summary.deserialize(vbp, vsp);
+            if (summary.may_contain(patch_id)) {
+                size_t size;
+                const char* data = spo->get(kbp, ksp, &size);
+                if (data != nullptr) {
+                    value.wrap(data, size);
+                    *matches += value.get_patchvalue_index(patch_id) >= 0;
+                    delete[] data;
+                }
+            }
+        } else {
+            value_reduced.wrap(vbp, vsp);
+            *matches += value_reduced.get_patchvalue_index(patch_id) >= 0;
+        }
+        delete[] kbp;
+    }
+    delete cursor;
+    long long duration = st.stopReal() / 1000;
+    db.close();
+    return duration;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 1) {
+        std::cerr << "ERROR: Deletion summaries benchmark command must be invoked without arguments" << std::endl;
+        return 1;
+    }
+
+    // Load the store
+    Controller controller("./", kyotocabinet::TreeDB::TCOMPRESS, true);
+
+    std::cout << "tree,layout,size,scanms,matches" << std::endl;
+    for (int patch_tree_id : controller.get_patch_tree_manager()->get_patch_trees_ids()) {
+        std::shared_ptr<DictionaryManager> dict = controller.get_dictionary_manager(patch_tree_id);
+        int max_patch_id = controller.get_patch_tree_manager()->get_patch_tree(patch_tree_id, dict)->get_max_patch_id();
+        // The middle of the delta chain is queried, so that the summaries have to exclude deletions on both sides
+        int patch_id = patch_tree_id + (max_patch_id - patch_tree_id) / 2;
+        TreeCodec codec;
+        TreeCodec::read("./" + PATCHTREE_FILENAME(patch_tree_id, "deletions_codec"), &codec);
+
+        PatchTreeKeyComparator spo_comparator(comp_s, comp_p, comp_o, dict);
+        std::unique_ptr<kyotocabinet::Compressor> spo_compressor;
+        kyotocabinet::TreeDB spo;
+        if (!open_tree(&spo, &spo_comparator, codec, "./" + PATCHTREE_FILENAME(patch_tree_id, "spo_deletions"),
+                       kyotocabinet::TreeDB::OREADER | kyotocabinet::TreeDB::ONOLOCK, &spo_compressor)) {
+            continue;
+        }
+
+        std::vector<std::pair<std::string, std::unique_ptr<PatchTreeKeyComparator>>> trees;
+        trees.emplace_back("pos", std::unique_ptr<PatchTreeKeyComparator>(new PatchTreeKeyComparator(comp_p, comp_o, comp_s, dict)));
+        trees.emplace_back("osp", std::unique_ptr<PatchTreeKeyComparator>(new PatchTreeKeyComparator(comp_o, comp_s, comp_p, dict)));
+        for (auto& tree : trees) {
+            std::string tree_name = PATCHTREE_FILENAME(patch_tree_id, tree.first + "_deletions");
+            for (bool summaries : {false, true}) {
+                if (!build_tree(&spo, tree.second.get(), codec, summaries, max_patch_id)) {
+                    continue;
+                }
+                long long size = file_size(BENCHMARK_FILE) + file_size(BENCHMARK_FILE "_dict");
+                long long matches;
+                long long scan_duration = scan_tree(&spo, tree.second.get(), codec, summaries, patch_id, max_patch_id, &matches);
+                std::cout << tree_name << "," << (summaries ? "summaries" : "reduced") << "," << size << ","
+                          << scan_duration << "," << matches << std::endl;
+                std::remove(BENCHMARK_FILE);
+                std::remove(BENCHMARK_FILE "_dict");
+            }
+        }
+        spo.close();
+    }
+
+    return 0;
+}
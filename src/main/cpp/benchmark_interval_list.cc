@@ -0,0 +1,155 @@
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "../../main/cpp/patch/interval_list.h"
+
+// The number of serialized lists per measurement
+#define BENCHMARK_LISTS 10000
+// The number of lookups per list
+#define BENCHMARK_LOOKUPS 16
+
+// The red-black tree representation that IntervalList used before, only with its read operations.
+template<class T>
+class MapIntervalList {
+private:
+    T max;
+    std::map<T, T> intervals;
+public:
+    explicit MapIntervalList(T max_value): max(max_value) {}
+    bool is_in(T element) const {
+        auto pos = intervals.upper_bound(element);
+        if (pos == intervals.begin()) {
+            return false;
+        }
+        pos--;
+        return pos->first <= element && element < pos->second;
+    }
+    long get_index(T value, T outer_limit) const {
+        long count = 0;
+        for (auto& inter: intervals) {
+            long max_value = inter.second == max ? outer_limit : inter.second;
+            if (inter.first <= value && value < max_value) {
+                return count + (value - inter.first);
+            }
+            count += max_value - inter.first;
+        }
+        return -1;
+    }
+    T get_element_at(long i, T outer_limit) const {
+        long index = 0;
+        for (auto& inter: intervals) {
+            long range = (inter.second == max ? outer_limit : inter.second) - inter.first;
+            if (i < index + range) {
+                return inter.first + (i - index);
+            }
+            index += range;
+        }
+        return max;
+    }
+    void deserialize(const char *data, size_t size) {
+        intervals.clear();
+        size_t i = 0;
+#ifdef USE_VSI
+        size_t decode_size;
+        int64_t bounds[LEB128_BLOCK_SIZE];
+        while (i < size) {
+            size_t count = decode_SLEB128_block((const uint8_t*)(data+i), size - i, bounds, LEB128_BLOCK_SIZE, &decode_size);
+            i += decode_size;
+            for (size_t j = 0; j + 1 < count; j += 2) {
+                intervals.insert(std::make_pair((T) bounds[j], (T) bounds[j + 1]));
+            }
+        }
+#else
+        while (i < size) {
+            T s, e;
+            std::memcpy(&s, data+i, sizeof(T));
+            i += sizeof(T);
+            std::memcpy(&e, data+i, sizeof(T));
+            i += sizeof(T);
+            intervals.insert(std::make_pair(s, e));
+        }
+#endif
+    }
+};
+
+// Deserialize every list into a reused list, and look up elements in it, as the patch tree iterators do.
+template<class L>
+void measure(const std::string& name, int interval_count, const std::vector<std::pair<const char*, size_t>>& data,
+             const std::vector<int>& lookups, int outer_limit) {
+    L list(std::numeric_limits<int>::max());
+    long long checksum = 0;
+    std::chrono::nanoseconds deserialize_duration(0), is_in_duration(0), index_duration(0), element_duration(0);
+    for (const auto& serialized : data) {
+        auto start = std::chrono::steady_clock::now();
+        list.deserialize(serialized.first, serialized.second);
+        auto t1 = std::chrono::steady_clock::now();
+        for (int lookup : lookups) {
+            checksum += list.is_in(lookup);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        for (int lookup : lookups) {
+            checksum += list.get_index(lookup, outer_limit);
+        }
+        auto t3 = std::chrono::steady_clock::now();
+        for (int lookup : lookups) {
+            checksum += list.get_element_at(lookup, outer_limit);
+        }
+        auto t4 = std::chrono::steady_clock::now();
+        deserialize_duration += t1 - start;
+        is_in_duration += t2 - t1;
+        index_duration += t3 - t2;
+        element_duration += t4 - t3;
+    }
+    long long lookup_count = (long long) data.size() * lookups.size();
+    std::cout << name << "," << interval_count << ","
+              << deserialize_duration.count() / (long long) data.size() << ","
+              << is_in_duration.count() / lookup_count << ","
+              << index_duration.count() / lookup_count << ","
+              << element_duration.count() / lookup_count << ","
+              << checksum << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<int> interval_counts = {1, 4, 16, 64, 256};
+    if (argc > 1) {
+        interval_counts.clear();
+        for (int i = 1; i < argc; i++) {
+            interval_counts.push_back(std::stoi(argv[i]));
+        }
+    }
+
+    std::mt19937 random(42);
+    std::cout << "implementation,intervals,deserializens,isinns,indexns,elementns,checksum" << std::endl;
+    for (int interval_count : interval_counts) {
+        // Build lists with alternating additions and deletions, as a triple that is added and deleted again over versions
+        int outer_limit = interval_count * 8 + 8;
+        std::vector<std::pair<const char*, size_t>> data;
+        for (int i = 0; i < BENCHMARK_LISTS; i++) {
+            IntervalList<int> list(std::numeric_limits<int>::max());
+            int version = random() % 4;
+            for (int j = 0; j < interval_count; j++) {
+                list.addition(version);
+                version += 1 + random() % 4;
+                list.deletion(version);
+                version += 1 + random() % 4;
+            }
+            data.push_back(list.serialize());
+        }
+        std::vector<int> lookups;
+        for (int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+            lookups.push_back(random() % outer_limit);
+        }
+
+        measure<MapIntervalList<int>>("map", interval_count, data, lookups, outer_limit);
+        measure<IntervalList<int>>("flat", interval_count, data, lookups, outer_limit);
+
+        for (auto& serialized : data) {
+            delete[] serialized.first;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <util/StopWatch.hpp>
+
+#include "../../main/cpp/patch/patch_tree.h"
+#include "../../main/cpp/dictionary/dictionary_manager.h"
+
+#define BENCHMARK_PATH "./.benchmark_parallel_append/"
+
+// Remove all files of the benchmark stores.
+void cleanup() {
+    DIR *dir;
+    struct dirent *ent;
+    if ((dir = opendir(BENCHMARK_PATH)) != nullptr) {
+        while ((ent = readdir(dir)) != nullptr) {
+            std::string entry_name = std::string(ent->d_name);
+            if (entry_name != "." && entry_name != "..") {
+                std::remove((BENCHMARK_PATH + entry_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(BENCHMARK_PATH);
+}
+
+// Append the given patch to the given tree, and return the duration in milliseconds.
+long long append(PatchTree& patch_tree, const PatchSorted& patch, int patch_id, int partitions) {
+    StopWatch st;
+    patch_tree.append_unsafe(patch, patch_id, partitions);
+    return st.stopReal() / 1000;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 3) {
+        std::cerr << "ERROR: Parallel append benchmark command must be invoked as [nr_triples [max_partitions]]" << std::endl;
+        return 1;
+    }
+    long nr_triples = argc > 1 ? std::stol(argv[1]) : 1000000;
+    int max_partitions = argc > 2 ? std::stoi(argv[2]) : (int) std::max(1u, std::thread::hardware_concurrency());
+
+    cleanup();
+    mkdir(BENCHMARK_PATH, 0755);
+    std::shared_ptr<DictionaryManager> dict = std::make_shared<DictionaryManager>(BENCHMARK_PATH, 0);
+
+    // The first patch adds the triples, the second one deletes as many other triples,
+    // so that it merges the deletions into the existing additions of the same subjects.
+    PatchSorted additions(dict);
+    PatchSorted deletions(dict);
+    for (long i = 0; i < nr_triples; i++) {
+        std::string subject = "http://example.org/s" + std::to_string(i / 10);
+        std::string predicate = "http://example.org/p" + std::to_string(i % 7);
+        additions.add_unsorted(PatchElement(Triple(subject, predicate, "\"a" + std::to_string(i % 1000) + "\"", dict), true));
+        deletions.add_unsorted(PatchElement(Triple(subject, predicate, "\"d" + std::to_string(i % 1000) + "\"", dict), false));
+    }
+    additions.sort();
+    deletions.sort();
+
+    std::cout << "partitions,triples,additions-ms,deletions-ms,speedup" << std::endl;
+    long long sequential_duration = 0;
+    for (int partitions = 1; partitions <= max_partitions; partitions *= 2) {
+        // Each run appends into a new patch tree
+        int patch_id = partitions * 2;
+        long long duration;
+        {
+            PatchTree patch_tree(BENCHMARK_PATH, patch_id, dict);
+            long long additions_duration = append(patch_tree, additions, patch_id, partitions);
+            long long deletions_duration = append(patch_tree, deletions, patch_id + 1, partitions);
+            duration = additions_duration + deletions_duration;
+            if (partitions == 1) {
+                sequential_duration = duration;
+            }
+            std::cout << partitions << "," << nr_triples << "," << additions_duration << "," << deletions_duration << ","
+                      << (duration > 0 ? (double) sequential_duration / duration : 0) << std::endl;
+        }
+    }
+
+    cleanup();
+    return 0;
+}
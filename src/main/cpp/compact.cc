@@ -0,0 +1,47 @@
+#include <iostream>
+#include <kchashdb.h>
+
+#include "../../main/cpp/controller/controller.h"
+#include "simpleprogresslistener.h"
+
+
+int main(int argc, char** argv) {
+    int param_offset = 0;
+
+    bool verbose = argc > 1 && std::string(argv[1]) == "-v";
+    if (verbose) {
+        param_offset += 1;
+    }
+    if (argc != 4 + param_offset) {
+        std::cerr << "ERROR: Compact command must be invoked as '[-v] target_path string int|float' " << std::endl;
+        return 1;
+    }
+    hdt::ProgressListener* progressListener = verbose ? new SimpleProgressListener() : nullptr;
+
+    std::string target_path = argv[1 + param_offset];
+    if (target_path.back() != '/') {
+        target_path += "/";
+    }
+    SnapshotCreationStrategy* strategy = SnapshotCreationStrategy::get_composite_strategy(argv[2 + param_offset], argv[3 + param_offset]);
+    if (strategy == nullptr) {
+        std::cerr << "ERROR: Unknown snapshot creation strategy: " << argv[2 + param_offset] << std::endl;
+        return 1;
+    }
+
+    // Load the store
+    Controller controller("./", kyotocabinet::TreeDB::TCOMPRESS, true);
+
+    bool status = controller.recompact(target_path, strategy, kyotocabinet::TreeDB::TCOMPRESS, progressListener);
+
+    if (progressListener)
+        std::cout << std::endl;
+
+    delete progressListener;
+    delete strategy;
+
+    if (!status) {
+        std::cerr << "ERROR: Compaction into '" << target_path << "' failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
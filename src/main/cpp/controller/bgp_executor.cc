@@ -0,0 +1,594 @@
+#include <set>
+#include <algorithm>
+#include "bgp_executor.h"
+
+static const hdt::TripleComponentRole POSITION_ROLES[3] = {hdt::SUBJECT, hdt::PREDICATE, hdt::OBJECT};
+
+static size_t get_component(const Triple& triple, int position) {
+    return position == 0 ? triple.get_subject() : (position == 1 ? triple.get_predicate() : triple.get_object());
+}
+
+static void set_component(Triple& triple, int position, size_t id) {
+    if (position == 0) {
+        triple.set_subject(id);
+    } else if (position == 1) {
+        triple.set_predicate(id);
+    } else {
+        triple.set_object(id);
+    }
+}
+
+// Hash for the join keys of the hash join.
+struct BGPKeyHash {
+    std::size_t operator()(const std::vector<size_t>& key) const {
+        std::size_t seed = key.size();
+        for (size_t id : key) {
+            seed ^= std::hash<size_t>()(id) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+};
+
+
+BGPSolution::BGPSolution() : addition(true) {}
+
+BGPSolution::BGPSolution(std::vector<std::string> values, bool addition, std::vector<int> versions)
+        : values(std::move(values)), addition(addition), versions(std::move(versions)) {}
+
+const std::vector<std::string>& BGPSolution::get_values() const {
+    return values;
+}
+
+bool BGPSolution::is_addition() const {
+    return addition;
+}
+
+const std::vector<int>& BGPSolution::get_versions() const {
+    return versions;
+}
+
+
+BGPSolutionIterator::BGPSolutionIterator(std::vector<BGPResultSet> result_sets, std::vector<int> projection,
+                                         std::vector<hdt::TripleComponentRole> roles)
+        : result_sets(std::move(result_sets)), projection(std::move(projection)), roles(std::move(roles)),
+          result_set_index(0), binding_index(0) {}
+
+BGPSolutionIterator::BGPSolutionIterator(std::vector<BGPSolution> decoded_solutions)
+        : decoded_solutions(std::move(decoded_solutions)), result_set_index(0), binding_index(0) {}
+
+bool BGPSolutionIterator::next(BGPSolution* solution) {
+    if (!decoded_solutions.empty() || result_sets.empty()) {
+        if (binding_index >= decoded_solutions.size()) {
+            return false;
+        }
+        *solution = decoded_solutions[binding_index++];
+        return true;
+    }
+    while (result_set_index < result_sets.size() && binding_index >= result_sets[result_set_index].bindings.size()) {
+        result_set_index++;
+        binding_index = 0;
+    }
+    if (result_set_index >= result_sets.size()) {
+        return false;
+    }
+    const BGPResultSet& result_set = result_sets[result_set_index];
+    const BGPBinding& binding = result_set.bindings[binding_index++];
+    std::vector<std::string> values;
+    values.reserve(projection.size());
+    for (int variable : projection) {
+        values.push_back(result_set.dict->idToString(binding.values[variable], roles[variable]));
+    }
+    *solution = BGPSolution(values, result_set.addition, binding.versions);
+    return true;
+}
+
+size_t BGPSolutionIterator::get_count() {
+    size_t count = 0;
+    BGPSolution solution;
+    while (next(&solution)) {
+        count++;
+    }
+    return count;
+}
+
+
+VersionMaterializedTripleSource::VersionMaterializedTripleSource(const Controller* controller, int patch_id)
+        : controller(controller), patch_id(patch_id) {}
+
+void VersionMaterializedTripleSource::find(const Triple& triple_pattern, std::vector<Triple>& triples, std::vector<std::vector<int>>* versions) {
+    TripleIterator* it = controller->get_version_materialized_ids(triple_pattern, 0, patch_id);
+    Triple triple;
+    while (it->next(&triple)) {
+        triples.push_back(triple);
+        if (versions != nullptr) {
+            versions->push_back({patch_id});
+        }
+    }
+    delete it;
+}
+
+
+VersionTripleSource::VersionTripleSource(const Controller* controller, int snapshot_id)
+        : controller(controller), snapshot_id(snapshot_id), patch_tree(nullptr) {
+    dict = controller->get_snapshot_manager()->get_dictionary_manager(snapshot_id);
+    // Only use the patch tree if it belongs to the delta chain of this snapshot
+    int patch_tree_id = controller->get_patch_tree_manager()->get_patch_tree_id(snapshot_id + 1);
+    if (patch_tree_id > snapshot_id) {
+        patch_tree = controller->get_patch_tree_manager()->get_patch_tree(patch_tree_id, dict);
+    }
+}
+
+void VersionTripleSource::find(const Triple& triple_pattern, std::vector<Triple>& triples, std::vector<std::vector<int>>* versions) {
+    std::shared_ptr<hdt::HDT> snapshot = controller->get_snapshot_manager()->get_snapshot(snapshot_id);
+    hdt::IteratorTripleID* snapshot_it = SnapshotManager::search_with_offset(snapshot, triple_pattern, 0, dict, true);
+    PatchTreeTripleVersionsIteratorV2 it(triple_pattern, snapshot_it, patch_tree, snapshot_id, dict);
+    TripleVersions triple_versions;
+    while (it.next(&triple_versions)) {
+        triples.push_back(*triple_versions.get_triple());
+        if (versions != nullptr) {
+            versions->push_back(*triple_versions.get_versions());
+        }
+    }
+}
+
+
+BGPExecutor::BGPExecutor(const Controller* controller, std::vector<StringTriple> patterns, const std::vector<std::string>& projection)
+        : controller(controller), patterns(std::move(patterns)), join_strategy(BGP_JOIN_AUTO) {
+    for (const StringTriple& pattern : this->patterns) {
+        std::array<std::string, 3> terms = get_terms(pattern);
+        std::array<int, 3> variables = {-1, -1, -1};
+        std::array<bool, 3> anonymous = {false, false, false};
+        for (int i = 0; i < 3; i++) {
+            anonymous[i] = terms[i].empty();
+            if (is_variable(terms[i])) {
+                auto it = variable_ids.find(terms[i]);
+                if (it == variable_ids.end()) {
+                    int variable = variable_names.size();
+                    variable_ids[terms[i]] = variable;
+                    variable_names.push_back(terms[i]);
+                    variable_roles.push_back(POSITION_ROLES[i]);
+                    variables[i] = variable;
+                } else {
+                    variables[i] = it->second;
+                }
+            }
+        }
+        pattern_variables.push_back(variables);
+        pattern_anonymous.push_back(anonymous);
+    }
+    if (projection.empty()) {
+        for (int variable = 0; variable < (int) variable_names.size(); variable++) {
+            this->projection.push_back(variable);
+        }
+    } else {
+        for (const std::string& variable_name : projection) {
+            auto it = variable_ids.find(variable_name);
+            if (it == variable_ids.end()) {
+                throw std::invalid_argument("The projected variable '" + variable_name + "' does not occur in the basic graph pattern.");
+            }
+            this->projection.push_back(it->second);
+        }
+    }
+}
+
+bool BGPExecutor::is_variable(const std::string& term) {
+    return !term.empty() && term[0] == '?';
+}
+
+StringTriple BGPExecutor::get_lookup_pattern(const StringTriple& pattern) {
+    return StringTriple(
+            is_variable(pattern.get_subject()) ? "" : pattern.get_subject(),
+            is_variable(pattern.get_predicate()) ? "" : pattern.get_predicate(),
+            is_variable(pattern.get_object()) ? "" : pattern.get_object()
+    );
+}
+
+std::array<std::string, 3> BGPExecutor::get_terms(const StringTriple& pattern) {
+    return {pattern.get_subject(), pattern.get_predicate(), pattern.get_object()};
+}
+
+size_t BGPExecutor::convert_role(size_t id, hdt::TripleComponentRole from, hdt::TripleComponentRole to, std::shared_ptr<DictionaryManager> dict) {
+    if (id == 0 || from == to) {
+        return id;
+    }
+    if (from != hdt::PREDICATE && to != hdt::PREDICATE && id <= dict->getHdtDict()->getNshared()) {
+        // Terms that are shared between subjects and objects have the same id in both roles
+        return id;
+    }
+    try {
+        std::string term = dict->idToString(id, from);
+        return term.empty() ? 0 : dict->stringToId(term, to);
+    } catch (std::exception& e) {
+        // The term does not exist in the target role
+        return 0;
+    }
+}
+
+size_t BGPExecutor::convert_cached(size_t id, hdt::TripleComponentRole from, hdt::TripleComponentRole to, std::shared_ptr<DictionaryManager> dict,
+                                   std::map<std::pair<size_t, int>, size_t>& conversions) const {
+    if (from == to) {
+        return id;
+    }
+    std::pair<size_t, int> key(id, from * 3 + to);
+    auto it = conversions.find(key);
+    if (it != conversions.end()) {
+        return it->second;
+    }
+    size_t converted = convert_role(id, from, to, dict);
+    conversions[key] = converted;
+    return converted;
+}
+
+std::vector<std::string> BGPExecutor::get_projection() const {
+    std::vector<std::string> names;
+    for (int variable : projection) {
+        names.push_back(variable_names[variable]);
+    }
+    return names;
+}
+
+void BGPExecutor::set_join_strategy(BGPJoinStrategy strategy) {
+    join_strategy = strategy;
+}
+
+std::vector<int> BGPExecutor::get_plan(const std::vector<size_t>& estimates, int first_pattern) const {
+    std::vector<int> plan;
+    std::vector<bool> planned(patterns.size(), false);
+    std::set<int> bound_variables;
+    auto add_to_plan = [&](int pattern_index) {
+        plan.push_back(pattern_index);
+        planned[pattern_index] = true;
+        for (int variable : pattern_variables[pattern_index]) {
+            if (variable >= 0) {
+                bound_variables.insert(variable);
+            }
+        }
+    };
+    if (first_pattern >= 0) {
+        add_to_plan(first_pattern);
+    }
+    // Greedily pick the pattern with the lowest estimate, preferring patterns that join with the already bound variables,
+    // so that we avoid cartesian products as long as possible.
+    while (plan.size() < patterns.size()) {
+        int best = -1;
+        bool best_connected = false;
+        for (int i = 0; i < (int) patterns.size(); i++) {
+            if (planned[i]) {
+                continue;
+            }
+            bool connected = false;
+            for (int variable : pattern_variables[i]) {
+                if (variable >= 0 && bound_variables.find(variable) != bound_variables.end()) {
+                    connected = true;
+                }
+            }
+            if (best < 0 || (connected && !best_connected) || (connected == best_connected && estimates[i] < estimates[best])) {
+                best = i;
+                best_connected = connected;
+            }
+        }
+        add_to_plan(best);
+    }
+    return plan;
+}
+
+bool BGPExecutor::encode_pattern(int pattern_index, std::shared_ptr<DictionaryManager> dict, Triple& encoded) const {
+    std::array<std::string, 3> terms = get_terms(patterns[pattern_index]);
+    for (int i = 0; i < 3; i++) {
+        size_t id = 0;
+        if (!terms[i].empty() && !is_variable(terms[i])) {
+            try {
+                id = dict->stringToId(terms[i], POSITION_ROLES[i]);
+            } catch (std::exception& e) {
+                // Unknown terms can not produce any matches
+                return false;
+            }
+            if (id == 0) {
+                return false;
+            }
+        }
+        set_component(encoded, i, id);
+    }
+    return true;
+}
+
+bool BGPExecutor::translate_triple(Triple& triple, std::shared_ptr<DictionaryManager> dict_from, std::shared_ptr<DictionaryManager> dict_to) {
+    try {
+        for (int i = 0; i < 3; i++) {
+            size_t id = dict_to->stringToId(dict_from->idToString(get_component(triple, i), POSITION_ROLES[i]), POSITION_ROLES[i]);
+            if (id == 0) {
+                return false;
+            }
+            set_component(triple, i, id);
+        }
+    } catch (std::exception& e) {
+        return false;
+    }
+    return true;
+}
+
+bool BGPExecutor::bind(BGPBinding& binding, int pattern_index, const Triple& triple, const std::vector<int>* triple_versions, bool first_pattern,
+                       std::shared_ptr<DictionaryManager> dict, std::map<std::pair<size_t, int>, size_t>& conversions) const {
+    const std::array<int, 3>& variables = pattern_variables[pattern_index];
+    for (int i = 0; i < 3; i++) {
+        int variable = variables[i];
+        if (variable >= 0) {
+            size_t id = convert_cached(get_component(triple, i), POSITION_ROLES[i], variable_roles[variable], dict, conversions);
+            if (id == 0) {
+                return false;
+            }
+            if (binding.values[variable] == 0) {
+                binding.values[variable] = id;
+            } else if (binding.values[variable] != id) {
+                return false;
+            }
+        } else if (pattern_anonymous[pattern_index][i]) {
+            binding.anonymous_values.resize(patterns.size() * 3, 0);
+            binding.anonymous_values[pattern_index * 3 + i] = get_component(triple, i);
+        }
+    }
+    if (triple_versions != nullptr) {
+        if (first_pattern) {
+            binding.versions = *triple_versions;
+        } else {
+            std::vector<int> versions;
+            std::set_intersection(binding.versions.begin(), binding.versions.end(),
+                                  triple_versions->begin(), triple_versions->end(), std::back_inserter(versions));
+            binding.versions = versions;
+        }
+        if (binding.versions.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<BGPBinding> BGPExecutor::evaluate(std::vector<BGPBinding> bindings, const std::vector<int>& plan, size_t first_step, bool track_versions,
+                                              BGPTripleSource& source, const std::vector<size_t>& estimates, std::shared_ptr<DictionaryManager> dict) const {
+    std::map<std::pair<size_t, int>, size_t> conversions;
+    for (size_t step = first_step; step < plan.size() && !bindings.empty(); step++) {
+        int pattern_index = plan[step];
+        bool first_pattern = step == 0;
+        const std::array<int, 3>& variables = pattern_variables[pattern_index];
+        Triple encoded;
+        if (!encode_pattern(pattern_index, dict, encoded)) {
+            return {};
+        }
+
+        // All bindings of a step have the same bound variables
+        std::vector<int> join_positions;
+        for (int i = 0; i < 3; i++) {
+            if (variables[i] >= 0 && bindings[0].values[variables[i]] != 0) {
+                join_positions.push_back(i);
+            }
+        }
+
+        bool bind_join;
+        if (join_positions.empty() || join_strategy == BGP_JOIN_HASH) {
+            bind_join = false;
+        } else if (join_strategy == BGP_JOIN_BIND) {
+            bind_join = true;
+        } else {
+            bind_join = bindings.size() * BGP_BIND_JOIN_RATIO <= estimates[pattern_index];
+        }
+
+        std::vector<BGPBinding> next_bindings;
+        std::vector<Triple> triples;
+        std::vector<std::vector<int>> versions;
+        std::vector<std::vector<int>>* versions_ptr = track_versions ? &versions : nullptr;
+        if (bind_join) {
+            // Look up the pattern once for every binding, with the bound variables filled in
+            for (const BGPBinding& binding : bindings) {
+                Triple bound_pattern = encoded;
+                bool valid = true;
+                for (int position : join_positions) {
+                    int variable = variables[position];
+                    size_t id = convert_cached(binding.values[variable], variable_roles[variable], POSITION_ROLES[position], dict, conversions);
+                    if (id == 0) {
+                        valid = false;
+                        break;
+                    }
+                    set_component(bound_pattern, position, id);
+                }
+                if (!valid) {
+                    continue;
+                }
+                triples.clear();
+                versions.clear();
+                source.find(bound_pattern, triples, versions_ptr);
+                for (size_t i = 0; i < triples.size(); i++) {
+                    BGPBinding extended = binding;
+                    if (bind(extended, pattern_index, triples[i], track_versions ? &versions[i] : nullptr, first_pattern, dict, conversions)) {
+                        next_bindings.push_back(std::move(extended));
+                    }
+                }
+            }
+        } else {
+            // Look up the pattern once, and hash its triples on the join variables
+            source.find(encoded, triples, versions_ptr);
+            std::unordered_map<std::vector<size_t>, std::vector<size_t>, BGPKeyHash> table;
+            for (size_t i = 0; i < triples.size(); i++) {
+                std::vector<size_t> key;
+                bool valid = true;
+                for (int position : join_positions) {
+                    int variable = variables[position];
+                    size_t id = convert_cached(get_component(triples[i], position), POSITION_ROLES[position], variable_roles[variable], dict, conversions);
+                    if (id == 0) {
+                        valid = false;
+                        break;
+                    }
+                    key.push_back(id);
+                }
+                if (valid) {
+                    table[key].push_back(i);
+                }
+            }
+            for (const BGPBinding& binding : bindings) {
+                std::vector<size_t> key;
+                for (int position : join_positions) {
+                    key.push_back(binding.values[variables[position]]);
+                }
+                auto it = table.find(key);
+                if (it != table.end()) {
+                    for (size_t i : it->second) {
+                        BGPBinding extended = binding;
+                        if (bind(extended, pattern_index, triples[i], track_versions ? &versions[i] : nullptr, first_pattern, dict, conversions)) {
+                            next_bindings.push_back(std::move(extended));
+                        }
+                    }
+                }
+            }
+        }
+        bindings = std::move(next_bindings);
+    }
+    return bindings;
+}
+
+BGPSolutionIterator* BGPExecutor::get_version_materialized(int patch_id) const {
+    std::vector<BGPResultSet> result_sets;
+    if (!patterns.empty() && controller->get_snapshot_manager()->get_latest_snapshot(patch_id) >= 0) {
+        std::shared_ptr<DictionaryManager> dict = controller->get_dictionary_manager(patch_id);
+        std::vector<size_t> estimates;
+        for (const StringTriple& pattern : patterns) {
+            estimates.push_back(controller->get_version_materialized_count(get_lookup_pattern(pattern), patch_id, true).first);
+        }
+        VersionMaterializedTripleSource source(controller, patch_id);
+        BGPBinding initial;
+        initial.values.resize(variable_names.size(), 0);
+        BGPResultSet result_set;
+        result_set.dict = dict;
+        result_set.addition = true;
+        result_set.bindings = evaluate({initial}, get_plan(estimates, -1), 0, false, source, estimates, dict);
+        result_sets.push_back(std::move(result_set));
+    }
+    return new BGPSolutionIterator(std::move(result_sets), projection, variable_roles);
+}
+
+BGPSolutionIterator* BGPExecutor::get_delta_materialized(int patch_id_start, int patch_id_end) const {
+    std::vector<BGPResultSet> result_sets;
+    if (patterns.empty() || patch_id_end <= patch_id_start || controller->get_snapshot_manager()->get_latest_snapshot(patch_id_start) < 0) {
+        return new BGPSolutionIterator(std::move(result_sets), projection, variable_roles);
+    }
+
+    std::vector<TripleDeltaIterator*> delta_its;
+    for (int side = 0; side < 2; side++) {
+        // Added solutions exist in the end version, deleted solutions exist in the start version
+        bool addition = side == 0;
+        int patch_id = addition ? patch_id_end : patch_id_start;
+        std::shared_ptr<DictionaryManager> dict = controller->get_dictionary_manager(patch_id);
+        BGPResultSet result_set;
+        result_set.dict = dict;
+        result_set.addition = addition;
+
+        bool matchable = true;
+        for (int i = 0; i < (int) patterns.size(); i++) {
+            Triple encoded;
+            matchable = matchable && encode_pattern(i, dict, encoded);
+        }
+        if (matchable) {
+            std::vector<size_t> estimates;
+            for (const StringTriple& pattern : patterns) {
+                estimates.push_back(controller->get_version_materialized_count(get_lookup_pattern(pattern), patch_id, true).first);
+            }
+            VersionMaterializedTripleSource source(controller, patch_id);
+            std::map<std::pair<size_t, int>, size_t> conversions;
+            // Solutions are deduplicated on their full binding, so that solutions that only differ in variables that are
+            // projected away, or in the triples matched by anonymous variables, are all kept, as in the other query types.
+            // Additions and deletions are never compared, as each side has its own result set.
+            std::set<std::pair<std::vector<size_t>, std::vector<size_t>>> emitted;
+            BGPBinding initial;
+            initial.values.resize(variable_names.size(), 0);
+
+            // Every added (deleted) solution contains at least one added (deleted) triple,
+            // so we let the delta of each triple pattern drive the evaluation once, and remove duplicate solutions.
+            for (int driver = 0; driver < (int) patterns.size(); driver++) {
+                std::vector<BGPBinding> bindings;
+                TripleDeltaIterator* it = controller->get_delta_materialized(get_lookup_pattern(patterns[driver]), 0, patch_id_start, patch_id_end);
+                TripleDelta triple_delta;
+                while (it->next(&triple_delta)) {
+                    if (triple_delta.is_addition() != addition) {
+                        continue;
+                    }
+                    Triple triple = *triple_delta.get_triple();
+                    if (triple_delta.get_dictionary() != nullptr && triple_delta.get_dictionary() != dict
+                        && !translate_triple(triple, triple_delta.get_dictionary(), dict)) {
+                        continue;
+                    }
+                    BGPBinding binding = initial;
+                    if (bind(binding, driver, triple, nullptr, true, dict, conversions)) {
+                        bindings.push_back(std::move(binding));
+                    }
+                }
+                delete it;
+
+                std::vector<BGPBinding> solutions = evaluate(std::move(bindings), get_plan(estimates, driver), 1, false, source, estimates, dict);
+                for (BGPBinding& solution : solutions) {
+                    if (emitted.insert(std::make_pair(solution.values, solution.anonymous_values)).second) {
+                        result_set.bindings.push_back(std::move(solution));
+                    }
+                }
+            }
+        }
+        result_sets.push_back(std::move(result_set));
+    }
+    return new BGPSolutionIterator(std::move(result_sets), projection, variable_roles);
+}
+
+BGPSolutionIterator* BGPExecutor::get_version() const {
+    std::vector<BGPResultSet> result_sets;
+    if (patterns.empty()) {
+        return new BGPSolutionIterator(std::move(result_sets), projection, variable_roles);
+    }
+
+    std::vector<size_t> estimates;
+    for (const StringTriple& pattern : patterns) {
+        estimates.push_back(controller->get_version_count(get_lookup_pattern(pattern), true).first);
+    }
+    std::vector<int> plan = get_plan(estimates, -1);
+    BGPBinding initial;
+    initial.values.resize(variable_names.size(), 0);
+
+    // Every version belongs to exactly one delta chain, so we can evaluate each delta chain separately.
+    for (int snapshot_id : controller->get_snapshot_manager()->get_snapshots_ids()) {
+        VersionTripleSource source(controller, snapshot_id);
+        BGPResultSet result_set;
+        result_set.dict = controller->get_snapshot_manager()->get_dictionary_manager(snapshot_id);
+        result_set.addition = true;
+        result_set.bindings = evaluate({initial}, plan, 0, true, source, estimates, result_set.dict);
+        result_sets.push_back(std::move(result_set));
+    }
+    if (result_sets.size() <= 1) {
+        return new BGPSolutionIterator(std::move(result_sets), projection, variable_roles);
+    }
+
+    // Solutions from different delta chains are encoded with different dictionaries,
+    // so we have to merge them on their decoded values.
+    // As within a single delta chain, solutions matching different triples through anonymous variables are kept apart.
+    std::map<std::pair<std::vector<std::string>, std::vector<std::string>>, std::vector<int>> merged;
+    for (const BGPResultSet& result_set : result_sets) {
+        for (const BGPBinding& binding : result_set.bindings) {
+            std::vector<std::string> values;
+            for (int variable = 0; variable < (int) variable_names.size(); variable++) {
+                values.push_back(result_set.dict->idToString(binding.values[variable], variable_roles[variable]));
+            }
+            std::vector<std::string> anonymous_values;
+            for (int position = 0; position < (int) binding.anonymous_values.size(); position++) {
+                size_t id = binding.anonymous_values[position];
+                anonymous_values.push_back(id == 0 ? "" : result_set.dict->idToString(id, POSITION_ROLES[position % 3]));
+            }
+            std::vector<int>& versions = merged[std::make_pair(values, anonymous_values)];
+            versions.insert(versions.end(), binding.versions.begin(), binding.versions.end());
+        }
+    }
+    std::vector<BGPSolution> solutions;
+    for (auto& kv : merged) {
+        std::vector<std::string> values;
+        for (int variable : projection) {
+            values.push_back(kv.first.first[variable]);
+        }
+        std::sort(kv.second.begin(), kv.second.end());
+        kv.second.erase(std::unique(kv.second.begin(), kv.second.end()), kv.second.end());
+        solutions.emplace_back(values, true, kv.second);
+    }
+    return new BGPSolutionIterator(std::move(solutions));
+}
@@ -0,0 +1,211 @@
+#ifndef OSTRICH_BGP_EXECUTOR_H
+#define OSTRICH_BGP_EXECUTOR_H
+
+#include <map>
+#include <array>
+#include <unordered_map>
+#include "controller.h"
+
+// The bind join is preferred over a hash join when the number of intermediate bindings
+// is at least this many times smaller than the estimated cardinality of the next triple pattern.
+#ifndef BGP_BIND_JOIN_RATIO
+#define BGP_BIND_JOIN_RATIO 8
+#endif
+
+
+enum BGPJoinStrategy {
+    BGP_JOIN_AUTO,
+    BGP_JOIN_BIND,
+    BGP_JOIN_HASH
+};
+
+
+// A solution of a basic graph pattern, containing the decoded values of the projected variables.
+class BGPSolution {
+protected:
+    std::vector<std::string> values;
+    bool addition;
+    std::vector<int> versions;
+public:
+    BGPSolution();
+    BGPSolution(std::vector<std::string> values, bool addition, std::vector<int> versions);
+    /**
+     * @return The values of the projected variables, in the order of the projection.
+     */
+    const std::vector<std::string>& get_values() const;
+    /**
+     * @return If this solution was added (otherwise deleted), only relevant for delta materialized queries.
+     */
+    bool is_addition() const;
+    /**
+     * @return The versions in which this solution exists, only relevant for version queries.
+     */
+    const std::vector<int>& get_versions() const;
+};
+
+
+// Intermediate solution of a basic graph pattern on dictionary-encoded values.
+struct BGPBinding {
+    // The id of each variable in its canonical role, 0 when unbound.
+    std::vector<size_t> values;
+    // The versions in which the bound triples all exist, only used for version queries.
+    std::vector<int> versions;
+    // The id at each anonymous position of each pattern, 0 when unbound, empty if the patterns have no anonymous variables.
+    // Solutions with equal values can be derived from different triples through these positions.
+    std::vector<size_t> anonymous_values;
+};
+
+
+// A set of bindings that are all encoded with the same dictionary.
+struct BGPResultSet {
+    std::shared_ptr<DictionaryManager> dict;
+    bool addition;
+    std::vector<BGPBinding> bindings;
+};
+
+
+// Iterator over the solutions of a basic graph pattern.
+// Values are only decoded to strings when a solution is emitted.
+class BGPSolutionIterator {
+private:
+    std::vector<BGPResultSet> result_sets;
+    std::vector<BGPSolution> decoded_solutions;
+    std::vector<int> projection;
+    std::vector<hdt::TripleComponentRole> roles;
+    size_t result_set_index;
+    size_t binding_index;
+public:
+    BGPSolutionIterator(std::vector<BGPResultSet> result_sets, std::vector<int> projection, std::vector<hdt::TripleComponentRole> roles);
+    explicit BGPSolutionIterator(std::vector<BGPSolution> decoded_solutions);
+    bool next(BGPSolution* solution);
+    size_t get_count();
+};
+
+
+// Source of encoded triples within a single delta chain.
+class BGPTripleSource {
+public:
+    virtual ~BGPTripleSource() = default;
+    /**
+     * Find all triples matching the given triple pattern.
+     * @param triple_pattern A triple pattern encoded with the dictionary of this source, 0 is a wildcard.
+     * @param triples The matching triples will be appended to this vector.
+     * @param versions The versions of each matching triple will be appended to this vector, if not null.
+     */
+    virtual void find(const Triple& triple_pattern, std::vector<Triple>& triples, std::vector<std::vector<int>>* versions) = 0;
+};
+
+
+// Triple source for a single materialized version.
+class VersionMaterializedTripleSource : public BGPTripleSource {
+private:
+    const Controller* controller;
+    int patch_id;
+public:
+    VersionMaterializedTripleSource(const Controller* controller, int patch_id);
+    void find(const Triple& triple_pattern, std::vector<Triple>& triples, std::vector<std::vector<int>>* versions) override;
+};
+
+
+// Triple source for all versions of a single delta chain.
+class VersionTripleSource : public BGPTripleSource {
+private:
+    const Controller* controller;
+    int snapshot_id;
+    std::shared_ptr<PatchTree> patch_tree;
+    std::shared_ptr<DictionaryManager> dict;
+public:
+    VersionTripleSource(const Controller* controller, int snapshot_id);
+    void find(const Triple& triple_pattern, std::vector<Triple>& triples, std::vector<std::vector<int>>* versions) override;
+};
+
+
+/**
+ * Evaluates basic graph patterns for a certain version (VM), between two versions (DM), or for all versions (VQ).
+ *
+ * Triple patterns are given as string triples, where terms starting with '?' are variables,
+ * and empty terms are anonymous variables.
+ * All joins are done on dictionary-encoded ids, the join order is determined using the count estimates of each pattern,
+ * and the join type (bind or hash join) is chosen for every step based on the number of intermediate bindings.
+ */
+class BGPExecutor {
+private:
+    const Controller* controller;
+    std::vector<StringTriple> patterns;
+    std::map<std::string, int> variable_ids;
+    std::vector<std::string> variable_names;
+    // For each pattern, the variable id at each triple position, -1 for constants and anonymous variables.
+    std::vector<std::array<int, 3>> pattern_variables;
+    // For each pattern, if each triple position is an anonymous variable.
+    std::vector<std::array<bool, 3>> pattern_anonymous;
+    // The role of the first occurrence of each variable, in which its ids are stored in bindings.
+    std::vector<hdt::TripleComponentRole> variable_roles;
+    std::vector<int> projection;
+    BGPJoinStrategy join_strategy;
+
+    static bool is_variable(const std::string& term);
+    static StringTriple get_lookup_pattern(const StringTriple& pattern);
+    static std::array<std::string, 3> get_terms(const StringTriple& pattern);
+    static bool translate_triple(Triple& triple, std::shared_ptr<DictionaryManager> dict_from, std::shared_ptr<DictionaryManager> dict_to);
+
+    std::vector<int> get_plan(const std::vector<size_t>& estimates, int first_pattern) const;
+    bool encode_pattern(int pattern_index, std::shared_ptr<DictionaryManager> dict, Triple& encoded) const;
+    size_t convert_cached(size_t id, hdt::TripleComponentRole from, hdt::TripleComponentRole to, std::shared_ptr<DictionaryManager> dict,
+                          std::map<std::pair<size_t, int>, size_t>& conversions) const;
+    bool bind(BGPBinding& binding, int pattern_index, const Triple& triple, const std::vector<int>* triple_versions, bool first_pattern,
+              std::shared_ptr<DictionaryManager> dict, std::map<std::pair<size_t, int>, size_t>& conversions) const;
+    std::vector<BGPBinding> evaluate(std::vector<BGPBinding> bindings, const std::vector<int>& plan, size_t first_step, bool track_versions,
+                                     BGPTripleSource& source, const std::vector<size_t>& estimates, std::shared_ptr<DictionaryManager> dict) const;
+
+public:
+    /**
+     * @param controller The controller to query.
+     * @param patterns The triple patterns of the basic graph pattern.
+     * @param projection The variables to project, including the '?' prefix. If empty, all variables are projected.
+     */
+    BGPExecutor(const Controller* controller, std::vector<StringTriple> patterns, const std::vector<std::string>& projection = {});
+
+    /**
+     * Convert an id from one triple component role to another within the given dictionary.
+     * @param id The id to convert.
+     * @param from The role of the id.
+     * @param to The target role.
+     * @param dict The dictionary of the id.
+     * @return The converted id, or 0 if the term does not exist in the target role.
+     */
+    static size_t convert_role(size_t id, hdt::TripleComponentRole from, hdt::TripleComponentRole to, std::shared_ptr<DictionaryManager> dict);
+
+    /**
+     * @return The names of the projected variables.
+     */
+    std::vector<std::string> get_projection() const;
+    /**
+     * Override the automatic choice between bind and hash joins.
+     */
+    void set_join_strategy(BGPJoinStrategy strategy);
+
+    /**
+     * Evaluate the basic graph pattern at a certain version.
+     * @param patch_id The version to query.
+     * @return An iterator over the solutions.
+     */
+    BGPSolutionIterator* get_version_materialized(int patch_id) const;
+    /**
+     * Evaluate the basic graph pattern between two versions.
+     * Solutions that exist in patch_id_end but not in patch_id_start are emitted as additions,
+     * solutions that exist in patch_id_start but not in patch_id_end are emitted as deletions.
+     * @param patch_id_start The start version.
+     * @param patch_id_end The end version.
+     * @return An iterator over the solutions.
+     */
+    BGPSolutionIterator* get_delta_materialized(int patch_id_start, int patch_id_end) const;
+    /**
+     * Evaluate the basic graph pattern over all versions.
+     * Solutions are annotated with all versions in which they exist.
+     * @return An iterator over the solutions.
+     */
+    BGPSolutionIterator* get_version() const;
+};
+
+
+#endif //OSTRICH_BGP_EXECUTOR_H
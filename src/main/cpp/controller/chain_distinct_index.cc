@@ -0,0 +1,290 @@
+#include <regex>
+#include <fstream>
+#include <dirent.h>
+#include "chain_distinct_index.h"
+
+
+ChainDistinctTriples::ChainDistinctTriples(const std::string& base_path, int snapshot_id, const std::string& part,
+                                           std::shared_ptr<DictionaryManager> dict, bool readonly) {
+    index_spo = new kyotocabinet::TreeDB();
+    index_pos = new kyotocabinet::TreeDB();
+    index_osp = new kyotocabinet::TreeDB();
+    index_spo->tune_comparator(spo_comparator = new PatchTreeKeyComparator(comp_s, comp_p, comp_o, dict));
+    index_pos->tune_comparator(pos_comparator = new PatchTreeKeyComparator(comp_p, comp_o, comp_s, dict));
+    index_osp->tune_comparator(osp_comparator = new PatchTreeKeyComparator(comp_o, comp_s, comp_p, dict));
+    open(index_spo, base_path + CHAIN_DISTINCT_FILENAME(snapshot_id, part, "spo"), readonly);
+    open(index_pos, base_path + CHAIN_DISTINCT_FILENAME(snapshot_id, part, "pos"), readonly);
+    open(index_osp, base_path + CHAIN_DISTINCT_FILENAME(snapshot_id, part, "osp"), readonly);
+}
+
+ChainDistinctTriples::~ChainDistinctTriples() {
+    for (kyotocabinet::TreeDB* db : {index_spo, index_pos, index_osp}) {
+        if (!db->close()) {
+            cerr << "close chain distinct index error: " << db->error().name() << endl;
+        }
+        delete db;
+    }
+    delete spo_comparator;
+    delete pos_comparator;
+    delete osp_comparator;
+}
+
+void ChainDistinctTriples::open(kyotocabinet::TreeDB* db, const std::string& file_name, bool readonly) {
+    db->tune_map(KC_MEMORY_MAP_SIZE);
+    db->tune_page_cache(KC_PAGE_CACHE_SIZE);
+    if (!db->open(file_name, (readonly ? kyotocabinet::TreeDB::OREADER : (kyotocabinet::TreeDB::OWRITER | kyotocabinet::TreeDB::OCREATE)) | kyotocabinet::TreeDB::ONOREPAIR)) {
+        cerr << "open " << file_name << " error: " << db->error().name() << endl;
+    }
+}
+
+void ChainDistinctTriples::insert(const Triple& triple) {
+    size_t key_size;
+    const char* raw_key = triple.serialize(&key_size);
+    index_spo->set(raw_key, key_size, "", 0);
+    index_pos->set(raw_key, key_size, "", 0);
+    index_osp->set(raw_key, key_size, "", 0);
+    delete[] raw_key;
+}
+
+void ChainDistinctTriples::synchronize() {
+    index_spo->synchronize();
+    index_pos->synchronize();
+    index_osp->synchronize();
+}
+
+size_t ChainDistinctTriples::count(const Triple& triple_pattern) const {
+    hdt::TripleComponentOrder order = TripleStore::get_query_order(triple_pattern);
+    kyotocabinet::TreeDB* tree = order == hdt::OSP ? index_osp : (order == hdt::POS ? index_pos : index_spo);
+    kyotocabinet::DB::Cursor* cursor = tree->cursor();
+    size_t size;
+    const char* data = triple_pattern.serialize(&size);
+    cursor->jump(data, size);
+    delete[] data;
+
+    size_t count = 0;
+    size_t ksp;
+    const char* kbp;
+    Triple triple;
+    while ((kbp = cursor->get_key(&ksp, true)) != nullptr) {
+        triple.deserialize(kbp, ksp);
+        delete[] kbp;
+        // The tree is chosen so that all matches are continuous, so we can stop at the first non-matching triple.
+        if (!Triple::pattern_match_triple(triple, triple_pattern)) {
+            break;
+        }
+        count++;
+    }
+    delete cursor;
+    return count;
+}
+
+
+ChainDistinctIndex::ChainDistinctIndex(std::string base_path, bool readonly) : base_path(std::move(base_path)), readonly(readonly) {}
+
+bool ChainDistinctIndex::encode(const StringTriple& triple, std::shared_ptr<DictionaryManager> dict, Triple* encoded) {
+    try {
+        encoded->set_subject(dict->stringToId(triple.get_subject(), hdt::SUBJECT));
+        encoded->set_predicate(dict->stringToId(triple.get_predicate(), hdt::PREDICATE));
+        encoded->set_object(dict->stringToId(triple.get_object(), hdt::OBJECT));
+    } catch (std::runtime_error& e) {
+        return false;
+    }
+    return true;
+}
+
+bool ChainDistinctIndex::in_chain(const StringTriple& triple, int snapshot_id, SnapshotManager* snapshot_manager, PatchTreeManager* patch_tree_manager) {
+    std::shared_ptr<hdt::HDT> snapshot = snapshot_manager->get_snapshot(snapshot_id);
+    std::shared_ptr<DictionaryManager> dict = snapshot_manager->get_dictionary_manager(snapshot_id);
+    Triple encoded;
+    if (!encode(triple, dict, &encoded)) {
+        return false;
+    }
+    hdt::IteratorTripleID* snapshot_it = SnapshotManager::search_with_offset(snapshot, encoded, 0, dict);
+    bool found = snapshot_it->hasNext();
+    delete snapshot_it;
+    if (!found) {
+        int patch_tree_id = patch_tree_manager->get_patch_tree_id(snapshot_id + 1);
+        if (patch_tree_id > snapshot_id) {
+            std::shared_ptr<PatchTree> patch_tree = patch_tree_manager->get_patch_tree(patch_tree_id, dict);
+            found = patch_tree != nullptr && patch_tree->contains_addition(encoded);
+        }
+    }
+    return found;
+}
+
+bool ChainDistinctIndex::in_earlier_chain(const StringTriple& triple, int snapshot_id, SnapshotManager* snapshot_manager, PatchTreeManager* patch_tree_manager) {
+    std::vector<int> snapshots = snapshot_manager->get_snapshots_ids();
+    // Start with the closest delta chain, as most triples of a snapshot already occur there
+    for (auto it = snapshots.rbegin(); it != snapshots.rend(); it++) {
+        if (*it < snapshot_id && in_chain(triple, *it, snapshot_manager, patch_tree_manager)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChainDistinctIndex::for_each_distinct_snapshot_triple(hdt::IteratorTripleID* snapshot_it, int snapshot_id, bool first, SnapshotManager* snapshot_manager,
+                                                          PatchTreeManager* patch_tree_manager, const std::function<void(const Triple&)>& callback) {
+    std::shared_ptr<DictionaryManager> dict = snapshot_manager->get_dictionary_manager(snapshot_id);
+    while (snapshot_it->hasNext()) {
+        Triple triple(*snapshot_it->next());
+        if (first || !in_earlier_chain(StringTriple(triple.get_subject(*dict), triple.get_predicate(*dict), triple.get_object(*dict)),
+                                       snapshot_id, snapshot_manager, patch_tree_manager)) {
+            callback(triple);
+        }
+    }
+    delete snapshot_it;
+}
+
+void ChainDistinctIndex::for_each_distinct_addition(const Triple& triple_pattern, int snapshot_id, bool first, SnapshotManager* snapshot_manager,
+                                                    PatchTreeManager* patch_tree_manager, const std::function<void(const Triple&)>& callback) {
+    int patch_tree_id = patch_tree_manager->get_patch_tree_id(snapshot_id + 1);
+    if (patch_tree_id <= snapshot_id) {
+        return;
+    }
+    std::shared_ptr<hdt::HDT> snapshot = snapshot_manager->get_snapshot(snapshot_id);
+    std::shared_ptr<DictionaryManager> dict = snapshot_manager->get_dictionary_manager(snapshot_id);
+    std::shared_ptr<PatchTree> patch_tree = patch_tree_manager->get_patch_tree(patch_tree_id, dict);
+    if (patch_tree == nullptr) {
+        return;
+    }
+    PatchTreeIterator* addition_it = patch_tree->addition_iterator(triple_pattern);
+#ifdef COMPRESSED_ADD_VALUES
+    PatchTreeAdditionValue value(patch_tree->get_max_patch_id());
+#else
+    PatchTreeAdditionValue value;
+#endif
+    PatchTreeKey key;
+    while (addition_it->next_addition(&key, &value)) {
+        // Triples that are deleted and added again also occur in the snapshot
+        hdt::IteratorTripleID* snapshot_it = SnapshotManager::search_with_offset(snapshot, key, 0, dict);
+        bool in_snapshot = snapshot_it->hasNext();
+        delete snapshot_it;
+        if (!in_snapshot && (first || !in_earlier_chain(StringTriple(key.get_subject(*dict), key.get_predicate(*dict), key.get_object(*dict)),
+                                                        snapshot_id, snapshot_manager, patch_tree_manager))) {
+            callback(key);
+        }
+    }
+    delete addition_it;
+}
+
+std::shared_ptr<ChainDistinctTriples> ChainDistinctIndex::get(int snapshot_id, const std::string& part, SnapshotManager* snapshot_manager) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = loaded_indexes.find(std::make_pair(snapshot_id, part));
+    if (it != loaded_indexes.end()) {
+        return it->second;
+    }
+    // Indexes are only usable once they have been completely built
+    std::ifstream marker(base_path + CHAIN_DISTINCT_FILENAME(snapshot_id, part, "complete"));
+    if (!marker.good()) {
+        return nullptr;
+    }
+    std::shared_ptr<ChainDistinctTriples> distinct = std::make_shared<ChainDistinctTriples>(base_path, snapshot_id, part,
+            snapshot_manager->get_dictionary_manager(snapshot_id), readonly);
+    loaded_indexes[std::make_pair(snapshot_id, part)] = distinct;
+    return distinct;
+}
+
+std::shared_ptr<ChainDistinctTriples> ChainDistinctIndex::build(int snapshot_id, const std::string& part, SnapshotManager* snapshot_manager,
+                                                                PatchTreeManager* patch_tree_manager) {
+    std::shared_ptr<ChainDistinctTriples> distinct = get(snapshot_id, part, snapshot_manager);
+    if (distinct != nullptr || readonly) {
+        return distinct;
+    }
+    std::vector<int> snapshots = snapshot_manager->get_snapshots_ids();
+    bool first = !snapshots.empty() && snapshots[0] == snapshot_id;
+    if (first && part == CHAIN_DISTINCT_SNAPSHOT) {
+        // All triples of the first snapshot are distinct, so they are counted from the snapshot itself
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto loaded_it = loaded_indexes.find(std::make_pair(snapshot_id, part));
+    if (loaded_it != loaded_indexes.end()) {
+        // Another thread has built this index in the meantime
+        return loaded_it->second;
+    }
+    std::shared_ptr<DictionaryManager> dict = snapshot_manager->get_dictionary_manager(snapshot_id);
+    distinct = std::make_shared<ChainDistinctTriples>(base_path, snapshot_id, part, dict, false);
+    auto insert = [&distinct](const Triple& triple) {
+        distinct->insert(triple);
+    };
+    if (part == CHAIN_DISTINCT_SNAPSHOT) {
+        std::shared_ptr<hdt::HDT> snapshot = snapshot_manager->get_snapshot(snapshot_id);
+        for_each_distinct_snapshot_triple(SnapshotManager::search_with_offset(snapshot, Triple(0, 0, 0), 0, dict),
+                                          snapshot_id, first, snapshot_manager, patch_tree_manager, insert);
+    } else {
+        for_each_distinct_addition(Triple(0, 0, 0), snapshot_id, first, snapshot_manager, patch_tree_manager, insert);
+    }
+    distinct->synchronize();
+    std::ofstream marker(base_path + CHAIN_DISTINCT_FILENAME(snapshot_id, part, "complete"));
+    loaded_indexes[std::make_pair(snapshot_id, part)] = distinct;
+    return distinct;
+}
+
+size_t ChainDistinctIndex::count(const StringTriple& triple_pattern, SnapshotManager* snapshot_manager, PatchTreeManager* patch_tree_manager) {
+    size_t count = 0;
+    auto increment = [&count](const Triple& triple) {
+        count++;
+    };
+    std::vector<int> snapshots = snapshot_manager->get_snapshots_ids();
+    for (int snapshot_id : snapshots) {
+        bool first = snapshot_id == snapshots[0];
+        std::shared_ptr<hdt::HDT> snapshot = snapshot_manager->get_snapshot(snapshot_id);
+        std::shared_ptr<DictionaryManager> dict = snapshot_manager->get_dictionary_manager(snapshot_id);
+        Triple pattern = triple_pattern.get_as_triple(dict);
+
+        // Count the snapshot triples that do not occur in an earlier delta chain
+        std::shared_ptr<ChainDistinctTriples> distinct_snapshot = first ? nullptr : get(snapshot_id, CHAIN_DISTINCT_SNAPSHOT, snapshot_manager);
+        if (distinct_snapshot != nullptr) {
+            count += distinct_snapshot->count(pattern);
+        } else if (first) {
+            // All triples of the first snapshot are distinct, so HDT can count them without iterating for most patterns
+            hdt::IteratorTripleID* snapshot_it = SnapshotManager::search_with_offset(snapshot, pattern, 0, dict);
+            if (snapshot_it->numResultEstimation() == hdt::EXACT) {
+                count += snapshot_it->estimatedNumResults();
+            } else {
+                while (snapshot_it->hasNext()) {
+                    snapshot_it->next();
+                    count++;
+                }
+            }
+            delete snapshot_it;
+        } else {
+            for_each_distinct_snapshot_triple(SnapshotManager::search_with_offset(snapshot, pattern, 0, dict),
+                                              snapshot_id, first, snapshot_manager, patch_tree_manager, increment);
+        }
+
+        // Count the additions of this delta chain that are neither in its snapshot nor in an earlier delta chain
+        std::shared_ptr<ChainDistinctTriples> distinct_additions = get(snapshot_id, CHAIN_DISTINCT_ADDITIONS, snapshot_manager);
+        if (distinct_additions != nullptr) {
+            count += distinct_additions->count(pattern);
+        } else {
+            for_each_distinct_addition(pattern, snapshot_id, first, snapshot_manager, patch_tree_manager, increment);
+        }
+    }
+    return count;
+}
+
+std::vector<std::pair<int, std::string>> ChainDistinctIndex::detect_indexes() const {
+    std::vector<std::pair<int, std::string>> indexes;
+    std::regex r("chaindistinct_([0-9]+)_([a-z]+)_complete");
+    std::smatch base_match;
+    DIR *dir;
+    struct dirent *ent;
+    if ((dir = opendir(base_path.c_str())) != nullptr) {
+        while ((ent = readdir(dir)) != nullptr) {
+            std::string dir_name = std::string(ent->d_name);
+            if (std::regex_match(dir_name, base_match, r)) {
+                indexes.emplace_back(std::stoi(base_match[1].str()), base_match[2].str());
+            }
+        }
+        closedir(dir);
+    }
+    return indexes;
+}
+
+void ChainDistinctIndex::unload() {
+    std::lock_guard<std::mutex> lock(mutex);
+    loaded_indexes.clear();
+}
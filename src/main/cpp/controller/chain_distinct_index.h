@@ -0,0 +1,136 @@
+#ifndef OSTRICH_CHAIN_DISTINCT_INDEX_H
+#define OSTRICH_CHAIN_DISTINCT_INDEX_H
+
+#include <map>
+#include <mutex>
+#include <functional>
+#include <kchashdb.h>
+#include "../snapshot/snapshot_manager.h"
+#include "../patch/patch_tree_manager.h"
+
+#define CHAIN_DISTINCT_FILENAME(snapshot_id, part, suffix) ("chaindistinct_" + std::to_string(snapshot_id) + "_" + part + "_" + suffix)
+#define CHAIN_DISTINCT_SNAPSHOT "snapshot"
+#define CHAIN_DISTINCT_ADDITIONS "additions"
+
+
+// Persisted set of the triples of one part of a delta chain, its snapshot or its additions, that do not occur in any earlier delta chain.
+// All triples are encoded with the dictionary of the snapshot, and are stored in SPO, POS and OSP order,
+// so that the triples matching any triple pattern can be counted as a single range in one of the trees.
+class ChainDistinctTriples {
+private:
+    kyotocabinet::TreeDB* index_spo;
+    kyotocabinet::TreeDB* index_pos;
+    kyotocabinet::TreeDB* index_osp;
+    PatchTreeKeyComparator* spo_comparator;
+    PatchTreeKeyComparator* pos_comparator;
+    PatchTreeKeyComparator* osp_comparator;
+protected:
+    void open(kyotocabinet::TreeDB* db, const std::string& file_name, bool readonly);
+public:
+    ChainDistinctTriples(const std::string& base_path, int snapshot_id, const std::string& part, std::shared_ptr<DictionaryManager> dict, bool readonly);
+    ~ChainDistinctTriples();
+    /**
+     * Add a triple to the set.
+     * @param triple A triple encoded with the dictionary of the snapshot.
+     */
+    void insert(const Triple& triple);
+    /**
+     * Flush all trees to disk.
+     */
+    void synchronize();
+    /**
+     * @param triple_pattern A triple pattern encoded with the dictionary of the snapshot.
+     * @return The number of triples in this set matching the given pattern.
+     */
+    size_t count(const Triple& triple_pattern) const;
+};
+
+
+/**
+ * Index to count the distinct triples over all delta chains.
+ * A triple can occur in multiple delta chains, so the sum of the counts of all delta chains overestimates the version count.
+ * The triples that already occurred in an earlier delta chain are filtered out once, and the remaining triples are persisted:
+ * for each snapshot after the first one, when it is created, and for the additions of each delta chain, when the next snapshot is created.
+ * Only the additions of the last delta chain then remain to be checked at query time.
+ */
+class ChainDistinctIndex {
+private:
+    std::string base_path;
+    bool readonly;
+    std::map<std::pair<int, std::string>, std::shared_ptr<ChainDistinctTriples>> loaded_indexes;
+    std::mutex mutex;
+protected:
+    /**
+     * Encode the given triple with the given dictionary, without adding unknown terms to the dictionary.
+     * @return If all terms of the triple are known.
+     */
+    static bool encode(const StringTriple& triple, std::shared_ptr<DictionaryManager> dict, Triple* encoded);
+    /**
+     * @param triple A triple.
+     * @param snapshot_id The snapshot of a delta chain.
+     * @return If the triple exists in the snapshot or has been added in any patch of its delta chain.
+     */
+    static bool in_chain(const StringTriple& triple, int snapshot_id, SnapshotManager* snapshot_manager, PatchTreeManager* patch_tree_manager);
+    /**
+     * @param triple A triple.
+     * @param snapshot_id The snapshot of a delta chain.
+     * @return If the triple exists in any delta chain before the given one.
+     */
+    static bool in_earlier_chain(const StringTriple& triple, int snapshot_id, SnapshotManager* snapshot_manager, PatchTreeManager* patch_tree_manager);
+    /**
+     * @param snapshot_it The snapshot triples to check, this will be deleted.
+     * @param first If the delta chain is the first one, so all its snapshot triples are distinct.
+     * @param callback Called for each triple of the snapshot that does not occur in an earlier delta chain.
+     */
+    static void for_each_distinct_snapshot_triple(hdt::IteratorTripleID* snapshot_it, int snapshot_id, bool first, SnapshotManager* snapshot_manager,
+                                                  PatchTreeManager* patch_tree_manager, const std::function<void(const Triple&)>& callback);
+    /**
+     * @param triple_pattern The triple pattern to get the additions for, encoded with the dictionary of the snapshot.
+     * @param first If the delta chain is the first one.
+     * @param callback Called for each addition of the delta chain that is neither in its snapshot nor in an earlier delta chain.
+     */
+    static void for_each_distinct_addition(const Triple& triple_pattern, int snapshot_id, bool first, SnapshotManager* snapshot_manager,
+                                           PatchTreeManager* patch_tree_manager, const std::function<void(const Triple&)>& callback);
+public:
+    ChainDistinctIndex(std::string base_path, bool readonly = false);
+    /**
+     * Get the persisted distinct triples of a part of the delta chain of the given snapshot.
+     * @param snapshot_id The snapshot.
+     * @param part CHAIN_DISTINCT_SNAPSHOT or CHAIN_DISTINCT_ADDITIONS.
+     * @param snapshot_manager The snapshot manager to get the dictionary of the snapshot from.
+     * @return The distinct triples, or null if they have not been built.
+     */
+    std::shared_ptr<ChainDistinctTriples> get(int snapshot_id, const std::string& part, SnapshotManager* snapshot_manager);
+    /**
+     * Build and persist the distinct triples of a part of the delta chain of the given snapshot, if they do not exist yet.
+     * The snapshot part scans the full snapshot once, and is not built for the first snapshot, as all of its triples are distinct.
+     * The additions part may only be built once no more patches will be added to the delta chain.
+     * @param snapshot_id The snapshot.
+     * @param part CHAIN_DISTINCT_SNAPSHOT or CHAIN_DISTINCT_ADDITIONS.
+     * @param snapshot_manager The snapshot manager.
+     * @param patch_tree_manager The patch tree manager.
+     * @return The distinct triples, or null if they are not built.
+     */
+    std::shared_ptr<ChainDistinctTriples> build(int snapshot_id, const std::string& part, SnapshotManager* snapshot_manager, PatchTreeManager* patch_tree_manager);
+    /**
+     * Count the distinct triples matching the given triple pattern over all delta chains.
+     * Parts of delta chains without persisted distinct triples are compared to the earlier delta chains at query time.
+     * @param triple_pattern The triple pattern.
+     * @param snapshot_manager The snapshot manager.
+     * @param patch_tree_manager The patch tree manager.
+     * @return The exact number of distinct triples.
+     */
+    size_t count(const StringTriple& triple_pattern, SnapshotManager* snapshot_manager, PatchTreeManager* patch_tree_manager);
+    /**
+     * Find all persisted distinct triples.
+     * @return The snapshot id and part of each index.
+     */
+    std::vector<std::pair<int, std::string>> detect_indexes() const;
+    /**
+     * Unload all indexes, so that their files can be removed.
+     */
+    void unload();
+};
+
+
+#endif //OSTRICH_CHAIN_DISTINCT_INDEX_H
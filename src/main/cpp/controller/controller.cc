@@ -4,6 +4,10 @@
 #include "../snapshot/combined_triple_iterator.h"
 #include "../simpleprogresslistener.h"
 #include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #define BASEURI "<http://example.org>"
 
@@ -12,9 +16,12 @@ Controller::Controller(const std::string& basePath, int8_t kc_opts, bool readonl
                                                                                     readonly, cache_size) {}
 
 Controller::Controller(const std::string& basePath, SnapshotCreationStrategy *strategy, int8_t kc_opts, bool readonly, size_t cache_size)
-        : patchTreeManager(new PatchTreeManager(basePath, kc_opts, readonly, cache_size)),
-          snapshotManager(new SnapshotManager(basePath, readonly, cache_size)),
-          strategy(strategy), metadata(nullptr), metadata_manager(nullptr) {
+        : memoryBudget(std::make_shared<MemoryBudget>()), manifest(std::make_shared<StoreManifest>(basePath, readonly)),
+          patchTreeManager(new PatchTreeManager(basePath, kc_opts, readonly, cache_size, memoryBudget, manifest)),
+          snapshotManager(new SnapshotManager(basePath, readonly, cache_size, memoryBudget, manifest)),
+          strategy(strategy), metadata(nullptr), metadata_manager(nullptr),
+          snapshotDiffCache(new SnapshotDiffCache(basePath, readonly)), snapshot_diff_distance(SNAPSHOT_DIFF_DISTANCE),
+          chainDistinctIndex(new ChainDistinctIndex(basePath, readonly)) {
     struct stat sb{};
     if (!(stat(basePath.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode))) {
         throw std::invalid_argument("The provided path '" + basePath + "' is not a valid directory.");
@@ -32,12 +39,47 @@ Controller::~Controller() {
     delete snapshotManager;
     delete metadata;
     delete metadata_manager;
+    delete snapshotDiffCache;
+    delete chainDistinctIndex;
 }
 
 size_t Controller::get_version_materialized_count_estimated(const Triple& triple_pattern, int patch_id) const {
     return get_version_materialized_count(triple_pattern, patch_id, true).first;
 }
 
+TripleVersionsBitmapIterator* Controller::get_version_materialized_multi(const StringTriple &triple_pattern, const std::vector<int>& patch_ids) const {
+    if (patch_ids.empty()) {
+        return new EmptyTripleVersionsBitmapIterator();
+    }
+    int snapshot_id = get_snapshot_manager()->get_latest_snapshot(*std::min_element(patch_ids.begin(), patch_ids.end()));
+    if (snapshot_id < 0) {
+        return new EmptyTripleVersionsBitmapIterator();
+    }
+    if (get_snapshot_manager()->get_latest_snapshot(*std::max_element(patch_ids.begin(), patch_ids.end())) != snapshot_id) {
+        throw std::invalid_argument("All patch ids of a multi-version query must belong to the same delta chain");
+    }
+    std::shared_ptr<hdt::HDT> snapshot = get_snapshot_manager()->get_snapshot(snapshot_id);
+    std::shared_ptr<DictionaryManager> dict = get_snapshot_manager()->get_dictionary_manager(snapshot_id);
+    Triple pattern = triple_pattern.get_as_triple(dict);
+    hdt::IteratorTripleID* snapshot_it = SnapshotManager::search_with_offset(snapshot, pattern, 0, dict, true);
+
+    // Only use the patch tree if it belongs to the delta chain of this snapshot
+    std::shared_ptr<PatchTree> patchTree = nullptr;
+    int patch_tree_id = get_patch_tree_manager()->get_patch_tree_id(snapshot_id + 1);
+    std::vector<int> versions = patch_ids;
+    if (patch_tree_id > snapshot_id) {
+        patchTree = get_patch_tree_manager()->get_patch_tree(patch_tree_id, dict);
+        // Versions after the latest patch of which the append has finished are answered as that patch
+        for (int& version : versions) {
+            version = std::max(snapshot_id, patchTree->pin_patch_id(version));
+        }
+    }
+    if (TripleStore::is_default_tree(pattern)) {
+        return new PatchTreeTripleVersionsBitmapIterator<PatchTreeDeletionValue>(pattern, snapshot_it, patchTree, versions, snapshot_id, dict);
+    }
+    return new PatchTreeTripleVersionsBitmapIterator<PatchTreeDeletionValueReduced>(pattern, snapshot_it, patchTree, versions, snapshot_id, dict);
+}
+
 std::pair<size_t, hdt::ResultEstimationType> Controller::get_version_materialized_count(const Triple& triple_pattern, int patch_id, bool allowEstimates) const {
     std::shared_ptr<DictionaryManager> dict = snapshotManager->get_dictionary_manager(0);
     StringTriple st(triple_pattern.get_subject(*dict), triple_pattern.get_predicate(*dict), triple_pattern.get_object(*dict));
@@ -76,28 +118,124 @@ std::pair<size_t, hdt::ResultEstimationType> Controller::get_version_materialize
     if(patchTree == nullptr) {
         return std::make_pair(snapshot_count, res_type);
     }
+    patch_id = patchTree->pin_patch_id(patch_id);
+    if (patch_id < patchTree->get_min_patch_id()) {
+        return std::make_pair(snapshot_count, res_type);
+    }
 
     std::pair<PatchPosition, Triple> deletion_count_data = patchTree->deletion_count(pattern, patch_id);
-    size_t addition_count = patchTree->addition_count(patch_id, pattern);
+    size_t addition_count;
+    if (allowEstimates) {
+        std::pair<PatchPosition, bool> addition_count_data = patchTree->addition_count_estimated(patch_id, pattern);
+        addition_count = addition_count_data.first;
+        if (!addition_count_data.second && res_type == hdt::EXACT) {
+            res_type = hdt::UP_TO;
+        }
+    } else {
+        addition_count = patchTree->addition_count(patch_id, pattern);
+    }
     return std::make_pair(snapshot_count - deletion_count_data.first + addition_count, res_type);
 }
 
-TripleIterator* Controller::get_version_materialized(const Triple &triple_pattern, int offset, int patch_id) const {
+std::vector<size_t> Controller::get_version_materialized_count_series(const StringTriple& triple_pattern, int patch_id_start, int patch_id_end, bool allowEstimates) const {
+    std::vector<size_t> counts;
+    std::vector<int> snapshot_ids = get_snapshot_manager()->get_snapshots_ids();
+    int patch_id = patch_id_start;
+    while (patch_id <= patch_id_end) {
+        int snapshot_id = get_snapshot_manager()->get_latest_snapshot(patch_id);
+        if (snapshot_id < 0) {
+            counts.push_back(0);
+            patch_id++;
+            continue;
+        }
+
+        // The versions until the next snapshot all belong to the same delta chain
+        int chain_end = patch_id_end;
+        auto it_next = std::upper_bound(snapshot_ids.begin(), snapshot_ids.end(), snapshot_id);
+        if (it_next != snapshot_ids.end()) {
+            chain_end = std::min(chain_end, *it_next - 1);
+        }
+
+        std::shared_ptr<hdt::HDT> snapshot = get_snapshot_manager()->get_snapshot(snapshot_id);
+        std::shared_ptr<DictionaryManager> dict = get_snapshot_manager()->get_dictionary_manager(snapshot_id);
+        Triple pattern = triple_pattern.get_as_triple(dict);
+
+        hdt::IteratorTripleID* snapshot_it = SnapshotManager::search_with_offset(snapshot, pattern, 0, dict);
+        size_t snapshot_count = snapshot_it->estimatedNumResults();
+        if (!allowEstimates && snapshot_it->numResultEstimation() != hdt::EXACT) {
+            snapshot_count = 0;
+            while (snapshot_it->hasNext()) {
+                snapshot_it->next();
+                snapshot_count++;
+            }
+        }
+        delete snapshot_it;
+        if (patch_id == snapshot_id) {
+            counts.push_back(snapshot_count);
+            patch_id++;
+        }
+        if (patch_id > chain_end) {
+            continue;
+        }
+
+        int id = get_patch_tree_manager()->get_patch_tree_id(patch_id);
+        std::shared_ptr<PatchTree> patchTree = get_patch_tree_manager()->get_patch_tree(id, dict);
+        if (patchTree == nullptr) {
+            for (; patch_id <= chain_end; patch_id++) {
+                counts.push_back(snapshot_count);
+            }
+            continue;
+        }
+
+        // Versions after the latest patch of which the append has finished are counted as that patch
+        int pinned_end = patchTree->pin_patch_id(chain_end);
+        int series_start = std::min(patch_id, pinned_end);
+        std::vector<PatchPosition> addition_counts;
+        if (pinned_end >= patchTree->get_min_patch_id()) {
+            addition_counts = patchTree->addition_count_series(series_start, pinned_end, pattern);
+        }
+        for (; patch_id <= chain_end; patch_id++) {
+            int pinned_id = std::min(patch_id, pinned_end);
+            if (pinned_id < patchTree->get_min_patch_id()) {
+                counts.push_back(snapshot_count);
+            } else {
+                PatchPosition deletion_count = patchTree->deletion_count(pattern, pinned_id).first;
+                counts.push_back(snapshot_count - deletion_count + addition_counts[pinned_id - series_start]);
+            }
+        }
+    }
+    return counts;
+}
+
+TripleIterator* Controller::get_version_materialized(const Triple &triple_pattern, int offset, int patch_id, int limit) const {
     std::shared_ptr<DictionaryManager> dict = snapshotManager->get_dictionary_manager(0);
     StringTriple st(triple_pattern.get_subject(*dict), triple_pattern.get_predicate(*dict), triple_pattern.get_object(*dict));
-    return get_version_materialized(st, offset, patch_id);
+    return get_version_materialized(st, offset, patch_id, limit);
 }
 
-TripleIterator* Controller::get_version_materialized(const StringTriple &triple_pattern, int offset, int patch_id) const {
+TripleIterator* Controller::get_version_materialized(const StringTriple &triple_pattern, int offset, int patch_id, int limit) const {
+    if (limit == 0) {
+        return new EmptyTripleIterator();
+    }
     // Find the snapshot
     int snapshot_id = get_snapshot_manager()->get_latest_snapshot(patch_id);
     if(snapshot_id < 0) {
         return new EmptyTripleIterator();
     }
-    std::shared_ptr<hdt::HDT> snapshot = get_snapshot_manager()->get_snapshot(snapshot_id);
     std::shared_ptr<DictionaryManager> dict = get_snapshot_manager()->get_dictionary_manager(snapshot_id);
+    TripleIterator* it = get_version_materialized_ids(triple_pattern.get_as_triple(dict), offset, patch_id);
+    // The snapshot and patch iterators are lazy, so they are never consumed beyond the limit.
+    return limit > 0 ? new LimitTripleIterator(it, (size_t) limit) : it;
+}
 
-    Triple pattern = triple_pattern.get_as_triple(dict);
+TripleIterator* Controller::get_version_materialized_ids(const Triple &pattern, int offset, int patch_id) const {
+    // Find the snapshot
+    int snapshot_id = get_snapshot_manager()->get_latest_snapshot(patch_id);
+    if(snapshot_id < 0) {
+        return new EmptyTripleIterator();
+    }
+    std::shared_ptr<hdt::HDT> snapshot = get_snapshot_manager()->get_snapshot(snapshot_id);
+    std::shared_ptr<DictionaryManager> dict = get_snapshot_manager()->get_dictionary_manager(snapshot_id);
 
     // Simple case: We are requesting a snapshot, delegate lookup to that snapshot.
     hdt::IteratorTripleID* snapshot_it = SnapshotManager::search_with_offset(snapshot, pattern, offset, dict);
@@ -115,10 +253,10 @@ TripleIterator* Controller::get_version_materialized(const StringTriple &triple_
     long added_offset = 0;
     bool check_offseted_deletions = true;
 
-    // Limit the patch id to the latest available patch id
-    int max_patch_id = patchTree->get_max_patch_id();
-    if (patch_id > max_patch_id) {
-        patch_id = max_patch_id;
+    // Limit the patch id to the latest patch of which the append has finished
+    patch_id = patchTree->pin_patch_id(patch_id);
+    if (patch_id < patchTree->get_min_patch_id()) {
+        return new SnapshotTripleIterator(snapshot_it);
     }
 
     std::pair<PatchPosition, Triple> deletion_count_data = patchTree->deletion_count(pattern, patch_id);
@@ -196,9 +334,13 @@ std::pair<size_t, hdt::ResultEstimationType> Controller::get_delta_materialized_
         if (patch_id_start > snapshot_id_start) {
             int id = patchTreeManager->get_patch_tree_id(patch_id_start);
             std::shared_ptr<DictionaryManager> dict = snapshotManager->get_dictionary_manager(snapshot_id_start);
-            std::shared_ptr<PatchTree> pt = patchTreeManager->get_patch_tree(id, dict);
-            Triple tp = triple_pattern.get_as_triple(dict);
-            count += pt->deletion_count(tp, patch_id_start).first + pt->addition_count(patch_id_start, tp);
+            std::shared_ptr<PatchTree> pt = id > snapshot_id_start ? patchTreeManager->get_patch_tree(id, dict) : nullptr;
+            // Patches of which the append has not finished yet are not counted
+            int pinned_start = pt != nullptr ? pt->pin_patch_id(patch_id_start) : snapshot_id_start;
+            if (pinned_start > snapshot_id_start) {
+                Triple tp = triple_pattern.get_as_triple(dict);
+                count += pt->deletion_count(tp, pinned_start).first + pt->addition_count_estimated(pinned_start, tp).first;
+            }
         }
         // We count for intermediary delta chains
         if (snapshot_id_start != snapshot_id_end) {
@@ -219,12 +361,32 @@ std::pair<size_t, hdt::ResultEstimationType> Controller::get_delta_materialized_
         if (patch_id_end > snapshot_id_end) {
             int id = patchTreeManager->get_patch_tree_id(patch_id_end);
             std::shared_ptr<DictionaryManager> dict = snapshotManager->get_dictionary_manager(snapshot_id_end);
-            std::shared_ptr<PatchTree> pt = patchTreeManager->get_patch_tree(id, dict);
-            Triple tp = triple_pattern.get_as_triple(dict);
-            count += pt->deletion_count(tp, patch_id_end).first + pt->addition_count(patch_id_end, tp);
+            std::shared_ptr<PatchTree> pt = id > snapshot_id_end ? patchTreeManager->get_patch_tree(id, dict) : nullptr;
+            // Patches of which the append has not finished yet are not counted
+            int pinned_end = pt != nullptr ? pt->pin_patch_id(patch_id_end) : snapshot_id_end;
+            if (pinned_end > snapshot_id_end) {
+                Triple tp = triple_pattern.get_as_triple(dict);
+                count += pt->deletion_count(tp, pinned_end).first + pt->addition_count_estimated(pinned_end, tp).first;
+            }
         }
         return std::make_pair(count, hdt::UP_TO);
     }
+    if (patch_id_end <= patch_id_start) {
+        return std::make_pair(0, hdt::EXACT);
+    }
+    int snapshot_id = snapshotManager->get_latest_snapshot(patch_id_start);
+    if (snapshot_id >= 0 && snapshot_id == snapshotManager->get_latest_snapshot(patch_id_end)) {
+        // Within a single delta chain, the patch tree can count the delta directly
+        std::shared_ptr<DictionaryManager> dict = snapshotManager->get_dictionary_manager(snapshot_id);
+        int id = patchTreeManager->get_patch_tree_id(patch_id_end);
+        std::shared_ptr<PatchTree> pt = id > snapshot_id ? patchTreeManager->get_patch_tree(id, dict) : nullptr;
+        if (pt == nullptr) {
+            return std::make_pair(0, hdt::EXACT);
+        }
+        if (pt->pin_patch_id(patch_id_end) == patch_id_end) {
+            return std::make_pair(pt->delta_count(triple_pattern.get_as_triple(dict), patch_id_start, patch_id_end), hdt::EXACT);
+        }
+    }
     auto dm_it = get_delta_materialized(triple_pattern, 0, patch_id_start, patch_id_end);
     size_t count = dm_it->get_count();
     delete dm_it;
@@ -236,21 +398,31 @@ size_t Controller::get_delta_materialized_count_estimated(const Triple &triple_p
 }
 
 TripleDeltaIterator* Controller::get_delta_materialized(const Triple &triple_pattern, int offset, int patch_id_start,
-                                                        int patch_id_end) const {
+                                                        int patch_id_end, int limit, bool use_plain_diff) const {
     std::shared_ptr<DictionaryManager> dict = snapshotManager->get_dictionary_manager(0);
     StringTriple st(triple_pattern.get_subject(*dict), triple_pattern.get_predicate(*dict), triple_pattern.get_object(*dict));
-    return get_delta_materialized(st, offset, patch_id_start, patch_id_end);
+    return get_delta_materialized(st, offset, patch_id_start, patch_id_end, limit, use_plain_diff);
 }
 
 TripleDeltaIterator* Controller::get_delta_materialized(const StringTriple &triple_pattern, int offset, int patch_id_start,
-                                                        int patch_id_end, bool use_plain_diff) const {
+                                                        int patch_id_end, int limit, bool use_plain_diff) const {
+    // Merged iterators cancel out triples that are added and deleted again, so their inputs can not be truncated,
+    // but as all of them are lazy, nothing beyond the limit is ever read.
+    auto limited = [limit](TripleDeltaIterator* it) -> TripleDeltaIterator* {
+        return limit >= 0 ? new LimitTripleDeltaIterator(it, (size_t) limit) : it;
+    };
 
     auto single_delta_query = [this, triple_pattern](int start_id, int end_id, std::shared_ptr<DictionaryManager> dict, bool sort = false) {
         TripleDeltaIterator* return_it;
         int patch_tree_id = patchTreeManager->get_patch_tree_id(end_id);
         std::shared_ptr<PatchTree> patch_tree = patchTreeManager->get_patch_tree(patch_tree_id, dict);
         Triple tp = triple_pattern.get_as_triple(dict);
-        if(patch_tree == nullptr) {
+        // Patches of which the append has not finished yet are not visible
+        if (patch_tree != nullptr) {
+            start_id = patch_tree->pin_patch_id(start_id);
+            end_id = patch_tree->pin_patch_id(end_id);
+        }
+        if(patch_tree == nullptr || end_id <= start_id) {
             return_it = new EmptyTripleDeltaIterator();
         } else {
             int snapshot_id = snapshotManager->get_latest_snapshot(start_id);
@@ -300,7 +472,7 @@ TripleDeltaIterator* Controller::get_delta_materialized(const StringTriple &trip
 
     // Both patches are in the same delta chain
     if (snapshot_id_start == snapshot_id_end) {
-        return (single_delta_query(patch_id_start, patch_id_end, dict_end, false))->offset(offset);
+        return limited((single_delta_query(patch_id_start, patch_id_end, dict_end, false))->offset(offset));
     }
 
     hdt::TripleComponentOrder qr_order = TripleStore::get_query_order(triple_pattern);
@@ -308,16 +480,16 @@ TripleDeltaIterator* Controller::get_delta_materialized(const StringTriple &trip
     if (use_plain_diff) {
         TripleIterator* it1 = get_version_materialized(triple_pattern, 0, patch_id_start);
         TripleIterator* it2 = get_version_materialized(triple_pattern, 0, patch_id_end);
-        return (new PlainDiffDeltaIterator(it1, it2, dict_start, dict_end))->offset(offset);
+        return limited((new PlainDiffDeltaIterator(it1, it2, dict_start, dict_end))->offset(offset));
     }
 
-    TripleDeltaIterator* snapshot_diff_it = new AutoSnapshotDiffIterator(triple_pattern, snapshotManager, patchTreeManager, snapshot_id_start, snapshot_id_end);
+    TripleDeltaIterator* snapshot_diff_it = get_snapshot_diff(triple_pattern, snapshot_id_start, snapshot_id_end);
     TripleDeltaIterator* delta_it_end = nullptr;
     TripleDeltaIterator* intermediate_it = nullptr;
 
     // start = snapshot and end = snapshot
     if (patch_id_start == snapshot_id_start && patch_id_end == snapshot_id_end) {
-        return snapshot_diff_it->offset(offset);
+        return limited(snapshot_diff_it->offset(offset));
     }
 
     // start = patch
@@ -332,12 +504,12 @@ TripleDeltaIterator* Controller::get_delta_materialized(const StringTriple &trip
 
     if (intermediate_it) {
         if (patch_id_end != snapshot_id_end) {
-            return (new MergeDiffIterator(intermediate_it, delta_it_end, qr_order))->offset(offset);
+            return limited((new MergeDiffIterator(intermediate_it, delta_it_end, qr_order))->offset(offset));
         }
-        return intermediate_it->offset(offset);
+        return limited(intermediate_it->offset(offset));
     }
 
-    return (new MergeDiffIterator(snapshot_diff_it, delta_it_end, qr_order))->offset(offset);
+    return limited((new MergeDiffIterator(snapshot_diff_it, delta_it_end, qr_order))->offset(offset));
 }
 
 std::pair<size_t, hdt::ResultEstimationType> Controller::get_version_count(const Triple &triple_pattern, bool allowEstimates) const {
@@ -353,9 +525,24 @@ std::pair<size_t, hdt::ResultEstimationType> Controller::get_version_count(const
     size_t count = 0;
     std::vector<int> snapshots = snapshotManager->get_snapshots_ids();
     if (!allowEstimates && snapshots.size() > 1) {
-        TripleVersionsIterator* it = get_version(triple_pattern, 0);
-        count = it->get_count();
-        delete it;
+        // Triples that occur in multiple delta chains are only counted in the first one
+        count = chainDistinctIndex->count(triple_pattern, snapshotManager, patchTreeManager);
+    } else if (snapshots.size() > 1 && triple_pattern.get_subject().empty() && triple_pattern.get_predicate().empty() && triple_pattern.get_object().empty()) {
+        // The distinct triples over all delta chains are estimated by merging the sketches of all snapshots and additions,
+        // so that triples that occur in multiple delta chains are only counted once.
+        HyperLogLog sketch;
+        for (int snapshot: snapshots) {
+            sketch.merge(snapshotManager->get_snapshot_sketch(snapshot));
+            int patch_tree_id = patchTreeManager->get_patch_tree_id(snapshot + 1);
+            if (patch_tree_id > snapshot) {
+                std::shared_ptr<PatchTree> patchTree = patchTreeManager->get_patch_tree(patch_tree_id, snapshotManager->get_dictionary_manager(snapshot));
+                if (patchTree != nullptr) {
+                    sketch.merge(patchTree->get_additions_sketch());
+                }
+            }
+        }
+        count = sketch.estimate();
+        estimation_type_used = hdt::APPROXIMATE;
     } else {
         for (int snapshot: snapshots) {
             std::shared_ptr<DictionaryManager> dict = snapshotManager->get_dictionary_manager(snapshot);
@@ -383,17 +570,24 @@ std::pair<size_t, hdt::ResultEstimationType> Controller::get_version_count(const
                 std::shared_ptr<PatchTree> patchTree = patchTreeManager->get_patch_tree(patch_tree_id, dict);
                 if (patchTree != nullptr) {
                     if (allowEstimates) {
-                        count += patchTree->addition_count(snapshot, pattern);
+                        std::pair<PatchPosition, bool> addition_count_data = patchTree->addition_count_estimated(0, pattern);
+                        count += addition_count_data.first;
+                        if (!addition_count_data.second && estimation_type_used == hdt::EXACT)
+                            estimation_type_used = hdt::UP_TO;
                     } else {
+                        // Additions of patches of which the append has not finished yet are not counted
+                        int max_patch_id = patchTree->pin_patch_id(std::numeric_limits<int>::max());
                         auto it = patchTree->addition_iterator(pattern);
                         Triple t;
-#if defined(COMPRESSED_ADD_VALUES) || defined(COMPRESSED_DEL_VALUES)
-                        PatchTreeValueBase<PatchTreeDeletionValue> del_val(patchTree->get_max_patch_id());
+#ifdef COMPRESSED_ADD_VALUES
+                        PatchTreeAdditionValue add_val(max_patch_id);
 #else
-                        PatchTreeValueBase<PatchTreeDeletionValue> del_val;
+                        PatchTreeAdditionValue add_val;
 #endif
-                        while (it->next(&t, &del_val)) {
-                            count++;
+                        while (it->next_addition(&t, &add_val)) {
+                            if (add_val.get_patch_id_at(0) <= max_patch_id) {
+                                count++;
+                            }
                         }
                         delete it;
                     }
@@ -408,23 +602,25 @@ size_t Controller::get_version_count_estimated(const Triple &triple_pattern) con
     return get_version_count(triple_pattern, true).first;
 }
 
-TripleVersionsIterator* Controller::get_version(const Triple &triple_pattern, int offset) const {
+TripleVersionsIterator* Controller::get_version(const Triple &triple_pattern, int offset, int limit) const {
     std::shared_ptr<DictionaryManager> dict = snapshotManager->get_dictionary_manager(0);
     StringTriple st(triple_pattern.get_subject(*dict), triple_pattern.get_predicate(*dict), triple_pattern.get_object(*dict));
-    return get_version(st, offset);
+    return get_version(st, offset, limit);
 }
 
-TripleVersionsIterator *Controller::get_version(const StringTriple &triple_pattern, int offset) const {
+TripleVersionsIterator *Controller::get_version(const StringTriple &triple_pattern, int offset, int limit) const {
     hdt::TripleComponentOrder qr_order = TripleStore::get_query_order(triple_pattern);
     std::vector<int> snapshots_id = snapshotManager->get_snapshots_ids();
 
+    // Only the first offset + limit triples of each delta chain can end up in the result
+    size_t max_triples = limit >= 0 ? (size_t) std::max(offset, 0) + (size_t) limit : std::numeric_limits<size_t>::max();
 //    auto it_version = new TripleVersionsIteratorCombined(qr_order);
-    auto it_version = new TripleVersionsIteratorCombinedV2(qr_order);
+    auto it_version = new TripleVersionsIteratorCombinedV2(qr_order, max_triples);
     for (int id: snapshots_id) {
         std::shared_ptr<DictionaryManager> dict = snapshotManager->get_dictionary_manager(id);
         Triple pattern = triple_pattern.get_as_triple(dict);
         std::shared_ptr<hdt::HDT> snapshot = snapshotManager->get_snapshot(id);
-        hdt::IteratorTripleID* snapshot_it = SnapshotManager::search_with_offset(snapshot, pattern, 0, dict, true);
+        hdt::IteratorTripleID* snapshot_it = SnapshotManager::search_with_offset(snapshot, pattern, 0, dict, true, max_triples);
         int patch_tree_id = patchTreeManager->get_patch_tree_id(id+1);
         std::shared_ptr<PatchTree> patchTree = patchTreeManager->get_patch_tree(patch_tree_id, dict);
 //        auto it = new PatchTreeTripleVersionsIterator(pattern, snapshot_it, patchTree, id, dict);
@@ -436,6 +632,15 @@ TripleVersionsIterator *Controller::get_version(const StringTriple &triple_patte
 }
 
 bool Controller::append(PatchElementIterator* patch_it, int patch_id, std::shared_ptr<DictionaryManager> dict, bool check_uniqueness, hdt::ProgressListener* progressListener) {
+    return append(patch_id, dict, [&](size_t& patch_size) {
+        bool status = patchTreeManager->append(patch_it, patch_id, dict, check_uniqueness, progressListener);
+        patch_size = patch_it->getPassed();
+        return status;
+    }, progressListener);
+}
+
+bool Controller::append(int patch_id, std::shared_ptr<DictionaryManager> dict, const std::function<bool(size_t& patch_size)>& append_patch,
+                        hdt::ProgressListener* progressListener) {
     // Detect if we need to construct a new patchTree (when last patch triggered a new snapshot)
     int snapshot_id = snapshotManager->get_latest_snapshot(patch_id);
     int patch_tree_id = patchTreeManager->get_patch_tree_id(patch_id);
@@ -446,18 +651,72 @@ bool Controller::append(PatchElementIterator* patch_it, int patch_id, std::share
 
     // Ingest as a regular delta
     auto istart = std::chrono::high_resolution_clock::now();
-    bool status = patchTreeManager->append(patch_it, patch_id, dict, check_uniqueness, progressListener);
+    size_t patch_size = 0;
+    bool status = append_patch(patch_size);
     auto istop = std::chrono::high_resolution_clock::now();
     auto iduration = std::chrono::duration_cast<std::chrono::milliseconds>(istop - istart);
-    metadata->ingestion_times = metadata_manager->store_uint64("ingest-time", snapshot_id, iduration.count());
+    store_patch_metadata(snapshot_id, patch_tree_id, patch_id, patch_size, iduration.count(), dict);
+
+    // If we need to create a new snapshot:
+    // - We do a VM query on the current patch_id
+    // - We use the result of the query to make a new snapshot
+    // - (optional) we delete the current patch_id in the patch_tree ?
+    bool create_snapshot = strategy != nullptr && strategy->doCreate(*metadata);
+    if (create_snapshot) {
+        NOTIFYMSG(progressListener, "\nCreating snapshot from patch...\n");
+        NOTIFYMSG(progressListener, "\nMaterializing version ...\n");
+        TripleIterator* triples_vm = get_version_materialized(Triple("", "", "", dict), 0, patch_id);
+        //TODO: custom IteratorTripleString to not have to buffer triples
+        std::vector<hdt::TripleString> triples;
+        Triple t;
+        while (triples_vm->next(&t)) {
+            triples.emplace_back(t.get_subject(*dict), t.get_predicate(*dict), t.get_object(*dict));
+        }
+        delete triples_vm;
+        IteratorTripleStringVector vec_it(&triples);
+        NOTIFYMSG(progressListener, "\nCreating new snapshot ...\n");
+        std::cout.setstate(std::ios_base::failbit); // Disable cout info from HDT
+        // The index of the new snapshot is built in the background while the previous delta chain is finalized
+        snapshotManager->write_snapshot(patch_id, &vec_it, BASEURI, progressListener);
+        std::cout.clear();
+
+        if (INDEX_CHAIN_DISTINCT_TRIPLES) {
+            NOTIFYMSG(progressListener, "\nIndexing distinct triples ...\n");
+            // The delta chain of the previous snapshot is final now
+            build_chain_distinct_index(snapshot_id);
+        }
+
+        if (FREEZE_CLOSED_DELTA_CHAINS) {
+            NOTIFYMSG(progressListener, "\nFreezing previous delta chain ...\n");
+            freeze_delta_chain(snapshot_id);
+        }
+
+        if (snapshot_diff_distance > 0) {
+            NOTIFYMSG(progressListener, "\nPersisting snapshot diffs ...\n");
+            std::vector<int> snapshots = snapshotManager->get_snapshots_ids();
+            auto snapshot_it = std::find(snapshots.begin(), snapshots.end(), patch_id);
+            for (int i = 0; i < snapshot_diff_distance && snapshot_it != snapshots.begin(); i++) {
+                snapshot_it--;
+                build_snapshot_diff(*snapshot_it, patch_id);
+            }
+        }
+        if (INDEX_CHAIN_DISTINCT_TRIPLES) {
+            build_chain_distinct_index(patch_id);
+        }
+    }
+    return status;
+}
+
+void Controller::store_patch_metadata(int snapshot_id, int patch_tree_id, int patch_id, size_t patch_size, uint64_t ingestion_time,
+                                      std::shared_ptr<DictionaryManager> dict) {
+    metadata->ingestion_times = metadata_manager->store_uint64("ingest-time", snapshot_id, ingestion_time);
 
     std::shared_ptr<PatchTree> pt = patchTreeManager->get_patch_tree(patch_tree_id, dict);
 
     // Fill the metadata struct for strategy
-    // Maybe move it to its own separate function later ?
     Triple tp("", "", "", dict);
     metadata->patch_id = patch_id;
-    metadata->delta_sizes = metadata_manager->store_uint64("delta-size", snapshot_id, patch_it->getPassed());
+    metadata->delta_sizes = metadata_manager->store_uint64("delta-size", snapshot_id, patch_size);
     size_t add_count = pt->addition_count(patch_id, tp);
     size_t del_count = pt->deletion_count(tp, patch_id).first;
     metadata->agg_delta_sizes = metadata_manager->store_uint64("agg-delta-size", snapshot_id, add_count + del_count);
@@ -469,43 +728,156 @@ bool Controller::append(PatchElementIterator* patch_it, int patch_id, std::share
     metadata->change_ratios = metadata_manager->store_double("change-ratio", snapshot_id, change_ratio);
     if (metadata->agg_delta_sizes.size() > 1) {
         uint64_t prev_ver_size = metadata->version_sizes[metadata->version_sizes.size()-2];
-        double loc_cr = (double) patch_it->getPassed() / (prev_ver_size + patch_it->getPassed());
+        double loc_cr = (double) patch_size / (prev_ver_size + patch_size);
         metadata->loc_change_ratios = metadata_manager->store_double("local-change-ratio", snapshot_id, loc_cr);
     } else {
         metadata->loc_change_ratios = metadata_manager->store_double("local-change-ratio", snapshot_id, 0.0);
     }
+}
 
-    // If we need to create a new snapshot:
-    // - We do a VM query on the current patch_id
-    // - We use the result of the query to make a new snapshot
-    // - (optional) we delete the current patch_id in the patch_tree ?
-    bool create_snapshot = strategy != nullptr && strategy->doCreate(*metadata);
-    if (create_snapshot) {
-        NOTIFYMSG(progressListener, "\nCreating snapshot from patch...\n");
-        NOTIFYMSG(progressListener, "\nMaterializing version ...\n");
-        TripleIterator* triples_vm = get_version_materialized(Triple("", "", "", dict), 0, patch_id);
-        //TODO: custom IteratorTripleString to not have to buffer triples
-        std::vector<hdt::TripleString> triples;
-        Triple t;
-        while (triples_vm->next(&t)) {
-            triples.emplace_back(t.get_subject(*dict), t.get_predicate(*dict), t.get_object(*dict));
+TripleDeltaIterator* Controller::get_snapshot_diff(const StringTriple& triple_pattern, int snapshot_id_start, int snapshot_id_end) const {
+    std::shared_ptr<SnapshotDiff> diff = snapshotDiffCache->get_diff(snapshot_id_start, snapshot_id_end, snapshotManager);
+    if (diff != nullptr) {
+        return new SnapshotDiffTripleDeltaIterator(diff, triple_pattern.get_as_triple(diff->get_dict_manager()));
+    }
+    return new AutoSnapshotDiffIterator(triple_pattern, snapshotManager, patchTreeManager, snapshot_id_start, snapshot_id_end);
+}
+
+bool Controller::build_snapshot_diff(int snapshot_id_start, int snapshot_id_end) {
+    if (snapshot_id_start >= snapshot_id_end
+        || snapshotManager->get_latest_snapshot(snapshot_id_start) != snapshot_id_start
+        || snapshotManager->get_latest_snapshot(snapshot_id_end) != snapshot_id_end) {
+        return false;
+    }
+    return snapshotDiffCache->build_diff(snapshot_id_start, snapshot_id_end, snapshotManager, patchTreeManager) != nullptr;
+}
+
+void Controller::set_snapshot_diff_distance(int distance) {
+    snapshot_diff_distance = distance;
+}
+
+void Controller::set_tree_codecs(const TreeCodec& addition_codec, const TreeCodec& deletion_codec) {
+    patchTreeManager->set_tree_codecs(addition_codec, deletion_codec);
+}
+
+bool Controller::freeze_delta_chain(int snapshot_id) {
+    if (snapshotManager->get_latest_snapshot(snapshot_id) != snapshot_id || snapshotManager->get_max_snapshot_id() <= snapshot_id) {
+        return false;
+    }
+    int patch_tree_id = patchTreeManager->get_patch_tree_id(snapshot_id + 1);
+    if (patch_tree_id <= snapshot_id) {
+        return false;
+    }
+    return patchTreeManager->freeze_patch_tree(patch_tree_id, snapshotManager->get_dictionary_manager(snapshot_id));
+}
+
+bool Controller::migrate_deletion_summaries(int snapshot_id) {
+    if (snapshotManager->get_latest_snapshot(snapshot_id) != snapshot_id) {
+        return false;
+    }
+    int patch_tree_id = patchTreeManager->get_patch_tree_id(snapshot_id + 1);
+    if (patch_tree_id <= snapshot_id) {
+        // A delta chain without patches has no deletion trees to migrate
+        return true;
+    }
+    return patchTreeManager->migrate_deletion_summaries(patch_tree_id, snapshotManager->get_dictionary_manager(snapshot_id));
+}
+
+// Streams the triples of a version as triple strings, the query is executed again when going back to the start.
+class VersionTripleStringIterator : public hdt::IteratorTripleString {
+private:
+    const Controller* controller;
+    int patch_id;
+    std::shared_ptr<DictionaryManager> dict;
+    TripleIterator* it;
+    Triple triple;
+    bool has_next;
+    hdt::TripleString current;
+public:
+    VersionTripleStringIterator(const Controller* controller, int patch_id)
+            : controller(controller), patch_id(patch_id), dict(controller->get_dictionary_manager(patch_id)),
+              it(nullptr), has_next(false) {
+        goToStart();
+    }
+    ~VersionTripleStringIterator() override {
+        delete it;
+    }
+    bool hasNext() override {
+        return has_next;
+    }
+    hdt::TripleString* next() override {
+        current = hdt::TripleString(triple.get_subject(*dict), triple.get_predicate(*dict), triple.get_object(*dict));
+        has_next = it->next(&triple);
+        return &current;
+    }
+    void goToStart() override {
+        delete it;
+        it = controller->get_version_materialized(StringTriple("", "", ""), 0, patch_id);
+        has_next = it->next(&triple);
+    }
+};
+
+bool Controller::recompact(const string& target_path, SnapshotCreationStrategy* strategy, int8_t kc_opts,
+                           hdt::ProgressListener* progressListener) const {
+    if (snapshotManager->get_latest_snapshot(0) != 0) {
+        return false;
+    }
+    int max_patch_id = get_max_patch_id();
+    Controller target(target_path, strategy, kc_opts);
+    if (target.get_snapshot_manager()->get_max_snapshot_id() >= 0) {
+        std::cerr << "The store at '" << target_path << "' already contains versions" << std::endl;
+        return false;
+    }
+
+    NOTIFYMSG(progressListener, "\nCreating snapshot 0 ...\n");
+    VersionTripleStringIterator snapshot_it(this, 0);
+    std::cout.setstate(std::ios_base::failbit); // Disable cout info from HDT
+    target.get_snapshot_manager()->write_snapshot(0, &snapshot_it, BASEURI, progressListener);
+    std::cout.clear();
+
+    for (int patch_id = 1; patch_id <= max_patch_id; patch_id++) {
+        NOTIFYMSG(progressListener, ("\nRewriting version " + to_string(patch_id) + " ...\n").c_str());
+        // The dictionary of the target version changes whenever the strategy has created a snapshot
+        std::shared_ptr<DictionaryManager> dict = target.get_dictionary_manager(patch_id);
+        PatchSorted patch(dict);
+        TripleDeltaIterator* it = get_delta_materialized(StringTriple("", "", ""), 0, patch_id - 1, patch_id);
+        TripleDelta triple_delta;
+        while (it->next(&triple_delta)) {
+            std::shared_ptr<DictionaryManager> source_dict = triple_delta.get_dictionary();
+            Triple* triple = triple_delta.get_triple();
+            patch.add_unsorted(PatchElement(Triple(triple->get_subject(*source_dict), triple->get_predicate(*source_dict),
+                                                   triple->get_object(*source_dict), dict), triple_delta.is_addition()));
+        }
+        delete it;
+        patch.sort();
+        if (!target.append(patch, patch_id, dict, false, progressListener)) {
+            return false;
         }
-        delete triples_vm;
-        IteratorTripleStringVector vec_it(&triples);
-        NOTIFYMSG(progressListener, "\nCreating new snapshot ...\n");
-        std::cout.setstate(std::ios_base::failbit); // Disable cout info from HDT
-        snapshotManager->create_snapshot(patch_id, &vec_it, BASEURI, progressListener);
-        std::cout.clear();
     }
-    return status;
+    return true;
+}
+
+bool Controller::build_chain_distinct_index(int snapshot_id) {
+    std::vector<int> snapshots = snapshotManager->get_snapshots_ids();
+    if (snapshots.empty() || snapshotManager->get_latest_snapshot(snapshot_id) != snapshot_id) {
+        return false;
+    }
+    bool built = true;
+    if (snapshot_id != snapshots[0]) {
+        built = chainDistinctIndex->build(snapshot_id, CHAIN_DISTINCT_SNAPSHOT, snapshotManager, patchTreeManager) != nullptr;
+    }
+    if (snapshot_id != snapshots.back()) {
+        built = chainDistinctIndex->build(snapshot_id, CHAIN_DISTINCT_ADDITIONS, snapshotManager, patchTreeManager) != nullptr && built;
+    }
+    return built;
 }
 
 bool Controller::append(const PatchSorted& patch, int patch_id, std::shared_ptr<DictionaryManager> dict, bool check_uniqueness,
                         hdt::ProgressListener *progressListener) {
-    PatchElementIteratorVector* it = new PatchElementIteratorVector(&patch.get_vector());
-    bool ret = append(it, patch_id, dict, check_uniqueness, progressListener);
-    delete it;
-    return ret;
+    return append(patch_id, dict, [&](size_t& patch_size) {
+        patch_size = patch.get_size();
+        return patchTreeManager->append(patch, patch_id, dict, check_uniqueness, progressListener);
+    }, progressListener);
 }
 
 PatchTreeManager* Controller::get_patch_tree_manager() const {
@@ -516,6 +888,10 @@ SnapshotManager* Controller::get_snapshot_manager() const {
     return snapshotManager;
 }
 
+std::shared_ptr<MemoryBudget> Controller::get_memory_budget() const {
+    return memoryBudget;
+}
+
 std::shared_ptr<DictionaryManager> Controller::get_dictionary_manager(int patch_id) const {
     int snapshot_id = get_snapshot_manager()->get_latest_snapshot(patch_id);
     if(snapshot_id < 0) {
@@ -554,18 +930,46 @@ void Controller::cleanup(std::string basePath, Controller* controller) {
         std::remove((basePath + PATCHTREE_FILENAME(id, "osp_additions")).c_str());
         std::remove((basePath + PATCHTREE_FILENAME(id, "count_additions")).c_str());
         std::remove((basePath + PATCHTREE_FILENAME(id, "count_additions.tmp")).c_str());
+        std::remove((basePath + PATCHTREE_FILENAME(id, "count_sketches")).c_str());
+        std::remove((basePath + PATCHTREE_FILENAME(id, "frozen")).c_str());
+        std::remove((basePath + PATCHTREE_FILENAME(id, "additions_codec")).c_str());
+        std::remove((basePath + PATCHTREE_FILENAME(id, "deletions_codec")).c_str());
+        std::remove((basePath + PATCHTREE_FILENAME(id, "deletion_summaries")).c_str());
+        for (const std::string tree : {"spo_deletions", "pos_deletions", "osp_deletions", "spo_additions", "pos_additions", "osp_additions"}) {
+            std::remove((basePath + PATCHTREE_FILENAME(id, tree + "_dict")).c_str());
+        }
         patchMetadataToDelete.push_back(id);
         itP++;
     }
 
+    // Delete snapshot diff files
+    controller->snapshotDiffCache->unload();
+    for (const auto& diff : controller->snapshotDiffCache->detect_diffs()) {
+        std::remove((basePath + SNAPSHOT_DIFF_FILENAME(diff.first, diff.second, "spo")).c_str());
+        std::remove((basePath + SNAPSHOT_DIFF_FILENAME(diff.first, diff.second, "pos")).c_str());
+        std::remove((basePath + SNAPSHOT_DIFF_FILENAME(diff.first, diff.second, "osp")).c_str());
+        std::remove((basePath + SNAPSHOT_DIFF_FILENAME(diff.first, diff.second, "complete")).c_str());
+    }
+
+    // Delete chain distinct index files
+    controller->chainDistinctIndex->unload();
+    for (const auto& index : controller->chainDistinctIndex->detect_indexes()) {
+        std::remove((basePath + CHAIN_DISTINCT_FILENAME(index.first, index.second, "spo")).c_str());
+        std::remove((basePath + CHAIN_DISTINCT_FILENAME(index.first, index.second, "pos")).c_str());
+        std::remove((basePath + CHAIN_DISTINCT_FILENAME(index.first, index.second, "osp")).c_str());
+        std::remove((basePath + CHAIN_DISTINCT_FILENAME(index.first, index.second, "complete")).c_str());
+    }
+
     // Delete snapshot files
     std::vector<int> snapshots = controller->get_snapshot_manager()->get_snapshots_ids();
     auto itS = snapshots.begin();
     std::list<int> patchDictsToDelete;
     while(itS != snapshots.end()) {
         int id = *itS;
+        controller->get_snapshot_manager()->wait_for_index(id);
         std::remove((basePath + SNAPSHOT_FILENAME_BASE(id)).c_str());
-        std::remove((basePath + SNAPSHOT_FILENAME_BASE(id) + ".index.v1-1").c_str());
+        std::remove((basePath + SNAPSHOT_INDEX_FILENAME(id)).c_str());
+        std::remove((basePath + SNAPSHOT_SKETCH_FILENAME(id)).c_str());
 
         patchDictsToDelete.push_back(id);
         itS++;
@@ -587,6 +991,8 @@ void Controller::cleanup(std::string basePath, Controller* controller) {
 
     // Delete strategy metadata database
     std::remove((basePath + "ingestion_metadata.kch").c_str());
+
+    StoreManifest::cleanup(basePath);
 }
 
 PatchBuilder* Controller::new_patch_bulk() {
@@ -634,12 +1040,11 @@ bool Controller::ingest(const std::vector<std::pair<hdt::IteratorTripleString *,
         NOTIFYMSG(progressListener, "\nCreating snapshot...\n");
         std::cout.setstate(std::ios_base::failbit); // Disable cout info from HDT
         auto istart = std::chrono::high_resolution_clock::now();
-        std::shared_ptr<hdt::HDT> hdt = snapshotManager->create_snapshot(patch_id, it_snapshot, BASEURI, progressListener);
+        added = snapshotManager->write_snapshot(patch_id, it_snapshot, BASEURI, progressListener);
         auto istop = std::chrono::high_resolution_clock::now();
         auto iduration = std::chrono::duration_cast<std::chrono::milliseconds>(istop - istart);
         metadata_manager->store_uint64("ingest-time", patch_id, iduration.count());
         std::cout.clear();
-        added = hdt->getTriples()->getNumberOfElements();
         delete it_snapshot;
     } else {
         if (sort) {
@@ -668,6 +1073,150 @@ bool Controller::ingest(const std::vector<std::pair<hdt::IteratorTripleString *,
     return true;
 }
 
+bool Controller::load_delta_chain(const DeltaChainInput& chain, bool sort, std::vector<uint64_t>& ingestion_times,
+                                  std::vector<size_t>& patch_sizes) {
+    auto sstart = std::chrono::high_resolution_clock::now();
+    snapshotManager->write_snapshot(chain.snapshot_id, chain.snapshot, BASEURI);
+    auto sstop = std::chrono::high_resolution_clock::now();
+    ingestion_times.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(sstop - sstart).count());
+    delete chain.snapshot;
+    if (chain.patches.empty()) {
+        return true;
+    }
+
+    std::shared_ptr<DictionaryManager> dict = get_dictionary_manager(chain.snapshot_id);
+    // The patch tree is created upfront, as the patches would otherwise end up in the patch tree of a preceding chain
+    patchTreeManager->construct_next_patch_tree(chain.snapshot_id + 1, dict);
+    bool status = true;
+    for (size_t i = 0; i < chain.patches.size(); i++) {
+        int patch_id = chain.snapshot_id + 1 + (int) i;
+        auto* it_patch = new PatchElementIteratorCombined(PatchTreeKeyComparator(comp_s, comp_p, comp_o, dict));
+        for (const auto& file : chain.patches[i]) {
+            it_patch->appendIterator(new PatchElementIteratorTripleStrings(dict, file.first, file.second));
+        }
+        // The iterators of the remaining patches are still deleted after a failed append
+        auto istart = std::chrono::high_resolution_clock::now();
+        size_t patch_size = 0;
+        if (status && sort) {
+            auto* comparator = new PatchElementComparator(new PatchTreeKeyComparator(comp_s, comp_p, comp_o, dict));
+            PatchSorted patch_sorted(comparator);
+            PatchElement patch_element;
+            while (it_patch->next(&patch_element)) {
+                patch_sorted.add_unsorted(patch_element);
+            }
+            patch_sorted.sort();
+            status = patchTreeManager->append(patch_sorted, patch_id, dict, false);
+            patch_size = patch_sorted.get_size();
+            delete comparator;
+        } else if (status) {
+            status = patchTreeManager->append(it_patch, patch_id, dict, false);
+            patch_size = it_patch->getPassed();
+        }
+        if (status) {
+            auto istop = std::chrono::high_resolution_clock::now();
+            ingestion_times.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(istop - istart).count());
+            patch_sizes.push_back(patch_size);
+        }
+        delete it_patch;
+    }
+    return status;
+}
+
+bool Controller::bulk_load(const std::vector<DeltaChainInput>& chains, bool sort, unsigned int threads,
+                           hdt::ProgressListener* progressListener) {
+    if (chains.empty()) {
+        return true;
+    }
+    int max_patch_id = get_max_patch_id();
+    for (const DeltaChainInput& chain : chains) {
+        if (chain.snapshot_id <= max_patch_id) {
+            std::cerr << "The delta chain of snapshot " << chain.snapshot_id << " overlaps with preceding versions" << std::endl;
+            // Nothing is loaded, but the iterators are still ours to delete
+            for (const DeltaChainInput& invalid_chain : chains) {
+                delete invalid_chain.snapshot;
+                for (const auto& patch : invalid_chain.patches) {
+                    for (const auto& file : patch) {
+                        delete file.first;
+                    }
+                }
+            }
+            return false;
+        }
+        max_patch_id = chain.snapshot_id + (int) chain.patches.size();
+    }
+    // The last delta chain of the store is closed by the first loaded snapshot, so it is finalized along with the loaded chains
+    std::vector<int> snapshot_ids;
+    int previous_snapshot_id = snapshotManager->get_max_snapshot_id();
+    if (previous_snapshot_id >= 0) {
+        snapshot_ids.push_back(previous_snapshot_id);
+    }
+
+    // Each thread loads one delta chain at a time, in order of snapshot id
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::atomic<size_t> next_chain(0);
+    std::atomic<bool> status(true);
+    std::vector<std::vector<uint64_t>> ingestion_times(chains.size());
+    std::vector<std::vector<size_t>> patch_sizes(chains.size());
+    std::mutex progress_mutex;
+    std::cout.setstate(std::ios_base::failbit); // Disable cout info from HDT
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min((size_t) threads, chains.size()); i++) {
+        workers.emplace_back([&]() {
+            size_t chain;
+            while ((chain = next_chain++) < chains.size()) {
+                if (!load_delta_chain(chains[chain], sort, ingestion_times[chain], patch_sizes[chain])) {
+                    status = false;
+                }
+                std::lock_guard<std::mutex> lock(progress_mutex);
+                NOTIFYMSG(progressListener, ("\nLoaded delta chain of snapshot " + to_string(chains[chain].snapshot_id) + "\n").c_str());
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    std::cout.clear();
+
+    // The metadata of a version depends on the preceding versions of its delta chain, so it is stored in order
+    for (size_t chain = 0; chain < chains.size(); chain++) {
+        int snapshot_id = chains[chain].snapshot_id;
+        metadata_manager->store_uint64("ingest-time", snapshot_id, ingestion_times[chain][0]);
+        std::shared_ptr<DictionaryManager> dict = get_dictionary_manager(snapshot_id);
+        for (size_t i = 0; i < patch_sizes[chain].size(); i++) {
+            store_patch_metadata(snapshot_id, snapshot_id + 1, snapshot_id + 1 + (int) i, patch_sizes[chain][i],
+                                 ingestion_times[chain][i + 1], dict);
+        }
+    }
+
+    // Indexing a delta chain depends on the preceding chains, so this is done in order
+    NOTIFYMSG(progressListener, "\nIndexing and freezing delta chains ...\n");
+    for (const DeltaChainInput& chain : chains) {
+        snapshot_ids.push_back(chain.snapshot_id);
+    }
+    for (int snapshot_id : snapshot_ids) {
+        if (INDEX_CHAIN_DISTINCT_TRIPLES) {
+            build_chain_distinct_index(snapshot_id);
+        }
+        if (FREEZE_CLOSED_DELTA_CHAINS) {
+            freeze_delta_chain(snapshot_id);
+        }
+    }
+    if (snapshot_diff_distance > 0) {
+        NOTIFYMSG(progressListener, "\nPersisting snapshot diffs ...\n");
+        std::vector<int> snapshots = snapshotManager->get_snapshots_ids();
+        for (const DeltaChainInput& chain : chains) {
+            auto snapshot_it = std::find(snapshots.begin(), snapshots.end(), chain.snapshot_id);
+            for (int i = 0; i < snapshot_diff_distance && snapshot_it != snapshots.begin(); i++) {
+                snapshot_it--;
+                build_snapshot_diff(*snapshot_it, chain.snapshot_id);
+            }
+        }
+    }
+    return status;
+}
+
 void Controller::init_strategy_metadata() {
     metadata = new CreationStrategyMetadata;
 //    metadata->num_version = get_number_versions();
@@ -10,16 +10,86 @@
 #include "triple_versions_iterator.h"
 #include "snapshot_creation_strategy.h"
 #include "metadata_manager.h"
+#include "snapshot_diff_cache.h"
+#include "chain_distinct_index.h"
 
+// If the delta chain of a snapshot is frozen into a compact read-only form once the next snapshot is created
+#ifndef FREEZE_CLOSED_DELTA_CHAINS
+#define FREEZE_CLOSED_DELTA_CHAINS true
+#endif
 
+// If the distinct triples of delta chains are indexed when a snapshot is created, for exact version counts
+#ifndef INDEX_CHAIN_DISTINCT_TRIPLES
+#define INDEX_CHAIN_DISTINCT_TRIPLES true
+#endif
+
+
+// All query methods (and their count variants) can be called concurrently from multiple threads on a single controller.
+// Each returned iterator owns its own cursors, so it must only be consumed by one thread at a time.
 class Controller {
 private:
+    // The memory budget that is shared by the snapshot and patch tree caches
+    std::shared_ptr<MemoryBudget> memoryBudget;
+    // The manifest that lists the snapshots and patch trees, so that the store directory does not have to be scanned
+    std::shared_ptr<StoreManifest> manifest;
     PatchTreeManager* patchTreeManager;
     SnapshotManager* snapshotManager;
     SnapshotCreationStrategy* strategy;
     CreationStrategyMetadata* metadata;
 
     MetadataManager* metadata_manager;
+    SnapshotDiffCache* snapshotDiffCache;
+    int snapshot_diff_distance;
+    ChainDistinctIndex* chainDistinctIndex;
+
+    /**
+     * Get an iterator over the diff between two snapshots, using the persisted diff if it exists.
+     */
+    TripleDeltaIterator* get_snapshot_diff(const StringTriple& triple_pattern, int snapshot_id_start, int snapshot_id_end) const;
+    /**
+     * Add a patch to a patch tree, and create a new snapshot afterwards if the snapshot creation strategy asks for it.
+     * @param patch_id The id of the patch to add.
+     * @param dict The dictionary of the delta chain.
+     * @param append_patch Appends the patch to the patch tree manager, sets the number of patch elements,
+     *                     and returns if the append succeeded.
+     * @param progressListener an optional progress listener.
+     * @return If the append succeeded.
+     */
+    bool append(int patch_id, std::shared_ptr<DictionaryManager> dict, const std::function<bool(size_t& patch_size)>& append_patch,
+                hdt::ProgressListener* progressListener);
+    /**
+     * Store the metadata of an appended patch, and update the metadata for the snapshot creation strategy.
+     * @param snapshot_id The id of the snapshot of the delta chain of the patch.
+     * @param patch_tree_id The id of the patch tree the patch was appended to.
+     * @param patch_id The id of the patch.
+     * @param patch_size The number of patch elements.
+     * @param ingestion_time The time it took to append the patch, in milliseconds.
+     * @param dict The dictionary of the delta chain.
+     */
+    void store_patch_metadata(int snapshot_id, int patch_tree_id, int patch_id, size_t patch_size, uint64_t ingestion_time,
+                              std::shared_ptr<DictionaryManager> dict);
+
+public:
+    typedef struct DeltaChainInput {
+        // The id of the snapshot of the delta chain
+        int snapshot_id;
+        // The triples of the snapshot
+        hdt::IteratorTripleString* snapshot;
+        // The files of the patches snapshot_id + 1, snapshot_id + 2, ..., as pairs of a triple iterator and if it contains additions
+        std::vector<std::vector<std::pair<hdt::IteratorTripleString*, bool>>> patches;
+    } DeltaChainInput;
+
+private:
+    /**
+     * Write the snapshot of the given delta chain, and append its patches to a new patch tree.
+     * This only touches the files of the delta chain itself, so different chains can be loaded concurrently.
+     * @param chain The delta chain, of which the iterators are deleted afterwards.
+     * @param sort If the triples of the patches need to be sorted before insertion.
+     * @param ingestion_times The time it took to write the snapshot and to append each patch, in milliseconds, are added to this.
+     * @param patch_sizes The number of patch elements of each appended patch are added to this.
+     * @return If all patches have been appended.
+     */
+    bool load_delta_chain(const DeltaChainInput& chain, bool sort, std::vector<uint64_t>& ingestion_times, std::vector<size_t>& patch_sizes);
 
 public:
     explicit Controller(const string& basePath, int8_t kc_opts = 0, bool readonly = false, size_t cache_size = 4);
@@ -31,12 +101,40 @@ public:
      * @param triple_pattern Only triples matching this pattern will be returned.
      * @param offset A certain offset the iterator should start with.
      * @param patch_id The patch id for which triples should be returned.
+     * @param limit The maximum number of triples to return, negative for no limit.
+     */
+    TripleIterator* get_version_materialized(const Triple &triple_pattern, int offset, int patch_id, int limit = -1) const;
+    TripleIterator* get_version_materialized(const StringTriple &triple_pattern, int offset, int patch_id, int limit = -1) const;
+    /**
+     * Same as get_version_materialized, but for a triple pattern that is already encoded
+     * with the dictionary of the delta chain the given patch id belongs to.
+     * @param triple_pattern Only triples matching this encoded pattern will be returned.
+     * @param offset A certain offset the iterator should start with.
+     * @param patch_id The patch id for which triples should be returned.
+     */
+    TripleIterator* get_version_materialized_ids(const Triple &triple_pattern, int offset, int patch_id) const;
+    /**
+     * Get an iterator for all triples matching the given triple pattern in any of the given patch ids.
+     * Triples are annotated with a bitmap of the given patch ids in which they exist.
+     * The snapshot and patch tree are only scanned once, instead of once per patch id.
+     * @param triple_pattern Only triples matching this pattern will be returned.
+     * @param patch_ids The patch ids for which triples should be returned, these must all belong to the same delta chain.
      */
-    TripleIterator* get_version_materialized(const Triple &triple_pattern, int offset, int patch_id) const;
-    TripleIterator* get_version_materialized(const StringTriple &triple_pattern, int offset, int patch_id) const;
+    TripleVersionsBitmapIterator* get_version_materialized_multi(const StringTriple &triple_pattern, const std::vector<int>& patch_ids) const;
     std::pair<size_t, hdt::ResultEstimationType> get_version_materialized_count(const Triple& triple_pattern, int patch_id, bool allowEstimates = false) const;
     std::pair<size_t, hdt::ResultEstimationType> get_version_materialized_count(const StringTriple& triple_pattern, int patch_id, bool allowEstimates = false) const;
     size_t get_version_materialized_count_estimated(const Triple& triple_pattern, int patch_id) const;
+    /**
+     * Get the number of triples matching the given triple pattern for every version in the given range.
+     * This is equivalent to calling get_version_materialized_count for each version,
+     * but the snapshot and the patch tree of each delta chain are only visited once.
+     * @param triple_pattern Only triples matching this pattern will be counted.
+     * @param patch_id_start The first patch id.
+     * @param patch_id_end The last patch id, inclusive.
+     * @param allowEstimates If the snapshot counts may be estimated.
+     * @return The count for each patch id, starting at patch_id_start.
+     */
+    std::vector<size_t> get_version_materialized_count_series(const StringTriple& triple_pattern, int patch_id_start, int patch_id_end, bool allowEstimates = false) const;
     /**
      * Get an addition/deletion iterator for all triples matching the given triple pattern with a certain offset
      * in the list of all triples that have been added or removed from patch_id until patch_id_end.
@@ -44,9 +142,11 @@ public:
      * @param triple_pattern Only triples matching this pattern will be returned.
      * @param offset A certain offset the iterator should start with.
      * @param patch_id The patch id for which triples should be returned.
+     * @param limit The maximum number of triples to return, negative for no limit.
+     * @param use_plain_diff If the delta between two snapshots should be computed by diffing them directly.
      */
-    TripleDeltaIterator* get_delta_materialized(const Triple &triple_pattern, int offset, int patch_id_start, int patch_id_end) const;
-    TripleDeltaIterator* get_delta_materialized(const StringTriple &triple_pattern, int offset, int patch_id_start, int patch_id_end, bool use_plain_diff = false) const;
+    TripleDeltaIterator* get_delta_materialized(const Triple &triple_pattern, int offset, int patch_id_start, int patch_id_end, int limit = -1, bool use_plain_diff = false) const;
+    TripleDeltaIterator* get_delta_materialized(const StringTriple &triple_pattern, int offset, int patch_id_start, int patch_id_end, int limit = -1, bool use_plain_diff = false) const;
     std::pair<size_t, hdt::ResultEstimationType> get_delta_materialized_count(const Triple& triple_pattern, int patch_id_start, int patch_id_end, bool allowEstimates = false) const;
     std::pair<size_t, hdt::ResultEstimationType> get_delta_materialized_count(const StringTriple& triple_pattern, int patch_id_start, int patch_id_end, bool allowEstimates = false) const;
     size_t get_delta_materialized_count_estimated(const Triple& triple_pattern, int patch_id_start, int patch_id_end) const;
@@ -56,10 +156,11 @@ public:
      * Triples are annotated with the version in which they are valid.
      * @param triple_pattern Only triples matching this pattern will be returned.
      * @param offset A certain offset the iterator should start with.
-     * @param patch_id The patch id for which triples should be returned.
+     * @param limit The maximum number of triples to return, negative for no limit.
+     *              As the triples of each delta chain are sorted, at most offset + limit triples are consumed per delta chain.
      */
-    TripleVersionsIterator* get_version(const StringTriple &triple_pattern, int offset) const;
-    TripleVersionsIterator* get_version(const Triple &triple_pattern, int offset) const;
+    TripleVersionsIterator* get_version(const StringTriple &triple_pattern, int offset, int limit = -1) const;
+    TripleVersionsIterator* get_version(const Triple &triple_pattern, int offset, int limit = -1) const;
     std::pair<size_t, hdt::ResultEstimationType> get_version_count(const Triple& triple_pattern, bool allowEstimates = false) const;
     std::pair<size_t, hdt::ResultEstimationType> get_version_count(const StringTriple& triple_pattern, bool allowEstimates = false) const;
     size_t get_version_count_estimated(const Triple& triple_pattern) const;
@@ -84,6 +185,66 @@ public:
      */
     bool append(const PatchSorted& patch, int patch_id, std::shared_ptr<DictionaryManager> dict, bool check_uniqueness = true, hdt::ProgressListener* progressListener = NULL);
 
+    /**
+     * Persist the diff between two snapshots, so that delta queries spanning both snapshots
+     * do not have to compare the snapshots anymore.
+     * @param snapshot_id_start The start snapshot.
+     * @param snapshot_id_end The end snapshot.
+     * @return If the diff exists after this call.
+     */
+    bool build_snapshot_diff(int snapshot_id_start, int snapshot_id_end);
+    /**
+     * Set the number of preceding snapshots to which a diff is persisted when a new snapshot is created.
+     * @param distance The number of snapshots, 0 disables this.
+     */
+    void set_snapshot_diff_distance(int distance);
+    /**
+     * Set the block compression codecs of the patch trees that are created from now on.
+     * The codec of each tree is persisted when it is created, so existing trees and readers need no configuration.
+     * @param addition_codec The codec of the addition trees, such as TreeCodec::parse("lz4").
+     * @param deletion_codec The codec of the deletion trees.
+     */
+    void set_tree_codecs(const TreeCodec& addition_codec, const TreeCodec& deletion_codec);
+    /**
+     * Persist the triples of the delta chain of the given snapshot that do not occur in any earlier delta chain,
+     * so that exact version counts do not have to compare delta chains anymore.
+     * The snapshot triples are indexed for all but the first snapshot,
+     * the additions are indexed once a later snapshot exists, as they are final from then on.
+     * This is done automatically when a snapshot is created, unless INDEX_CHAIN_DISTINCT_TRIPLES is false.
+     * @param snapshot_id The snapshot.
+     * @return If all parts of the delta chain that can be indexed have been indexed after this call.
+     */
+    bool build_chain_distinct_index(int snapshot_id);
+    /**
+     * Rewrite the patch tree of the delta chain of the given snapshot into a compact read-only form.
+     * This is done automatically when the next snapshot is created, unless FREEZE_CLOSED_DELTA_CHAINS is false.
+     * @param snapshot_id The snapshot, a later snapshot must exist.
+     * @return If the patch tree has been frozen.
+     */
+    bool freeze_delta_chain(int snapshot_id);
+    /**
+     * Migrate the patch tree of the delta chain of the given snapshot, so that its POS and OSP deletion trees
+     * only contain version summaries, of which the exact values are resolved in the SPO deletion tree.
+     * Stores that were created with SECONDARY_DELETION_SUMMARIES already have this layout.
+     * The delta chain can be queried during the migration, appends to it wait until the migration has finished.
+     * The calling thread must not hold any iterators over the delta chain.
+     * @param snapshot_id The snapshot.
+     * @return If the deletion trees of the delta chain contain summaries after this call.
+     */
+    bool migrate_deletion_summaries(int snapshot_id);
+    /**
+     * Rewrite all versions of this store into a new store, in which snapshots are created where the given strategy decides.
+     * The first version is streamed into the first snapshot, and every later version is appended
+     * as its delta to the previous version, so the original input files are not needed.
+     * @param target_path The directory of the new store, which must not contain a store yet.
+     * @param strategy The snapshot creation strategy of the new store, null to never create snapshots.
+     * @param kc_opts The KC options of the new store.
+     * @param progressListener an optional progress listener.
+     * @return If all versions have been rewritten.
+     */
+    bool recompact(const string& target_path, SnapshotCreationStrategy* strategy, int8_t kc_opts = 0,
+                   hdt::ProgressListener* progressListener = nullptr) const;
+
     /**
      * @return The internal patchtree manager.
      */
@@ -92,6 +253,12 @@ public:
      * @return The internal snapshot manager.
      */
     SnapshotManager* get_snapshot_manager() const;
+    /**
+     * The loaded snapshots, dictionaries and patch trees are charged to this budget,
+     * of which the current usage can be read and the maximum size can be changed.
+     * @return The memory budget that is shared by the snapshot and patch tree caches.
+     */
+    std::shared_ptr<MemoryBudget> get_memory_budget() const;
     /**
      * @return The DictionaryManager file for a certain patch id, this patch id does not have to be created yet.
      */
@@ -137,6 +304,22 @@ public:
     * @return if ingestion has succeeded
     */
     bool ingest(const std::vector<std::pair<hdt::IteratorTripleString*, bool>>& files, int patch_id, bool sort = false, hdt::ProgressListener* progressListener = nullptr);
+    /**
+     * Load independent delta chains concurrently, each with its own snapshot, dictionary and patch tree.
+     * The snapshot creation strategy is not consulted, as the chains determine where the snapshots are.
+     * Once all chains have been loaded, the delta chains that are closed by them are indexed and frozen in order,
+     * just like when their next snapshot would have been created by an append.
+     * @param chains The delta chains, sorted by snapshot id, of which the versions must not overlap
+     *               and must all come after the versions that are already in the store.
+     *               The iterators are always deleted, also when the chains are invalid.
+     * @param sort If the triples of the patches need to be sorted before insertion.
+     * @param threads The number of chains that are loaded at the same time, 0 for the number of hardware threads.
+     * @param progressListener an optional progress listener.
+     * @return If all delta chains have been loaded, nothing is loaded if the chains are invalid.
+     *         The ingestion metadata of all loaded versions is stored just like when they would have been appended.
+     */
+    bool bulk_load(const std::vector<DeltaChainInput>& chains, bool sort = false, unsigned int threads = 0,
+                   hdt::ProgressListener* progressListener = nullptr);
 
 };
 
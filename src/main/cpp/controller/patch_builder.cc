@@ -25,7 +25,7 @@ void PatchBuilder::commit(hdt::ProgressListener* progressListener) {
     }
     if (patch_id == 0) {
         VectorTripleIterator* it = new VectorTripleIterator(triples);
-        controller->get_snapshot_manager()->create_snapshot(0, it, BASEURI);
+        controller->get_snapshot_manager()->write_snapshot(0, it, BASEURI);
         delete it;
     } else {
         patch->sort();
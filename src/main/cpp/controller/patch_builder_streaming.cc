@@ -13,7 +13,7 @@ PatchBuilderStreaming::PatchBuilderStreaming(Controller* controller, int patch_i
 
 void PatchBuilderStreaming::threaded_insert() {
     if (patch_id == 0) {
-        controller->get_snapshot_manager()->create_snapshot(0, this, BASEURI);
+        controller->get_snapshot_manager()->write_snapshot(0, this, BASEURI);
     } else {
         controller->append(this, patch_id, dict, check_uniqueness, progressListener);
     }
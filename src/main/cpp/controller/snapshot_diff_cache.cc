@@ -0,0 +1,175 @@
+#include <regex>
+#include <fstream>
+#include <dirent.h>
+#include "snapshot_diff_cache.h"
+
+
+SnapshotDiff::SnapshotDiff(const std::string& base_path, int snapshot_id_start, int snapshot_id_end,
+                           std::shared_ptr<DictionaryManager> dict, bool readonly)
+        : snapshot_id_start(snapshot_id_start), snapshot_id_end(snapshot_id_end), dict(dict) {
+    index_spo = new kyotocabinet::TreeDB();
+    index_pos = new kyotocabinet::TreeDB();
+    index_osp = new kyotocabinet::TreeDB();
+    index_spo->tune_comparator(spo_comparator = new PatchTreeKeyComparator(comp_s, comp_p, comp_o, dict));
+    index_pos->tune_comparator(pos_comparator = new PatchTreeKeyComparator(comp_p, comp_o, comp_s, dict));
+    index_osp->tune_comparator(osp_comparator = new PatchTreeKeyComparator(comp_o, comp_s, comp_p, dict));
+    open(index_spo, base_path + SNAPSHOT_DIFF_FILENAME(snapshot_id_start, snapshot_id_end, "spo"), readonly);
+    open(index_pos, base_path + SNAPSHOT_DIFF_FILENAME(snapshot_id_start, snapshot_id_end, "pos"), readonly);
+    open(index_osp, base_path + SNAPSHOT_DIFF_FILENAME(snapshot_id_start, snapshot_id_end, "osp"), readonly);
+}
+
+SnapshotDiff::~SnapshotDiff() {
+    for (kyotocabinet::TreeDB* db : {index_spo, index_pos, index_osp}) {
+        if (!db->close()) {
+            cerr << "close snapshot diff error: " << db->error().name() << endl;
+        }
+        delete db;
+    }
+    delete spo_comparator;
+    delete pos_comparator;
+    delete osp_comparator;
+}
+
+void SnapshotDiff::open(kyotocabinet::TreeDB* db, const std::string& file_name, bool readonly) {
+    db->tune_map(KC_MEMORY_MAP_SIZE);
+    db->tune_page_cache(KC_PAGE_CACHE_SIZE);
+    if (!db->open(file_name, (readonly ? kyotocabinet::TreeDB::OREADER : (kyotocabinet::TreeDB::OWRITER | kyotocabinet::TreeDB::OCREATE)) | kyotocabinet::TreeDB::ONOREPAIR)) {
+        cerr << "open " << file_name << " error: " << db->error().name() << endl;
+    }
+}
+
+void SnapshotDiff::insert(const Triple& triple, bool addition) {
+    size_t key_size;
+    const char* raw_key = triple.serialize(&key_size);
+    char raw_value = addition ? 1 : 0;
+    index_spo->set(raw_key, key_size, &raw_value, 1);
+    index_pos->set(raw_key, key_size, &raw_value, 1);
+    index_osp->set(raw_key, key_size, &raw_value, 1);
+    delete[] raw_key;
+}
+
+void SnapshotDiff::synchronize() {
+    index_spo->synchronize();
+    index_pos->synchronize();
+    index_osp->synchronize();
+}
+
+kyotocabinet::TreeDB* SnapshotDiff::get_tree(const Triple& triple_pattern) const {
+    hdt::TripleComponentOrder order = TripleStore::get_query_order(triple_pattern);
+    if (order == hdt::OSP) return index_osp;
+    if (order == hdt::POS) return index_pos;
+    return index_spo;
+}
+
+std::shared_ptr<DictionaryManager> SnapshotDiff::get_dict_manager() const {
+    return dict;
+}
+
+
+SnapshotDiffTripleDeltaIterator::SnapshotDiffTripleDeltaIterator(std::shared_ptr<SnapshotDiff> diff, const Triple& triple_pattern)
+        : diff(diff), cursor(diff->get_tree(triple_pattern)->cursor()), triple_pattern(triple_pattern) {
+    size_t size;
+    const char* data = triple_pattern.serialize(&size);
+    cursor->jump(data, size);
+    delete[] data;
+}
+
+SnapshotDiffTripleDeltaIterator::~SnapshotDiffTripleDeltaIterator() {
+    delete cursor;
+}
+
+bool SnapshotDiffTripleDeltaIterator::next(TripleDelta* triple) {
+    size_t ksp, vsp;
+    const char* vbp;
+    const char* kbp = cursor->get(&ksp, &vbp, &vsp, true);
+    if (!kbp) {
+        return false;
+    }
+    triple->get_triple()->deserialize(kbp, ksp);
+    bool addition = vsp > 0 && vbp[0] == 1;
+    delete[] kbp;
+    // The tree is chosen so that all matches are continuous, so we can stop at the first non-matching triple.
+    if (!Triple::pattern_match_triple(*triple->get_triple(), triple_pattern)) {
+        return false;
+    }
+    triple->set_addition(addition);
+    triple->set_dictionary(diff->get_dict_manager());
+    return true;
+}
+
+
+SnapshotDiffCache::SnapshotDiffCache(std::string base_path, bool readonly) : base_path(std::move(base_path)), readonly(readonly) {}
+
+std::shared_ptr<SnapshotDiff> SnapshotDiffCache::get_diff(int snapshot_id_start, int snapshot_id_end, SnapshotManager* snapshot_manager) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = loaded_diffs.find(std::make_pair(snapshot_id_start, snapshot_id_end));
+    if (it != loaded_diffs.end()) {
+        return it->second;
+    }
+    // Diffs are only usable once they have been completely built
+    std::ifstream marker(base_path + SNAPSHOT_DIFF_FILENAME(snapshot_id_start, snapshot_id_end, "complete"));
+    if (!marker.good()) {
+        return nullptr;
+    }
+    std::shared_ptr<SnapshotDiff> diff = std::make_shared<SnapshotDiff>(base_path, snapshot_id_start, snapshot_id_end,
+            snapshot_manager->get_dictionary_manager(snapshot_id_end), readonly);
+    loaded_diffs[std::make_pair(snapshot_id_start, snapshot_id_end)] = diff;
+    return diff;
+}
+
+std::shared_ptr<SnapshotDiff> SnapshotDiffCache::build_diff(int snapshot_id_start, int snapshot_id_end, SnapshotManager* snapshot_manager,
+                                                            PatchTreeManager* patch_tree_manager) {
+    std::shared_ptr<SnapshotDiff> diff = get_diff(snapshot_id_start, snapshot_id_end, snapshot_manager);
+    if (diff != nullptr || readonly) {
+        return diff;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto loaded_it = loaded_diffs.find(std::make_pair(snapshot_id_start, snapshot_id_end));
+    if (loaded_it != loaded_diffs.end()) {
+        // Another thread has built this diff in the meantime
+        return loaded_it->second;
+    }
+    std::shared_ptr<DictionaryManager> dict = snapshot_manager->get_dictionary_manager(snapshot_id_end);
+    diff = std::make_shared<SnapshotDiff>(base_path, snapshot_id_start, snapshot_id_end, dict, false);
+    AutoSnapshotDiffIterator it(StringTriple("", "", ""), snapshot_manager, patch_tree_manager, snapshot_id_start, snapshot_id_end);
+    TripleDelta triple_delta;
+    while (it.next(&triple_delta)) {
+        const Triple* triple = triple_delta.get_triple_const();
+        std::shared_ptr<DictionaryManager> triple_dict = triple_delta.get_dictionary();
+        if (triple_dict == dict) {
+            diff->insert(*triple, triple_delta.is_addition());
+        } else {
+            // Triples that come from the start snapshot or its delta chain have to be re-encoded
+            Triple encoded(triple->get_subject(*triple_dict), triple->get_predicate(*triple_dict), triple->get_object(*triple_dict), dict);
+            diff->insert(encoded, triple_delta.is_addition());
+        }
+    }
+    diff->synchronize();
+    std::ofstream marker(base_path + SNAPSHOT_DIFF_FILENAME(snapshot_id_start, snapshot_id_end, "complete"));
+    loaded_diffs[std::make_pair(snapshot_id_start, snapshot_id_end)] = diff;
+    return diff;
+}
+
+std::vector<std::pair<int, int>> SnapshotDiffCache::detect_diffs() const {
+    std::vector<std::pair<int, int>> diffs;
+    std::regex r("snapshotdiff_([0-9]+)_([0-9]+)_complete");
+    std::smatch base_match;
+    DIR *dir;
+    struct dirent *ent;
+    if ((dir = opendir(base_path.c_str())) != nullptr) {
+        while ((ent = readdir(dir)) != nullptr) {
+            std::string dir_name = std::string(ent->d_name);
+            if (std::regex_match(dir_name, base_match, r)) {
+                diffs.emplace_back(std::stoi(base_match[1].str()), std::stoi(base_match[2].str()));
+            }
+        }
+        closedir(dir);
+    }
+    return diffs;
+}
+
+void SnapshotDiffCache::unload() {
+    std::lock_guard<std::mutex> lock(mutex);
+    loaded_diffs.clear();
+}
@@ -0,0 +1,113 @@
+#ifndef OSTRICH_SNAPSHOT_DIFF_CACHE_H
+#define OSTRICH_SNAPSHOT_DIFF_CACHE_H
+
+#include <map>
+#include <mutex>
+#include <kchashdb.h>
+#include "triple_delta_iterator.h"
+
+#define SNAPSHOT_DIFF_FILENAME(start, end, suffix) ("snapshotdiff_" + std::to_string(start) + "_" + std::to_string(end) + "_" + suffix)
+
+// The number of preceding snapshots to which a diff is persisted when a new snapshot is created, 0 disables this.
+#ifndef SNAPSHOT_DIFF_DISTANCE
+#define SNAPSHOT_DIFF_DISTANCE 0
+#endif
+
+
+// Persisted diff between two snapshots.
+// All triples are encoded with the dictionary of the end snapshot, and are stored in SPO, POS and OSP order,
+// so that any triple pattern can be resolved as a single range in one of the trees.
+class SnapshotDiff {
+private:
+    int snapshot_id_start;
+    int snapshot_id_end;
+    kyotocabinet::TreeDB* index_spo;
+    kyotocabinet::TreeDB* index_pos;
+    kyotocabinet::TreeDB* index_osp;
+    PatchTreeKeyComparator* spo_comparator;
+    PatchTreeKeyComparator* pos_comparator;
+    PatchTreeKeyComparator* osp_comparator;
+    std::shared_ptr<DictionaryManager> dict;
+protected:
+    void open(kyotocabinet::TreeDB* db, const std::string& file_name, bool readonly);
+public:
+    SnapshotDiff(const std::string& base_path, int snapshot_id_start, int snapshot_id_end, std::shared_ptr<DictionaryManager> dict, bool readonly);
+    ~SnapshotDiff();
+    /**
+     * Add a triple to the diff.
+     * @param triple A triple encoded with the dictionary of the end snapshot.
+     * @param addition If the triple was added, otherwise it was deleted.
+     */
+    void insert(const Triple& triple, bool addition);
+    /**
+     * Flush all trees to disk.
+     */
+    void synchronize();
+    /**
+     * @param triple_pattern A triple pattern
+     * @return The tree in which the given triple pattern matches a continuous range of triples.
+     */
+    kyotocabinet::TreeDB* get_tree(const Triple& triple_pattern) const;
+    /**
+     * @return The dictionary of the end snapshot, with which all triples are encoded.
+     */
+    std::shared_ptr<DictionaryManager> get_dict_manager() const;
+};
+
+
+// Iterator over the triples in a persisted snapshot diff that match a triple pattern.
+// Triples are emitted in the query order of the triple pattern.
+class SnapshotDiffTripleDeltaIterator : public TripleDeltaIterator {
+private:
+    std::shared_ptr<SnapshotDiff> diff;
+    kyotocabinet::DB::Cursor* cursor;
+    Triple triple_pattern;
+public:
+    SnapshotDiffTripleDeltaIterator(std::shared_ptr<SnapshotDiff> diff, const Triple& triple_pattern);
+    ~SnapshotDiffTripleDeltaIterator() override;
+    bool next(TripleDelta* triple) override;
+};
+
+
+/**
+ * Manages the persisted diffs between pairs of snapshots.
+ * Diffs only depend on their two snapshots, so once built, they are valid forever.
+ */
+class SnapshotDiffCache {
+private:
+    std::string base_path;
+    bool readonly;
+    std::map<std::pair<int, int>, std::shared_ptr<SnapshotDiff>> loaded_diffs;
+    std::mutex mutex;
+public:
+    SnapshotDiffCache(std::string base_path, bool readonly = false);
+    /**
+     * Get the persisted diff between the given snapshots.
+     * @param snapshot_id_start The start snapshot.
+     * @param snapshot_id_end The end snapshot.
+     * @param snapshot_manager The snapshot manager to get the dictionary of the end snapshot from.
+     * @return The diff, or null if it has not been built.
+     */
+    std::shared_ptr<SnapshotDiff> get_diff(int snapshot_id_start, int snapshot_id_end, SnapshotManager* snapshot_manager);
+    /**
+     * Build and persist the diff between the given snapshots, if it does not exist yet.
+     * @param snapshot_id_start The start snapshot.
+     * @param snapshot_id_end The end snapshot.
+     * @param snapshot_manager The snapshot manager.
+     * @param patch_tree_manager The patch tree manager.
+     * @return The diff.
+     */
+    std::shared_ptr<SnapshotDiff> build_diff(int snapshot_id_start, int snapshot_id_end, SnapshotManager* snapshot_manager, PatchTreeManager* patch_tree_manager);
+    /**
+     * Find all persisted diffs.
+     * @return The start and end snapshot of each diff.
+     */
+    std::vector<std::pair<int, int>> detect_diffs() const;
+    /**
+     * Unload all diffs, so that their files can be removed.
+     */
+    void unload();
+};
+
+
+#endif //OSTRICH_SNAPSHOT_DIFF_CACHE_H
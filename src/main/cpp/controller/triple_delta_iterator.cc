@@ -17,6 +17,20 @@ size_t TripleDeltaIterator::get_count() {
     return count;
 }
 
+LimitTripleDeltaIterator::LimitTripleDeltaIterator(TripleDeltaIterator* it, size_t limit) : it(it), limit(limit) {}
+
+LimitTripleDeltaIterator::~LimitTripleDeltaIterator() {
+    delete it;
+}
+
+bool LimitTripleDeltaIterator::next(TripleDelta* triple) {
+    if (limit == 0) {
+        return false;
+    }
+    limit--;
+    return it->next(triple);
+}
+
 
 bool EmptyTripleDeltaIterator::next(TripleDelta *triple) {
     return false;
@@ -44,6 +44,17 @@ public:
     bool next(TripleDelta* triple);
 };
 
+// Emits at most a given number of triples from another iterator.
+class LimitTripleDeltaIterator : public TripleDeltaIterator {
+private:
+    TripleDeltaIterator* it;
+    size_t limit;
+public:
+    LimitTripleDeltaIterator(TripleDeltaIterator* it, size_t limit);
+    ~LimitTripleDeltaIterator() override;
+    bool next(TripleDelta* triple) override;
+};
+
 class EmptyTripleDeltaIterator : public TripleDeltaIterator {
 public:
     bool next(TripleDelta* triple) override;
@@ -7,7 +7,8 @@
 
 
 PatchTreeTripleVersionsIterator::PatchTreeTripleVersionsIterator(Triple triple_pattern, hdt::IteratorTripleID* snapshot_it, std::shared_ptr<PatchTree> patchTree, int first_version, std::shared_ptr<DictionaryManager> dictionary)
-        : triple_pattern(triple_pattern), snapshot_it(snapshot_it), patchTree(patchTree), addition_it(nullptr), first_version(first_version), dict(dictionary) {}
+        : triple_pattern(triple_pattern), snapshot_it(snapshot_it), patchTree(patchTree), addition_it(nullptr), first_version(first_version),
+          max_patch_id(patchTree != nullptr ? patchTree->pin_patch_id(std::numeric_limits<int>::max()) : first_version), dict(dictionary) {}
 
 PatchTreeTripleVersionsIterator::~PatchTreeTripleVersionsIterator() {
     delete snapshot_it;
@@ -22,7 +23,7 @@ inline void PatchTreeTripleVersionsIterator::eraseDeletedVersions(std::vector<in
     } else {
         PatchTreeDeletionValue* deletion = patchTree->get_deletion_value(*currentTriple);
         versions->clear();
-        versions->resize(patchTree->get_max_patch_id() + 1 - initial_version);
+        versions->resize(max_patch_id + 1 - initial_version);
         std::iota(versions->begin(), versions->end(), initial_version); // Fill up the vector with all versions from initial_version to max_patch_id
         if (deletion != nullptr) {
             for (int v_del = 0; v_del < deletion->get_size(); v_del++) {
@@ -68,7 +69,8 @@ bool PatchTreeTripleVersionsIterator::next(TripleVersions* triple_versions) {
     while (addition_it->next_addition(triple_versions->get_triple(), &value)) {
         // Skip if FIRST this addition has a local change for its first patch id,
         // because in that case the triple was originally part of the snapshot, so it's already emitted.
-        if (!value.is_local_change(value.get_patch_id_at(0))) {
+        // Triples that were only added in patches of which the append has not finished yet are skipped as well.
+        if (!value.is_local_change(value.get_patch_id_at(0)) && value.get_patch_id_at(0) <= max_patch_id) {
             eraseDeletedVersions(triple_versions->get_versions(), triple_versions->get_triple(), value.get_patch_id_at(0));
             return true;
         }
@@ -304,7 +306,7 @@ void PatchTreeTripleVersionsIteratorV2::eraseDeletedVersions(std::vector<int> *v
     } else {
         PatchTreeDeletionValue* deletion = patchTree->get_deletion_value(*currentTriple);
         versions->clear();
-        versions->resize(patchTree->get_max_patch_id() + 1 - initial_version);
+        versions->resize(max_patch_id + 1 - initial_version);
         std::iota(versions->begin(), versions->end(), initial_version); // Fill up the vector with all versions from initial_version to max_patch_id
         if (deletion != nullptr) {
             for (int v_del = 0; v_del < deletion->get_size(); v_del++) {
@@ -324,6 +326,7 @@ PatchTreeTripleVersionsIteratorV2::PatchTreeTripleVersionsIteratorV2(Triple trip
                                                                          patchTree(patchTree),
                                                                          addition_it(nullptr),
                                                                          first_version(first_version),
+                                                                         max_patch_id(patchTree != nullptr ? patchTree->pin_patch_id(std::numeric_limits<int>::max()) : first_version),
                                                                          dict(dictionary) {
 
     hdt::TripleComponentOrder qr_order = TripleStore::get_query_order(triple_pattern);
@@ -346,12 +349,21 @@ PatchTreeTripleVersionsIteratorV2::PatchTreeTripleVersionsIteratorV2(Triple trip
 #else
         value = std::unique_ptr<PatchTreeAdditionValue>(new PatchTreeAdditionValue);
 #endif
-        status2 = addition_it->next_addition(&t2, value.get());
+        status2 = next_addition();
     } else {
         status2 = false;
     }
 }
 
+bool PatchTreeTripleVersionsIteratorV2::next_addition() {
+    while (addition_it->next_addition(&t2, value.get())) {
+        if (value->get_patch_id_at(0) <= max_patch_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool PatchTreeTripleVersionsIteratorV2::next(TripleVersions *triple_versions) {
     auto emit_triple = [] (const Triple& source, Triple& target) {
         target.set_subject(source.get_subject());
@@ -378,7 +390,7 @@ bool PatchTreeTripleVersionsIteratorV2::next(TripleVersions *triple_versions) {
             emit_triple(t1, *triple_versions->get_triple());
             eraseDeletedVersions(triple_versions->get_versions(), triple_versions->get_triple(), first_version);
             step_snapshot_it();
-            status2 = addition_it->next_addition(&t2, value.get());
+            status2 = next_addition();
         } else if (comp < 0) {
             emit_triple(t1, *triple_versions->get_triple());
             eraseDeletedVersions(triple_versions->get_versions(), triple_versions->get_triple(), first_version);
@@ -386,22 +398,20 @@ bool PatchTreeTripleVersionsIteratorV2::next(TripleVersions *triple_versions) {
         } else {
             emit_triple(t2, *triple_versions->get_triple());
             eraseDeletedVersions(triple_versions->get_versions(), triple_versions->get_triple(), value->get_patch_id_at(0));
-            status2 = addition_it->next_addition(&t2, value.get());
+            status2 = next_addition();
         }
         return true;
     }
     if (status1 && !status2) {
-        std::string s1 = t1.to_string(*dict);
         emit_triple(t1, *triple_versions->get_triple());
         eraseDeletedVersions(triple_versions->get_versions(), triple_versions->get_triple(), first_version);
         step_snapshot_it();
         return true;
     }
     if (!status1 && status2) {
-        std::string s2 = t2.to_string(*dict);
         emit_triple(t2, *triple_versions->get_triple());
         eraseDeletedVersions(triple_versions->get_versions(), triple_versions->get_triple(), value->get_patch_id_at(0));
-        status2 = addition_it->next_addition(&t2, value.get());
+        status2 = next_addition();
         return true;
     }
     return false;
@@ -427,11 +437,17 @@ hdt::TripleComponentOrder PatchTreeTripleVersionsIteratorV2::get_order() {
 }
 
 
-TripleVersionsIteratorCombinedV2::TripleVersionsIteratorCombinedV2(hdt::TripleComponentOrder order) : comparator(TripleComparator::get_triple_comparator(order)) {}
+TripleVersionsIteratorCombinedV2::TripleVersionsIteratorCombinedV2(hdt::TripleComponentOrder order, size_t limit)
+        : comparator(TripleComparator::get_triple_comparator(order)), limit(limit) {}
 
 void TripleVersionsIteratorCombinedV2::add_iterator(TripleVersionsIterator *it) {
+    // The first limit triples of the combined iterator can only come from the first limit triples of each sorted iterator
+    size_t consumed = 0;
+    auto next = [&](TripleVersions* triple_versions) {
+        return consumed++ < limit && it->next(triple_versions);
+    };
     auto* t = new TripleVersions;
-    bool status = it->next(t);
+    bool status = next(t);
     auto pos = std::lower_bound(triples.begin(), triples.end(), t, *comparator);
     while (status) {
         if (pos != triples.end()) {
@@ -441,12 +457,12 @@ void TripleVersionsIteratorCombinedV2::add_iterator(TripleVersionsIterator *it)
                 std::set_union((*pos)->get_versions()->begin(), (*pos)->get_versions()->end(), t->get_versions()->begin(), t->get_versions()->end(), std::back_inserter(nv));
                 (*pos)->get_versions()->clear();
                 (*pos)->get_versions()->insert((*pos)->get_versions()->begin(), nv.begin(), nv.end());
-                status = it->next(t);
+                status = next(t);
                 pos++;
             } else if (comp < 0) {
                 pos = triples.insert(pos, t);
                 t = new TripleVersions;
-                status = it->next(t);
+                status = next(t);
                 pos++;
             } else {
                 pos = std::lower_bound(pos, triples.end(), t, *comparator);
@@ -454,10 +470,14 @@ void TripleVersionsIteratorCombinedV2::add_iterator(TripleVersionsIterator *it)
         } else {
             triples.push_back(t);
             t = new TripleVersions;
-            status = it->next(t);
+            status = next(t);
             pos = triples.end();
         }
     }
+    while (triples.size() > limit) {
+        delete triples.back();
+        triples.pop_back();
+    }
     triples_it = triples.begin();
     delete t;
 }
@@ -545,3 +565,107 @@ bool SortedPatchTreeIteratorAdditionProxy::next(Triple *triple, int *first_versi
     }
     return false;
 }
+
+
+size_t TripleVersionsBitmapIterator::get_count() {
+    size_t count = 0;
+    TripleVersionsBitmap t;
+    while (next(&t)) count++;
+    return count;
+}
+
+
+bool EmptyTripleVersionsBitmapIterator::next(TripleVersionsBitmap* triple) {
+    return false;
+}
+
+
+template <class DV>
+PatchTreeTripleVersionsBitmapIterator<DV>::PatchTreeTripleVersionsBitmapIterator(const Triple& triple_pattern, hdt::IteratorTripleID* snapshot_it,
+                                                                                std::shared_ptr<PatchTree> patchTree, std::vector<int> versions,
+                                                                                int snapshot_id, std::shared_ptr<DictionaryManager> dictionary)
+        : snapshot_it(snapshot_it), versions(std::move(versions)), snapshot_id(snapshot_id), dict(dictionary),
+          comparator(TripleComparator::get_triple_comparator(TripleStore::get_query_order(triple_pattern), dictionary, dictionary)),
+          has_addition_triple(false), has_deletion_triple(false) {
+    step_snapshot();
+    if (patchTree != nullptr) {
+        addition_it = std::unique_ptr<PatchTreeIterator>(patchTree->addition_iterator(triple_pattern));
+        deletion_it = std::unique_ptr<PatchTreeIteratorBase<DV>>(patchTree->deletion_iterator<DV>(triple_pattern));
+#ifdef COMPRESSED_ADD_VALUES
+        addition_value = std::unique_ptr<PatchTreeAdditionValue>(new PatchTreeAdditionValue(patchTree->get_max_patch_id()));
+#else
+        addition_value = std::unique_ptr<PatchTreeAdditionValue>(new PatchTreeAdditionValue());
+#endif
+#ifdef COMPRESSED_DEL_VALUES
+        deletion_value = std::unique_ptr<DV>(new DV(patchTree->get_max_patch_id()));
+#else
+        deletion_value = std::unique_ptr<DV>(new DV());
+#endif
+        has_addition_triple = addition_it->next_addition(&addition_triple, addition_value.get());
+        has_deletion_triple = deletion_it->next_deletion(&deletion_triple, deletion_value.get());
+    }
+}
+
+template <class DV>
+void PatchTreeTripleVersionsBitmapIterator<DV>::step_snapshot() {
+    if (snapshot_it->hasNext()) {
+        hdt::TripleID *tripleId = snapshot_it->next();
+        snapshot_triple.set_subject(tripleId->getSubject());
+        snapshot_triple.set_predicate(tripleId->getPredicate());
+        snapshot_triple.set_object(tripleId->getObject());
+        has_snapshot_triple = true;
+    } else {
+        has_snapshot_triple = false;
+    }
+}
+
+template <class DV>
+bool PatchTreeTripleVersionsBitmapIterator<DV>::next(TripleVersionsBitmap* triple) {
+    triple->set_dictionary(dict);
+    std::vector<bool>* bitmap = triple->get_bitmap();
+    while (has_snapshot_triple || has_addition_triple) {
+        // Take the smallest triple of the snapshot and the additions
+        bool from_snapshot = has_snapshot_triple
+                && (!has_addition_triple || comparator->compare(snapshot_triple, addition_triple) <= 0);
+        bool from_additions = has_addition_triple
+                && (!has_snapshot_triple || comparator->compare(addition_triple, snapshot_triple) <= 0);
+        *triple->get_triple() = from_snapshot ? snapshot_triple : addition_triple;
+
+        // Deletions of triples that are neither in the snapshot nor in the additions can be skipped
+        while (has_deletion_triple && comparator->compare(deletion_triple, *triple->get_triple()) < 0) {
+            has_deletion_triple = deletion_it->next_deletion(&deletion_triple, deletion_value.get());
+        }
+        bool has_deletion = has_deletion_triple && comparator->compare(deletion_triple, *triple->get_triple()) == 0;
+
+        bool any = false;
+        bitmap->assign(versions.size(), false);
+        for (size_t i = 0; i < versions.size(); i++) {
+            int version = versions[i];
+            bool present;
+            if (version == snapshot_id) {
+                present = from_snapshot;
+            } else if (from_snapshot) {
+                present = !has_deletion || deletion_value->get_patchvalue_index(version) < 0 || deletion_value->is_local_change(version);
+            } else {
+                present = addition_value->is_patch_id(version) && !addition_value->is_local_change(version);
+            }
+            (*bitmap)[i] = present;
+            any = any || present;
+        }
+
+        if (from_snapshot) {
+            step_snapshot();
+        }
+        if (from_additions) {
+            has_addition_triple = addition_it->next_addition(&addition_triple, addition_value.get());
+        }
+        if (any) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+template class PatchTreeTripleVersionsBitmapIterator<PatchTreeDeletionValue>;
+template class PatchTreeTripleVersionsBitmapIterator<PatchTreeDeletionValueReduced>;
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <set>
+#include <limits>
 #include "../patch/triple.h"
 #include "../patch/patch_tree.h"
 #include "../patch/triple_comparator.h"
@@ -24,6 +25,8 @@ protected:
     std::shared_ptr<PatchTree> patchTree;
     PatchTreeIterator* addition_it;
     int first_version;
+    // The largest patch id of which the append had finished when this iterator was created
+    int max_patch_id;
     inline void eraseDeletedVersions(std::vector<int>* versions, Triple* currentTriple, int initial_version);
     std::shared_ptr<DictionaryManager> dict;
 public:
@@ -127,6 +130,8 @@ protected:
     std::shared_ptr<PatchTree> patchTree;
     std::unique_ptr<PatchTreeIterator> addition_it;
     int first_version;
+    // The largest patch id of which the append had finished when this iterator was created
+    int max_patch_id;
     inline void eraseDeletedVersions(std::vector<int>* versions, Triple* currentTriple, int initial_version);
     std::shared_ptr<DictionaryManager> dict;
 
@@ -137,6 +142,12 @@ protected:
     std::unique_ptr<PatchTreeAdditionValue> value;
     Triple t2;
     bool status2;
+
+    /**
+     * Move to the next addition into t2, skipping the triples that were only added in patches after max_patch_id.
+     * @return If there was a next addition.
+     */
+    bool next_addition();
 public:
     PatchTreeTripleVersionsIteratorV2(Triple triple_pattern, hdt::IteratorTripleID* snapshot_it, std::shared_ptr<PatchTree> patchTree, int first_version = 0, std::shared_ptr<DictionaryManager> dictionary = nullptr);
     bool next(TripleVersions* triple_versions) override;
@@ -151,14 +162,19 @@ private:
     std::unique_ptr<TripleComparator> comparator;
     std::vector<TripleVersions*> triples;
     std::vector<TripleVersions*>::iterator triples_it;
+    size_t limit;
 
 public:
-    explicit TripleVersionsIteratorCombinedV2(hdt::TripleComponentOrder order);
+    /**
+     * @param order The order of the triples.
+     * @param limit Only the first limit triples in the given order are kept.
+     */
+    explicit TripleVersionsIteratorCombinedV2(hdt::TripleComponentOrder order, size_t limit = std::numeric_limits<size_t>::max());
     ~TripleVersionsIteratorCombinedV2() override;
     /**
      * Add an iterator
      * reset the internal position of the TripleVersionsIteratorCombined
-     * consume all triples in the iterator
+     * consume all triples in the iterator, or only the first limit triples, as the iterator is sorted
      * @param it the iterator to add
      */
     void add_iterator(TripleVersionsIterator* it);
@@ -168,4 +184,57 @@ public:
 };
 
 
+// Iterator for triples annotated with the requested versions in which they exist.
+class TripleVersionsBitmapIterator {
+public:
+    virtual ~TripleVersionsBitmapIterator() = default;
+    virtual bool next(TripleVersionsBitmap* triple) = 0;
+    size_t get_count();
+};
+
+
+class EmptyTripleVersionsBitmapIterator: public TripleVersionsBitmapIterator {
+public:
+    bool next(TripleVersionsBitmap* triple) override;
+};
+
+
+// Materializes a triple pattern for multiple versions of a single delta chain at once.
+// The snapshot, the additions and the deletions are each only scanned once, and merged in the query order.
+template <class DV>
+class PatchTreeTripleVersionsBitmapIterator: public TripleVersionsBitmapIterator {
+protected:
+    std::unique_ptr<hdt::IteratorTripleID> snapshot_it;
+    std::unique_ptr<PatchTreeIterator> addition_it;
+    std::unique_ptr<PatchTreeIteratorBase<DV>> deletion_it;
+    std::vector<int> versions;
+    int snapshot_id;
+    std::shared_ptr<DictionaryManager> dict;
+    std::unique_ptr<TripleComparator> comparator;
+
+    Triple snapshot_triple;
+    bool has_snapshot_triple;
+    Triple addition_triple;
+    std::unique_ptr<PatchTreeAdditionValue> addition_value;
+    bool has_addition_triple;
+    Triple deletion_triple;
+    std::unique_ptr<DV> deletion_value;
+    bool has_deletion_triple;
+
+    void step_snapshot();
+public:
+    /**
+     * @param triple_pattern The encoded triple pattern.
+     * @param snapshot_it A snapshot iterator sorted in the query order of the pattern, ownership is taken.
+     * @param patchTree The patch tree of the delta chain, can be null.
+     * @param versions The requested versions, which must all belong to the delta chain.
+     * @param snapshot_id The snapshot id of the delta chain.
+     * @param dictionary The dictionary of the delta chain.
+     */
+    PatchTreeTripleVersionsBitmapIterator(const Triple& triple_pattern, hdt::IteratorTripleID* snapshot_it, std::shared_ptr<PatchTree> patchTree,
+                                          std::vector<int> versions, int snapshot_id, std::shared_ptr<DictionaryManager> dictionary);
+    bool next(TripleVersionsBitmap* triple) override;
+};
+
+
 #endif //TPFPATCH_STORE_TRIPLEVERSIONITERATOR_H
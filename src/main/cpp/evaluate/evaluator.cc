@@ -1,5 +1,7 @@
 #include <iostream>
 #include <dirent.h>
+#include <thread>
+#include <atomic>
 #include <util/StopWatch.hpp>
 #include <rdf/RDFParserNtriples.hpp>
 
@@ -8,12 +10,13 @@
 #include "evaluator.h"
 #include "../simpleprogresslistener.h"
 #include "../controller/statistics.h"
+#include "../patch/serialization_arena.h"
 
 void Evaluator::init(string basePath, string patchesBasePatch, int startIndex, int endIndex, hdt::ProgressListener* progressListener) {
     controller = new Controller(basePath, kyotocabinet::TreeDB::TCOMPRESS);
 
     cout << "---INSERTION START---" << endl;
-    cout << "version,added,durationms,rate,accsize" << endl;
+    cout << "version,added,durationms,rate,accsize,arenaallocations" << endl;
     DIR *dir;
     if ((dir = opendir(patchesBasePatch.c_str())) != NULL) {
         for (int i = startIndex; i <= endIndex; i++) {
@@ -54,6 +57,7 @@ void Evaluator::populate_controller_with_version(int patch_id, string path, hdt:
 
     DIR *dir;
     struct dirent *ent;
+    long long arena_allocations = SerializationArena::get_heap_allocations();
     StopWatch st;
     NOTIFYMSG(progressListener, "Loading patch...\n");
     if ((dir = opendir(path.c_str())) != NULL) {
@@ -93,7 +97,8 @@ void Evaluator::populate_controller_with_version(int patch_id, string path, hdt:
     if (duration == 0) duration = 1; // Avoid division by 0
     long long rate = added / duration;
     std::ifstream::pos_type accsize = patchstore_size(controller);
-    cout << patch_id << "," << added << "," << duration << "," << rate << "," << accsize << endl;
+    arena_allocations = SerializationArena::get_heap_allocations() - arena_allocations;
+    cout << patch_id << "," << added << "," << duration << "," << rate << "," << accsize << "," << arena_allocations << endl;
 
     delete it_snapshot;
     delete it_patch;
@@ -280,7 +285,7 @@ void BearEvaluatorMS::init(string basePath, string patchesBasePatch, SnapshotCre
                            hdt::ProgressListener *progressListener) {
     controller = new Controller(basePath, strategy, kyotocabinet::TreeDB::TCOMPRESS);
 //    cout << "---INSERTION START---" << endl;
-//    cout << "version,added,durationms,rate,accsize" << endl;
+//    cout << "version,added,durationms,rate,accsize,arenaallocations" << endl;
     DIR *dir;
     if ((dir = opendir(patchesBasePatch.c_str())) != nullptr) {
         for (int i = startIndex; i <= endIndex; i++) {
@@ -356,6 +361,45 @@ void BearEvaluatorMS::test_lookup(std::string s, std::string p, std::string o, i
     std::cout << "" << offset << "," << limit << "," << dcount << "," << median_t << "," << d1 << "," << result_count1 << std::endl;
 }
 
+void BearEvaluatorMS::test_concurrent_lookup(const std::vector<StringTriple>& triple_patterns, int replications, int max_threads) {
+    std::cout << "--- ---CONCURRENT VERSION MATERIALIZED" << std::endl;
+    std::cout << "threads,queries,duration-ms,queries-per-s" << std::endl;
+    for (int thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+        std::atomic<uint64_t> query_count(0);
+        std::vector<std::thread> threads;
+        StopWatch st;
+        for (int thread_id = 0; thread_id < thread_count; thread_id++) {
+            threads.emplace_back([&, thread_id]() {
+                Triple t;
+                for (int r = 0; r < replications; r++) {
+                    for (const StringTriple& triple_pattern : triple_patterns) {
+                        for (int i = 0; i < patch_count; i++) {
+                            // Spread the threads over the versions, so they hit different snapshots and patch trees
+                            int patch_id = (i + thread_id) % patch_count;
+                            int snapshot_id = controller->get_snapshot_manager()->get_latest_snapshot(patch_id);
+                            std::shared_ptr<DictionaryManager> dict = controller->get_snapshot_manager()->get_dictionary_manager(snapshot_id);
+                            TripleIterator* ti = controller->get_version_materialized(triple_pattern, 0, patch_id);
+                            while (ti->next(&t)) {
+                                t.get_subject(*dict);
+                                t.get_predicate(*dict);
+                                t.get_object(*dict);
+                            }
+                            delete ti;
+                            query_count++;
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        uint64_t duration = st.stopReal() / 1000;
+        double throughput = duration > 0 ? (double) query_count * 1000.0 / (double) duration : 0;
+        std::cout << thread_count << "," << query_count << "," << duration << "," << throughput << std::endl;
+    }
+}
+
 void BearEvaluatorMS::compute_statistics() {
     Statistics stat(controller);
     std::cout << "Version,Change-ratio,Dynamicity,Growth-ratio,Entity-changes,Triple-to-entity-change,Object-updates" << std::endl;
@@ -410,6 +454,7 @@ void BearEvaluatorMS::populate_controller_with_version(int patch_id, std::string
         it_patch = new PatchElementIteratorCombined(PatchTreeKeyComparator(comp_s, comp_p, comp_o, dict));
     }
 
+    long long arena_allocations = SerializationArena::get_heap_allocations();
     StopWatch st;
     NOTIFYMSG(progressListener, "Loading patch...\n");
     if (first) {
@@ -442,7 +487,8 @@ void BearEvaluatorMS::populate_controller_with_version(int patch_id, std::string
     if (duration == 0) duration = 1; // Avoid division by 0
     uint64_t rate = added / duration;
     std::ifstream::pos_type accsize = patchstore_size(controller);
-    cout << patch_id << "," << added << "," << duration << "," << rate << "," << accsize << endl;
+    arena_allocations = SerializationArena::get_heap_allocations() - arena_allocations;
+    cout << patch_id << "," << added << "," << duration << "," << rate << "," << accsize << "," << arena_allocations << endl;
 
     delete it_snapshot;
     delete it_patch;
@@ -617,7 +663,7 @@ BearEvaluatorMS::measure_lookup_delta_materialized(const StringTriple &triple_pa
     // Warmup
     for (int i = 0; i < replications; i++) {
         TripleDeltaIterator *tmp_ti = controller->get_delta_materialized(triple_pattern, offset, patch_id_start,
-                                                                         patch_id_end, false);
+                                                                         patch_id_end);
         while (tmp_ti->next(&t)) {
             t.get_triple()->get_subject(*(t.get_dictionary()));
             t.get_triple()->get_predicate(*(t.get_dictionary()));
@@ -633,7 +679,7 @@ BearEvaluatorMS::measure_lookup_delta_materialized(const StringTriple &triple_pa
         int limit_l = limit;
         StopWatch st;
         TripleDeltaIterator *ti = controller->get_delta_materialized(triple_pattern, offset, patch_id_start,
-                                                                     patch_id_end, false);
+                                                                     patch_id_end);
         while ((limit_l == -2 || limit_l-- > 0) && ti->next(&t)) {
             t.get_triple()->get_subject(*(t.get_dictionary()));
             t.get_triple()->get_predicate(*(t.get_dictionary()));
@@ -53,6 +53,12 @@ public:
     void init(std::string basePath, std::string patchesBasePatch, SnapshotCreationStrategy* strategy, int startIndex, int endIndex, hdt::ProgressListener* progressListener = nullptr);
     void init_readonly(string basePath, bool warmup = false);
     void test_lookup(std::string s, std::string p, std::string o, int replications, int offset, int limit);
+    /**
+     * Run the given triple patterns concurrently on the same controller for all versions,
+     * with an increasing number of threads (1, 2, 4, ... up to max_threads).
+     * CSV-formatted throughput data will be emitted: threads,queries,duration-ms,queries-per-s.
+     */
+    void test_concurrent_lookup(const std::vector<StringTriple>& triple_patterns, int replications, int max_threads);
     void compute_statistics();
     void cleanup_controller();
 protected:
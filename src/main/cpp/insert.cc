@@ -14,7 +14,7 @@
 
 int main(int argc, char** argv) {
     if (argc < 2) {
-        std::cerr << "ERROR: Insert command must be invoked as '[-v] [-s string int|float] patch_id [+|- file_1.nt [file_2.nt [...]]]*' " << std::endl;
+        std::cerr << "ERROR: Insert command must be invoked as '[-v] [-s string int|float] [-c codec] patch_id [+|- file_1.nt [file_2.nt [...]]]*' " << std::endl;
         return 1;
     }
 
@@ -37,9 +37,25 @@ int main(int argc, char** argv) {
         strategy = SnapshotCreationStrategy::get_composite_strategy(strat_name, strat_param);
     }
 
+    TreeCodec codec;
+    bool has_codec = std::string(argv[1 + param_offset]) == "-c";
+    if (has_codec) {
+        param_offset += 1;
+        try {
+            codec = TreeCodec::parse(argv[1 + param_offset]);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
+        }
+        param_offset += 1;
+    }
+
     // Load the store
 
     Controller controller("./", strategy, kyotocabinet::TreeDB::TCOMPRESS);
+    if (has_codec) {
+        controller.set_tree_codecs(codec, codec);
+    }
 
     // Get parameters
     int patch_id = std::stoi(argv[1 + param_offset]);
@@ -0,0 +1,179 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "count_sketch.h"
+
+uint64_t sketch_hash::mix(uint64_t value) {
+    // splitmix64 finalizer
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+uint64_t sketch_hash::hash_ids(uint64_t a, uint64_t b, uint64_t c, uint64_t d) {
+    uint64_t hash = mix(a);
+    hash = mix(hash ^ b);
+    hash = mix(hash ^ c);
+    return mix(hash ^ d);
+}
+
+uint64_t sketch_hash::hash_string(const std::string& value, uint64_t seed) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+    for (char c : value) {
+        hash ^= (uint8_t) c;
+        hash *= 0x100000001b3ULL;
+    }
+    return mix(hash);
+}
+
+uint64_t sketch_hash::hash_terms(const std::string& subject, const std::string& predicate, const std::string& object) {
+    return TermHashCache::combine(hash_string(subject, 1), hash_string(predicate, 2), hash_string(object, 3));
+}
+
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth) : width(width), depth(depth), counters(width * depth, 0), total(0) {}
+
+void CountMinSketch::add(uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint32_t count) {
+    uint64_t hash = sketch_hash::hash_ids(a, b, c, d);
+    // Derive the row hashes from two halves of a single hash (Kirsch-Mitzenmacher)
+    uint64_t h1 = hash & 0xffffffffULL;
+    uint64_t h2 = hash >> 32;
+    for (size_t row = 0; row < depth; row++) {
+        uint32_t& counter = counters[row * width + (h1 + row * h2) % width];
+        counter = (uint32_t) std::min<uint64_t>((uint64_t) counter + count, UINT32_MAX);
+    }
+    total += count;
+}
+
+uint64_t CountMinSketch::estimate(uint64_t a, uint64_t b, uint64_t c, uint64_t d) const {
+    uint64_t hash = sketch_hash::hash_ids(a, b, c, d);
+    uint64_t h1 = hash & 0xffffffffULL;
+    uint64_t h2 = hash >> 32;
+    uint64_t estimate = UINT64_MAX;
+    for (size_t row = 0; row < depth; row++) {
+        estimate = std::min<uint64_t>(estimate, counters[row * width + (h1 + row * h2) % width]);
+    }
+    return depth == 0 ? 0 : estimate;
+}
+
+uint64_t CountMinSketch::get_total() const {
+    return total;
+}
+
+const char* CountMinSketch::serialize(size_t* size) const {
+    *size = 3 * sizeof(uint64_t) + counters.size() * sizeof(uint32_t);
+    char* data = new char[*size];
+    uint64_t header[3] = {width, depth, total};
+    std::memcpy(data, header, sizeof(header));
+    std::memcpy(data + sizeof(header), counters.data(), counters.size() * sizeof(uint32_t));
+    return data;
+}
+
+bool CountMinSketch::deserialize(const char* data, size_t size) {
+    uint64_t header[3];
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(header, data, sizeof(header));
+    if (size != sizeof(header) + header[0] * header[1] * sizeof(uint32_t)) {
+        return false;
+    }
+    width = header[0];
+    depth = header[1];
+    total = header[2];
+    counters.resize(width * depth);
+    std::memcpy(counters.data(), data + sizeof(header), counters.size() * sizeof(uint32_t));
+    return true;
+}
+
+
+HyperLogLog::HyperLogLog(int precision) : precision(precision), registers((size_t) 1 << precision, 0) {}
+
+void HyperLogLog::add(uint64_t hash) {
+    size_t index = hash >> (64 - precision);
+    uint64_t rest = (hash << precision) | ((uint64_t) 1 << (precision - 1)); // Guard bit to bound the rank
+    uint8_t rank = (uint8_t) (__builtin_clzll(rest) + 1);
+    registers[index] = std::max(registers[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    if (other.precision != precision) {
+        return;
+    }
+    for (size_t i = 0; i < registers.size(); i++) {
+        registers[i] = std::max(registers[i], other.registers[i]);
+    }
+}
+
+uint64_t HyperLogLog::estimate() const {
+    double m = registers.size();
+    double alpha = m >= 128 ? 0.7213 / (1 + 1.079 / m) : (m >= 64 ? 0.709 : (m >= 32 ? 0.697 : 0.673));
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t value : registers) {
+        sum += std::ldexp(1.0, -value);
+        if (value == 0) {
+            zeros++;
+        }
+    }
+    double estimate = alpha * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        // Linear counting is more accurate for small cardinalities
+        estimate = m * std::log(m / zeros);
+    }
+    return (uint64_t) std::llround(estimate);
+}
+
+const char* HyperLogLog::serialize(size_t* size) const {
+    *size = 1 + registers.size();
+    char* data = new char[*size];
+    data[0] = (char) precision;
+    std::memcpy(data + 1, registers.data(), registers.size());
+    return data;
+}
+
+bool HyperLogLog::deserialize(const char* data, size_t size) {
+    if (size < 1 || data[0] < 4 || data[0] > 18 || size != 1 + ((size_t) 1 << data[0])) {
+        return false;
+    }
+    precision = data[0];
+    registers.assign(data + 1, data + size);
+    return true;
+}
+
+TermHashCache::TermHashCache(size_t max_size) : max_size(max_size) {}
+
+bool TermHashCache::find(size_t id, int position, uint64_t* hash) const {
+    auto it = hashes[position].find(id);
+    if (it == hashes[position].end()) {
+        return false;
+    }
+    *hash = it->second;
+    return true;
+}
+
+uint64_t TermHashCache::insert(size_t id, int position, const std::string& term) {
+    uint64_t hash = sketch_hash::hash_string(term, (uint64_t) position + 1);
+    if (hashes[position].size() >= max_size) {
+        hashes[position].clear();
+    }
+    hashes[position][id] = hash;
+    return hash;
+}
+
+uint64_t TermHashCache::hash(size_t subject, size_t predicate, size_t object, const std::function<std::string(size_t id, int position)>& decode) {
+    size_t ids[3] = {subject, predicate, object};
+    uint64_t term_hashes[3];
+    for (int position = 0; position < 3; position++) {
+        if (!find(ids[position], position, &term_hashes[position])) {
+            term_hashes[position] = insert(ids[position], position, decode(ids[position], position));
+        }
+    }
+    return combine(term_hashes[0], term_hashes[1], term_hashes[2]);
+}
+
+uint64_t TermHashCache::combine(uint64_t subject_hash, uint64_t predicate_hash, uint64_t object_hash) {
+    return sketch_hash::hash_ids(subject_hash, predicate_hash, object_hash, 0);
+}
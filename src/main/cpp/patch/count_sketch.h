@@ -0,0 +1,146 @@
+#ifndef OSTRICH_COUNT_SKETCH_H
+#define OSTRICH_COUNT_SKETCH_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <unordered_map>
+
+// The number of counters per row of a count-min sketch, estimates exceed the count by at most e/width of the total count
+#ifndef COUNT_SKETCH_WIDTH
+#define COUNT_SKETCH_WIDTH 1024
+#endif
+// The number of rows of a count-min sketch, the error bound of an estimate fails with probability e^-depth
+#ifndef COUNT_SKETCH_DEPTH
+#define COUNT_SKETCH_DEPTH 4
+#endif
+// The number of index bits of a HyperLogLog sketch, the standard error is 1.04/sqrt(2^precision)
+#ifndef HLL_PRECISION
+#define HLL_PRECISION 12
+#endif
+// The number of term hashes per triple position that are kept while hashing the triples of a dictionary
+#ifndef TERM_HASH_CACHE_SIZE
+#define TERM_HASH_CACHE_SIZE (1 << 18)
+#endif
+
+/**
+ * Hash functions that are stable across builds, as sketches are persisted.
+ */
+namespace sketch_hash {
+    uint64_t mix(uint64_t value);
+    uint64_t hash_ids(uint64_t a, uint64_t b, uint64_t c, uint64_t d);
+    uint64_t hash_string(const std::string& value, uint64_t seed = 0);
+    /**
+     * Hash a triple by its terms, so that the hash does not depend on any dictionary.
+     */
+    uint64_t hash_terms(const std::string& subject, const std::string& predicate, const std::string& object);
+}
+
+/**
+ * A count-min sketch over keys consisting of four integers.
+ * Estimates are never lower than the actual count.
+ */
+class CountMinSketch {
+protected:
+    size_t width;
+    size_t depth;
+    std::vector<uint32_t> counters;
+    uint64_t total;
+public:
+    explicit CountMinSketch(size_t width = COUNT_SKETCH_WIDTH, size_t depth = COUNT_SKETCH_DEPTH);
+    /**
+     * Add a count for the given key.
+     */
+    void add(uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint32_t count = 1);
+    /**
+     * @return An upper bound of the count of the given key.
+     */
+    uint64_t estimate(uint64_t a, uint64_t b, uint64_t c, uint64_t d) const;
+    /**
+     * @return The sum of all added counts.
+     */
+    uint64_t get_total() const;
+    /**
+     * Serialize this sketch to a byte array
+     * @param size This will contain the size of the returned byte array
+     * @return The byte array
+     */
+    const char* serialize(size_t* size) const;
+    /**
+     * Deserialize the given byte array to this object.
+     * @param data The data to deserialize from.
+     * @param size The size of the byte array
+     * @return If the data was valid.
+     */
+    bool deserialize(const char* data, size_t size);
+};
+
+/**
+ * A HyperLogLog sketch for estimating the number of distinct elements.
+ * Sketches with the same precision can be merged to estimate the number of distinct elements in their union.
+ */
+class HyperLogLog {
+protected:
+    int precision;
+    std::vector<uint8_t> registers;
+public:
+    explicit HyperLogLog(int precision = HLL_PRECISION);
+    /**
+     * Add the element with the given hash.
+     */
+    void add(uint64_t hash);
+    /**
+     * Add all elements of the given sketch to this sketch.
+     */
+    void merge(const HyperLogLog& other);
+    /**
+     * @return The estimated number of distinct elements.
+     */
+    uint64_t estimate() const;
+    const char* serialize(size_t* size) const;
+    bool deserialize(const char* data, size_t size);
+};
+
+/**
+ * Hashes triples of a single dictionary like sketch_hash::hash_terms,
+ * but only decodes and hashes each term once as long as it remains cached.
+ * This is not thread-safe, concurrent users must use find and insert under their own lock.
+ */
+class TermHashCache {
+protected:
+    size_t max_size;
+    std::unordered_map<size_t, uint64_t> hashes[3];
+public:
+    explicit TermHashCache(size_t max_size = TERM_HASH_CACHE_SIZE);
+    /**
+     * @param id A term id.
+     * @param position The triple position of the term, 0 for subject, 1 for predicate and 2 for object.
+     * @param hash The cached hash of the term, if found.
+     * @return If the hash of the term was cached.
+     */
+    bool find(size_t id, int position, uint64_t* hash) const;
+    /**
+     * Cache the hash of the given term, the cache of the position is cleared once it is full.
+     * @param id A term id.
+     * @param position The triple position of the term.
+     * @param term The term string.
+     * @return The hash of the term.
+     */
+    uint64_t insert(size_t id, int position, const std::string& term);
+    /**
+     * @param subject The subject id.
+     * @param predicate The predicate id.
+     * @param object The object id.
+     * @param decode Returns the term string of an id at a triple position.
+     * @return The hash of the triple, equal to sketch_hash::hash_terms of its term strings.
+     */
+    uint64_t hash(size_t subject, size_t predicate, size_t object, const std::function<std::string(size_t id, int position)>& decode);
+    /**
+     * @return The hash of a triple of the given term hashes, equal to sketch_hash::hash_terms of their term strings.
+     */
+    static uint64_t combine(uint64_t subject_hash, uint64_t predicate_hash, uint64_t object_hash);
+};
+
+#endif //OSTRICH_COUNT_SKETCH_H
@@ -1,7 +1,8 @@
 #ifndef OSTRICH_INTERVAL_LIST_H
 #define OSTRICH_INTERVAL_LIST_H
 
-#include <map>
+#include <string>
+#include <vector>
 #include <cstddef>
 #include <cstring>
 #include <limits>
@@ -11,12 +12,46 @@
  * This class represent an ordered list of discrete elements supporting '==', '<', and '+' operators
  * The representation is compressed such that only intervals of values are stored.
  * Works preferably with trivial types which can be fully copied with memcpy() for serialization
+ * Intervals are stored as two flat sorted arrays of starts and ends, so that lookups are a branchless binary search
+ * over contiguous memory, and deserializing into a reused list does not allocate.
  */
 template<class T>
 class IntervalList {
 private:
     T max;
-    std::map<T, T> intervals;
+    std::vector<T> starts;
+    std::vector<T> ends;
+
+    /**
+     * Find the last interval that starts at or before the given element.
+     * @param element the value to search for
+     * @return the index of the interval, or the number of intervals if there is none
+     */
+    size_t find(T element) const {
+        size_t n = starts.size();
+        if (n == 0) {
+            return 0;
+        }
+        // Count the starts that are not larger than the element, without branching on the comparisons
+        const T* base = starts.data();
+        while (n > 1) {
+            size_t half = n / 2;
+            base = base[half] <= element ? base + half : base;
+            n -= half;
+        }
+        size_t count = (base - starts.data()) + (*base <= element);
+        return count == 0 ? starts.size() : count - 1;
+    }
+
+    void insert(size_t index, T start, T end) {
+        starts.insert(starts.begin() + index, start);
+        ends.insert(ends.begin() + index, end);
+    }
+
+    void erase(size_t index) {
+        starts.erase(starts.begin() + index);
+        ends.erase(ends.begin() + index);
+    }
 
 public:
     explicit IntervalList(T max_value): max(max_value) {}
@@ -26,43 +61,40 @@ public:
      * @param element the new element
      */
     bool addition(T element) {
-        bool has_changed = false;
-        auto pos = intervals.lower_bound(element);
-        if (pos == intervals.end()) {
-            if (pos != intervals.begin()) {
-                pos--;
-                if (pos->first < element && pos->second == element) {
-                    intervals[pos->first] = max;
-                    has_changed = true;
-                } else if (pos->second < element) {
-                    intervals.insert(std::make_pair(element, max));
-                    has_changed = true;
-                }
+        size_t n = starts.size();
+        size_t pos = find(element);
+        if (pos == n) {
+            // The element comes before all intervals, so the first interval now starts at the element
+            if (n == 0) {
+                insert(0, element, max);
             } else {
-                intervals.insert(std::make_pair(element, max));
-                has_changed = true;
+                starts[0] = element;
             }
-        } else {
-            if (element < pos->first) {
-                pos--;
-                if (pos->second < element) {
-                    pos++;
-                    T old_del_val = pos->second;
-                    intervals.erase(pos);
-                    intervals.insert(std::make_pair(element, old_del_val));
-                    has_changed = true;
-                } else if (pos->second == element) {
-                    auto tmp_pos = pos;
-                    if (++tmp_pos != intervals.end()) {
-                        T old_del_val = tmp_pos->second;
-                        intervals.erase(tmp_pos);
-                        pos->second = old_del_val;
-                        has_changed = true;
-                    }
-                }
+            return true;
+        }
+        if (starts[pos] == element) {
+            return false;
+        }
+        if (pos + 1 == n) {
+            if (ends[pos] == element) {
+                ends[pos] = max;
+                return true;
+            } else if (ends[pos] < element) {
+                insert(n, element, max);
+                return true;
             }
+            return false;
+        }
+        if (ends[pos] < element) {
+            // The element comes before the next interval, so that interval now starts at the element
+            starts[pos + 1] = element;
+            return true;
+        } else if (ends[pos] == element) {
+            ends[pos] = ends[pos + 1];
+            erase(pos + 1);
+            return true;
         }
-        return has_changed;
+        return false;
     }
 
     /**
@@ -71,13 +103,13 @@ public:
      * @return
      */
     bool lone_addition(T element) {
-        bool hs = false;
         auto inter = get_interval(element);
         if (inter.first == max && inter.second == max) {  // the value don't exist in an existing interval
-            intervals[element] = element+1;
-            hs = true;
+            size_t pos = find(element);
+            insert(pos == starts.size() ? 0 : pos + 1, element, element + 1);
+            return true;
         }
-        return hs;
+        return false;
     }
 
     /**
@@ -85,18 +117,15 @@ public:
      * @param element the deleted element
      */
     bool deletion(T element) {
-        if (intervals.empty()) {
+        size_t pos = find(element);
+        if (pos == starts.size()) {
             return false;
         }
-        auto pos = intervals.lower_bound(element);
-        if (pos == intervals.end() || element < pos->first) {
-            pos--;
-        }
-        if (element < pos->second) {
-            if (pos->first == element) {
-                intervals.erase(pos);
+        if (element < ends[pos]) {
+            if (starts[pos] == element) {
+                erase(pos);
             } else {
-                pos->second = element;
+                ends[pos] = element;
             }
             return true;
         }
@@ -108,16 +137,8 @@ public:
      * @return boolean on the existence of the element
      */
     [[nodiscard]] bool is_in(T element) const {
-        auto pos = intervals.lower_bound(element);
-        if (pos == intervals.end()) {
-            if (pos == intervals.begin()) {
-                return false;
-            }
-            pos--;
-        } else if (element < pos->first) {
-            pos--;
-        }
-        return pos->first <= element && element < pos->second;
+        size_t pos = find(element);
+        return pos != starts.size() && element < ends[pos];
     }
     /**
      * Return the interval in the internal representation that contain the value
@@ -125,22 +146,29 @@ public:
      * @return
      */
     std::pair<T,T> get_interval(T element) const {
-        auto pos = intervals.lower_bound(element);
-        if (pos == intervals.end()) {
-            if (pos == intervals.begin()) {
-                return std::make_pair(max,max);
-            }
-            pos--;
-        }
-        if (element < pos->first) pos--;
-        if (pos->second < element) return std::make_pair(max,max);
-        return std::make_pair(pos->first, pos->second);
+        size_t pos = find(element);
+        if (pos == starts.size() || ends[pos] < element) return std::make_pair(max,max);
+        return std::make_pair(starts[pos], ends[pos]);
     }
 
     T get_max_value() const {
         return max;
     }
 
+    /**
+     * @return the first element of the list, or "max" if it is empty
+     */
+    T get_first() const {
+        return starts.empty() ? max : starts.front();
+    }
+
+    /**
+     * @return the end of the last interval, which is "max" if it is open or if the list is empty
+     */
+    T get_last_end() const {
+        return ends.empty() ? max : ends.back();
+    }
+
     /**
      * Get the index of the value in the "virtual" value vector
      * @param value the value to look for
@@ -148,16 +176,19 @@ public:
      * @return the index or -1 the value do not exist
      */
     long get_index(T value, T outer_limit) const {
-        int count = 0;
-        for (auto& inter: intervals) {
-            int max_value = inter.second == max ? outer_limit : inter.second;
-            int range = max_value - inter.first;
-            if (inter.first <= value && value < max_value) {
-                return count + (value - inter.first);
-            }
-            count += range;
+        size_t pos = find(value);
+        if (pos == starts.size()) {
+            return -1;
         }
-        return -1;
+        long max_value = ends[pos] == max ? outer_limit : ends[pos];
+        if (value >= max_value) {
+            return -1;
+        }
+        long count = value - starts[pos];
+        for (size_t i = 0; i < pos; i++) {
+            count += (ends[i] == max ? outer_limit : ends[i]) - starts[i];
+        }
+        return count;
     }
 
     /**
@@ -167,12 +198,11 @@ public:
      * @return the element at the index or "max" if not found
      */
     T get_element_at(long i, T outer_limit) const {
-        int index = 0;
-        for (auto& inter: intervals) {
-            int max_value = inter.second == max ? outer_limit : inter.second;
-            int range = max_value - inter.first;
+        long index = 0;
+        for (size_t j = 0; j < starts.size(); j++) {
+            long range = (ends[j] == max ? outer_limit : ends[j]) - starts[j];
             if (i < index + range) {
-                return inter.first + (i - index);
+                return starts[j] + (i - index);
             }
             index += range;
         }
@@ -185,11 +215,9 @@ public:
      * @return the size
      */
     long get_size(T outer_limit) const {
-        int size = 0;
-        for (auto& inter: intervals) {
-            int max_value = inter.second == max ? outer_limit : inter.second;
-            int range = max_value - inter.first;
-            size += range;
+        long size = 0;
+        for (size_t j = 0; j < starts.size(); j++) {
+            size += (ends[j] == max ? outer_limit : ends[j]) - starts[j];
         }
         return size;
     }
@@ -199,39 +227,45 @@ public:
      * @return pair (data, size)
      */
     [[nodiscard]] std::pair<const char*, size_t> serialize() const {
+        if (!starts.empty()) {
+            char* data = new char[max_serialization_size()];
+            size_t size = serialize(data);
+            return std::make_pair(data, size);
+        }
+        return std::make_pair(nullptr, 0);
+    }
+
+    /**
+     * Serialize the data into the given byte array
+     * @param data the byte array, of at least max_serialization_size() bytes
+     * @return the number of bytes written
+     */
+    size_t serialize(char *data) const {
+        size_t offset = 0;
+        for (size_t j = 0; j < starts.size(); j++) {
 #ifdef USE_VSI
-        size_t unit_size_bytes = get_SLEB128_size(std::numeric_limits<T>::max());
+            offset += encode_SLEB128(starts[j], (uint8_t*)(data+offset));
+            offset += encode_SLEB128(ends[j], (uint8_t*)(data+offset));
 #else
-        size_t unit_size_bytes = sizeof(T);
+            std::memcpy(data+offset, &(starts[j]), sizeof(T));
+            offset += sizeof(T);
+            std::memcpy(data+offset, &(ends[j]), sizeof(T));
+            offset += sizeof(T);
 #endif
-        size_t alloc_size = unit_size_bytes * 2 * intervals.size();
-        if (intervals.size() > 0) {
-            char* data = new char[alloc_size];
-            size_t offset = 0;
-#ifdef USE_VSI
-            std::vector<uint8_t> buffer;
-#endif
-            for (auto& t: intervals) {
+        }
+        return offset;
+    }
+
+    /**
+     * @return an upper bound on the size of the serialized data
+     */
+    size_t max_serialization_size() const {
 #ifdef USE_VSI
-                encode_SLEB128(t.first, buffer);
-                std::memcpy(data+offset, buffer.data(), buffer.size());
-                offset += buffer.size();
-                buffer.clear();
-
-                encode_SLEB128(t.second, buffer);
-                std::memcpy(data+offset, buffer.data(), buffer.size());
-                offset += buffer.size();
-                buffer.clear();
+        size_t unit_size_bytes = get_SLEB128_size(std::numeric_limits<T>::max());
 #else
-                std::memcpy(data+offset, &(t.first), sizeof(T));
-                offset += sizeof(T);
-                std::memcpy(data+offset, &(t.second), sizeof(T));
-                offset += sizeof(T);
+        size_t unit_size_bytes = sizeof(T);
 #endif
-            }
-            return std::make_pair(data, offset);
-        }
-        return std::make_pair(nullptr, 0);
+        return unit_size_bytes * 2 * starts.size();
     }
 
     /**
@@ -240,39 +274,46 @@ public:
      * @param size
      */
     void deserialize(const char *data, size_t size) {
-        intervals.clear();
+        clear();
         size_t i = 0;
 #ifdef USE_VSI
+        // Bounds are decoded LEB128_BLOCK_SIZE at a time, which is even, so an interval is always decoded at once
         size_t decode_size;
-#endif
+        int64_t bounds[LEB128_BLOCK_SIZE];
         while (i < size) {
-            T s, e;
-#ifdef USE_VSI
-            s = decode_SLEB128((const uint8_t*)(data+i), &decode_size);
-            i += decode_size;
-            e = decode_SLEB128((const uint8_t*)(data+i), &decode_size);
+            size_t count = decode_SLEB128_block((const uint8_t*)(data+i), size - i, bounds, LEB128_BLOCK_SIZE, &decode_size);
             i += decode_size;
+            for (size_t j = 0; j + 1 < count; j += 2) {
+                starts.push_back((T) bounds[j]);
+                ends.push_back((T) bounds[j + 1]);
+            }
+        }
 #else
+        while (i < size) {
+            T s, e;
             std::memcpy(&s, data+i, sizeof(T));
             i += sizeof(T);
             std::memcpy(&e, data+i, sizeof(T));
             i += sizeof(T);
-#endif
-            intervals.insert(std::make_pair(s, e));
+            starts.push_back(s);
+            ends.push_back(e);
         }
+#endif
     }
 
     /**
      * Clear the data contained in the structure
      */
     void clear() {
-        intervals.clear();
+        // The capacity is kept, so that a list can be deserialized again without allocating
+        starts.clear();
+        ends.clear();
     }
 
     std::string to_string() const {
         std::string s;
-        for (auto& kv: intervals) {
-            s += "(" + std::to_string(kv.first) + "," + std::to_string(kv.second) + ") ";
+        for (size_t j = 0; j < starts.size(); j++) {
+            s += "(" + std::to_string(starts[j]) + "," + std::to_string(ends[j]) + ") ";
         }
         return s;
     }
@@ -283,4 +324,138 @@ public:
 
 };
 
+/*
+ * A read-only view over a serialized IntervalList.
+ * Intervals are decoded one at a time while answering a query, and decoding stops as soon as the answer is known,
+ * so that a single lookup does not need to deserialize the whole list.
+ * The view does not own the data, which must outlive it.
+ */
+template<class T>
+class IntervalListView {
+private:
+    T max;
+    const char* data;
+    size_t size;
+
+    /**
+     * Decode the interval at the given offset
+     * @param offset the offset of the interval, which will be moved to the next interval
+     * @param start the start of the interval
+     * @param end the end of the interval
+     * @return if there was an interval at the offset
+     */
+    bool next(size_t* offset, T* start, T* end) const {
+        if (*offset >= size) {
+            return false;
+        }
+#ifdef USE_VSI
+        size_t decode_size;
+        *start = (T) decode_SLEB128((const uint8_t*)(data + *offset), &decode_size);
+        *offset += decode_size;
+        *end = (T) decode_SLEB128((const uint8_t*)(data + *offset), &decode_size);
+        *offset += decode_size;
+#else
+        std::memcpy(start, data + *offset, sizeof(T));
+        *offset += sizeof(T);
+        std::memcpy(end, data + *offset, sizeof(T));
+        *offset += sizeof(T);
+#endif
+        return true;
+    }
+
+public:
+    explicit IntervalListView(T max_value): max(max_value), data(nullptr), size(0) {}
+
+    /**
+     * Point this view to a serialized list
+     * @param data the output of IntervalList::serialize
+     * @param size the size of the data
+     */
+    void wrap(const char* data, size_t size) {
+        this->data = data;
+        this->size = size;
+    }
+
+    /**
+     * @see IntervalList::is_in
+     */
+    [[nodiscard]] bool is_in(T element) const {
+        size_t offset = 0;
+        T start, end;
+        while (next(&offset, &start, &end) && start <= element) {
+            if (element < end) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @see IntervalList::get_index
+     */
+    long get_index(T value, T outer_limit) const {
+        long count = 0;
+        size_t offset = 0;
+        T start, end;
+        while (next(&offset, &start, &end) && start <= value) {
+            long max_value = end == max ? outer_limit : end;
+            if (value < max_value) {
+                return count + (value - start);
+            }
+            count += max_value - start;
+        }
+        return -1;
+    }
+
+    /**
+     * @see IntervalList::get_element_at
+     */
+    T get_element_at(long i, T outer_limit) const {
+        long index = 0;
+        size_t offset = 0;
+        T start, end;
+        while (next(&offset, &start, &end)) {
+            long range = (end == max ? outer_limit : end) - start;
+            if (i < index + range) {
+                return start + (i - index);
+            }
+            index += range;
+        }
+        return max;
+    }
+
+    /**
+     * @see IntervalList::get_first
+     */
+    T get_first() const {
+        size_t offset = 0;
+        T start, end;
+        return next(&offset, &start, &end) ? start : max;
+    }
+
+    /**
+     * @see IntervalList::get_last_end
+     */
+    T get_last_end() const {
+        size_t offset = 0;
+        T start, end = max;
+        while (next(&offset, &start, &end));
+        return end;
+    }
+
+    /**
+     * @see IntervalList::get_size
+     */
+    long get_size(T outer_limit) const {
+        long count = 0;
+        size_t offset = 0;
+        T start, end;
+        while (next(&offset, &start, &end)) {
+            count += (end == max ? outer_limit : end) - start;
+        }
+        return count;
+    }
+
+};
+
 #endif //OSTRICH_INTERVAL_LIST_H
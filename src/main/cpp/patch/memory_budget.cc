@@ -0,0 +1,112 @@
+#include <algorithm>
+
+#include "memory_budget.h"
+
+MemoryBudget::MemoryBudget(size_t max_size) : max_size(max_size), clock(0), usage(0) {}
+
+uint64_t MemoryBudget::tick() {
+    return clock.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void MemoryBudget::charge(Cache* cache, int id, size_t cost, const std::atomic<uint64_t>* last_access) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(std::make_pair(cache, id));
+    if (it != entries.end()) {
+        usage -= it->second.cost;
+        it->second = Entry{cost, last_access};
+    } else {
+        entries.emplace(std::make_pair(cache, id), Entry{cost, last_access});
+    }
+    usage += cost;
+}
+
+void MemoryBudget::release(Cache* cache, int id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(std::make_pair(cache, id));
+    if (it != entries.end()) {
+        usage -= it->second.cost;
+        entries.erase(it);
+    }
+}
+
+void MemoryBudget::release_all(Cache* cache) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->first.first == cache) {
+            usage -= it->second.cost;
+            it = entries.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+std::vector<std::pair<MemoryBudget::Cache*, int>> MemoryBudget::get_eviction_order(Cache* cache, int id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t now = clock.load(std::memory_order_relaxed);
+    std::vector<std::pair<double, std::pair<Cache*, int>>> scores;
+    for (const auto& kv : entries) {
+        if (kv.first.first == cache && kv.first.second == id) {
+            continue;
+        }
+        uint64_t last_access = kv.second.last_access->load(std::memory_order_relaxed);
+        double age = now >= last_access ? (double) (now - last_access) + 1 : 1;
+        scores.emplace_back(age * (double) kv.second.cost, kv.first);
+    }
+    std::sort(scores.begin(), scores.end(), [](const std::pair<double, std::pair<Cache*, int>>& a,
+                                               const std::pair<double, std::pair<Cache*, int>>& b) {
+        return a.first > b.first;
+    });
+    std::vector<std::pair<Cache*, int>> order;
+    order.reserve(scores.size());
+    for (const auto& score : scores) {
+        order.push_back(score.second);
+    }
+    return order;
+}
+
+void MemoryBudget::enforce(Cache* cache, int id, const std::function<bool(int)>& evict) {
+    while (is_exceeded()) {
+        bool evicted = false;
+        // The budget lock is not held while evicting, as caches release their entries when they unload them
+        for (const auto& candidate : get_eviction_order(cache, id)) {
+            if (candidate.first == cache ? evict(candidate.second) : candidate.first->try_evict(candidate.second)) {
+                evicted = true;
+                break;
+            }
+        }
+        if (!evicted) {
+            // All other entries are still in use, so we temporarily exceed the budget
+            break;
+        }
+    }
+}
+
+bool MemoryBudget::is_exceeded() const {
+    size_t max = max_size.load(std::memory_order_relaxed);
+    return max > 0 && get_usage() > max;
+}
+
+size_t MemoryBudget::get_usage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usage;
+}
+
+size_t MemoryBudget::get_usage(const Cache* cache) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t cache_usage = 0;
+    for (const auto& kv : entries) {
+        if (kv.first.first == cache) {
+            cache_usage += kv.second.cost;
+        }
+    }
+    return cache_usage;
+}
+
+size_t MemoryBudget::get_max_size() const {
+    return max_size.load(std::memory_order_relaxed);
+}
+
+void MemoryBudget::set_max_size(size_t max_size) {
+    this->max_size.store(max_size, std::memory_order_relaxed);
+}
@@ -0,0 +1,119 @@
+#ifndef OSTRICH_MEMORY_BUDGET_H
+#define OSTRICH_MEMORY_BUDGET_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// The number of bytes that the loaded snapshots, dictionaries and patch trees of a store may occupy together (0 = no limit)
+#ifndef MEMORY_BUDGET_SIZE
+#define MEMORY_BUDGET_SIZE 0
+#endif
+
+
+/**
+ * Tracks the memory cost of the loaded entries of one or more caches against a shared budget in bytes.
+ * When the budget is exceeded, the entries with the largest product of their cost and the time since their last access
+ * are evicted first (size-adjusted LRU), so that a large entry that is rarely used makes room before several small ones.
+ * Access times come from a clock that is shared by all caches, so that entries of different caches can be compared.
+ */
+class MemoryBudget {
+public:
+    /**
+     * A cache of which the entries are charged to a budget.
+     */
+    class Cache {
+    public:
+        virtual ~Cache() = default;
+        /**
+         * Unload the given entry if it is not in use anymore, without waiting for other threads.
+         * @param id The id of the entry.
+         * @return If the entry has been unloaded.
+         */
+        virtual bool try_evict(int id) = 0;
+    };
+
+private:
+    typedef struct Entry {
+        size_t cost;
+        const std::atomic<uint64_t>* last_access;
+    } Entry;
+
+    std::atomic<size_t> max_size;
+    std::atomic<uint64_t> clock;
+    mutable std::mutex mutex;
+    std::map<std::pair<Cache*, int>, Entry> entries;
+    size_t usage;
+
+    /**
+     * @param cache The cache that is loading an entry.
+     * @param id The id of that entry, which must not be evicted.
+     * @return The entries of all caches in the order in which they should be evicted.
+     */
+    std::vector<std::pair<Cache*, int>> get_eviction_order(Cache* cache, int id) const;
+public:
+    explicit MemoryBudget(size_t max_size = MEMORY_BUDGET_SIZE);
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+    /**
+     * @return The next time of the clock that is shared by all caches, to mark an entry as accessed.
+     */
+    uint64_t tick();
+    /**
+     * Charge a loaded entry to this budget, or update its cost if it was charged before.
+     * @param cache The cache of the entry.
+     * @param id The id of the entry.
+     * @param cost The number of bytes the entry occupies.
+     * @param last_access The last access time of the entry, which must remain valid until the entry is released.
+     */
+    void charge(Cache* cache, int id, size_t cost, const std::atomic<uint64_t>* last_access);
+    /**
+     * Release an entry that was unloaded.
+     * @param cache The cache of the entry.
+     * @param id The id of the entry.
+     */
+    void release(Cache* cache, int id);
+    /**
+     * Release all entries of the given cache, this must be called before the cache is destroyed.
+     * @param cache The cache.
+     */
+    void release_all(Cache* cache);
+    /**
+     * Evict entries of all caches until this budget is not exceeded anymore.
+     * Entries of other caches are only evicted if their cache is not locked,
+     * so this can safely be called while the lock of the given cache is held.
+     * @param cache The cache that is loading an entry.
+     * @param id The id of that entry, which will not be evicted.
+     * @param evict Unloads an entry of the given cache if it is not in use anymore, returns if it has been unloaded.
+     */
+    void enforce(Cache* cache, int id, const std::function<bool(int)>& evict);
+    /**
+     * @return If the charged entries occupy more than the maximum size.
+     */
+    bool is_exceeded() const;
+    /**
+     * @return The number of bytes that all charged entries occupy.
+     */
+    size_t get_usage() const;
+    /**
+     * @param cache A cache.
+     * @return The number of bytes that the charged entries of the given cache occupy.
+     */
+    size_t get_usage(const Cache* cache) const;
+    /**
+     * @return The maximum number of bytes, 0 if there is no limit.
+     */
+    size_t get_max_size() const;
+    /**
+     * @param max_size The maximum number of bytes, 0 for no limit.
+     *                 This is enforced when the next entry is loaded.
+     */
+    void set_max_size(size_t max_size);
+};
+
+
+#endif //OSTRICH_MEMORY_BUDGET_H
@@ -78,12 +78,18 @@ void PatchElementIteratorCombined::goToStart() {
     }
 }
 
-PatchElementIteratorVector::PatchElementIteratorVector(const std::vector<PatchElement>* elements) : elements(elements), passed(0) {
+PatchElementIteratorVector::PatchElementIteratorVector(const std::vector<PatchElement>* elements)
+        : begin(elements->begin()), end(elements->end()), passed(0) {
+    goToStart();
+}
+
+PatchElementIteratorVector::PatchElementIteratorVector(const std::vector<PatchElement>* elements, size_t begin_index, size_t end_index)
+        : begin(elements->begin() + begin_index), end(elements->begin() + end_index), passed(0) {
     goToStart();
 }
 
 bool PatchElementIteratorVector::next(PatchElement* element) {
-    if (it != elements->end()) {
+    if (it != end) {
         element->set_triple(it->get_triple());
         element->set_addition(it->is_addition());
         it++;
@@ -94,7 +100,7 @@ bool PatchElementIteratorVector::next(PatchElement* element) {
 }
 
 void PatchElementIteratorVector::goToStart() {
-    it = elements->begin();
+    it = begin;
 }
 
 size_t PatchElementIteratorVector::getPassed() {
@@ -48,11 +48,18 @@ public:
 
 class PatchElementIteratorVector : public PatchElementIterator {
 protected:
-    const std::vector<PatchElement>* elements;
+    std::vector<PatchElement>::const_iterator begin;
+    std::vector<PatchElement>::const_iterator end;
     std::vector<PatchElement>::const_iterator it;
     size_t passed;
 public:
     explicit PatchElementIteratorVector(const std::vector<PatchElement>* elements);
+    /**
+     * @param elements The elements.
+     * @param begin_index The index of the first element to iterate over.
+     * @param end_index The index after the last element to iterate over.
+     */
+    PatchElementIteratorVector(const std::vector<PatchElement>* elements, size_t begin_index, size_t end_index);
     bool next(PatchElement* element) override;
     void goToStart() override;
     size_t getPassed() override;
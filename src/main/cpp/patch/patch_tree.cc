@@ -1,28 +1,21 @@
+#include <thread>
 #include <kchashdb.h>
 
 #include "patch_tree.h"
 #include "../simpleprogresslistener.h"
 
 
-PatchTree::PatchTree(string basePath, int min_patch_id, std::shared_ptr<DictionaryManager> dict, int8_t kc_opts, bool readonly)
-        : metadata_filename(basePath + METADATA_FILENAME_BASE(min_patch_id)), min_patch_id(min_patch_id), max_patch_id(min_patch_id), readonly(readonly) {
-    tripleStore = new TripleStore(basePath + PATCHTREE_FILENAME_BASE(min_patch_id), dict, kc_opts, readonly);
+PatchTree::PatchTree(string basePath, int min_patch_id, std::shared_ptr<DictionaryManager> dict, int8_t kc_opts, bool readonly,
+                     const TreeCodec& addition_codec, const TreeCodec& deletion_codec)
+        : metadata_filename(basePath + METADATA_FILENAME_BASE(min_patch_id)), positions_filename(basePath + PATCHTREE_FILENAME(min_patch_id, "positions")),
+          min_patch_id(min_patch_id), max_patch_id(min_patch_id),
+          published_patch_id(min_patch_id - 1), readonly(readonly) {
+    tripleStore = new TripleStore(basePath + PATCHTREE_FILENAME_BASE(min_patch_id), dict, kc_opts, readonly, addition_codec, deletion_codec);
+    this->readonly = readonly || tripleStore->is_frozen();
     read_metadata();
 
-    if (!readonly) {
-        std::remove(".additions.sp_.tmp");
-        std::remove(".additions.s_o.tmp");
-        std::remove(".additions.s__.tmp");
-        std::remove(".additions._po.tmp");
-        std::remove(".additions._p_.tmp");
-        std::remove(".additions.__o.tmp");
-
-        sp_.open(".additions.sp_.tmp", kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE);
-        s_o.open(".additions.s_o.tmp", kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE);
-        s__.open(".additions.s__.tmp", kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE);
-        _po.open(".additions._po.tmp", kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE);
-        _p_.open(".additions._p_.tmp", kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE);
-        __o.open(".additions.__o.tmp", kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE);
+    if (!this->readonly) {
+        position_counters.reset(new PatchPositionCounters(positions_filename));
     }
 };
 
@@ -31,24 +24,96 @@ PatchTree::~PatchTree() {
         write_metadata();
     }
     delete tripleStore;
+}
 
-    if (!readonly) {
-        std::remove(".additions.sp_.tmp");
-        std::remove(".additions.s_o.tmp");
-        std::remove(".additions.s__.tmp");
-        std::remove(".additions._po.tmp");
-        std::remove(".additions._p_.tmp");
-        std::remove(".additions.__o.tmp");
+bool PatchTree::freeze() {
+    if (readonly) {
+        return false;
     }
+    write_metadata();
+    if (!tripleStore->freeze()) {
+        return false;
+    }
+    readonly = true;
+    return true;
+}
+
+bool PatchTree::is_frozen() const {
+    return tripleStore->is_frozen();
 }
 
-void PatchTree::clear_temp_insertion_trees() {
+bool PatchTree::migrate_deletion_summaries() {
+    if (readonly) {
+        return tripleStore->has_deletion_summaries();
+    }
+    if (!tripleStore->migrate_deletion_summaries()) {
+        return false;
+    }
+    // This tree keeps reading the original deletion trees, so patches must be appended to a reopened tree
+    write_metadata();
+    readonly = true;
+    return true;
+}
+
+bool PatchTree::has_deletion_summaries() const {
+    return tripleStore->has_deletion_summaries();
+}
+
+size_t PatchTree::get_memory_cost() const {
+    return tripleStore->get_memory_cost();
+}
+
+PatchPositionCounters::PatchPositionCounters(std::string file_name_base) : file_name_base(std::move(file_name_base)), ___(0) {
+    for (const auto& counter : get_files()) {
+        std::remove(counter.second.c_str());
+        counter.first->open(counter.second, kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE);
+    }
+}
+
+PatchPositionCounters::~PatchPositionCounters() {
+    for (const auto& counter : get_files()) {
+        counter.first->close();
+        std::remove(counter.second.c_str());
+    }
+}
+
+std::vector<std::pair<kyotocabinet::HashDB*, std::string>> PatchPositionCounters::get_files() {
+    return {{&sp_, file_name_base + ".sp_.tmp"}, {&s_o, file_name_base + ".s_o.tmp"}, {&s__, file_name_base + ".s__.tmp"},
+            {&_po, file_name_base + "._po.tmp"}, {&_p_, file_name_base + "._p_.tmp"}, {&__o, file_name_base + ".__o.tmp"}};
+}
+
+void PatchPositionCounters::clear() {
     sp_.clear();
     s_o.clear();
     s__.clear();
     _po.clear();
     _p_.clear();
     __o.clear();
+    ___ = 0;
+}
+
+inline PatchPosition get_position_count(kyotocabinet::HashDB& m, size_t hash) {
+    char raw_key[sizeof(long)];
+    memcpy(raw_key, &hash, sizeof(long));
+    PatchPosition count = 0;
+    size_t _;
+    char* raw_value = m.get(raw_key, sizeof(long), &_);
+    if (raw_value != nullptr) {
+        memcpy(&count, raw_value, sizeof(PatchPosition));
+        delete[] raw_value;
+    }
+    return count;
+}
+
+PatchPositions PatchPositionCounters::get_counts(const Triple& triple) {
+    return PatchPositions(
+            get_position_count(sp_, triple.get_subject() | (triple.get_predicate() << 16)),
+            get_position_count(s_o, triple.get_subject() | (triple.get_object() << 16)),
+            get_position_count(s__, triple.get_subject()),
+            get_position_count(_po, triple.get_predicate() | (triple.get_object() << 16)),
+            get_position_count(_p_, triple.get_predicate()),
+            get_position_count(__o, triple.get_object()),
+            ___);
 }
 
 /*
@@ -106,6 +171,136 @@ void PatchTree::append_unsafe(PatchElementIterator* patch_it, int patch_id, hdt:
     // TODO: enable this for improved efficiency, and after it has been fixed...
     //PatchElementIteratorBuffered* patch_it = new PatchElementIteratorBuffered(patch_it_original, PATCH_INSERT_BUFFER_SIZE);
 
+    position_counters->clear();
+    append_range(patch_it, patch_id, nullptr, nullptr, *position_counters, progressListener);
+    finish_append(patch_id, progressListener);
+}
+
+void PatchTree::append_unsafe(const PatchSorted& patch, int patch_id, int partitions, hdt::ProgressListener* progressListener) {
+    if (readonly) {
+        throw std::invalid_argument("Can not append in read-only mode");
+    }
+
+    // Split the patch at subject boundaries, so that all keys of a subject lie in a single range
+    const std::vector<PatchElement>& elements = patch.get_vector();
+    std::vector<size_t> bounds = {0};
+    for (int partition = 1; partition < partitions; partition++) {
+        size_t bound = std::max(bounds.back() + 1, elements.size() * partition / partitions);
+        while (bound < elements.size() && elements[bound].get_triple().get_subject() == elements[bound - 1].get_triple().get_subject()) {
+            bound++;
+        }
+        if (bound >= elements.size()) {
+            break;
+        }
+        bounds.push_back(bound);
+    }
+    if (bounds.size() == 1) {
+        PatchElementIteratorVector patch_it(&elements);
+        append_unsafe(&patch_it, patch_id, progressListener);
+        return;
+    }
+    size_t ranges = bounds.size();
+    bounds.push_back(elements.size());
+    std::vector<PatchTreeKey> lower_keys;
+    for (size_t range = 0; range < ranges; range++) {
+        lower_keys.emplace_back(elements[bounds[range]].get_triple().get_subject(), 0, 0);
+    }
+
+    // Each range counts the patch positions of its own deletions
+    position_counters->clear();
+    std::vector<std::unique_ptr<PatchPositionCounters>> range_position_counters;
+    std::vector<PatchPositionCounters*> counters = {position_counters.get()};
+    for (size_t range = 1; range < ranges; range++) {
+        range_position_counters.emplace_back(new PatchPositionCounters(positions_filename + "_" + std::to_string(range)));
+        counters.push_back(range_position_counters.back().get());
+    }
+
+    NOTIFYMSG(progressListener, ("Inserting " + std::to_string(ranges) + " ranges in parallel...\n").c_str());
+    std::vector<std::thread> threads;
+    for (size_t range = 0; range < ranges; range++) {
+        threads.emplace_back([&, range]() {
+            PatchElementIteratorVector patch_it(&elements, bounds[range], bounds[range + 1]);
+            append_range(&patch_it, patch_id, range > 0 ? &lower_keys[range] : nullptr,
+                         range + 1 < ranges ? &lower_keys[range + 1] : nullptr, *counters[range],
+                         range == 0 ? progressListener : nullptr);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // The positions of the deletions in later ranges only become known once all preceding ranges have been counted
+    NOTIFYMSG(progressListener, "\nOffsetting patch positions...\n");
+    threads.clear();
+    for (size_t range = 1; range < ranges; range++) {
+        threads.emplace_back([&, range]() {
+            offset_range_positions(patch_id, lower_keys[range], range + 1 < ranges ? &lower_keys[range + 1] : nullptr,
+                                   std::vector<PatchPositionCounters*>(counters.begin(), counters.begin() + range));
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    finish_append(patch_id, progressListener);
+}
+
+void PatchTree::offset_range_positions(int patch_id, const PatchTreeKey& lower, const PatchTreeKey* upper,
+                                       const std::vector<PatchPositionCounters*>& preceding_counters) {
+    PatchPosition ___ = 0;
+    for (PatchPositionCounters* counters : preceding_counters) {
+        ___ += counters->___;
+    }
+
+    kyotocabinet::DB::Cursor* cursor = tripleStore->getDefaultDeletionsTree()->cursor();
+    size_t size;
+    const char* data = lower.serialize(&size);
+    cursor->jump(data, size);
+    delete[] data;
+
+    // The patch id must lie below the limit of the open intervals of compressed values
+#ifdef COMPRESSED_DEL_VALUES
+    PatchTreeDeletionValue deletion_value(patch_id + 1);
+#else
+    PatchTreeDeletionValue deletion_value;
+#endif
+    PatchTreeKey deletion_key;
+    const char *kbp, *vbp;
+    size_t ksp, vsp;
+    while ((kbp = cursor->get(&ksp, &vbp, &vsp, false)) != nullptr) {
+        deletion_key.deserialize(kbp, ksp);
+        if (upper != nullptr && tripleStore->get_spo_comparator()->compare(deletion_key, *upper) > 0) {
+            delete[] kbp;
+            break;
+        }
+        deletion_value.deserialize(vbp, vsp);
+        delete[] kbp;
+
+        long index = deletion_value.get_patchvalue_index(patch_id);
+        if (index >= 0 && !deletion_value.get_patch_at(index).is_local_change()) {
+            PatchPositions positions = deletion_value.get_patch_at(index).get_patch_positions();
+            // The subject patterns of preceding ranges only have counts for colliding pattern hashes,
+            // which are shared with this range just like in a sequential append
+            for (PatchPositionCounters* counters : preceding_counters) {
+                PatchPositions counts = counters->get_counts(deletion_key);
+                positions.sp_ += counts.sp_;
+                positions.s_o += counts.s_o;
+                positions.s__ += counts.s__;
+                positions._po += counts._po;
+                positions._p_ += counts._p_;
+                positions.__o += counts.__o;
+            }
+            positions.___ += ___;
+            deletion_value.add(PatchTreeDeletionValueElement(patch_id, positions));
+            tripleStore->updateDeletionPositions(&deletion_value, cursor);
+        }
+        cursor->step();
+    }
+    delete cursor;
+}
+
+void PatchTree::append_range(PatchElementIterator* patch_it, int patch_id, const PatchTreeKey* lower, const PatchTreeKey* upper,
+                             PatchPositionCounters& counters, hdt::ProgressListener* progressListener) {
     const char *kbp, *vbp;
     size_t ksp, vsp;
 
@@ -128,13 +323,25 @@ void PatchTree::append_unsafe(PatchElementIterator* patch_it, int patch_id, hdt:
     kyotocabinet::DB::Cursor* cursor_deletions = tripleStore->getDefaultDeletionsTree()->cursor();
     kyotocabinet::DB::Cursor* cursor_additions = tripleStore->getDefaultAdditionsTree()->cursor();
 
-    cursor_deletions->jump();
-    cursor_additions->jump();
+    if (lower != nullptr) {
+        size_t size;
+        const char* data = lower->serialize(&size);
+        cursor_deletions->jump(data, size);
+        cursor_additions->jump(data, size);
+        delete[] data;
+    } else {
+        cursor_deletions->jump();
+        cursor_additions->jump();
+    }
 
     // Counters for all possible patch positions
-    // We use KC hashmaps to store the potentially large amounts of triple patterns to avoid running out of memory.
-    PatchPosition ___ = 0;
-    clear_temp_insertion_trees();
+    kyotocabinet::HashDB& sp_ = counters.sp_;
+    kyotocabinet::HashDB& s_o = counters.s_o;
+    kyotocabinet::HashDB& s__ = counters.s__;
+    kyotocabinet::HashDB& _po = counters._po;
+    kyotocabinet::HashDB& _p_ = counters._p_;
+    kyotocabinet::HashDB& __o = counters.__o;
+    PatchPosition& ___ = counters.___;
 
     bool should_step_patch = true;
     bool should_step_deletions = true;
@@ -157,8 +364,12 @@ void PatchTree::append_unsafe(PatchElementIterator* patch_it, int patch_id, hdt:
             kbp = cursor_deletions->get(&ksp, &vbp, &vsp, false);
             have_deletions_ended = kbp == nullptr;
             if (!have_deletions_ended) {
-                deletion_value.deserialize(vbp, vsp);
                 deletion_key.deserialize(kbp, ksp);
+                // The keys after the range belong to another range
+                have_deletions_ended = upper != nullptr && tripleStore->get_spo_comparator()->compare(deletion_key, *upper) > 0;
+                if (!have_deletions_ended) {
+                    deletion_value.deserialize(vbp, vsp);
+                }
                 delete[] kbp;
             }
         }
@@ -167,7 +378,10 @@ void PatchTree::append_unsafe(PatchElementIterator* patch_it, int patch_id, hdt:
             have_additions_ended = kbp == nullptr;
             if (!have_additions_ended) {
                 addition_key.deserialize(kbp, ksp);
-                addition_value.deserialize(vbp, vsp);
+                have_additions_ended = upper != nullptr && tripleStore->get_spo_comparator()->compare(addition_key, *upper) > 0;
+                if (!have_additions_ended) {
+                    addition_value.deserialize(vbp, vsp);
+                }
                 delete[] kbp;
             }
         }
@@ -246,6 +460,7 @@ void PatchTree::append_unsafe(PatchElementIterator* patch_it, int patch_id, hdt:
             if (patch_element.is_addition()) {
                 tripleStore->insertAdditionSingle(&patch_element.get_triple(), patch_id, false, true);
                 tripleStore->increment_addition_counts(0, patch_element.get_triple());
+                tripleStore->add_to_additions_sketch(patch_element.get_triple());
             } else {
                 PatchPositions patch_positions = Patch::positions(patch_element.get_triple(), sp_, s_o, s__, _po, _p_, __o, ___);
                 tripleStore->insertDeletionSingle(&patch_element.get_triple(), patch_positions, patch_id, false, true);
@@ -461,17 +676,30 @@ void PatchTree::append_unsafe(PatchElementIterator* patch_it, int patch_id, hdt:
         }
     }
 
+    delete cursor_deletions;
+    delete cursor_additions;
+}
+
+void PatchTree::finish_append(int patch_id, hdt::ProgressListener* progressListener) {
+    // The POS and OSP trees are merged in the background, while the addition counts are flushed
+    NOTIFYMSG(progressListener, "\nCompacting sorted runs...\n");
+    tripleStore->compact_runs();
+
     NOTIFYMSG(progressListener, "\nFlushing addition counts...\n");
     long addition_counts = tripleStore->flush_addition_counts();
     NOTIFYMSG(progressListener, ("\nSaved " + std::to_string(addition_counts) + " addition counts\n").c_str());
 
+    // Readers do not wait for the merge of the runs, so the patch is only published once all trees contain it
+    tripleStore->wait_for_runs();
     NOTIFYMSG(progressListener, "\nFinished patch insertion\n");
     if (patch_id > max_patch_id) {
         max_patch_id = patch_id;
     }
-
-    delete cursor_deletions;
-    delete cursor_additions;
+    if (patch_id > published_patch_id.load(std::memory_order_relaxed)) {
+        published_patch_id.store(patch_id, std::memory_order_release);
+    }
+    // The manager reads the max patch id of unloaded trees from the metadata, so it must not lag behind the appends
+    write_metadata();
 }
 
 bool PatchTree::append(PatchElementIterator* patch_it, int patch_id, hdt::ProgressListener* progressListener) {
@@ -489,10 +717,18 @@ bool PatchTree::append(PatchElementIterator* patch_it, int patch_id, hdt::Progre
 }
 
 bool PatchTree::append(const PatchSorted& patch, int patch_id, hdt::ProgressListener* progressListener) {
-    PatchElementIteratorVector* it = new PatchElementIteratorVector(&patch.get_vector());
-    bool ret = append(it, patch_id, progressListener);
-    delete it;
-    return ret;
+    for (const PatchElement& element : patch.get_vector()) {
+        // We IGNORE the element type, because it makes no sense to have +/- for the same triple in the same patch!
+        if(contains(element, patch_id, true)) {
+            return false;
+        }
+    }
+    append_unsafe(patch, patch_id, get_append_partitions(patch), progressListener);
+    return true;
+}
+
+int PatchTree::get_append_partitions(const PatchSorted& patch) {
+    return (int) std::max((unsigned long) 1, std::min((unsigned long) APPEND_PARTITIONS, patch.get_size() / APPEND_PARTITION_MIN_SIZE));
 }
 
 bool PatchTree::contains(const PatchElement& patch_element, int patch_id, bool ignore_type) const {
@@ -529,6 +765,15 @@ bool PatchTree::contains_addition(const PatchElement& patch_element, int patch_i
     return ret;
 }
 
+bool PatchTree::contains_addition(const Triple& triple) const {
+    PatchTreeKey key = triple;
+    size_t key_size;
+    const char* raw_key = key.serialize(&key_size);
+    bool ret = tripleStore->getDefaultAdditionsTree()->check(raw_key, key_size) >= 0;
+    delete[] raw_key;
+    return ret;
+}
+
 bool PatchTree::contains_deletion(const PatchElement& patch_element, int patch_id) const {
     PatchTreeKey key = patch_element.get_triple();
     size_t key_size, value_size;
@@ -539,15 +784,15 @@ bool PatchTree::contains_deletion(const PatchElement& patch_element, int patch_i
     // First, we check if the key is present
     bool ret = raw_value != nullptr;
     if(ret) {
-        // After that, we have to deserialize the value and check if it exists for the given patch.
+        // After that, we have to check if the value exists for the given patch, for which we only decode its patch ids.
 #ifdef COMPRESSED_DEL_VALUES
-        PatchTreeDeletionValue value(max_patch_id);
+        PatchTreeDeletionValueView value(max_patch_id);
 #else
-        PatchTreeDeletionValue value;
+        PatchTreeDeletionValueView value;
 #endif
-        value.deserialize(raw_value, value_size);
-        delete[] raw_value;
+        value.wrap(raw_value, value_size);
         long i = value.get_patchvalue_index(patch_id);
+        delete[] raw_value;
         ret = i >= 0;
     }
     return ret;
@@ -617,6 +862,13 @@ PatchTreeIterator PatchTree::iterator(PatchTreeKey *key, int patch_id, bool exac
     return patchTreeIterator;
 }
 
+template <class DV>
+void PatchTree::set_deletion_summaries(PatchTreeIteratorBase<DV>* it, const Triple& triple_pattern) const {
+    if (tripleStore->has_deletion_summaries() && !TripleStore::is_default_tree(triple_pattern)) {
+        it->set_deletion_summaries(tripleStore->getDefaultDeletionsTree());
+    }
+}
+
 template <class DV>
 PatchTreeIteratorBase<DV>* PatchTree::iterator(const Triple *triple_pattern) const {
     kyotocabinet::DB::Cursor* cursor_deletions = tripleStore->getDeletionsTree(*triple_pattern)->cursor();
@@ -628,6 +880,7 @@ PatchTreeIteratorBase<DV>* PatchTree::iterator(const Triple *triple_pattern) con
     delete[] data;
     PatchTreeIteratorBase<DV>* patchTreeIterator = new PatchTreeIteratorBase<DV>(cursor_deletions, cursor_additions, get_spo_comparator());
     patchTreeIterator->set_triple_pattern_filter(*triple_pattern);
+    set_deletion_summaries(patchTreeIterator, *triple_pattern);
     return patchTreeIterator;
 }
 
@@ -658,6 +911,7 @@ std::pair<DV*, Triple> PatchTree::last_deletion_value(const Triple &triple_patte
     patchTreeIterator.set_triple_pattern_filter(triple_pattern);
     patchTreeIterator.set_filter_local_changes(true);
     patchTreeIterator.set_reverse(true); // Because we start _after_ the last matching triple because of the jump_back.
+    set_deletion_summaries(&patchTreeIterator, triple_pattern);
 
     PatchTreeKey key;
 #ifdef COMPRESSED_DEL_VALUES
@@ -693,10 +947,19 @@ std::pair<PatchPosition, Triple> PatchTree::deletion_count(const Triple &triple_
             return std::make_pair((PatchPosition) 0, Triple());
         }
         delete value.first;
-        PatchTreeDeletionValue *dv = get_deletion_value(value.second);
-        patch_position = dv->get(patch_id).get_patch_positions().get_by_pattern(triple_pattern) + 1;
+        size_t ksp, vsp = 0;
+        const char* kbp = value.second.serialize(&ksp);
+        const char* vbp = tripleStore->getDefaultDeletionsTree()->get(kbp, ksp, &vsp);
+        delete[] kbp;
+#ifdef COMPRESSED_DEL_VALUES
+        PatchTreeDeletionValueView dv(max_patch_id);
+#else
+        PatchTreeDeletionValueView dv;
+#endif
+        dv.wrap(vbp, vsp);
+        patch_position = dv.get(patch_id).get_patch_positions().get_by_pattern(triple_pattern) + 1;
         triple = value.second;
-        delete dv;
+        delete[] vbp;
     }
     return std::make_pair(patch_position, triple);
 }
@@ -771,21 +1034,115 @@ PatchTreeDeletionValueBase<DV>* PatchTree::get_deletion_value_after(const Triple
         deletion_value = reinterpret_cast<PatchTreeDeletionValueBase<DV>*>(new PatchTreeDeletionValueReduced());
 #endif
     }
+    if (!TripleStore::is_default_tree(triple_pattern) && tripleStore->has_deletion_summaries()) {
+        // The tree only contains the summary of the value, so we take the value from the SPO-tree instead.
+        delete[] kbp;
+        kbp = triple.serialize(&ksp);
+        vbp = tripleStore->getDefaultDeletionsTree()->get(kbp, ksp, &vsp);
+        delete[] kbp;
+        if (vbp == nullptr) {
+            delete deletion_value;
+            return nullptr;
+        }
+#ifdef COMPRESSED_DEL_VALUES
+        deletion_value->deserialize(vbp, vsp);
+#else
+        PatchTreeDeletionValue value;
+        value.deserialize(vbp, vsp);
+        size_t size;
+        const char* data = value.to_reduced().serialize(&size);
+        deletion_value->deserialize(data, size);
+        delete[] data;
+#endif
+        delete[] vbp;
+        return deletion_value;
+    }
     deletion_value->deserialize(vbp, vsp);
     delete[] kbp;
     return deletion_value;
 }
 
+bool PatchTree::last_deletion_triple(const Triple &triple_pattern, int patch_id, Triple* triple) const {
+    if (TripleStore::is_default_tree(triple_pattern)) {
+        std::pair<PatchTreeDeletionValue*, Triple> value = last_deletion_value<PatchTreeDeletionValue>(triple_pattern, patch_id);
+        if (value.first == nullptr) {
+            return false;
+        }
+        delete value.first;
+        *triple = value.second;
+    } else {
+        std::pair<PatchTreeDeletionValueReduced*, Triple> value = last_deletion_value<PatchTreeDeletionValueReduced>(triple_pattern, patch_id);
+        if (value.first == nullptr) {
+            return false;
+        }
+        delete value.first;
+        *triple = value.second;
+    }
+    return true;
+}
+
+PatchPositions PatchTree::get_deletion_positions(const Triple& triple, int patch_id) const {
+    size_t ksp, vsp;
+    const char* kbp = triple.serialize(&ksp);
+    const char* vbp = tripleStore->getDefaultDeletionsTree()->get(kbp, ksp, &vsp);
+    delete[] kbp;
+    if (vbp == nullptr) {
+        return PatchPositions();
+    }
+#ifdef COMPRESSED_DEL_VALUES
+    PatchTreeDeletionValueView dv(max_patch_id);
+#else
+    PatchTreeDeletionValueView dv;
+#endif
+    dv.wrap(vbp, vsp);
+    PatchPositions positions = dv.get(patch_id).get_patch_positions();
+    delete[] vbp;
+    return positions;
+}
+
 PatchPositions PatchTree::get_deletion_patch_positions(const Triple& triple, int patch_id, bool override___, PatchPosition ___) const {
-    return PatchPositions(
-            deletion_count(Triple(triple.get_subject(), triple.get_predicate(), 0), patch_id).first,
-            deletion_count(Triple(triple.get_subject(), 0, triple.get_object()), patch_id).first,
-            deletion_count(Triple(triple.get_subject(), 0, 0), patch_id).first,
-            deletion_count(Triple(0, triple.get_predicate(), triple.get_object()), patch_id).first,
-            deletion_count(Triple(0, triple.get_predicate(), 0), patch_id).first,
-            deletion_count(Triple(0, 0, triple.get_object()), patch_id).first,
-            override___ ? ___ : deletion_count(Triple(0, 0, 0), patch_id).first
-    );
+    size_t s = triple.get_subject();
+    size_t p = triple.get_predicate();
+    size_t o = triple.get_object();
+    // The patterns of each tree, from general to specific, so that a pattern only matches triples that match the patterns before it.
+    // If the last deletion of a pattern matches the next pattern, it is the last deletion of that pattern as well.
+    std::vector<std::vector<Triple>> trees_patterns = {
+            {Triple(0, 0, 0), Triple(s, 0, 0), Triple(s, p, 0)},
+            {Triple(0, p, 0), Triple(0, p, o)},
+            {Triple(0, 0, o), Triple(s, 0, o)},
+    };
+    if (override___) {
+        trees_patterns[0].erase(trees_patterns[0].begin());
+    }
+
+    PatchPositions positions(0, 0, 0, 0, 0, 0, ___);
+    // The positions of the last deletions, so that each of them is only looked up once in the SPO-tree
+    std::vector<std::pair<Triple, PatchPositions>> last_positions;
+    for (const std::vector<Triple>& patterns : trees_patterns) {
+        bool searched = false;
+        bool found = false;
+        Triple last;
+        for (const Triple& pattern : patterns) {
+            // If a more general pattern has no deletions, this pattern has none either
+            if (!searched || (found && !Triple::pattern_match_triple(last, pattern))) {
+                found = last_deletion_triple(pattern, patch_id, &last);
+                searched = true;
+            }
+            PatchPosition position = 0;
+            if (found) {
+                auto last_it = last_positions.begin();
+                while (last_it != last_positions.end() && !(last_it->first == last)) {
+                    last_it++;
+                }
+                if (last_it == last_positions.end()) {
+                    last_it = last_positions.insert(last_it, std::make_pair(last, get_deletion_positions(last, patch_id)));
+                }
+                position = last_it->second.get_by_pattern(pattern) + 1;
+            }
+            positions.set_by_pattern(pattern, position);
+        }
+    }
+    return positions;
 }
 
 PatchTreeTripleIterator* PatchTree::addition_iterator_from(long offset, int patch_id, const Triple& triple_pattern) const {
@@ -829,6 +1186,56 @@ PatchTreeIterator* PatchTree::addition_iterator(const Triple &triple_pattern) co
     return it;
 }
 
+// Count the triples of which the presence differs between two patches, this mirrors ForwardDiffPatchTripleDeltaIterator.
+template <class DV>
+static PatchPosition count_patch_differences(PatchTreeIteratorBase<DV>* it, int max_patch_id, int patch_id_start, int patch_id_end) {
+    it->set_patch_filter(patch_id_end, false);
+    it->set_early_break(true);
+    it->set_squash_equal_addition_deletion(true);
+#if defined(COMPRESSED_ADD_VALUES) || defined(COMPRESSED_DEL_VALUES)
+    PatchTreeValueBase<DV> value(max_patch_id);
+#else
+    PatchTreeValueBase<DV> value;
+#endif
+    PatchTreeKey key;
+    PatchPosition count = 0;
+    while (it->next(&key, &value)) {
+        if (!value.is_delta_type_equal(patch_id_start, patch_id_end)) {
+            count++;
+        }
+    }
+    delete it;
+    return count;
+}
+
+PatchPosition PatchTree::delta_count(const Triple &triple_pattern, int patch_id_start, int patch_id_end) const {
+    if (patch_id_end <= patch_id_start) {
+        return 0;
+    }
+    if (patch_id_start < min_patch_id) {
+        // Patches are stored relative to the snapshot, so the delta with the snapshot is exactly the patch itself.
+        // The addition count iterates if it is below MIN_ADDITION_COUNT, as those counts are not stored.
+        return deletion_count(triple_pattern, patch_id_end).first + addition_count(patch_id_end, triple_pattern);
+    }
+    if (TripleStore::is_default_tree(triple_pattern)) {
+        return count_patch_differences(iterator<PatchTreeDeletionValue>(&triple_pattern), max_patch_id, patch_id_start, patch_id_end);
+    }
+    return count_patch_differences(iterator<PatchTreeDeletionValueReduced>(&triple_pattern), max_patch_id, patch_id_start, patch_id_end);
+}
+
+template <class DV>
+PatchTreeIteratorBase<DV>* PatchTree::deletion_iterator(const Triple &triple_pattern) const {
+    kyotocabinet::DB::Cursor* cursor = tripleStore->getDeletionsTree(triple_pattern)->cursor();
+    size_t size;
+    const char* data = triple_pattern.serialize(&size);
+    cursor->jump(data, size);
+    delete[] data;
+    PatchTreeIteratorBase<DV>* it = new PatchTreeIteratorBase<DV>(cursor, nullptr, get_spo_comparator());
+    it->set_triple_pattern_filter(triple_pattern);
+    set_deletion_summaries(it, triple_pattern);
+    return it;
+}
+
 PatchPosition PatchTree::addition_count(int patch_id, const Triple& triple_pattern) const {
     PatchPosition count = tripleStore->get_addition_count(patch_id, triple_pattern);
     if (!count) {
@@ -852,6 +1259,52 @@ PatchPosition PatchTree::addition_count(int patch_id, const Triple& triple_patte
     return count;
 }
 
+std::pair<PatchPosition, bool> PatchTree::addition_count_estimated(int patch_id, const Triple& triple_pattern) const {
+    PatchPosition count;
+    if (tripleStore->get_addition_count_estimate(patch_id, triple_pattern, &count)) {
+        return std::make_pair(count, count >= MIN_ADDITION_COUNT);
+    }
+    return std::make_pair(addition_count(patch_id, triple_pattern), true);
+}
+
+HyperLogLog PatchTree::get_additions_sketch() const {
+    return tripleStore->get_additions_sketch();
+}
+
+std::vector<PatchPosition> PatchTree::addition_count_series(int patch_id_start, int patch_id_end, const Triple& triple_pattern) const {
+    std::vector<PatchPosition> counts;
+    std::vector<int> missing_patch_ids;
+    for (int patch_id = patch_id_start; patch_id <= patch_id_end; patch_id++) {
+        PatchPosition count = tripleStore->get_addition_count(patch_id, triple_pattern);
+        if (!count) {
+            missing_patch_ids.push_back(patch_id);
+        }
+        counts.push_back(count);
+    }
+    if (missing_patch_ids.empty()) {
+        return counts;
+    }
+
+    // The missing counts were too low to be stored in the count db,
+    // so we count them manually, using a single iteration over all additions matching the pattern.
+    PatchTreeIterator* it = addition_iterator(triple_pattern);
+    PatchTreeKey key;
+#ifdef COMPRESSED_ADD_VALUES
+    PatchTreeAdditionValue value(max_patch_id);
+#else
+    PatchTreeAdditionValue value;
+#endif
+    while (it->next_addition(&key, &value)) {
+        for (int patch_id : missing_patch_ids) {
+            if (value.is_patch_id(patch_id) && !value.is_local_change(patch_id)) {
+                counts[patch_id - patch_id_start]++;
+            }
+        }
+    }
+    delete it;
+    return counts;
+}
+
 PatchTreeAdditionValue* PatchTree::get_addition_value(const Triple &triple) const {
     size_t ksp, vsp;
     const char* kbp = triple.serialize(&ksp);
@@ -886,6 +1339,10 @@ int PatchTree::get_min_patch_id() const {
     return min_patch_id;
 }
 
+int PatchTree::pin_patch_id(int patch_id) const {
+    return std::min(patch_id, published_patch_id.load(std::memory_order_acquire));
+}
+
 void PatchTree::write_metadata() {
     ofstream metadata_file;
     metadata_file.open(metadata_filename);
@@ -894,14 +1351,28 @@ void PatchTree::write_metadata() {
 }
 
 void PatchTree::read_metadata() {
+    // The patches of an existing patch tree are readable, a new patch tree has none until its first append has finished
+    int stored_max_patch_id = read_metadata(metadata_filename, -1);
+    if (stored_max_patch_id >= 0) {
+        max_patch_id = stored_max_patch_id;
+        published_patch_id = stored_max_patch_id;
+    }
+}
+
+int PatchTree::read_metadata(const string& file_name, int default_max_patch_id) {
     ifstream metadata_file;
-    metadata_file.open(metadata_filename);
+    metadata_file.open(file_name);
     if (metadata_file.good()) {
         string max_patch_id_str;
         metadata_file >> max_patch_id_str;
-        max_patch_id = stoi(max_patch_id_str);
         metadata_file.close();
+        return stoi(max_patch_id_str);
     }
+    return default_max_patch_id;
+}
+
+int PatchTree::read_max_patch_id(const string& basePath, int min_patch_id) {
+    return read_metadata(basePath + METADATA_FILENAME_BASE(min_patch_id), min_patch_id);
 }
 
 // Explicit specialization is required
@@ -909,3 +1380,5 @@ template PatchTreeDeletionValue* PatchTree::get_deletion_value_after(const Tripl
 template PatchTreeDeletionValueReduced* PatchTree::get_deletion_value_after(const Triple& triple_pattern) const;
 template PatchTreeIteratorBase<PatchTreeDeletionValue>* PatchTree::iterator(const Triple* triple_pattern) const;
 template PatchTreeIteratorBase<PatchTreeDeletionValueReduced>* PatchTree::iterator(const Triple* triple_pattern) const;
+template PatchTreeIteratorBase<PatchTreeDeletionValue>* PatchTree::deletion_iterator(const Triple& triple_pattern) const;
+template PatchTreeIteratorBase<PatchTreeDeletionValueReduced>* PatchTree::deletion_iterator(const Triple& triple_pattern) const;
@@ -1,7 +1,10 @@
 #ifndef TPFPATCH_STORE_PATCH_TREE_H
 #define TPFPATCH_STORE_PATCH_TREE_H
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 #include <kchashdb.h>
 #include "patch_tree_iterator.h"
 #include "patch.h"
@@ -19,23 +22,66 @@
 #ifndef PATCH_INSERT_BUFFER_SIZE
 #define PATCH_INSERT_BUFFER_SIZE 100
 #endif
+// The number of subject ranges of which the merges run in parallel when a sorted patch is appended (1 = sequential)
+#ifndef APPEND_PARTITIONS
+#define APPEND_PARTITIONS 1
+#endif
+// The minimum number of patch elements per subject range when a sorted patch is appended in parallel
+#ifndef APPEND_PARTITION_MIN_SIZE
+#define APPEND_PARTITION_MIN_SIZE 100000
+#endif
 
 
-// A PatchTree can store Patches which are persisted to a file
-class PatchTree {
+// Counters for all possible patch positions of the deletions that are inserted during an append.
+// We use KC hashmaps to store the potentially large amounts of triple patterns to avoid running out of memory.
+class PatchPositionCounters {
 private:
-    TripleStore* tripleStore;
-    std::string metadata_filename;
-    int min_patch_id;
-    int max_patch_id;
-    bool readonly;
-
+    std::string file_name_base;
+    /**
+     * @return The counters with their file names.
+     */
+    std::vector<std::pair<kyotocabinet::HashDB*, std::string>> get_files();
+public:
     kyotocabinet::HashDB sp_;
     kyotocabinet::HashDB s_o;
     kyotocabinet::HashDB s__;
     kyotocabinet::HashDB _po;
     kyotocabinet::HashDB _p_;
     kyotocabinet::HashDB __o;
+    PatchPosition ___;
+
+    /**
+     * @param file_name_base The base file name of the temporary counter files, which are removed again on destruction.
+     */
+    explicit PatchPositionCounters(std::string file_name_base);
+    ~PatchPositionCounters();
+    /**
+     * Reset all counters to zero.
+     */
+    void clear();
+    /**
+     * @param triple A triple.
+     * @return The number of counted deletions for each triple pattern that is derived from the given triple,
+     *         with the same pattern hashes as Patch::positions.
+     */
+    PatchPositions get_counts(const Triple& triple);
+};
+
+
+// A PatchTree can store Patches which are persisted to a file
+class PatchTree {
+private:
+    TripleStore* tripleStore;
+    std::string metadata_filename;
+    // The base file name of the temporary patch position counters, which is unique per patch tree
+    std::string positions_filename;
+    int min_patch_id;
+    std::atomic<int> max_patch_id;
+    // The largest patch id of which the append has finished, readers never see patches beyond it
+    std::atomic<int> published_patch_id;
+    bool readonly;
+    // The patch position counters of sequential appends, and of the first subject range of partitioned appends
+    std::unique_ptr<PatchPositionCounters> position_counters;
 protected:
     /**
      * Reconstruct the given patch id in the given patch.
@@ -44,12 +90,86 @@ protected:
      * @param ignore_local_changes If local changes should be ignored when reconstructing the patch, false by default.
      */
     void reconstruct_to_patch(Patch* patch, int patch_id, bool ignore_local_changes = false) const;
-    void clear_temp_insertion_trees();
+    /**
+     * Merge the given sorted patch elements into the trees, only considering the existing keys in the given range.
+     * @param patch_it The patch elements, which must all lie in the given range.
+     * @param patch_id The id of the patch.
+     * @param lower The smallest key of the range, or nullptr to start at the first key.
+     * @param upper The smallest key after the range, or nullptr to continue until the last key.
+     * @param counters The patch position counters of the deletions in the range.
+     * @param progressListener an optional progress listener.
+     */
+    void append_range(PatchElementIterator* patch_it, int patch_id, const PatchTreeKey* lower, const PatchTreeKey* upper,
+                      PatchPositionCounters& counters, hdt::ProgressListener* progressListener);
+    /**
+     * Add the number of deletions of the preceding subject ranges to the patch positions of the deletions in a range,
+     * after the ranges have been merged in parallel with their own counters.
+     * @param patch_id The id of the patch.
+     * @param lower The smallest key of the range.
+     * @param upper The smallest key after the range, or nullptr to continue until the last key.
+     * @param preceding_counters The patch position counters of all preceding ranges.
+     */
+    void offset_range_positions(int patch_id, const PatchTreeKey& lower, const PatchTreeKey* upper,
+                                const std::vector<PatchPositionCounters*>& preceding_counters);
+    /**
+     * Finish an append once all patch elements have been merged, and publish the patch to readers.
+     * @param patch_id The id of the patch.
+     * @param progressListener an optional progress listener.
+     */
+    void finish_append(int patch_id, hdt::ProgressListener* progressListener);
     template <class DV>
     std::pair<DV*, Triple> last_deletion_value(const Triple &triple_pattern, int patch_id) const;
+    /**
+     * Find the last deletion of the given patch that matches the given triple pattern, ignoring local changes.
+     * @param triple_pattern The triple pattern.
+     * @param patch_id The patch id.
+     * @param triple This will contain the last deletion, if it exists.
+     * @return If a matching deletion exists.
+     */
+    bool last_deletion_triple(const Triple &triple_pattern, int patch_id, Triple* triple) const;
+    /**
+     * @param triple A triple that is deleted in the given patch.
+     * @param patch_id The patch id.
+     * @return The patch positions of the given deletion, as stored in the SPO-tree.
+     */
+    PatchPositions get_deletion_positions(const Triple& triple, int patch_id) const;
+    /**
+     * Let the given iterator look up deletion values in the SPO-tree if its deletion tree only contains summaries.
+     * @param it An iterator over the deletion tree of the given triple pattern.
+     * @param triple_pattern The triple pattern.
+     */
+    template <class DV>
+    void set_deletion_summaries(PatchTreeIteratorBase<DV>* it, const Triple& triple_pattern) const;
 public:
-    PatchTree(string basePath, int min_patch_id, std::shared_ptr<DictionaryManager> dict, int8_t kc_opts = 0, bool readonly = false);
+    PatchTree(string basePath, int min_patch_id, std::shared_ptr<DictionaryManager> dict, int8_t kc_opts = 0, bool readonly = false,
+              const TreeCodec& addition_codec = TreeCodec(), const TreeCodec& deletion_codec = TreeCodec());
     ~PatchTree();
+    /**
+     * Rewrite this tree into a compact read-only form, after which no more patches can be appended.
+     * This may only be done once a newer snapshot exists, so that no more patches will be added to this tree.
+     * @return If the tree has been frozen.
+     */
+    bool freeze();
+    /**
+     * @return If this tree has been frozen.
+     */
+    bool is_frozen() const;
+    /**
+     * Rewrite the POS and OSP deletion trees of this tree so that they only contain summaries of the deletion values.
+     * Trees that are created with SECONDARY_DELETION_SUMMARIES already have this layout.
+     * This tree can still be queried afterwards, with its original deletion trees,
+     * but it becomes read-only, the migrated trees are only used once the patch tree is loaded again.
+     * @return If the deletion trees only contain summaries after this call.
+     */
+    bool migrate_deletion_summaries();
+    /**
+     * @return If the POS and OSP deletion trees only contain summaries of the deletion values.
+     */
+    bool has_deletion_summaries() const;
+    /**
+     * @return An estimate of the number of bytes this patch tree occupies in memory.
+     */
+    size_t get_memory_cost() const;
     /**
      * Append the given patch elements to the tree with given patch id.
      * This can OVERWRITE existing elements without a warning.
@@ -60,6 +180,19 @@ public:
      * If you want to change this behaviour, you'll have to first check if the patch elements are really new.
      */
     void append_unsafe(PatchElementIterator *patch_it, int patch_id, hdt::ProgressListener *progressListener = nullptr);
+    /**
+     * Append the given patch to the tree with given patch id, by splitting it into subject ranges that are merged in parallel.
+     * Each range has its own cursors and patch position counters,
+     * after which the patch positions of the deletions are offset by the counts of the preceding ranges.
+     * This results in the same trees as a sequential append.
+     * This can OVERWRITE existing elements without a warning.
+     * @param patch The patch.
+     * @param patch_id The id of the patch.
+     * @param partitions The maximum number of subject ranges, the patch is appended sequentially if this is 1.
+     * @param progressListener an optional progress listener.
+     */
+    void append_unsafe(const PatchSorted& patch, int patch_id, int partitions = APPEND_PARTITIONS,
+                       hdt::ProgressListener* progressListener = nullptr);
     /**
      * Append the given patch elements to the tree with given patch id.
      * This safe append will first check if the patch is completely new, only then it will add the data
@@ -78,6 +211,12 @@ public:
      * @return If the patch was added, otherwise the patch was not completely new.
      */
     bool append(const PatchSorted& patch, int patch_id, hdt::ProgressListener* progressListener = nullptr);
+    /**
+     * @param patch A patch.
+     * @return The number of subject ranges in which the given patch is appended by default,
+     *         up to APPEND_PARTITIONS with at least APPEND_PARTITION_MIN_SIZE elements per range.
+     */
+    static int get_append_partitions(const PatchSorted& patch);
     /**
      * Check if the given patch element is present in the tree.
      * @param patch_element The patch element to look for
@@ -93,6 +232,12 @@ public:
      * @return If the patch is present in the addition tree.
      */
     bool contains_addition(const PatchElement& patch_element, int patch_id) const;
+    /**
+     * Check if the given triple has been added in any patch of this tree.
+     * @param triple The triple to look for
+     * @return If the triple is present in the addition tree.
+     */
+    bool contains_addition(const Triple& triple) const;
     /**
      * Check if the given patch element is present in the deletion tree.
      * @param patch_element The patch element to look for
@@ -180,8 +325,12 @@ public:
     PatchTreeDeletionValueBase<DV>* get_deletion_value_after(const Triple& triple_pattern) const;
     /**
      * Calculate the patch positions for the current triple for the current patch id.
+     * This is equal to the deletion counts of all triple patterns of the triple,
+     * but patterns that are answered by the same tree share their lookups where possible.
      * @param triple The triple to calculate the patch positions for.
      * @param patch_id The patch in which to calculate the positions for this triple.
+     * @param override___ If the position of the ??? pattern should not be calculated, but set to the given value.
+     * @param ___ The position of the ??? pattern if override___ is true.
      * @return The patch positions for the given triple in the given patch id.
      */
     PatchPositions get_deletion_patch_positions(const Triple& triple, int patch_id, bool override___ = false, PatchPosition ___ = 0) const;
@@ -200,6 +349,15 @@ public:
      * @return The iterator that will loop over the tree for the additions.
      */
     PatchTreeIterator* addition_iterator(const Triple& triple_pattern) const;
+    /**
+     * Get an iterator that loops over all deletions matching given triple pattern, without patch filter.
+     * The deletion value type must match the deletion tree of the given pattern,
+     * PatchTreeDeletionValue for the default tree and PatchTreeDeletionValueReduced otherwise.
+     * @param triple_pattern Only triples that match the given pattern will be returned in the iterator.
+     * @return The iterator that will loop over the tree for the deletions.
+     */
+    template <class DV>
+    PatchTreeIteratorBase<DV>* deletion_iterator(const Triple& triple_pattern) const;
     /**
      * Get the addition value for the given triple.
      * @param triple The triple to find
@@ -213,6 +371,41 @@ public:
      * @return The iterator that will loop over the tree for the given patch.
      */
     PatchPosition addition_count(int patch_id, const Triple& triple_pattern) const;
+    /**
+     * Get the number of additions in the given patch id for the given triple pattern in constant time.
+     * Counts that are too low to be stored in the count db are estimated with a count-min sketch,
+     * so the estimate is never lower than the actual count.
+     * @param patch_id The patch id to filter by, this includes all patches before this one.
+     * @param triple_pattern The triple pattern to match by.
+     * @return The count, and if this count is exact.
+     */
+    std::pair<PatchPosition, bool> addition_count_estimated(int patch_id, const Triple& triple_pattern) const;
+    /**
+     * @return The HyperLogLog sketch of all triples that were ever added in this tree.
+     */
+    HyperLogLog get_additions_sketch() const;
+    /**
+     * Get the number of additions for all patch ids in the given range for the given triple pattern.
+     * Counts that are not stored in the count db are calculated together in a single pass over the additions.
+     * @param patch_id_start The first patch id.
+     * @param patch_id_end The last patch id, inclusive.
+     * @param triple_pattern Only triples that match the given pattern will be counted.
+     * @return The number of additions for each patch id, starting at patch_id_start.
+     */
+    std::vector<PatchPosition> addition_count_series(int patch_id_start, int patch_id_end, const Triple& triple_pattern) const;
+    /**
+     * Get the exact number of triples matching the given triple pattern that differ between two versions of this delta chain.
+     * If patch_id_start is the snapshot of this tree, this is the sum of the deletion count (from the patch positions)
+     * and the addition count for patch_id_end.
+     * The addition count is only a lookup if it reaches MIN_ADDITION_COUNT, smaller counts are not stored in the count db,
+     * so these are counted by iterating over the additions that match the pattern, like addition_count does.
+     * Otherwise, the changes are counted by iterating over the tree, without materializing the triples.
+     * @param triple_pattern The triple pattern to match by.
+     * @param patch_id_start The start version, either the snapshot of this tree or a patch id in this tree.
+     * @param patch_id_end The end version, a patch id in this tree.
+     * @return The number of added and deleted triples between both versions.
+     */
+    PatchPosition delta_count(const Triple& triple_pattern, int patch_id_start, int patch_id_end) const;
 
     /**
      * @return The comparator for this patch tree in SPO order.
@@ -230,9 +423,29 @@ public:
      * @return The smallest patch id that is currently available.
      */
     int get_min_patch_id() const;
+    /**
+     * Pin the version of a reader to the patches of which the append has finished,
+     * so that a reader never sees a patch that is still being appended.
+     * The records of such a patch are already in the trees, but they are never read for smaller patch ids.
+     * @param patch_id The requested patch id.
+     * @return The given patch id, or the largest finished patch id if it is smaller.
+     *         This is smaller than the smallest patch id of this tree if no append has finished yet.
+     */
+    int pin_patch_id(int patch_id) const;
+    /**
+     * Read the largest patch id of a patch tree from its metadata file, without loading the patch tree.
+     * @param basePath The directory of the store.
+     * @param min_patch_id The id of the patch tree.
+     * @return The largest patch id, which is the id of the patch tree if it has no metadata file.
+     */
+    static int read_max_patch_id(const string& basePath, int min_patch_id);
 protected:
     void write_metadata();
     void read_metadata();
+    /**
+     * @return The largest patch id in the given metadata file, or the given default if the file does not exist.
+     */
+    static int read_metadata(const string& file_name, int default_max_patch_id);
 };
 
 #endif //TPFPATCH_STORE_PATCH_TREE_H
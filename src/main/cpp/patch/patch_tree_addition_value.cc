@@ -62,60 +62,54 @@ std::string PatchTreeAdditionValue::to_string() const {
 }
 
 const char *PatchTreeAdditionValue::serialize(size_t *size) const {
-    size_t patches_size = patches.size();
-    size_t local_changes_size = local_changes.size();
-#ifdef USE_VSI
-    size_t size_t_size_bytes = get_ULEB128_size(std::numeric_limits<size_t>::max());
-    size_t int_size_bytes = get_SLEB128_size(std::numeric_limits<int>::max());
-    size_t patches_size_bytes = patches_size * int_size_bytes;
-    size_t local_changes_size_bytes = local_changes_size * int_size_bytes;
-#else
-    size_t size_t_size_bytes = sizeof(size_t);
-    size_t patches_size_bytes = patches_size * sizeof(int);
-    size_t local_changes_size_bytes = local_changes_size * sizeof(int);
-#endif
-    size_t alloc_size = size_t_size_bytes + patches_size_bytes + local_changes_size_bytes;
-    char* bytes = new char[alloc_size];
+    char* bytes = new char[max_serialization_size()];
+    *size = serialize(bytes);
+    return bytes;
+}
 
+size_t PatchTreeAdditionValue::serialize(char *data) const {
+    size_t size;
 #ifdef USE_VSI
     // Encode and append patches count
-    std::vector<uint8_t> buffer;
-    encode_ULEB128(patches_size, buffer);
-    std::memcpy(bytes, buffer.data(), buffer.size());
-    *size = buffer.size();
-    buffer.clear();
+    size = encode_ULEB128(patches.size(), (uint8_t*) data);
 
     // Encode and append patches
     for (auto p: patches) {
-        encode_SLEB128(p, buffer);
-        std::memcpy(bytes+*size, buffer.data(), buffer.size());
-        *size += buffer.size();
-        buffer.clear();
+        size += encode_SLEB128(p, (uint8_t*)(data+size));
     }
 
     // Encode and append local changes
     for (auto l: local_changes) {
-        encode_SLEB128(l, buffer);
-        std::memcpy(bytes+*size, buffer.data(), buffer.size());
-        *size += buffer.size();
-        buffer.clear();
+        size += encode_SLEB128(l, (uint8_t*)(data+size));
     }
 #else
+    size_t patches_size = patches.size();
     // Append patches count
-    std::memcpy(bytes, &patches_size, size_t_size_bytes);
+    std::memcpy(data, &patches_size, sizeof(size_t));
+    size = sizeof(size_t);
 
     // Append patches
-    for(int i = 0; i < patches.size(); i++) {
-        std::memcpy(&bytes[size_t_size_bytes + i * sizeof(int)], &patches[i], sizeof(int));
+    if (!patches.empty()) {
+        std::memcpy(data+size, patches.data(), patches.size() * sizeof(int));
+        size += patches.size() * sizeof(int);
     }
 
     // Append local changes
-    for(int i = 0; i < local_changes.size(); i++) {
-        std::memcpy(&bytes[size_t_size_bytes + patches_size_bytes + i * sizeof(int)], &local_changes[i], sizeof(int));
+    if (!local_changes.empty()) {
+        std::memcpy(data+size, local_changes.data(), local_changes.size() * sizeof(int));
+        size += local_changes.size() * sizeof(int);
     }
-    *size = alloc_size;
 #endif
-    return bytes;
+    return size;
+}
+
+size_t PatchTreeAdditionValue::max_serialization_size() const {
+#ifdef USE_VSI
+    return get_ULEB128_size(std::numeric_limits<size_t>::max())
+           + (patches.size() + local_changes.size()) * get_SLEB128_size(std::numeric_limits<int>::max());
+#else
+    return sizeof(size_t) + (patches.size() + local_changes.size()) * sizeof(int);
+#endif
 }
 
 void PatchTreeAdditionValue::deserialize(const char *data, size_t size) {
@@ -125,17 +119,26 @@ void PatchTreeAdditionValue::deserialize(const char *data, size_t size) {
     offset = decode_size;
 
     // Read patches
+    int64_t values[LEB128_BLOCK_SIZE];
     patches.resize(patches_size);
-    for (int i=0; i<patches_size; i++) {
-        patches[i] = decode_SLEB128((const uint8_t*)(data+offset), &decode_size);
+    for (size_t i = 0; i < patches_size;) {
+        size_t count = decode_SLEB128_block((const uint8_t*)(data+offset), size - offset, values,
+                                            std::min(patches_size - i, (size_t) LEB128_BLOCK_SIZE), &decode_size);
+        if (count == 0) {
+            throw std::runtime_error("Addition value is truncated");
+        }
         offset += decode_size;
+        for (size_t j = 0; j < count; j++) {
+            patches[i++] = values[j];
+        }
     }
 
     // Read local changes (the remaining of the data)
     local_changes.clear();
     while (offset < size) {
-        local_changes.push_back(decode_SLEB128((const uint8_t*)(data+offset), &decode_size));
+        size_t count = decode_SLEB128_block((const uint8_t*)(data+offset), size - offset, values, LEB128_BLOCK_SIZE, &decode_size);
         offset += decode_size;
+        local_changes.insert(local_changes.end(), values, values + count);
     }
 #else
     size_t patches_size, local_changes_size;
@@ -148,13 +151,13 @@ void PatchTreeAdditionValue::deserialize(const char *data, size_t size) {
 
     // Read patches
     patches.resize(patches_size);
-    for(int i = 0; i < patches_size; i++) {
+    for(size_t i = 0; i < patches_size; i++) {
         std::memcpy(&patches[i], &data[size_t_size_bits + i * sizeof(int)], sizeof(int));
     }
 
     // Read local changes
     local_changes.resize(local_changes_size);
-    for(int i = 0; i < local_changes_size; i++) {
+    for(size_t i = 0; i < local_changes_size; i++) {
         std::memcpy(&local_changes[i], &data[size_t_size_bits + patches_size_bits + i * sizeof(int)], sizeof(int));
     }
 #endif
@@ -238,33 +241,40 @@ std::string PatchTreeAdditionValue::to_string() const {
 }
 
 const char *PatchTreeAdditionValue::serialize(size_t *size) const {
-    auto bin_patches = patches.serialize();
-    auto bin_local = local_changes.serialize();
+    char* data = new char[max_serialization_size()];
+    *size = serialize(data);
+    return data;
+}
+
+size_t PatchTreeAdditionValue::serialize(char *data) const {
+    // The patches are serialized behind the room for their size, and moved forward if their size is encoded in less bytes
 #ifdef USE_VSI
     size_t size_t_size_bytes = get_ULEB128_size(std::numeric_limits<size_t>::max());
 #else
     size_t size_t_size_bytes = sizeof(size_t);
 #endif
-    size_t alloc_size = bin_patches.second + bin_local.second + size_t_size_bytes;
-    char* data = new char[alloc_size];
+    size_t patches_size = patches.serialize(data + size_t_size_bytes);
+    size_t size;
 #ifdef USE_VSI
-    std::vector<uint8_t> buffer;
-    encode_ULEB128(bin_patches.second, buffer);
-    std::memcpy(data, buffer.data(), buffer.size());
-    *size = buffer.size();
+    size = get_ULEB128_size(patches_size);
+    std::memmove(data + size, data + size_t_size_bytes, patches_size);
+    encode_ULEB128(patches_size, (uint8_t*) data);
 #else
-    std::memcpy(data, &bin_patches.second, sizeof(size_t));
-    *size = sizeof(size_t);
+    std::memcpy(data, &patches_size, sizeof(size_t));
+    size = sizeof(size_t);
 #endif
-    std::memcpy(data+*size, bin_patches.first, bin_patches.second);
-    *size += bin_patches.second;
-    if (bin_local.second > 0) {
-        std::memcpy(data+*size, bin_local.first, bin_local.second);
-        *size += bin_local.second;
-    }
-    delete[] bin_patches.first;
-    delete[] bin_local.first;
-    return data;
+    size += patches_size;
+    size += local_changes.serialize(data + size);
+    return size;
+}
+
+size_t PatchTreeAdditionValue::max_serialization_size() const {
+#ifdef USE_VSI
+    size_t size_t_size_bytes = get_ULEB128_size(std::numeric_limits<size_t>::max());
+#else
+    size_t size_t_size_bytes = sizeof(size_t);
+#endif
+    return size_t_size_bytes + patches.max_serialization_size() + local_changes.max_serialization_size();
 }
 
 void PatchTreeAdditionValue::deserialize(const char *data, size_t size) {
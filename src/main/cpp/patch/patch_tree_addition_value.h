@@ -63,6 +63,16 @@ public:
      * @return The byte array
      */
     const char* serialize(size_t* size) const;
+    /**
+     * Serialize this value into the given byte array
+     * @param data The byte array, of at least max_serialization_size() bytes
+     * @return The number of bytes written
+     */
+    size_t serialize(char* data) const;
+    /**
+     * @return An upper bound on the size of the serialization of this value
+     */
+    size_t max_serialization_size() const;
     /**
      * Deserialize the given byte array to this object.
      * @param data The data to deserialize from.
@@ -154,6 +164,16 @@ public:
      * @return The byte array
      */
     const char* serialize(size_t* size) const;
+    /**
+     * Serialize this value into the given byte array
+     * @param data The byte array, of at least max_serialization_size() bytes
+     * @return The number of bytes written
+     */
+    size_t serialize(char* data) const;
+    /**
+     * @return An upper bound on the size of the serialization of this value
+     */
+    size_t max_serialization_size() const;
     /**
      * Deserialize the given byte array to this object.
      * @param data The data to deserialize from.
@@ -17,18 +17,18 @@ string PatchTreeDeletionValueElement::to_string() const {
 }
 
 char *PatchTreeDeletionValueElement::serialize(size_t *size) const {
-    char* base_data = PatchTreeDeletionValueElementBase::serialize(size);
-    char* data = new char[*size + PatchPositions::max_serialization_size()];
-    std::memcpy(data, base_data, *size);
-    delete[] base_data;
+    char* data = new char[max_serialization_size()];
+    *size = serialize(data);
+    return data;
+}
 
-    size_t pos_size;
-    char* pos_data = patch_positions.serialize(&pos_size);
-    std::memcpy(data+*size, pos_data, pos_size);
-    *size += pos_size;
-    delete[] pos_data;
+size_t PatchTreeDeletionValueElement::serialize(char *data) const {
+    size_t size = PatchTreeDeletionValueElementBase::serialize(data);
+    return size + patch_positions.serialize(data+size);
+}
 
-    return data;
+size_t PatchTreeDeletionValueElement::max_serialization_size() {
+    return PatchTreeDeletionValueElementBase::max_serialization_size() + PatchPositions::max_serialization_size();
 }
 
 size_t PatchTreeDeletionValueElement::deserialize(const char *data) {
@@ -50,19 +50,24 @@ string PatchTreeDeletionValueElementBase::to_string() const {
 }
 
 char* PatchTreeDeletionValueElementBase::serialize(size_t* size) const {
-    char* data = new char[get_SLEB128_size(std::numeric_limits<int>::max()) + sizeof(bool)];
+    char* data = new char[max_serialization_size()];
+    *size = serialize(data);
+    return data;
+}
+
+size_t PatchTreeDeletionValueElementBase::serialize(char* data) const {
 #ifdef USE_VSI
-    std::vector<uint8_t> buffer;
-    encode_SLEB128(patch_id, buffer);
-    std::memcpy(data, buffer.data(), buffer.size());
-    *size = buffer.size();
+    size_t size = encode_SLEB128(patch_id, (uint8_t*) data);
 #else
     std::memcpy(data, &patch_id, sizeof(int));
-    *size = sizeof(int);
+    size_t size = sizeof(int);
 #endif
-    std::memcpy(data+*size, &local_change, sizeof(bool));
-    *size += sizeof(bool);
-    return data;
+    std::memcpy(data+size, &local_change, sizeof(bool));
+    return size + sizeof(bool);
+}
+
+size_t PatchTreeDeletionValueElementBase::max_serialization_size() {
+    return get_SLEB128_size(std::numeric_limits<int>::max()) + sizeof(bool);
 }
 
 size_t PatchTreeDeletionValueElementBase::deserialize(const char *data) {
@@ -77,6 +82,58 @@ size_t PatchTreeDeletionValueElementBase::deserialize(const char *data) {
     return consumed_size+sizeof(bool);
 }
 
+PatchTreeDeletionSummary::PatchTreeDeletionSummary()
+        : first_patch_id(std::numeric_limits<int>::max()), last_patch_id(std::numeric_limits<int>::max()) {}
+
+PatchTreeDeletionSummary::PatchTreeDeletionSummary(int first_patch_id, int last_patch_id)
+        : first_patch_id(first_patch_id), last_patch_id(last_patch_id) {}
+
+int PatchTreeDeletionSummary::get_first_patch_id() const {
+    return first_patch_id;
+}
+
+int PatchTreeDeletionSummary::get_last_patch_id() const {
+    return last_patch_id;
+}
+
+bool PatchTreeDeletionSummary::may_contain(int patch_id) const {
+    return first_patch_id <= patch_id && patch_id <= last_patch_id;
+}
+
+bool PatchTreeDeletionSummary::operator==(const PatchTreeDeletionSummary& rhs) const {
+    return first_patch_id == rhs.first_patch_id && last_patch_id == rhs.last_patch_id;
+}
+
+bool PatchTreeDeletionSummary::operator!=(const PatchTreeDeletionSummary& rhs) const {
+    return !this->operator==(rhs);
+}
+
+size_t PatchTreeDeletionSummary::serialize(char* data) const {
+#ifdef USE_VSI
+    size_t size = encode_SLEB128(first_patch_id, (uint8_t*) data);
+    return size + encode_SLEB128(last_patch_id, (uint8_t*) data + size);
+#else
+    std::memcpy(data, &first_patch_id, sizeof(int));
+    std::memcpy(data + sizeof(int), &last_patch_id, sizeof(int));
+    return 2 * sizeof(int);
+#endif
+}
+
+size_t PatchTreeDeletionSummary::max_serialization_size() {
+    return 2 * get_SLEB128_size(std::numeric_limits<int>::max());
+}
+
+void PatchTreeDeletionSummary::deserialize(const char* data, size_t size) {
+#ifdef USE_VSI
+    size_t decode_size;
+    first_patch_id = (int) decode_SLEB128((const uint8_t*) data, &decode_size);
+    last_patch_id = (int) decode_SLEB128((const uint8_t*) data + decode_size, &decode_size);
+#else
+    std::memcpy(&first_patch_id, data, sizeof(int));
+    std::memcpy(&last_patch_id, data + sizeof(int), sizeof(int));
+#endif
+}
+
 #ifndef COMPRESSED_DEL_VALUES
 template <class T>
 PatchTreeDeletionValueBase<T>::PatchTreeDeletionValueBase() {}
@@ -153,25 +210,23 @@ string PatchTreeDeletionValueBase<T>::to_string() const {
 
 template <class T>
 const char* PatchTreeDeletionValueBase<T>::serialize(size_t* size) const {
-    *size = 0;
-    size_t elem_size;
-#ifdef USE_VSI
-    elem_size = get_SLEB128_size(std::numeric_limits<int>::max()) + sizeof(bool);
-    if (T::has_positions()) {
-        elem_size += PatchPositions::max_serialization_size();
-    }
-#else
-    elem_size = sizeof(T);
-#endif
-    char* bytes = new char[elements.size() * elem_size];
-    size_t elem_data_size;
+    char* bytes = new char[max_serialization_size()];
+    *size = serialize(bytes);
+    return bytes;
+}
+
+template <class T>
+size_t PatchTreeDeletionValueBase<T>::serialize(char* data) const {
+    size_t size = 0;
     for (const auto& e: elements) {
-        char* elem_data = e.serialize(&elem_data_size);
-        std::memcpy(bytes+*size, elem_data, elem_data_size);
-        *size += elem_data_size;
-        delete[] elem_data;
+        size += e.serialize(data+size);
     }
-    return bytes;
+    return size;
+}
+
+template <class T>
+size_t PatchTreeDeletionValueBase<T>::max_serialization_size() const {
+    return elements.size() * T::max_serialization_size();
 }
 
 template <class T>
@@ -183,6 +238,108 @@ void PatchTreeDeletionValueBase<T>::deserialize(const char* data, size_t size) {
         offset += elements.back().deserialize(data+offset);
     }
 }
+
+template <class T>
+PatchTreeDeletionSummary PatchTreeDeletionValueBase<T>::get_summary() const {
+    if (elements.empty()) {
+        return PatchTreeDeletionSummary();
+    }
+    return PatchTreeDeletionSummary(elements.front().get_patch_id(), elements.back().get_patch_id());
+}
+
+template <class T>
+typename PatchTreeDeletionValueBase<T>::View PatchTreeDeletionValueBase<T>::create_view() const {
+    return View();
+}
+
+template <class T>
+PatchTreeDeletionValueViewBase<T>::PatchTreeDeletionValueViewBase() : data(nullptr), size(0) {}
+
+template <class T>
+void PatchTreeDeletionValueViewBase<T>::wrap(const char* data, size_t size) {
+    this->data = data;
+    this->size = size;
+}
+
+template <class T>
+long PatchTreeDeletionValueViewBase<T>::get_patchvalue_index(int patch_id) const {
+    // Elements are sorted by patch id, so we can stop decoding at the first larger one
+    T element;
+    size_t offset = 0;
+    for (long index = 0; offset < size; index++) {
+        offset += element.deserialize(data+offset);
+        if (element.get_patch_id() >= patch_id) {
+            return element.get_patch_id() == patch_id ? index : -1;
+        }
+    }
+    return -1;
+}
+
+template <class T>
+long PatchTreeDeletionValueViewBase<T>::get_size() const {
+    T element;
+    size_t offset = 0;
+    long count = 0;
+    while (offset < size) {
+        offset += element.deserialize(data+offset);
+        count++;
+    }
+    return count;
+}
+
+template <class T>
+int PatchTreeDeletionValueViewBase<T>::get_patch_id_at(long index) const {
+    T element;
+    size_t offset = 0;
+    for (long i = 0; offset < size; i++) {
+        offset += element.deserialize(data+offset);
+        if (i == index) {
+            return element.get_patch_id();
+        }
+    }
+    return std::numeric_limits<int>::max();
+}
+
+template <class T>
+T PatchTreeDeletionValueViewBase<T>::get(int patch_id) const {
+    // Like PatchTreeDeletionValueBase::get, fall back to the last element if the patch id is not present
+    T element;
+    size_t offset = 0;
+    while (offset < size) {
+        offset += element.deserialize(data+offset);
+        if (element.get_patch_id() == patch_id) {
+            break;
+        }
+    }
+    return element;
+}
+
+template <class T>
+bool PatchTreeDeletionValueViewBase<T>::is_local_change(int patch_id) const {
+    T element;
+    size_t offset = 0;
+    while (offset < size) {
+        offset += element.deserialize(data+offset);
+        if (element.get_patch_id() >= patch_id) {
+            break;
+        }
+    }
+    return element.is_local_change();
+}
+
+template <class T>
+PatchTreeDeletionSummary PatchTreeDeletionValueViewBase<T>::get_summary() const {
+    if (size == 0) {
+        return PatchTreeDeletionSummary();
+    }
+    T element;
+    size_t offset = element.deserialize(data);
+    int first_patch_id = element.get_patch_id();
+    while (offset < size) {
+        offset += element.deserialize(data+offset);
+    }
+    return PatchTreeDeletionSummary(first_patch_id, element.get_patch_id());
+}
 #else
 template <class T>
 PatchTreeDeletionValueBase<T>::PatchTreeDeletionValueBase(int max_patch_id): max_patch_id(max_patch_id+1) {}
@@ -252,12 +409,116 @@ const char* PatchTreeDeletionValueBase<T>::serialize(size_t* size) const {
     return data.first;
 }
 
+template <class T>
+size_t PatchTreeDeletionValueBase<T>::serialize(char* data) const {
+    return elements.serialize(data);
+}
+
+template <class T>
+size_t PatchTreeDeletionValueBase<T>::max_serialization_size() const {
+    return elements.max_serialization_size();
+}
+
 template <class T>
 void PatchTreeDeletionValueBase<T>::deserialize(const char* data, size_t size) {
     elements.deserialize(data, size);
 }
+
+template <class T>
+PatchTreeDeletionSummary PatchTreeDeletionValueBase<T>::get_summary() const {
+    return elements.get_summary();
+}
+
+template <class T>
+typename PatchTreeDeletionValueBase<T>::View PatchTreeDeletionValueBase<T>::create_view() const {
+    return View(max_patch_id - 1);
+}
+
+template <class T>
+PatchTreeDeletionValueViewBase<T>::PatchTreeDeletionValueViewBase(int max_patch_id)
+        : data(nullptr), size(0), max_patch_id(max_patch_id+1),
+          patches(std::numeric_limits<int>::max()), local_changes(std::numeric_limits<int>::max()),
+          positions_data(nullptr), positions_size(0) {}
+
+template <class T>
+void PatchTreeDeletionValueViewBase<T>::wrap(const char* data, size_t size) {
+    this->data = data;
+    this->size = size;
+    // Only the segment sizes are read here, the segments themselves are decoded on demand (see DVIntervalList::serialize)
+    size_t patches_size = 0, local_size = 0;
+    if (size >= 2 * sizeof(size_t)) {
+        std::memcpy(&patches_size, data, sizeof(size_t));
+        std::memcpy(&local_size, data+sizeof(size_t), sizeof(size_t));
+        data += 2 * sizeof(size_t);
+        size -= 2 * sizeof(size_t);
+    } else {
+        size = 0;
+    }
+    patches.wrap(data, patches_size);
+    local_changes.wrap(data+patches_size, local_size);
+    positions_data = data+patches_size+local_size;
+    positions_size = size - patches_size - local_size;
+}
+
+template <class T>
+long PatchTreeDeletionValueViewBase<T>::get_patchvalue_index(int patch_id) const {
+    return patches.get_index(patch_id, max_patch_id);
+}
+
+template <class T>
+long PatchTreeDeletionValueViewBase<T>::get_size() const {
+    return patches.get_size(max_patch_id);
+}
+
+template <class T>
+int PatchTreeDeletionValueViewBase<T>::get_patch_id_at(long index) const {
+    return patches.get_element_at(index, max_patch_id);
+}
+
+template <class T>
+T PatchTreeDeletionValueViewBase<T>::get(int patch_id) const {
+    // Like PatchTreeDeletionValueBase::get, fall back to the last element if the patch id is not present
+    if (get_patchvalue_index(patch_id) < 0) {
+        patch_id = get_patch_id_at(get_size() - 1);
+    }
+    bool local_change = local_changes.is_in(patch_id);
+    if (!T::has_positions()) {
+        return T(patch_id, local_change);
+    }
+    PatchPositions positions;
+    if (positions_size > 0) {
+        DeltaPatchPositionsContainerV2::find_positions(positions_data, positions_size, patch_id, positions);
+    }
+    return T(patch_id, local_change, positions);
+}
+
+template <class T>
+bool PatchTreeDeletionValueViewBase<T>::is_local_change(int patch_id) const {
+    if (get_size() == 0) return false;
+    if (get_patchvalue_index(patch_id) < 0) {
+        patch_id = get_patch_id_at(get_size() - 1);
+    }
+    return local_changes.is_in(patch_id);
+}
+
+template <class T>
+PatchTreeDeletionSummary PatchTreeDeletionValueViewBase<T>::get_summary() const {
+    // Like DVIntervalList::get_summary, an open interval means that the value contains all later patches
+    int end = patches.get_last_end();
+    return PatchTreeDeletionSummary(patches.get_first(), end == std::numeric_limits<int>::max() ? end : end - 1);
+}
 #endif
 
+template <class T>
+const char* PatchTreeDeletionValueViewBase<T>::get_data() const {
+    return data;
+}
+
+template <class T>
+size_t PatchTreeDeletionValueViewBase<T>::get_data_size() const {
+    return size;
+}
+
 
 bool IntervalPatchPositionsContainer::insert_positions(int patch_id, const PatchPositions &positions) {
     bool has_changed = false;
@@ -356,28 +617,19 @@ bool IntervalPatchPositionsContainer::get_positions(int patch_id, PatchPositions
 }
 
 std::pair<const char *, size_t> IntervalPatchPositionsContainer::serialize() const {
-    size_t size = positions_map.size() * (2*sizeof(int)+PatchPositions::max_serialization_size());
-    char* data = new char[size];
+    char* data = new char[max_serialization_size()];
+    size_t size = serialize(data);
+    return std::make_pair(data, size);
+}
+
+size_t IntervalPatchPositionsContainer::serialize(char *data) const {
     size_t offset = 0;
 #ifdef USE_VSI
-    std::vector<uint8_t> buffer;
     for (const auto& inter_p: positions_map) {
-        encode_SLEB128(inter_p.first, buffer);
-        std::memcpy(data+offset, buffer.data(), buffer.size());
-        offset += buffer.size();
-
-        buffer.clear();
-        encode_SLEB128(inter_p.second.first, buffer);
-        std::memcpy(data+offset, buffer.data(), buffer.size());
-        offset += buffer.size();
-
-        buffer.clear();
-        size_t pos_size = 0;
-        char* pos_data = inter_p.second.second.serialize(&pos_size);
-        std::memcpy(data+offset, pos_data, pos_size);
-        offset += PatchPositions::max_serialization_size();
-    }
-    return std::make_pair(data, offset);
+        offset += encode_SLEB128(inter_p.first, (uint8_t*)(data+offset));
+        offset += encode_SLEB128(inter_p.second.first, (uint8_t*)(data+offset));
+        offset += inter_p.second.second.serialize(data+offset);
+    }
 #else
     for (const auto& inter_p: positions_map) {
         std::memcpy(data+offset, &inter_p.first, sizeof(int));
@@ -387,7 +639,15 @@ std::pair<const char *, size_t> IntervalPatchPositionsContainer::serialize() con
         std::memcpy(data+offset, &inter_p.second.second, sizeof(PatchPositions));
         offset += sizeof(PatchPositions);
     }
-    return std::make_pair(data, size);
+#endif
+    return offset;
+}
+
+size_t IntervalPatchPositionsContainer::max_serialization_size() const {
+#ifdef USE_VSI
+    return positions_map.size() * (2*get_SLEB128_size(std::numeric_limits<int>::max()) + PatchPositions::max_serialization_size());
+#else
+    return positions_map.size() * (2*sizeof(int) + sizeof(PatchPositions));
 #endif
 }
 
@@ -419,176 +679,180 @@ void IntervalPatchPositionsContainer::deserialize(const char *data, size_t size)
 }
 
 
+// The maximal serialization size of the given number of delta-encoded positions
+static size_t max_delta_positions_size(size_t count) {
+    return count * (sizeof(uint8_t) + get_SLEB128_size(std::numeric_limits<int>::max()) + PatchPositions::max_serialization_size());
+}
+
 void
 DeltaPatchPositionsContainerBase::delta_serialize_position_vec(const vector<VerPatchPositions<int>> &position_vec, char **data,
                                                                size_t *size) {
+    *size = 0;
+    if (!position_vec.empty()) {
+        *data = new char[max_delta_positions_size(position_vec.size())];
+        *size = delta_serialize_position_vec(position_vec, *data);
+    }
+}
+
+size_t DeltaPatchPositionsContainerBase::delta_serialize_position_vec(const vector<VerPatchPositions<int>> &position_vec,
+                                                                      char *data) {
     auto position_diff = [](char* data, const VerPatchPositions<int>& first, const VerPatchPositions<int>& second) {
         uint8_t head = 0;
-        std::vector<PatchPosition> diff_values;
+        PatchPosition diff_values[7];
+        size_t diff_count = 0;
 
         PatchPosition diff = second.positions.sp_ - first.positions.sp_;
         head |= (bool)diff;
-        if (diff) diff_values.push_back(diff);
+        if (diff) diff_values[diff_count++] = diff;
 
         diff = second.positions.s_o - first.positions.s_o;
         head |= (bool)diff << 1;
-        if (diff) diff_values.push_back(diff);
+        if (diff) diff_values[diff_count++] = diff;
 
         diff = second.positions.s__ - first.positions.s__;
         head |= (bool)diff << 2;
-        if (diff) diff_values.push_back(diff);
+        if (diff) diff_values[diff_count++] = diff;
 
         diff = second.positions._po - first.positions._po;
         head |= (bool)diff << 3;
-        if (diff) diff_values.push_back(diff);
+        if (diff) diff_values[diff_count++] = diff;
 
         diff = second.positions._p_ - first.positions._p_;
         head |= (bool)diff << 4;
-        if (diff) diff_values.push_back(diff);
+        if (diff) diff_values[diff_count++] = diff;
 
         diff = second.positions.__o - first.positions.__o;
         head |= (bool)diff << 5;
-        if (diff) diff_values.push_back(diff);
+        if (diff) diff_values[diff_count++] = diff;
 
         diff = second.positions.___ - first.positions.___;
         head |= (bool)diff << 6;
-        if (diff) diff_values.push_back(diff);
+        if (diff) diff_values[diff_count++] = diff;
 
 
         size_t size = sizeof(uint8_t);
         std::memcpy(data, &head, sizeof(uint8_t));
 #ifdef USE_VSI
-        std::vector<uint8_t> buffer;
-        encode_SLEB128(second.patch_id, buffer);
-        std::memcpy(data+size, buffer.data(), buffer.size());
-        size += buffer.size();
-        buffer.clear();
-        for (PatchPosition d: diff_values) {
-            encode_SLEB128(d, buffer);
-            std::memcpy(data+size, buffer.data(), buffer.size());
-            size += buffer.size();
-            buffer.clear();
+        size += encode_SLEB128(second.patch_id, (uint8_t*)(data+size));
+        for (size_t i = 0; i < diff_count; i++) {
+            size += encode_SLEB128(diff_values[i], (uint8_t*)(data+size));
         }
 #else
-        size += sizeof(int) + diff_values.size()*sizeof(PatchPosition);
-        std::memcpy(data+sizeof(uint8_t), &second.patch_id, sizeof(int));
-        std::memcpy(data+sizeof(uint8_t)+sizeof(int), diff_values.data(), diff_values.size()*sizeof(PatchPosition));
+        std::memcpy(data+size, &second.patch_id, sizeof(int));
+        size += sizeof(int);
+        std::memcpy(data+size, diff_values, diff_count*sizeof(PatchPosition));
+        size += diff_count*sizeof(PatchPosition);
 #endif
         return size;
     };
 
-    *size = 0;
+    size_t size = 0;
     if (!position_vec.empty()) {
-        size_t alloc_size = position_vec.size()*(PatchPositions::max_serialization_size()+sizeof(int)+sizeof(uint8_t));
-        *data = new char[alloc_size];
 #ifdef USE_VSI
-        std::vector<uint8_t> buffer;
-        encode_SLEB128(position_vec[0].patch_id, buffer);
-        *size += buffer.size();
-        std::memcpy(*data, buffer.data(), buffer.size());
+        size += encode_SLEB128(position_vec[0].patch_id, (uint8_t*)data);
 #else
-        std::memcpy(*data, &position_vec[0].patch_id, sizeof(int));
-        *size += sizeof(int);
+        std::memcpy(data, &position_vec[0].patch_id, sizeof(int));
+        size += sizeof(int);
 #endif
-        size_t positions_data_size = 0;
-        char* positions_data = position_vec[0].positions.serialize(&positions_data_size);
-        std::memcpy(*data+*size, positions_data, positions_data_size);
-        delete[] positions_data;
-        *size += positions_data_size;
-        if (position_vec.size() > 1) {
-            for (size_t i=1; i<position_vec.size(); i++) {
-                *size += position_diff(*data+*size, position_vec[i-1], position_vec[i]);
-            }
+        size += position_vec[0].positions.serialize(data+size);
+        for (size_t i=1; i<position_vec.size(); i++) {
+            size += position_diff(data+size, position_vec[i-1], position_vec[i]);
         }
     }
+    return size;
 }
 
-void
-DeltaPatchPositionsContainerBase::delta_deserialize_position_vec(vector<VerPatchPositions<int>> &position_vec, const char *data,
-                                                                 size_t size) {
-    auto position_undiff = [] (const char* data, const PatchPositions& prev, VerPatchPositions<int>& pos) {
-        uint8_t head;
-        size_t offset = 0;
+size_t DeltaPatchPositionsContainerBase::max_serialization_size() const {
+    return max_delta_positions_size(position_vec.size());
+}
 
-        std::memcpy(&head, data+offset, sizeof(uint8_t));
-        offset += sizeof(uint8_t);
+size_t DeltaPatchPositionsContainerBase::decode_first_positions(const char *data, VerPatchPositions<int> &pos) {
+    size_t offset = 0;
 #ifdef USE_VSI
-        size_t leb128_decode_size = 0;
-        pos.patch_id = decode_SLEB128((const uint8_t*)(data + offset), &leb128_decode_size);
-        offset += leb128_decode_size;
+    pos.patch_id = decode_SLEB128((const uint8_t*)data, &offset);
 #else
-        std::memcpy(&pos.patch_id, data+offset, sizeof(int));
-        offset += sizeof(int);
+    std::memcpy(&pos.patch_id, data, sizeof(int));
+    offset += sizeof(int);
 #endif
-        PatchPosition diff = 0;
-        if (head & 1) {
-            offset += decode_diff(data+offset, diff);
-        }
-        pos.positions.sp_ = prev.sp_ + diff;
+    offset += pos.positions.deserialize(data+offset);
+    return offset;
+}
 
-        diff = 0;
-        head >>= 1;
-        if (head & 1) {
-            offset += decode_diff(data+offset, diff);
-        }
-        pos.positions.s_o = prev.s_o + diff;
+size_t DeltaPatchPositionsContainerBase::decode_delta_positions(const char *data, const PatchPositions &prev,
+                                                               VerPatchPositions<int> &pos) {
+    uint8_t head;
+    size_t offset = 0;
 
-        diff = 0;
-        head >>= 1;
-        if (head & 1) {
-            offset += decode_diff(data+offset, diff);
-        }
-        pos.positions.s__ = prev.s__ + diff;
+    std::memcpy(&head, data+offset, sizeof(uint8_t));
+    offset += sizeof(uint8_t);
+#ifdef USE_VSI
+    size_t leb128_decode_size = 0;
+    pos.patch_id = decode_SLEB128((const uint8_t*)(data + offset), &leb128_decode_size);
+    offset += leb128_decode_size;
+#else
+    std::memcpy(&pos.patch_id, data+offset, sizeof(int));
+    offset += sizeof(int);
+#endif
+    PatchPosition diff = 0;
+    if (head & 1) {
+        offset += decode_diff(data+offset, diff);
+    }
+    pos.positions.sp_ = prev.sp_ + diff;
 
-        diff = 0;
-        head >>= 1;
-        if (head & 1) {
-            offset += decode_diff(data+offset, diff);
-        }
-        pos.positions._po = prev._po + diff;
+    diff = 0;
+    head >>= 1;
+    if (head & 1) {
+        offset += decode_diff(data+offset, diff);
+    }
+    pos.positions.s_o = prev.s_o + diff;
 
-        diff = 0;
-        head >>= 1;
-        if (head & 1) {
-            offset += decode_diff(data+offset, diff);
-        }
-        pos.positions._p_ = prev._p_ + diff;
+    diff = 0;
+    head >>= 1;
+    if (head & 1) {
+        offset += decode_diff(data+offset, diff);
+    }
+    pos.positions.s__ = prev.s__ + diff;
 
-        diff = 0;
-        head >>= 1;
-        if (head & 1) {
-            offset += decode_diff(data+offset, diff);
-        }
-        pos.positions.__o = prev.__o + diff;
+    diff = 0;
+    head >>= 1;
+    if (head & 1) {
+        offset += decode_diff(data+offset, diff);
+    }
+    pos.positions._po = prev._po + diff;
 
-        diff = 0;
-        head >>= 1;
-        if (head & 1) {
-            offset += decode_diff(data+offset, diff);
-        }
-        pos.positions.___ = prev.___ + diff;
+    diff = 0;
+    head >>= 1;
+    if (head & 1) {
+        offset += decode_diff(data+offset, diff);
+    }
+    pos.positions._p_ = prev._p_ + diff;
 
-        return offset;
-    };
+    diff = 0;
+    head >>= 1;
+    if (head & 1) {
+        offset += decode_diff(data+offset, diff);
+    }
+    pos.positions.__o = prev.__o + diff;
 
-    std::vector<uint8_t> s_byte;
-    for (int i=0; i<size; i++) {
-        s_byte.push_back(data[i]);
+    diff = 0;
+    head >>= 1;
+    if (head & 1) {
+        offset += decode_diff(data+offset, diff);
     }
+    pos.positions.___ = prev.___ + diff;
 
+    return offset;
+}
+
+void
+DeltaPatchPositionsContainerBase::delta_deserialize_position_vec(vector<VerPatchPositions<int>> &position_vec, const char *data,
+                                                                 size_t size) {
     position_vec.resize(1);
-    size_t offset = 0;
-#ifdef USE_VSI
-    position_vec[0].patch_id = decode_SLEB128((const uint8_t*)data, &offset);
-#else
-    std::memcpy(&position_vec[0].patch_id, data, sizeof(int));
-    offset += sizeof(int);
-#endif
-    offset += position_vec[0].positions.deserialize(data+offset);
+    size_t offset = decode_first_positions(data, position_vec[0]);
     size_t prev_index = 0;
     while(offset < size) {
         position_vec.emplace_back();  // insert default value at the back the vector to be modified
-        offset += position_undiff(data+offset, position_vec[prev_index].positions, position_vec.back());
+        offset += decode_delta_positions(data+offset, position_vec[prev_index].positions, position_vec.back());
         prev_index += 1;
     }
 }
@@ -672,6 +936,10 @@ std::pair<const char *, size_t> DeltaPatchPositionsContainer::serialize() const
     return std::make_pair(data, size);
 }
 
+size_t DeltaPatchPositionsContainer::serialize(char *data) const {
+    return DeltaPatchPositionsContainerBase::delta_serialize_position_vec(position_vec, data);
+}
+
 void DeltaPatchPositionsContainer::deserialize(const char *data, size_t size) {
     DeltaPatchPositionsContainerBase::delta_deserialize_position_vec(position_vec, data, size);
 //    DeltaPatchPositionsContainerBase::deserialize_position_vec(position_vec, data, size);
@@ -725,11 +993,40 @@ std::pair<const char *, size_t> DeltaPatchPositionsContainerV2::serialize() cons
     return std::make_pair(data, size);
 }
 
+size_t DeltaPatchPositionsContainerV2::serialize(char *data) const {
+    return DeltaPatchPositionsContainerBase::delta_serialize_position_vec(position_vec, data);
+}
+
 void DeltaPatchPositionsContainerV2::deserialize(const char *data, size_t size) {
     DeltaPatchPositionsContainerBase::delta_deserialize_position_vec(position_vec, data, size);
 //    DeltaPatchPositionsContainerBase::deserialize_position_vec(position_vec, data, size);
 }
 
+bool DeltaPatchPositionsContainerV2::find_positions(const char *data, size_t size, int patch_id, PatchPositions &positions) {
+    if (size == 0) {
+        return false;
+    }
+    VerPatchPositions<int> current;
+    size_t offset = decode_first_positions(data, current);
+    if (current.patch_id > patch_id) {
+        return false;
+    }
+    // Positions are delta-encoded in patch id order, so we only decode until the next patch id is too large
+    VerPatchPositions<int> next;
+    while (offset < size) {
+        size_t next_size = decode_delta_positions(data+offset, current.positions, next);
+        if (next.patch_id > patch_id) {
+            break;
+        }
+        current = next;
+        offset += next_size;
+    }
+    positions = current.positions;
+    return true;
+}
+
 
 template class PatchTreeDeletionValueBase<PatchTreeDeletionValueElement>;
 template class PatchTreeDeletionValueBase<PatchTreeDeletionValueElementBase>;
+template class PatchTreeDeletionValueViewBase<PatchTreeDeletionValueElement>;
+template class PatchTreeDeletionValueViewBase<PatchTreeDeletionValueElementBase>;
@@ -55,6 +55,19 @@ typedef struct PatchPositions {
         /*if(!s & !p & !o)*/ return ___;
     }
 
+    void set_by_pattern(const Triple &triple_pattern, PatchPosition position) {
+        bool s = triple_pattern.get_subject() > 0;
+        bool p = triple_pattern.get_predicate() > 0;
+        bool o = triple_pattern.get_object() > 0;
+        if (s & p & !o) sp_ = position;
+        else if (s & !p & o) s_o = position;
+        else if (s & !p & !o) s__ = position;
+        else if (!s & p & o) _po = position;
+        else if (!s & p & !o) _p_ = position;
+        else if (!s & !p & o) __o = position;
+        else if (!s & !p & !o) ___ = position;
+    }
+
     bool operator==(const PatchPositions &rhs) const {
         return this->sp_ == rhs.sp_
                && this->s_o == rhs.s_o
@@ -70,61 +83,38 @@ typedef struct PatchPositions {
     }
 
     char* serialize(size_t* size) const {
-        *size = 0;
         char* data = new char[max_serialization_size()];
+        *size = serialize(data);
+        return data;
+    }
+
+    size_t serialize(char* data) const {
+        size_t size = 0;
 #ifdef USE_VSI
-        std::vector<uint8_t> buffer;
-
-        encode_SLEB128(this->sp_, buffer);
-        std::memcpy(data+*size, buffer.data(), buffer.size());
-        *size += buffer.size();
-        buffer.clear();
-
-        encode_SLEB128(this->s_o, buffer);
-        std::memcpy(data+*size, buffer.data(), buffer.size());
-        *size += buffer.size();
-        buffer.clear();
-
-        encode_SLEB128(this->s__, buffer);
-        std::memcpy(data+*size, buffer.data(), buffer.size());
-        *size += buffer.size();
-        buffer.clear();
-
-        encode_SLEB128(this->_po, buffer);
-        std::memcpy(data+*size, buffer.data(), buffer.size());
-        *size += buffer.size();
-        buffer.clear();
-
-        encode_SLEB128(this->_p_, buffer);
-        std::memcpy(data+*size, buffer.data(), buffer.size());
-        *size += buffer.size();
-        buffer.clear();
-
-        encode_SLEB128(this->__o, buffer);
-        std::memcpy(data+*size, buffer.data(), buffer.size());
-        *size += buffer.size();
-        buffer.clear();
-
-        encode_SLEB128(this->___, buffer);
-        std::memcpy(data+*size, buffer.data(), buffer.size());
-        *size += buffer.size();
+        size += encode_SLEB128(this->sp_, (uint8_t*)data+size);
+        size += encode_SLEB128(this->s_o, (uint8_t*)data+size);
+        size += encode_SLEB128(this->s__, (uint8_t*)data+size);
+        size += encode_SLEB128(this->_po, (uint8_t*)data+size);
+        size += encode_SLEB128(this->_p_, (uint8_t*)data+size);
+        size += encode_SLEB128(this->__o, (uint8_t*)data+size);
+        size += encode_SLEB128(this->___, (uint8_t*)data+size);
 #else
-        std::memcpy(data+*size, &sp_, sizeof(PatchPosition));
-        *size += sizeof(PatchPosition);
-        std::memcpy(data+*size, &s_o, sizeof(PatchPosition));
-        *size += sizeof(PatchPosition);
-        std::memcpy(data+*size, &s__, sizeof(PatchPosition));
-        *size += sizeof(PatchPosition);
-        std::memcpy(data+*size, &_po, sizeof(PatchPosition));
-        *size += sizeof(PatchPosition);
-        std::memcpy(data+*size, &_p_, sizeof(PatchPosition));
-        *size += sizeof(PatchPosition);
-        std::memcpy(data+*size, &__o, sizeof(PatchPosition));
-        *size += sizeof(PatchPosition);
-        std::memcpy(data+*size, &___, sizeof(PatchPosition));
-        *size += sizeof(PatchPosition);
+        std::memcpy(data+size, &sp_, sizeof(PatchPosition));
+        size += sizeof(PatchPosition);
+        std::memcpy(data+size, &s_o, sizeof(PatchPosition));
+        size += sizeof(PatchPosition);
+        std::memcpy(data+size, &s__, sizeof(PatchPosition));
+        size += sizeof(PatchPosition);
+        std::memcpy(data+size, &_po, sizeof(PatchPosition));
+        size += sizeof(PatchPosition);
+        std::memcpy(data+size, &_p_, sizeof(PatchPosition));
+        size += sizeof(PatchPosition);
+        std::memcpy(data+size, &__o, sizeof(PatchPosition));
+        size += sizeof(PatchPosition);
+        std::memcpy(data+size, &___, sizeof(PatchPosition));
+        size += sizeof(PatchPosition);
 #endif
-        return data;
+        return size;
     }
 
     size_t deserialize(const char* data) {
@@ -236,7 +226,12 @@ public:
     }
 
     virtual char* serialize(size_t* size) const;
+    virtual size_t serialize(char* data) const;
     virtual size_t deserialize(const char* data);
+    /**
+     * @return An upper bound on the size of a serialized element
+     */
+    static size_t max_serialization_size();
 };
 
 // A PatchTreeDeletionValueElement contains a patch id, a relative patch position and
@@ -275,10 +270,60 @@ public:
     }
 
     char* serialize(size_t* size) const override;
+    size_t serialize(char* data) const override;
     size_t deserialize(const char* data) override;
+    /**
+     * @return An upper bound on the size of a serialized element
+     */
+    static size_t max_serialization_size();
 };
 
 
+// A PatchTreeDeletionSummary contains the range of patch ids of a deletion value.
+// The secondary deletion trees can store it instead of the full value, as it only changes
+// when a triple is deleted for the first time, or when it is re-added or deleted again,
+// while the exact value is looked up in the SPO tree for triples that lie in the range.
+class PatchTreeDeletionSummary {
+protected:
+    int first_patch_id;
+    int last_patch_id;
+public:
+    /**
+     * Create the summary of an empty value.
+     */
+    PatchTreeDeletionSummary();
+    /**
+     * @param first_patch_id The first patch id of the value.
+     * @param last_patch_id The last patch id of the value, or the maximum int value if it is deleted for all later patches.
+     */
+    PatchTreeDeletionSummary(int first_patch_id, int last_patch_id);
+    int get_first_patch_id() const;
+    int get_last_patch_id() const;
+    /**
+     * @param patch_id A patch id.
+     * @return If the summarized value can contain the given patch id, which must be checked against the full value.
+     */
+    bool may_contain(int patch_id) const;
+    bool operator==(const PatchTreeDeletionSummary& rhs) const;
+    bool operator!=(const PatchTreeDeletionSummary& rhs) const;
+    /**
+     * Serialize this summary into the given byte array
+     * @param data The byte array, of at least max_serialization_size() bytes
+     * @return The number of bytes written
+     */
+    size_t serialize(char* data) const;
+    /**
+     * @return An upper bound on the size of a serialized summary
+     */
+    static size_t max_serialization_size();
+    /**
+     * Deserialize the given byte array to this object.
+     * @param data The data to deserialize from.
+     * @param size The size of the byte array
+     */
+    void deserialize(const char* data, size_t size);
+};
+
 template <class I>
 struct VerPatchPositions {
     I patch_id;
@@ -303,6 +348,16 @@ public:
     virtual bool get_positions(int patch_id, PatchPositions& positions, int outer_patch_limit) const = 0;
 
     virtual std::pair<const char*, size_t> serialize() const = 0;
+    /**
+     * Serialize into the given byte array
+     * @param data The byte array, of at least max_serialization_size() bytes
+     * @return The number of bytes written
+     */
+    virtual size_t serialize(char* data) const = 0;
+    /**
+     * @return An upper bound on the size of the serialization
+     */
+    virtual size_t max_serialization_size() const = 0;
     virtual void deserialize(const char* data, size_t size) = 0;
 };
 
@@ -320,6 +375,8 @@ public:
     bool get_positions(int patch_id, PatchPositions& positions, int outer_patch_limit) const override;
 
     std::pair<const char*, size_t> serialize() const override;
+    size_t serialize(char* data) const override;
+    size_t max_serialization_size() const override;
     void deserialize(const char* data, size_t size) override;
 };
 
@@ -329,8 +386,11 @@ protected:
     std::vector<VerPatchPositions<int>> position_vec;
 
     static inline size_t decode_diff(const char *data, PatchPosition &diff);
+    static inline size_t decode_first_positions(const char *data, VerPatchPositions<int>& pos);
+    static inline size_t decode_delta_positions(const char *data, const PatchPositions& prev, VerPatchPositions<int>& pos);
 
     static inline void delta_serialize_position_vec(const std::vector<VerPatchPositions<int>>& position_vec, char** data, size_t* size);
+    static inline size_t delta_serialize_position_vec(const std::vector<VerPatchPositions<int>>& position_vec, char* data);
     static inline void delta_deserialize_position_vec(std::vector<VerPatchPositions<int>>& position_vec, const char* data, size_t size);
     static inline void serialize_position_vec(const std::vector<VerPatchPositions<int>>& position_vec, char** data, size_t* size);
     static inline void deserialize_position_vec(std::vector<VerPatchPositions<int>>& position_vec, const char* data, size_t size);
@@ -341,6 +401,8 @@ public:
     bool get_positions(int patch_id, PatchPositions& positions, int outer_patch_limit) const override = 0;
 
     std::pair<const char*, size_t> serialize() const override = 0;
+    size_t serialize(char* data) const override = 0;
+    size_t max_serialization_size() const override;
     void deserialize(const char* data, size_t size) override = 0;
 };
 
@@ -351,6 +413,7 @@ public:
     bool get_positions(int patch_id, PatchPositions& positions, int outer_patch_limit) const override;
 
     std::pair<const char*, size_t> serialize() const override;
+    size_t serialize(char* data) const override;
     void deserialize(const char* data, size_t size) override;
 };
 
@@ -361,7 +424,19 @@ public:
     bool get_positions(int patch_id, PatchPositions& positions, int outer_patch_limit) const override;
 
     std::pair<const char*, size_t> serialize() const override;
+    size_t serialize(char* data) const override;
     void deserialize(const char* data, size_t size) override;
+
+    /**
+     * Find the positions of the given patch in a serialized container, without deserializing it.
+     * Only the positions up to the given patch are decoded.
+     * @param data The output of serialize().
+     * @param size The size of the data.
+     * @param patch_id The patch id.
+     * @param positions The positions to write to.
+     * @return If positions were found, following the semantics of get_positions().
+     */
+    static bool find_positions(const char* data, size_t size, int patch_id, PatchPositions& positions);
 };
 
 
@@ -412,6 +487,11 @@ public:
         return patches.get_size(outer_patch_limit);
     }
 
+    PatchTreeDeletionSummary get_summary() const {
+        int end = patches.get_last_end();
+        return PatchTreeDeletionSummary(patches.get_first(), end == std::numeric_limits<int>::max() ? end : end - 1);
+    }
+
     T get_element_at(long index, int outer_patch_limit) const {
         int patch_id = patches.get_element_at(index, outer_patch_limit);
         bool local_change = local_changes.is_in(patch_id);
@@ -424,31 +504,28 @@ public:
     }
 
     std::pair<const char*, size_t> serialize() const {
-        auto data_patches = patches.serialize();
-        auto data_local = local_changes.serialize();
-        auto data_positions = patch_positions_container->serialize();
-        size_t size = 2 * sizeof(size_t) + data_patches.second + data_local.second + data_positions.second;
-        char* data = new char[size];
-        char* data_p = data;
-
-        std::memcpy(data_p, &data_patches.second, sizeof(size_t));
-        data_p += sizeof(size_t);
-
-        std::memcpy(data_p, &data_local.second, sizeof(size_t));
-        data_p += sizeof(size_t);
-
-        std::memcpy(data_p, data_patches.first, data_patches.second);
-        data_p += data_patches.second;
-        delete[] data_patches.first;
+        char* data = new char[max_serialization_size()];
+        size_t size = serialize(data);
+        return std::make_pair(data, size);
+    }
 
-        std::memcpy(data_p, data_local.first, data_local.second);
-        data_p += data_local.second;
-        delete[] data_local.first;
+    size_t serialize(char* data) const {
+        // The segment sizes are written in front of the segments once these are known
+        char* data_p = data + 2 * sizeof(size_t);
+        size_t patches_size = patches.serialize(data_p);
+        data_p += patches_size;
+        size_t local_size = local_changes.serialize(data_p);
+        data_p += local_size;
+        data_p += patch_positions_container->serialize(data_p);
 
-        std::memcpy(data_p, data_positions.first, data_positions.second);
-        delete[] data_positions.first;
+        std::memcpy(data, &patches_size, sizeof(size_t));
+        std::memcpy(data + sizeof(size_t), &local_size, sizeof(size_t));
+        return data_p - data;
+    }
 
-        return std::make_pair(data, size);
+    size_t max_serialization_size() const {
+        return 2 * sizeof(size_t) + patches.max_serialization_size() + local_changes.max_serialization_size()
+               + patch_positions_container->max_serialization_size();
     }
 
     void deserialize(const char *data, size_t size) {
@@ -474,6 +551,73 @@ public:
 
 };
 
+/**
+ * A read-only view over a serialized PatchTreeDeletionValueBase.
+ * Lookups for a single patch id only decode the parts of the value that are needed to answer them,
+ * instead of deserializing all of its patches, local changes and positions.
+ * The view does not own the data, which must outlive it.
+ * @tparam T DeletionValueElement type
+ */
+template <class T>
+class PatchTreeDeletionValueViewBase {
+private:
+    const char* data;
+    size_t size;
+#ifdef COMPRESSED_DEL_VALUES
+    int max_patch_id;
+    IntervalListView<int> patches;
+    IntervalListView<int> local_changes;
+    const char* positions_data;
+    size_t positions_size;
+#endif
+public:
+#ifdef COMPRESSED_DEL_VALUES
+    explicit PatchTreeDeletionValueViewBase(int max_patch_id);
+#else
+    PatchTreeDeletionValueViewBase();
+#endif
+    /**
+     * Point this view to a serialized value.
+     * @param data The output of PatchTreeDeletionValueBase::serialize.
+     * @param size The size of the data.
+     */
+    void wrap(const char* data, size_t size);
+    /**
+     * @return The serialized value this view points to.
+     */
+    const char* get_data() const;
+    /**
+     * @return The size of the serialized value this view points to.
+     */
+    size_t get_data_size() const;
+    /**
+     * @see PatchTreeDeletionValueBase::get_patchvalue_index
+     */
+    long get_patchvalue_index(int patch_id) const;
+    /**
+     * @see PatchTreeDeletionValueBase::get_size
+     */
+    long get_size() const;
+    /**
+     * Get the patch id of the given index, without decoding its local change flag or positions.
+     * @param index The index in this value list.
+     * @return The patch id, or the maximum int value if the index is out of range.
+     */
+    int get_patch_id_at(long index) const;
+    /**
+     * @see PatchTreeDeletionValueBase::get
+     */
+    T get(int patch_id) const;
+    /**
+     * @see PatchTreeDeletionValueBase::is_local_change
+     */
+    bool is_local_change(int patch_id) const;
+    /**
+     * @see PatchTreeDeletionValueBase::get_summary
+     */
+    PatchTreeDeletionSummary get_summary() const;
+};
+
 #ifndef COMPRESSED_DEL_VALUES
 
 // A PatchTreeDeletionValue in a PatchTree is a sorted list of PatchTreeValueElements
@@ -485,6 +629,8 @@ class PatchTreeDeletionValueBase {
 protected:
     std::vector<T> elements;
 public:
+    typedef PatchTreeDeletionValueViewBase<T> View;
+
     PatchTreeDeletionValueBase();
     /**
      * Add the given element.
@@ -519,6 +665,10 @@ public:
      * @return If it is a local change.
      */
     bool is_local_change(int patch_id) const;
+    /**
+     * @return The range of patch ids of this value.
+     */
+    PatchTreeDeletionSummary get_summary() const;
     /**
      * @return The string representation of this patch.
      */
@@ -529,12 +679,26 @@ public:
      * @return The byte array
      */
     const char* serialize(size_t* size) const;
+    /**
+     * Serialize this value into the given byte array
+     * @param data The byte array, of at least max_serialization_size() bytes
+     * @return The number of bytes written
+     */
+    size_t serialize(char* data) const;
+    /**
+     * @return An upper bound on the size of the serialization of this value
+     */
+    size_t max_serialization_size() const;
     /**
      * Deserialize the given byte array to this object.
      * @param data The data to deserialize from.
      * @param size The size of the byte array
      */
     void deserialize(const char* data, size_t size);
+    /**
+     * @return An empty view with the same patch limit as this value, to which serialized values can be wrapped.
+     */
+    View create_view() const;
     inline PatchTreeDeletionValueBase<PatchTreeDeletionValueElementBase> to_reduced() {
         PatchTreeDeletionValueBase<PatchTreeDeletionValueElementBase> reduced;
         for (long i = 0; i < get_size(); i++) {
@@ -553,6 +717,8 @@ protected:
     DVIntervalList<T> elements;
     int max_patch_id;
 public:
+    typedef PatchTreeDeletionValueViewBase<T> View;
+
     explicit PatchTreeDeletionValueBase(int max_patch_id);
     /**
      * Add the given element.
@@ -588,6 +754,10 @@ public:
      * @return If it is a local change.
      */
     bool is_local_change(int patch_id) const;
+    /**
+     * @return The range of patch ids of this value.
+     */
+    PatchTreeDeletionSummary get_summary() const;
     /**
      * @return The string representation of this patch.
      */
@@ -598,12 +768,26 @@ public:
      * @return The byte array
      */
     const char* serialize(size_t* size) const;
+    /**
+     * Serialize this value into the given byte array
+     * @param data The byte array, of at least max_serialization_size() bytes
+     * @return The number of bytes written
+     */
+    size_t serialize(char* data) const;
+    /**
+     * @return An upper bound on the size of the serialization of this value
+     */
+    size_t max_serialization_size() const;
     /**
      * Deserialize the given byte array to this object.
      * @param data The data to deserialize from.
      * @param size The size of the byte array
      */
     void deserialize(const char* data, size_t size);
+    /**
+     * @return An empty view with the same patch limit as this value, to which serialized values can be wrapped.
+     */
+    View create_view() const;
     inline PatchTreeDeletionValueBase<PatchTreeDeletionValueElementBase> to_reduced() {
         PatchTreeDeletionValueBase<PatchTreeDeletionValueElementBase> reduced(max_patch_id);
         for (long i = 0; i < get_size(); i++) {
@@ -618,5 +802,7 @@ public:
 
 typedef PatchTreeDeletionValueBase<PatchTreeDeletionValueElement> PatchTreeDeletionValue;
 typedef PatchTreeDeletionValueBase<PatchTreeDeletionValueElementBase> PatchTreeDeletionValueReduced;
+typedef PatchTreeDeletionValueViewBase<PatchTreeDeletionValueElement> PatchTreeDeletionValueView;
+typedef PatchTreeDeletionValueViewBase<PatchTreeDeletionValueElementBase> PatchTreeDeletionValueViewReduced;
 
 #endif //TPFPATCH_STORE_PATCH_TREE_DELETION_VALUE_H
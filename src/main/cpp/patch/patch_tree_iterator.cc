@@ -10,7 +10,7 @@ PatchTreeIteratorBase<DV>::PatchTreeIteratorBase(kyotocabinet::DB::Cursor* curso
           is_patch_id_filter(false),
           is_patch_id_filter_exact(false), patch_id_filter(-1),
           is_triple_pattern_filter(false), triple_pattern_filter(Triple(0, 0, 0)),
-          reverse(false), is_filter_local_changes(false),
+          reverse(false), is_filter_local_changes(false), primary_deletions(nullptr), deletion_buffer(nullptr),
           has_temp_key_deletion(false), has_temp_key_addition(false),
           temp_key_deletion(new PatchTreeKey()), temp_key_addition(new PatchTreeKey()) {}
 
@@ -20,6 +20,7 @@ PatchTreeIteratorBase<DV>::~PatchTreeIteratorBase() {
     delete cursor_additions;
     delete temp_key_deletion;
     delete temp_key_addition;
+    delete[] deletion_buffer;
 }
 
 template <class DV>
@@ -54,6 +55,11 @@ void PatchTreeIteratorBase<DV>::set_filter_local_changes(bool filter_local_chang
     this->is_filter_local_changes = filter_local_changes;
 }
 
+template <class DV>
+void PatchTreeIteratorBase<DV>::set_deletion_summaries(kyotocabinet::DB* primary_deletions) {
+    this->primary_deletions = primary_deletions;
+}
+
 template <class DV>
 int PatchTreeIteratorBase<DV>::get_patch_id_filter() {
     return this->patch_id_filter;
@@ -81,6 +87,17 @@ bool PatchTreeIteratorBase<DV>::is_reverse() const {
 
 template <class DV>
 bool PatchTreeIteratorBase<DV>::next_deletion(PatchTreeKey* key, DV* value, bool silent_step) {
+    typename DV::View view = value->create_view();
+    if (!next_deletion(key, &view, silent_step)) {
+        return false;
+    }
+    // Only values that match the filters are fully deserialized
+    value->deserialize(view.get_data(), view.get_data_size());
+    return true;
+}
+
+template <class DV>
+bool PatchTreeIteratorBase<DV>::next_deletion(PatchTreeKey* key, typename DV::View* value, bool silent_step) {
     // TODO: abstract code
     if(!is_deletion_tree()) {
         throw std::invalid_argument("Tried to call PatchTreeIteratorBase<DV>::next_deletion(PatchTreeKey* key, PatchTreeDeletionValue* value) on non-deletion tree.");
@@ -97,10 +114,12 @@ bool PatchTreeIteratorBase<DV>::next_deletion(PatchTreeKey* key, DV* value, bool
         kbp = cursor_deletions->get(&ksp, &vbp, &vsp);
         if (!kbp)
             return false;
-        value->deserialize(vbp, vsp);
+        // The value is only decoded as far as the filters need it
+        delete[] deletion_buffer;
+        deletion_buffer = kbp;
+        value->wrap(vbp, vsp);
 
         key->deserialize(kbp, ksp);
-        delete[] kbp;
         if (is_triple_pattern_filter && !Triple::pattern_match_triple(*key, triple_pattern_filter)) {
             if (can_early_break) {
                 // We stop iterating here, because due to the fact that we are always using a triple pattern tree
@@ -113,18 +132,24 @@ bool PatchTreeIteratorBase<DV>::next_deletion(PatchTreeKey* key, DV* value, bool
             filter_valid = true;
         }
 
+        if(filter_valid && primary_deletions != nullptr) {
+            // Only values of which the summary matches the patch filter are looked up in the SPO tree
+            PatchTreeDeletionSummary summary;
+            summary.deserialize(vbp, vsp);
+            if(is_patch_id_filter) {
+                filter_valid = is_patch_id_filter_exact ? summary.may_contain(patch_id_filter)
+                                                        : summary.get_first_patch_id() <= patch_id_filter;
+            }
+            filter_valid = filter_valid && resolve_deletion(kbp, ksp, value);
+        }
+
         if(filter_valid && is_patch_id_filter) {
             if(is_patch_id_filter_exact) {
                 long element = value->get_patchvalue_index(patch_id_filter);
                 filter_valid = element >= 0;
             } else {
-                filter_valid = false;
-                for(long i = value->get_size() - 1; i >= 0 && !filter_valid; i--) {
-                    PatchTreeDeletionValueElementBase element = value->get_patch_at(i);
-                    if(element.get_patch_id() <= patch_id_filter) {
-                        filter_valid = true;
-                    }
-                }
+                // Patch ids are sorted, so some patch id is <= patch_id_filter if the first one is
+                filter_valid = value->get_patch_id_at(0) <= patch_id_filter;
             }
         }
 
@@ -139,6 +164,37 @@ bool PatchTreeIteratorBase<DV>::next_deletion(PatchTreeKey* key, DV* value, bool
     return true;
 }
 
+#ifndef COMPRESSED_DEL_VALUES
+// Values of the SPO deletion tree contain patch positions, which are dropped for iterators over reduced values
+static const char* convert_primary_deletion_value(const char* data, size_t* size, PatchTreeDeletionValue*) {
+    return data;
+}
+
+static const char* convert_primary_deletion_value(const char* data, size_t* size, PatchTreeDeletionValueReduced*) {
+    PatchTreeDeletionValue value;
+    value.deserialize(data, *size);
+    delete[] data;
+    return value.to_reduced().serialize(size);
+}
+#endif
+
+template <class DV>
+bool PatchTreeIteratorBase<DV>::resolve_deletion(const char* kbp, size_t ksp, typename DV::View* value) {
+    size_t vsp;
+    const char* vbp = primary_deletions->get(kbp, ksp, &vsp);
+    if (!vbp) {
+        return false;
+    }
+    // Compressed reduced values share the layout of full values, of which they ignore the positions at the end
+#ifndef COMPRESSED_DEL_VALUES
+    vbp = convert_primary_deletion_value(vbp, &vsp, (DV*) nullptr);
+#endif
+    delete[] deletion_buffer;
+    deletion_buffer = vbp;
+    value->wrap(vbp, vsp);
+    return true;
+}
+
 template <class DV>
 bool PatchTreeIteratorBase<DV>::next_addition(PatchTreeKey* key, PatchTreeAdditionValue* value) {
     if(!is_addition_tree()) {
@@ -26,6 +26,11 @@ private:
 
     bool reverse;
 
+    // The SPO deletion tree, if the deletion tree only contains summaries of the values in there, null otherwise
+    kyotocabinet::DB* primary_deletions;
+    // The record the deletion cursor was last pointing at, to which deletion value views point
+    const char* deletion_buffer;
+
     bool has_temp_key_deletion;
     bool has_temp_key_addition;
     PatchTreeKey* temp_key_deletion;
@@ -33,6 +38,12 @@ private:
 
     bool can_early_break = true;
     bool squash_equal_addition_deletion = false;
+
+    /**
+     * Point the given view to the value of the given key in the SPO deletion tree.
+     * @return If the key exists in the SPO deletion tree.
+     */
+    bool resolve_deletion(const char* kbp, size_t ksp, typename DV::View* value);
 public:
     PatchTreeIteratorBase(kyotocabinet::DB::Cursor* cursor_deletions, kyotocabinet::DB::Cursor* cursor_additions, PatchTreeKeyComparator* comparator);
     ~PatchTreeIteratorBase();
@@ -64,6 +75,12 @@ public:
      * If the iterator can break early if a non-matching triple was found.
      */
     void set_early_break(bool can_early_break);
+    /**
+     * Indicate that the deletion tree of this iterator only contains summaries of its values,
+     * so that the values that match the summary are looked up in the given SPO deletion tree.
+     * @param primary_deletions The SPO deletion tree.
+     */
+    void set_deletion_summaries(kyotocabinet::DB* primary_deletions);
     /**
      * If equal additions and deletion elements in the iterators should be combined in a single return element.
      * Default is false.
@@ -99,6 +116,16 @@ public:
      * @return If this next element exists, otherwise the key and value will be invalid and should be ignored.
      */
     bool next_deletion(PatchTreeKey* key, DV* value, bool silent_step = false);
+    /**
+     * Point to the next deletion element, without deserializing its value.
+     * Can only be called if iterating over a deletion tree.
+     * @param key The key the iterator is currently pointing at.
+     * @param value The view that will point to the value the iterator is currently pointing at,
+     *              it is only valid until the next call to this iterator.
+     * @param silent_step If the cursor doesn't need to be moved.
+     * @return If this next element exists, otherwise the key and value will be invalid and should be ignored.
+     */
+    bool next_deletion(PatchTreeKey* key, typename DV::View* value, bool silent_step = false);
     /**
      * Point to the next addition element
      * Can only be called if iterating over an addition tree.
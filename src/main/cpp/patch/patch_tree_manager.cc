@@ -1,15 +1,36 @@
 #include <dirent.h>
 #include <iostream>
 #include <memory>
+#include <limits>
+#include <sys/stat.h>
+#include <thread>
 #include "patch_tree_manager.h"
 
-PatchTreeManager::PatchTreeManager(string basePath, int8_t kc_opts, bool readonly, size_t cache_size) : basePath(basePath), max_loaded_patches(std::max((size_t)2,cache_size)), kc_opts(kc_opts), readonly(readonly) {
-    detect_patch_trees();
+PatchTreeManager::PatchTreeManager(string basePath, int8_t kc_opts, bool readonly, size_t cache_size, std::shared_ptr<MemoryBudget> budget,
+                                   std::shared_ptr<StoreManifest> manifest)
+        : basePath(basePath), max_loaded_patches(std::max((size_t)2,cache_size)),
+          budget(budget != nullptr ? budget : std::make_shared<MemoryBudget>()), manifest(manifest), kc_opts(kc_opts), readonly(readonly) {
+    if (!read_manifest()) {
+        detect_patch_trees();
+        if (manifest != nullptr) {
+            for (const auto& kv : loaded_patchtrees) {
+                record_patch_tree(kv.first, PatchTree::read_max_patch_id(basePath, kv.first));
+            }
+            manifest->write();
+        }
+    }
 }
 
-PatchTreeManager::~PatchTreeManager() = default;
+PatchTreeManager::~PatchTreeManager() {
+    // Closing the trees still changes their files, so their sizes are recorded again once they are closed
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    for (const auto& kv : loaded_patchtrees) {
+        unload(kv.first);
+    }
+    budget->release_all(this);
+}
 
-bool PatchTreeManager::append(PatchElementIterator* patch_it, int patch_id, std::shared_ptr<DictionaryManager> dict, bool check_uniqueness, hdt::ProgressListener* progressListener) {
+bool PatchTreeManager::append(int patch_id, std::shared_ptr<DictionaryManager> dict, const std::function<bool(PatchTree&)>& append_patch) {
     int patchtree_id = get_patch_tree_id(patch_id);
     std::shared_ptr<PatchTree> patchtree;
     if(patchtree_id < 0) {
@@ -17,21 +38,34 @@ bool PatchTreeManager::append(PatchElementIterator* patch_it, int patch_id, std:
     } else {
         patchtree = get_patch_tree(patchtree_id, dict);
     }
-    std::unique_lock<std::mutex> append_lock(append_mutex);
-    if (check_uniqueness) {
-        return patchtree->append(patch_it, patch_id, progressListener);
-    } else {
-        patchtree->append_unsafe(patch_it, patch_id, progressListener);
-        return true;
+    std::unique_lock<std::mutex> append_lock(get_append_mutex(patchtree->get_min_patch_id()));
+    bool appended = append_patch(*patchtree);
+    if (manifest != nullptr) {
+        record_patch_tree(patchtree->get_min_patch_id(), patchtree->get_max_patch_id());
+        manifest->write();
     }
+    return appended;
+}
+
+bool PatchTreeManager::append(PatchElementIterator* patch_it, int patch_id, std::shared_ptr<DictionaryManager> dict, bool check_uniqueness, hdt::ProgressListener* progressListener) {
+    return append(patch_id, dict, [&](PatchTree& patchtree) {
+        if (check_uniqueness) {
+            return patchtree.append(patch_it, patch_id, progressListener);
+        }
+        patchtree.append_unsafe(patch_it, patch_id, progressListener);
+        return true;
+    });
 }
 
 bool PatchTreeManager::append(const PatchSorted &patch, int patch_id, std::shared_ptr<DictionaryManager> dict, bool check_uniqueness,
                               hdt::ProgressListener *progressListener) {
-    auto* it = new PatchElementIteratorVector(&patch.get_vector());
-    bool ret = append(it, patch_id, dict, check_uniqueness, progressListener);
-    delete it;
-    return ret;
+    return append(patch_id, dict, [&](PatchTree& patchtree) {
+        if (check_uniqueness) {
+            return patchtree.append(patch, patch_id, progressListener);
+        }
+        patchtree.append_unsafe(patch, patch_id, PatchTree::get_append_partitions(patch), progressListener);
+        return true;
+    });
 }
 
 const std::map<int, std::shared_ptr<PatchTree>>& PatchTreeManager::detect_patch_trees() {
@@ -58,6 +92,64 @@ const std::map<int, std::shared_ptr<PatchTree>>& PatchTreeManager::detect_patch_
     return loaded_patchtrees;
 }
 
+bool PatchTreeManager::read_manifest() {
+    if (manifest == nullptr || !manifest->is_loaded()) {
+        return false;
+    }
+    std::map<int, StoreManifest::PatchTreeEntry> patch_trees = manifest->get_patch_trees();
+    std::map<int, size_t> snapshots = manifest->get_snapshots();
+
+    // Patch trees that were created after the manifest was last written start right after a snapshot,
+    // which may itself be missing from the manifest if it follows the newest version in there.
+    int newest_version = snapshots.empty() ? -1 : snapshots.rbegin()->first;
+    std::vector<int> unlisted_patch_tree_ids;
+    for (const auto& kv : snapshots) {
+        unlisted_patch_tree_ids.push_back(kv.first + 1);
+    }
+    if (!patch_trees.empty()) {
+        newest_version = std::max(newest_version, patch_trees.rbegin()->second.max_patch_id);
+    }
+    unlisted_patch_tree_ids.push_back(newest_version + 2);
+    struct stat sb{};
+    for (int patch_id_start : unlisted_patch_tree_ids) {
+        if (patch_trees.find(patch_id_start) == patch_trees.end()
+            && stat((basePath + PATCHTREE_FILENAME(patch_id_start, "spo_deletions")).c_str(), &sb) == 0) {
+            return false;
+        }
+    }
+
+    // Only the newest patch tree can have been appended to after the manifest was last written
+    if (!patch_trees.empty()) {
+        auto newest = patch_trees.rbegin();
+        if (stat((basePath + PATCHTREE_FILENAME(newest->first, "spo_deletions")).c_str(), &sb) != 0
+            || get_patch_tree_size(newest->first) != newest->second.size
+            || PatchTree::read_max_patch_id(basePath, newest->first) != newest->second.max_patch_id) {
+            return false;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    for (const auto& kv : patch_trees) {
+        loaded_patchtrees[kv.first] = nullptr; // Don't load the actual file, we do this lazily
+    }
+    return true;
+}
+
+size_t PatchTreeManager::get_patch_tree_size(int patch_id_start) const {
+    size_t size = 0;
+    struct stat sb{};
+    for (const std::string tree : {"spo_deletions", "pos_deletions", "osp_deletions", "spo_additions", "pos_additions", "osp_additions"}) {
+        if (stat((basePath + PATCHTREE_FILENAME(patch_id_start, tree)).c_str(), &sb) == 0) {
+            size += sb.st_size;
+        }
+    }
+    return size;
+}
+
+void PatchTreeManager::record_patch_tree(int patch_id_start, int max_patch_id) {
+    manifest->set_patch_tree(patch_id_start, max_patch_id, get_patch_tree_size(patch_id_start));
+}
+
 //const std::map<int, std::shared_ptr<PatchTree>>& PatchTreeManager::get_patch_trees() const {
 //    return this->loaded_patchtrees;
 //}
@@ -74,13 +166,15 @@ std::vector<int> PatchTreeManager::get_patch_trees_ids() {
 
 std::shared_ptr<PatchTree> PatchTreeManager::load_patch_tree(int patch_id_start, std::shared_ptr<DictionaryManager> dict) {
     std::unique_lock<std::shared_mutex> lock(mutex);
-    update_cache(patch_id_start);
     auto it = loaded_patchtrees.find(patch_id_start);
     if (it != loaded_patchtrees.end() && it->second) {
+        update_cache(patch_id_start);
         return it->second;
     }
-    loaded_patchtrees[patch_id_start] = std::make_shared<PatchTree>(basePath, patch_id_start, dict, kc_opts, readonly);
-    return loaded_patchtrees[patch_id_start];
+    std::shared_ptr<PatchTree> patchtree = std::make_shared<PatchTree>(basePath, patch_id_start, dict, kc_opts, readonly, addition_codec, deletion_codec);
+    loaded_patchtrees[patch_id_start] = patchtree;
+    update_cache(patch_id_start);
+    return patchtree;
 }
 
 std::shared_ptr<PatchTree> PatchTreeManager::get_patch_tree(int patch_id_start, std::shared_ptr<DictionaryManager> dict) {
@@ -97,10 +191,13 @@ std::shared_ptr<PatchTree> PatchTreeManager::get_patch_tree(int patch_id_start,
     }
     std::shared_ptr<PatchTree> patchtree = it->second;
     if(patchtree == nullptr) {
+        int id = it->first;
         lock.unlock();
-        return load_patch_tree(it->first, dict);
+        return load_patch_tree(id, dict);
     }
-    return it->second;
+    // Cache hit, we only have to record the access, which does not require an exclusive lock
+    touch(it->first);
+    return patchtree;
 }
 
 std::shared_ptr<PatchTree> PatchTreeManager::construct_next_patch_tree(int patch_id_start, std::shared_ptr<DictionaryManager> dict) {
@@ -136,40 +233,139 @@ int PatchTreeManager::get_max_patch_id(std::shared_ptr<DictionaryManager> dict)
         --it;
         std::shared_ptr<PatchTree> patchTree = it->second;
         if (patchTree == nullptr) {
-            lock.unlock();
-            patchTree = load_patch_tree(it->first, dict);
+            // The metadata file is written on each append, and is also what the patch tree would be loaded from,
+            // so the last patch tree does not have to be loaded
+            return PatchTree::read_max_patch_id(basePath, it->first);
         }
+        touch(it->first);
         return patchTree->get_max_patch_id();
     }
     return -1;
 }
 
+std::mutex& PatchTreeManager::get_append_mutex(int patch_id_start) {
+    // Mutexes are never removed from the map, so the reference stays valid after the lock is released
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    return append_mutexes[patch_id_start];
+}
+
+void PatchTreeManager::touch(int patch_id_start) {
+    auto it = last_access.find(patch_id_start);
+    if (it != last_access.end()) {
+        it->second.store(budget->tick(), std::memory_order_relaxed);
+    }
+}
+
+bool PatchTreeManager::freeze_patch_tree(int patch_id_start, std::shared_ptr<DictionaryManager> dict) {
+    std::unique_lock<std::mutex> append_lock(get_append_mutex(patch_id_start));
+    if (readonly || get_patch_tree_id(patch_id_start) != patch_id_start) {
+        return false;
+    }
+    std::shared_ptr<PatchTree> patchtree = get_patch_tree(patch_id_start, dict);
+    if (patchtree == nullptr || !patchtree->freeze()) {
+        return false;
+    }
+    if (manifest != nullptr) {
+        record_patch_tree(patch_id_start, patchtree->get_max_patch_id());
+        manifest->write();
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    loaded_patchtrees[patch_id_start] = nullptr;
+    budget->release(this, patch_id_start);
+    return true;
+}
+
+bool PatchTreeManager::migrate_deletion_summaries(int patch_id_start, std::shared_ptr<DictionaryManager> dict) {
+    std::unique_lock<std::mutex> append_lock(get_append_mutex(patch_id_start));
+    if (get_patch_tree_id(patch_id_start) != patch_id_start) {
+        return false;
+    }
+    std::shared_ptr<PatchTree> patchtree = get_patch_tree(patch_id_start, dict);
+    if (patchtree == nullptr || patchtree->has_deletion_summaries()) {
+        return patchtree != nullptr;
+    }
+    if (!patchtree->migrate_deletion_summaries()) {
+        return false;
+    }
+    // Later accesses load the tree again, from the migrated files
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        loaded_patchtrees[patch_id_start] = nullptr;
+        budget->release(this, patch_id_start);
+    }
+    // Queries can keep using the original tree, which shares its other files with the reloaded tree,
+    // so appends are only allowed again once the original tree has been closed
+    while (!patchtree.unique()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    patchtree = nullptr;
+    return true;
+}
+
 void PatchTreeManager::update_cache(int accessed_patch_id) {
-    update_cache_internal(accessed_patch_id, lru_map.size());
-}
-
-void PatchTreeManager::update_cache_internal(int accessed_id, int iterations) {
-    if (lru_map.size() >= max_loaded_patches) {
-        if (iterations > 0) {
-            int lru_patchtree = lru_list.back();
-            lru_list.pop_back();
-            lru_map.erase(lru_patchtree);
-            if (!loaded_patchtrees[lru_patchtree].unique() || lru_patchtree == accessed_id) {
-                // the patchtree we want to unload is still used somewhere
-                // so we push it to the front of the list
-                lru_list.push_front(lru_patchtree);
-                lru_map[lru_patchtree] = lru_list.begin();
-                update_cache_internal(accessed_id, --iterations);
-            } else {
-                loaded_patchtrees[lru_patchtree] = nullptr;
+    std::atomic<uint64_t>& accessed = last_access[accessed_patch_id];
+    accessed.store(budget->tick(), std::memory_order_relaxed);
+    // The cost is measured again on each load, as the trees of a patch tree grow while patches are appended
+    budget->charge(this, accessed_patch_id, loaded_patchtrees[accessed_patch_id]->get_memory_cost(), &accessed);
+    size_t loaded_count = 0;
+    for (const auto& kv: loaded_patchtrees) {
+        if (kv.second != nullptr) {
+            loaded_count++;
+        }
+    }
+    while (loaded_count > max_loaded_patches) {
+        // Find the least recently used patchtree that is not used anywhere else anymore
+        int lru_patchtree = -1;
+        uint64_t lru_time = std::numeric_limits<uint64_t>::max();
+        for (const auto& kv: loaded_patchtrees) {
+            if (kv.first == accessed_patch_id || kv.second == nullptr || !kv.second.unique()) {
+                continue;
             }
+            auto it_access = last_access.find(kv.first);
+            uint64_t time = it_access != last_access.end() ? it_access->second.load(std::memory_order_relaxed) : 0;
+            if (time < lru_time) {
+                lru_time = time;
+                lru_patchtree = kv.first;
+            }
+        }
+        if (lru_patchtree < 0) {
+            // All other patchtrees are still in use, so we temporarily exceed the cache size
+            break;
         }
+        unload(lru_patchtree);
+        loaded_count--;
+    }
+    budget->enforce(this, accessed_patch_id, [this](int patch_id_start) { return unload(patch_id_start); });
+}
+
+bool PatchTreeManager::unload(int patch_id_start) {
+    auto it = loaded_patchtrees.find(patch_id_start);
+    if (it == loaded_patchtrees.end() || it->second == nullptr || !it->second.unique()) {
+        return false;
     }
-    if (lru_map.find(accessed_id) != lru_map.end()) {
-        lru_list.erase(lru_map[accessed_id]);
+    it->second = nullptr;
+    budget->release(this, patch_id_start);
+    if (manifest != nullptr && !readonly) {
+        // The tree files are only final once the tree has been closed
+        record_patch_tree(patch_id_start, PatchTree::read_max_patch_id(basePath, patch_id_start));
+        manifest->write();
     }
-    lru_list.push_front(accessed_id);
-    lru_map[accessed_id] = lru_list.begin();
+    return true;
+}
+
+bool PatchTreeManager::try_evict(int patch_id_start) {
+    std::unique_lock<std::shared_mutex> lock(mutex, std::try_to_lock);
+    return lock.owns_lock() && unload(patch_id_start);
+}
+
+std::shared_ptr<MemoryBudget> PatchTreeManager::get_memory_budget() const {
+    return budget;
+}
+
+void PatchTreeManager::set_tree_codecs(const TreeCodec& addition_codec, const TreeCodec& deletion_codec) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    this->addition_codec = addition_codec;
+    this->deletion_codec = deletion_codec;
 }
 
 size_t PatchTreeManager::get_cache_max_size() const {
@@ -5,30 +5,87 @@
 #include <map>
 #include <list>
 #include <memory>
+#include <atomic>
+#include <functional>
 #include <shared_mutex>
 #include "patch_tree.h"
+#include "memory_budget.h"
+#include "store_manifest.h"
 
-class PatchTreeManager {
+class PatchTreeManager : public MemoryBudget::Cache {
 private:
     string basePath;
 
     size_t max_loaded_patches;
-    std::list<int> lru_list;
-    std::map<int, std::list<int>::iterator> lru_map;
+    // The memory budget that loaded patch trees are charged to, which may be shared with other caches
+    std::shared_ptr<MemoryBudget> budget;
+    // The manifest that lists the patch trees of the store, can be null
+    std::shared_ptr<StoreManifest> manifest;
+    // Last access time per patch tree id on the clock of the budget, used for LRU eviction.
+    // Access times are atomics, so cache hits only need to take a shared lock.
+    std::map<int, std::atomic<uint64_t>> last_access;
     // Mapping from patchtree_id -> patchTree
     std::map<int, std::shared_ptr<PatchTree>> loaded_patchtrees;
     // Options for KC trees
     int8_t kc_opts;
+    // Codecs for newly created addition and deletion trees
+    TreeCodec addition_codec;
+    TreeCodec deletion_codec;
     bool readonly;
 
     std::shared_mutex mutex;
-    std::mutex append_mutex;
+    // Appends are serialized per patch tree, so that independent delta chains can be appended to concurrently
+    std::map<int, std::mutex> append_mutexes;
 
-    void update_cache_internal(int accessed_id, int iterations);
+    /**
+     * @param patch_id_start The id of a patch tree.
+     * @return The mutex that serializes the appends to the given patch tree.
+     */
+    std::mutex& get_append_mutex(int patch_id_start);
+    /**
+     * Mark the given patch tree as accessed.
+     * This only requires a shared lock on the manager.
+     */
+    void touch(int patch_id_start);
+    /**
+     * Unload the given patch tree if it is not in use anymore.
+     * @note The caller must hold an exclusive lock on this manager.
+     * @return If the patch tree has been unloaded.
+     */
+    bool unload(int patch_id_start);
+    /**
+     * Find all patch trees in the manifest, if it still matches the patch tree files.
+     * This is not the case if the newest patch tree has been changed after the manifest was written,
+     * or if a patch tree exists after a snapshot or version that the manifest does not have a patch tree for.
+     * @return If the patch trees have been found, otherwise they must be detected.
+     */
+    bool read_manifest();
+    /**
+     * @param patch_id_start The id of a patch tree.
+     * @return The summed size of the files of the given patch tree.
+     */
+    size_t get_patch_tree_size(int patch_id_start) const;
+    /**
+     * Add the given patch tree to the manifest, without writing it.
+     * @param patch_id_start The id of the patch tree.
+     * @param max_patch_id The largest patch id in the patch tree.
+     */
+    void record_patch_tree(int patch_id_start, int max_patch_id);
+    /**
+     * Add a patch to the patch tree of the given patch id, creating that patch tree if needed.
+     * @param patch_id The id of the patch to add.
+     * @param dict The dictionary that must be used in the patch tree if a new one will be created.
+     * @param append_patch Appends the patch to the given patch tree, returns if the append succeeded.
+     * @return If the append succeeded.
+     * @note Patches can be appended concurrently to different patch trees,
+     *       as long as the patch tree of each delta chain has been constructed before.
+     */
+    bool append(int patch_id, std::shared_ptr<DictionaryManager> dict, const std::function<bool(PatchTree&)>& append_patch);
 
 public:
-    PatchTreeManager(string basePath, int8_t kc_opts = 0, bool readonly = false, size_t cache_size = 4);
-    ~PatchTreeManager();
+    PatchTreeManager(string basePath, int8_t kc_opts = 0, bool readonly = false, size_t cache_size = 4,
+                     std::shared_ptr<MemoryBudget> budget = nullptr, std::shared_ptr<StoreManifest> manifest = nullptr);
+    ~PatchTreeManager() override;
     /**
      * Add the given patch to a patch tree.
      * @param patch_it The patch iterator with elements to add.
@@ -41,6 +98,7 @@ public:
     bool append(PatchElementIterator* patch_it, int patch_id, std::shared_ptr<DictionaryManager> dict, bool check_uniqueness = true, hdt::ProgressListener* progressListener = nullptr);
     /**
      * Add the given patch to a patch tree.
+     * Large patches are appended in parallel subject ranges if APPEND_PARTITIONS is larger than 1.
      * @param patch The patch to add.
      * @param patch_id The id of the patch to add.
      * @param dict The dictionary that must be used in the patch tree if a new one will be created.
@@ -101,11 +159,44 @@ public:
      * @return The largest patch id that is currently available.
      */
     int get_max_patch_id(std::shared_ptr<DictionaryManager> dict);
+    /**
+     * Rewrite the given patch tree into a compact read-only form.
+     * The tree is unloaded afterwards, so that it is loaded from its frozen form on its next access.
+     * @param patch_id_start The id of the patch tree to freeze, no more patches may be added to it.
+     * @param dict The dictionary of the patch tree.
+     * @return If the patch tree has been frozen.
+     */
+    bool freeze_patch_tree(int patch_id_start, std::shared_ptr<DictionaryManager> dict);
+    /**
+     * Replace the values of the POS and OSP deletion trees of the given patch tree with version summaries.
+     * The patch tree can be queried during the migration, after which it is loaded again from the migrated trees.
+     * This waits until the queries that still use the original patch tree have finished,
+     * so the calling thread must not hold any iterators of it.
+     * @param patch_id_start The id of the patch tree to migrate, it must not be frozen.
+     * @param dict The dictionary of the patch tree.
+     * @return If the deletion trees of the patch tree contain summaries after this call.
+     */
+    bool migrate_deletion_summaries(int patch_id_start, std::shared_ptr<DictionaryManager> dict);
 
     /**
-     * Update the state of the patch cache
+     * Update the state of the patch cache, unloading the least recently used patch trees that are not in use anymore,
+     * until both the maximum number of patch trees and the memory budget are respected.
+     * @note The caller must hold an exclusive lock on this manager.
      */
     void update_cache(int accessed_patch_id);
+    bool try_evict(int patch_id_start) override;
+    /**
+     * @return The memory budget that loaded patch trees are charged to.
+     */
+    std::shared_ptr<MemoryBudget> get_memory_budget() const;
+
+    /**
+     * Set the codecs with which the trees of patch trees that are created from now on are compressed.
+     * Existing patch trees keep the codec they were created with.
+     * @param addition_codec The codec of the addition trees.
+     * @param deletion_codec The codec of the deletion trees.
+     */
+    void set_tree_codecs(const TreeCodec& addition_codec, const TreeCodec& deletion_codec);
 
     size_t get_cache_max_size() const;
 
@@ -10,10 +10,11 @@ PositionedTripleIterator::~PositionedTripleIterator() {
 
 bool PositionedTripleIterator::next(PositionedTriple *positioned_triple, bool silent_step, bool get_position) {
     PatchTreeKey key;
+    // Only the positions of our patch are needed, so we avoid deserializing the whole value
 #ifdef COMPRESSED_DEL_VALUES
-    PatchTreeDeletionValue value(patch_id);
+    PatchTreeDeletionValueView value(patch_id);
 #else
-    PatchTreeDeletionValue value;
+    PatchTreeDeletionValueView value;
 #endif
     bool ret = it->next_deletion(&key, &value, silent_step);
     if(ret) {
@@ -0,0 +1,42 @@
+#include <algorithm>
+
+#include "serialization_arena.h"
+
+std::atomic<long long> SerializationArena::heap_allocations(0);
+
+SerializationArena::Scope::Scope(SerializationArena& arena) : arena(arena), block(arena.block), offset(arena.offset) {}
+
+SerializationArena::Scope::~Scope() {
+    arena.block = block;
+    arena.offset = offset;
+}
+
+SerializationArena::SerializationArena() : block(0), offset(0) {}
+
+char* SerializationArena::allocate(size_t size) {
+    if (block < blocks.size() && offset + size <= blocks[block].size) {
+        char* data = blocks[block].data.get() + offset;
+        offset += size;
+        return data;
+    }
+    // Continue in the next block, and only insert a new one if there is none, or if it is too small.
+    // Blocks are never removed, and new blocks are only inserted after the current one, so outer scopes remain valid.
+    size_t next = block < blocks.size() ? block + 1 : block;
+    if (next >= blocks.size() || blocks[next].size < size) {
+        size_t block_size = std::max(size, (size_t) SERIALIZATION_ARENA_BLOCK_SIZE);
+        blocks.insert(blocks.begin() + next, Block{std::unique_ptr<char[]>(new char[block_size]), block_size});
+        heap_allocations++;
+    }
+    block = next;
+    offset = size;
+    return blocks[block].data.get();
+}
+
+SerializationArena& SerializationArena::local() {
+    thread_local SerializationArena arena;
+    return arena;
+}
+
+long long SerializationArena::get_heap_allocations() {
+    return heap_allocations;
+}
@@ -0,0 +1,82 @@
+#ifndef OSTRICH_SERIALIZATION_ARENA_H
+#define OSTRICH_SERIALIZATION_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// The minimal size of the blocks an arena allocates (64KB)
+#ifndef SERIALIZATION_ARENA_BLOCK_SIZE
+#define SERIALIZATION_ARENA_BLOCK_SIZE (1 << 16)
+#endif
+
+
+/**
+ * A bump allocator for the short-lived buffers into which keys and values are serialized before they are passed to KC.
+ * Each thread has its own arena, and buffers are released all at once when the scope that allocated them ends,
+ * so that once an arena has grown large enough, serializing does not allocate on the heap anymore.
+ */
+class SerializationArena {
+private:
+    typedef struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    } Block;
+
+    std::vector<Block> blocks;
+    size_t block;
+    size_t offset;
+
+    static std::atomic<long long> heap_allocations;
+public:
+    /**
+     * Releases all buffers that were allocated in an arena during the lifetime of this scope.
+     * Scopes can be nested.
+     */
+    class Scope {
+    private:
+        SerializationArena& arena;
+        size_t block;
+        size_t offset;
+    public:
+        explicit Scope(SerializationArena& arena = SerializationArena::local());
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    SerializationArena();
+    SerializationArena(const SerializationArena&) = delete;
+    SerializationArena& operator=(const SerializationArena&) = delete;
+    /**
+     * Allocate a buffer, which remains valid until the current scope ends.
+     * @param size The size of the buffer.
+     * @return The buffer.
+     */
+    char* allocate(size_t size);
+    /**
+     * Serialize an object into a buffer of this arena.
+     * @tparam T The object type, which must have the max_serialization_size() and serialize(char*) methods.
+     * @param object The object to serialize.
+     * @param size This will contain the size of the returned byte array.
+     * @return The byte array, which remains valid until the current scope ends.
+     */
+    template <class T>
+    const char* serialize(const T& object, size_t* size) {
+        char* data = allocate(object.max_serialization_size());
+        *size = object.serialize(data);
+        return data;
+    }
+    /**
+     * @return The arena of the current thread.
+     */
+    static SerializationArena& local();
+    /**
+     * @return The number of heap allocations that were done by all arenas.
+     */
+    static long long get_heap_allocations();
+};
+
+
+#endif //OSTRICH_SERIALIZATION_ARENA_H
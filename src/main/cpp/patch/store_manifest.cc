@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#include "store_manifest.h"
+
+StoreManifest::StoreManifest(std::string base_path, bool readonly)
+        : base_path(std::move(base_path)), readonly(readonly), loaded(false) {
+    loaded = read();
+}
+
+bool StoreManifest::read() {
+    std::ifstream file(base_path + STORE_MANIFEST_FILENAME);
+    if (!file.good()) {
+        return false;
+    }
+    std::string magic;
+    int version;
+    if (!(file >> magic >> version) || magic != "ostrich-manifest" || version != STORE_MANIFEST_VERSION) {
+        return false;
+    }
+    std::map<int, size_t> read_snapshots;
+    std::map<int, PatchTreeEntry> read_patch_trees;
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        std::istringstream entry(line);
+        std::string type;
+        int id;
+        entry >> type >> id;
+        if (type == "snapshot") {
+            size_t size;
+            if (!(entry >> size)) {
+                return false;
+            }
+            read_snapshots[id] = size;
+        } else if (type == "patchtree") {
+            PatchTreeEntry patch_tree{};
+            if (!(entry >> patch_tree.max_patch_id >> patch_tree.size)) {
+                return false;
+            }
+            read_patch_trees[id] = patch_tree;
+        } else if (type == "end") {
+            // Only a manifest that was written completely is used
+            snapshots = read_snapshots;
+            patch_trees = read_patch_trees;
+            return true;
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool StoreManifest::is_loaded() const {
+    return loaded;
+}
+
+std::map<int, size_t> StoreManifest::get_snapshots() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return snapshots;
+}
+
+std::map<int, StoreManifest::PatchTreeEntry> StoreManifest::get_patch_trees() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return patch_trees;
+}
+
+void StoreManifest::set_snapshot(int snapshot_id, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    snapshots[snapshot_id] = size;
+}
+
+void StoreManifest::set_patch_tree(int patch_tree_id, int max_patch_id, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    patch_trees[patch_tree_id] = PatchTreeEntry{max_patch_id, size};
+}
+
+bool StoreManifest::write() const {
+    if (readonly) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string file_name = base_path + STORE_MANIFEST_FILENAME;
+    std::string temp_file_name = file_name + ".tmp";
+    {
+        std::ofstream file(temp_file_name, std::ios::trunc);
+        file << "ostrich-manifest " << STORE_MANIFEST_VERSION << "\n";
+        for (const auto& snapshot : snapshots) {
+            file << "snapshot " << snapshot.first << " " << snapshot.second << "\n";
+        }
+        for (const auto& patch_tree : patch_trees) {
+            file << "patchtree " << patch_tree.first << " " << patch_tree.second.max_patch_id << " "
+                 << patch_tree.second.size << "\n";
+        }
+        file << "end\n";
+        file.flush();
+        if (!file.good()) {
+            std::remove(temp_file_name.c_str());
+            return false;
+        }
+    }
+    // The rename replaces the previous manifest at once, so readers never see a partially written manifest
+    return std::rename(temp_file_name.c_str(), file_name.c_str()) == 0;
+}
+
+void StoreManifest::cleanup(const std::string& base_path) {
+    std::remove((base_path + STORE_MANIFEST_FILENAME).c_str());
+    std::remove((base_path + STORE_MANIFEST_FILENAME ".tmp").c_str());
+}
@@ -0,0 +1,85 @@
+#ifndef OSTRICH_STORE_MANIFEST_H
+#define OSTRICH_STORE_MANIFEST_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+
+#define STORE_MANIFEST_FILENAME "manifest.dat"
+#define STORE_MANIFEST_VERSION 1
+
+
+/**
+ * A single file that lists the snapshots and patch trees of a store, so that a store can be opened without scanning
+ * its directory and reading the metadata file of each patch tree.
+ * The manifest is rewritten atomically after each change, by writing a temporary file that replaces the previous one.
+ * Stores without a manifest are scanned as before, after which a writable store gets a manifest.
+ * The managers check that the newest entry of their part of the manifest still matches the files,
+ * and scan the store if it does not.
+ */
+class StoreManifest {
+public:
+    typedef struct PatchTreeEntry {
+        int max_patch_id;
+        size_t size;
+    } PatchTreeEntry;
+
+private:
+    std::string base_path;
+    bool readonly;
+    bool loaded;
+    // Mapping from snapshot id -> size of the HDT file
+    std::map<int, size_t> snapshots;
+    // Mapping from patch tree id -> largest patch id and size of the trees
+    std::map<int, PatchTreeEntry> patch_trees;
+    mutable std::mutex mutex;
+
+    /**
+     * Read the manifest file.
+     * @return If the file exists and has the current version.
+     */
+    bool read();
+
+public:
+    StoreManifest(std::string base_path, bool readonly);
+    /**
+     * @return If the snapshots and patch trees have been read from an existing manifest,
+     *         otherwise they must be detected from the files of the store.
+     */
+    bool is_loaded() const;
+    /**
+     * @return The sizes of the HDT files of the snapshots, by snapshot id.
+     */
+    std::map<int, size_t> get_snapshots() const;
+    /**
+     * @return The largest patch ids and tree sizes of the patch trees, by patch tree id.
+     */
+    std::map<int, PatchTreeEntry> get_patch_trees() const;
+    /**
+     * Add or update a snapshot, without writing the manifest.
+     * @param snapshot_id The id of the snapshot.
+     * @param size The size of the HDT file of the snapshot.
+     */
+    void set_snapshot(int snapshot_id, size_t size);
+    /**
+     * Add or update a patch tree, without writing the manifest.
+     * @param patch_tree_id The id of the patch tree, which is the id of its first patch.
+     * @param max_patch_id The largest patch id in the patch tree.
+     * @param size The total size of the trees of the patch tree.
+     */
+    void set_patch_tree(int patch_tree_id, int max_patch_id, size_t size);
+    /**
+     * Write the manifest file, which replaces the previous one at once.
+     * @return If the manifest has been written, which is never the case for read-only stores.
+     */
+    bool write() const;
+    /**
+     * Remove the manifest of the store in the given directory.
+     * @param base_path The directory of the store.
+     */
+    static void cleanup(const std::string& base_path);
+};
+
+
+#endif //OSTRICH_STORE_MANIFEST_H
@@ -0,0 +1,328 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <kccompress.h>
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+#include "tree_codec.h"
+
+
+#ifdef USE_LZ4
+// LZ4 block compressor, the decompressed size is stored in front of each block.
+class LZ4Compressor : public kyotocabinet::Compressor {
+public:
+    char* compress(const void* buf, size_t size, size_t* sp) override {
+        int bound = LZ4_compressBound((int) size);
+        char* data = new char[sizeof(uint32_t) + bound];
+        uint32_t original_size = (uint32_t) size;
+        std::memcpy(data, &original_size, sizeof(uint32_t));
+        int compressed_size = LZ4_compress_default((const char*) buf, data + sizeof(uint32_t), (int) size, bound);
+        if (compressed_size <= 0) {
+            delete[] data;
+            return nullptr;
+        }
+        *sp = sizeof(uint32_t) + compressed_size;
+        return data;
+    }
+    char* decompress(const void* buf, size_t size, size_t* sp) override {
+        if (size < sizeof(uint32_t)) {
+            return nullptr;
+        }
+        uint32_t original_size;
+        std::memcpy(&original_size, buf, sizeof(uint32_t));
+        char* data = new char[original_size + 1];
+        int decompressed_size = LZ4_decompress_safe((const char*) buf + sizeof(uint32_t), data,
+                                                    (int) (size - sizeof(uint32_t)), (int) original_size);
+        if (decompressed_size < 0 || (uint32_t) decompressed_size != original_size) {
+            delete[] data;
+            return nullptr;
+        }
+        // KC expects a terminating zero after decompressed data
+        data[original_size] = '\0';
+        *sp = original_size;
+        return data;
+    }
+};
+#endif
+
+#ifdef USE_ZSTD
+// Zstd compression and decompression contexts, which can not be shared between threads.
+struct ZstdContexts {
+    ZSTD_CCtx* cctx;
+    ZSTD_DCtx* dctx;
+    ZstdContexts() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()) {}
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+};
+
+// Zstd frame compressor, optionally with a trained dictionary.
+class ZstdCompressor : public kyotocabinet::Compressor {
+private:
+    int level;
+    ZSTD_CDict* cdict;
+    ZSTD_DDict* ddict;
+    static ZstdContexts& get_contexts() {
+        static thread_local ZstdContexts contexts;
+        return contexts;
+    }
+public:
+    ZstdCompressor(int level, const std::string& trained_dictionary) : level(level), cdict(nullptr), ddict(nullptr) {
+        if (!trained_dictionary.empty()) {
+            cdict = ZSTD_createCDict(trained_dictionary.data(), trained_dictionary.size(), level);
+            ddict = ZSTD_createDDict(trained_dictionary.data(), trained_dictionary.size());
+        }
+    }
+    ~ZstdCompressor() override {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+    }
+    char* compress(const void* buf, size_t size, size_t* sp) override {
+        size_t bound = ZSTD_compressBound(size);
+        char* data = new char[bound];
+        size_t compressed_size = cdict != nullptr
+                ? ZSTD_compress_usingCDict(get_contexts().cctx, data, bound, buf, size, cdict)
+                : ZSTD_compressCCtx(get_contexts().cctx, data, bound, buf, size, level);
+        if (ZSTD_isError(compressed_size)) {
+            delete[] data;
+            return nullptr;
+        }
+        *sp = compressed_size;
+        return data;
+    }
+    char* decompress(const void* buf, size_t size, size_t* sp) override {
+        unsigned long long original_size = ZSTD_getFrameContentSize(buf, size);
+        if (original_size == ZSTD_CONTENTSIZE_ERROR || original_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+            return nullptr;
+        }
+        char* data = new char[original_size + 1];
+        size_t decompressed_size = ddict != nullptr
+                ? ZSTD_decompress_usingDDict(get_contexts().dctx, data, original_size, buf, size, ddict)
+                : ZSTD_decompressDCtx(get_contexts().dctx, data, original_size, buf, size);
+        if (ZSTD_isError(decompressed_size) || decompressed_size != original_size) {
+            delete[] data;
+            return nullptr;
+        }
+        // KC expects a terminating zero after decompressed data
+        data[original_size] = '\0';
+        *sp = original_size;
+        return data;
+    }
+};
+#endif
+
+
+TreeCodec::TreeCodec(TreeCodecType type, int level, bool dictionary) : type(type), level(level), dictionary(dictionary) {}
+
+TreeCodec TreeCodec::parse(const std::string& name) {
+    size_t separator = name.find(':');
+    std::string type_name = name.substr(0, separator);
+    int level = separator == std::string::npos ? ZSTD_DEFAULT_LEVEL : std::stoi(name.substr(separator + 1));
+    TreeCodec codec;
+    if (type_name == "default") {
+        codec = TreeCodec(TREE_CODEC_DEFAULT);
+    } else if (type_name == "none") {
+        codec = TreeCodec(TREE_CODEC_NONE);
+    } else if (type_name == "zlib") {
+        codec = TreeCodec(TREE_CODEC_ZLIB);
+    } else if (type_name == "lzo") {
+        codec = TreeCodec(TREE_CODEC_LZO);
+    } else if (type_name == "lzma") {
+        codec = TreeCodec(TREE_CODEC_LZMA);
+    } else if (type_name == "lz4") {
+        codec = TreeCodec(TREE_CODEC_LZ4);
+    } else if (type_name == "zstd") {
+        codec = TreeCodec(TREE_CODEC_ZSTD, level);
+    } else if (type_name == "zstd-dict") {
+        codec = TreeCodec(TREE_CODEC_ZSTD, level, true);
+    } else {
+        throw std::invalid_argument("Unknown tree codec: " + name);
+    }
+    if (!is_available(codec.type)) {
+        throw std::invalid_argument("Tree codec is not available in this build: " + name);
+    }
+    return codec;
+}
+
+std::string TreeCodec::to_string() const {
+    switch (type) {
+        case TREE_CODEC_NONE: return "none";
+        case TREE_CODEC_ZLIB: return "zlib";
+        case TREE_CODEC_LZO: return "lzo";
+        case TREE_CODEC_LZMA: return "lzma";
+        case TREE_CODEC_LZ4: return "lz4";
+        case TREE_CODEC_ZSTD: return (dictionary ? "zstd-dict:" : "zstd:") + std::to_string(level);
+        default: return "default";
+    }
+}
+
+TreeCodecType TreeCodec::get_type() const {
+    return type;
+}
+
+bool TreeCodec::is_available(TreeCodecType type) {
+#ifndef USE_LZ4
+    if (type == TREE_CODEC_LZ4) return false;
+#endif
+#ifndef USE_ZSTD
+    if (type == TREE_CODEC_ZSTD) return false;
+#endif
+    return true;
+}
+
+int8_t TreeCodec::get_options(int8_t kc_opts) const {
+    if (type == TREE_CODEC_DEFAULT) {
+        return kc_opts;
+    }
+    if (type == TREE_CODEC_NONE) {
+        return kc_opts & ~kyotocabinet::TreeDB::TCOMPRESS;
+    }
+    return kc_opts | kyotocabinet::TreeDB::TCOMPRESS;
+}
+
+kyotocabinet::Compressor* TreeCodec::create_compressor(const std::string& trained_dictionary) const {
+    switch (type) {
+        case TREE_CODEC_ZLIB: return new kyotocabinet::ZLIBCompressor<kyotocabinet::ZLIB::RAW>();
+        case TREE_CODEC_LZO: return new kyotocabinet::LZOCompressor<kyotocabinet::LZO::RAW>();
+        case TREE_CODEC_LZMA: return new kyotocabinet::LZMACompressor<kyotocabinet::LZMA::RAW>();
+#ifdef USE_LZ4
+        case TREE_CODEC_LZ4: return new LZ4Compressor();
+#endif
+#ifdef USE_ZSTD
+        case TREE_CODEC_ZSTD: return new ZstdCompressor(level, dictionary ? trained_dictionary : "");
+#endif
+        default: return nullptr;
+    }
+}
+
+kyotocabinet::Compressor* TreeCodec::tune(kyotocabinet::TreeDB* db, const std::string& file_name, int8_t kc_opts) const {
+    db->tune_options(get_options(kc_opts));
+    std::string trained_dictionary;
+    if (dictionary) {
+        std::ifstream dictionary_file(file_name + "_dict", std::ios::binary);
+        if (dictionary_file.good()) {
+            trained_dictionary.assign(std::istreambuf_iterator<char>(dictionary_file), std::istreambuf_iterator<char>());
+        }
+    }
+    kyotocabinet::Compressor* compressor = create_compressor(trained_dictionary);
+    if (compressor != nullptr) {
+        db->tune_compressor(compressor);
+    }
+    return compressor;
+}
+
+bool TreeCodec::copy_tree(kyotocabinet::TreeDB* db, kyotocabinet::Comparator* comparator, const std::string& file_name, int32_t page_size,
+                          const std::function<std::string(const char* kbp, size_t ksp, const char* vbp, size_t vsp)>& transform) const {
+    db->synchronize();
+    std::remove((file_name + "_dict").c_str());
+    std::string trained_dictionary;
+    if (dictionary) {
+        trained_dictionary = train_dictionary(db);
+        if (!trained_dictionary.empty()) {
+            std::ofstream dictionary_file(file_name + "_dict", std::ios::binary | std::ios::trunc);
+            dictionary_file.write(trained_dictionary.data(), trained_dictionary.size());
+        }
+    }
+    std::unique_ptr<kyotocabinet::Compressor> compressor(create_compressor(trained_dictionary));
+
+    kyotocabinet::TreeDB copy_db;
+    copy_db.tune_comparator(comparator);
+    copy_db.tune_options(get_options(kyotocabinet::TreeDB::TCOMPRESS));
+    if (compressor != nullptr) {
+        copy_db.tune_compressor(compressor.get());
+    }
+    if (page_size > 0) {
+        copy_db.tune_page(page_size);
+    }
+    if (!copy_db.open(file_name, kyotocabinet::TreeDB::OWRITER | kyotocabinet::TreeDB::OCREATE | kyotocabinet::TreeDB::OTRUNCATE)) {
+        std::cerr << "open " << file_name << " error: " << copy_db.error().name() << std::endl;
+        return false;
+    }
+    // Records are inserted in key order, so pages are only ever appended to
+    kyotocabinet::DB::Cursor* cursor = db->cursor();
+    cursor->jump();
+    const char* kbp;
+    const char* vbp;
+    size_t ksp, vsp;
+    bool ok = true;
+    while (ok && (kbp = cursor->get(&ksp, &vbp, &vsp, true)) != nullptr) {
+        if (transform) {
+            std::string value = transform(kbp, ksp, vbp, vsp);
+            ok = copy_db.set(kbp, ksp, value.data(), value.size());
+        } else {
+            ok = copy_db.set(kbp, ksp, vbp, vsp);
+        }
+        delete[] kbp;
+    }
+    delete cursor;
+    if (!copy_db.close() || !ok) {
+        std::cerr << "copy " << file_name << " error: " << copy_db.error().name() << std::endl;
+        std::remove(file_name.c_str());
+        std::remove((file_name + "_dict").c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string TreeCodec::train_dictionary(kyotocabinet::TreeDB* db) {
+#ifdef USE_ZSTD
+    // Sample records evenly over the whole tree
+    int64_t count = db->count();
+    int64_t bytes = db->size();
+    int64_t step = bytes > ZSTD_DICTIONARY_SAMPLES_SIZE ? bytes / ZSTD_DICTIONARY_SAMPLES_SIZE + 1 : 1;
+    std::string samples;
+    std::vector<size_t> sample_sizes;
+    kyotocabinet::DB::Cursor* cursor = db->cursor();
+    cursor->jump();
+    const char* kbp;
+    const char* vbp;
+    size_t ksp, vsp;
+    for (int64_t i = 0; i < count && samples.size() < ZSTD_DICTIONARY_SAMPLES_SIZE
+                        && (kbp = cursor->get(&ksp, &vbp, &vsp, true)) != nullptr; i++) {
+        if (i % step == 0) {
+            samples.append(kbp, ksp);
+            samples.append(vbp, vsp);
+            sample_sizes.push_back(ksp + vsp);
+        }
+        delete[] kbp;
+    }
+    delete cursor;
+    std::string trained_dictionary(ZSTD_DICTIONARY_SIZE, '\0');
+    size_t size = ZDICT_trainFromBuffer(&trained_dictionary[0], trained_dictionary.size(), samples.data(),
+                                        sample_sizes.data(), (unsigned) sample_sizes.size());
+    // Training fails if there are too few samples, the tree is then compressed without dictionary
+    if (ZDICT_isError(size)) {
+        return "";
+    }
+    trained_dictionary.resize(size);
+    return trained_dictionary;
+#else
+    return "";
+#endif
+}
+
+bool TreeCodec::read(const std::string& file_name, TreeCodec* codec) {
+    std::ifstream codec_file(file_name);
+    std::string name;
+    if (!codec_file.good() || !std::getline(codec_file, name)) {
+        return false;
+    }
+    *codec = parse(name);
+    return true;
+}
+
+void TreeCodec::write(const std::string& file_name) const {
+    std::ofstream codec_file(file_name, std::ios::trunc);
+    codec_file << to_string() << std::endl;
+}
@@ -0,0 +1,122 @@
+#ifndef OSTRICH_TREE_CODEC_H
+#define OSTRICH_TREE_CODEC_H
+
+#include <functional>
+#include <string>
+#include <kchashdb.h>
+
+// The default zstd compression level
+#ifndef ZSTD_DEFAULT_LEVEL
+#define ZSTD_DEFAULT_LEVEL 3
+#endif
+// The maximum size of a trained zstd dictionary (64KB)
+#ifndef ZSTD_DICTIONARY_SIZE
+#define ZSTD_DICTIONARY_SIZE (1 << 16)
+#endif
+// The maximum number of bytes of records that are sampled to train a zstd dictionary (16MB)
+#ifndef ZSTD_DICTIONARY_SAMPLES_SIZE
+#define ZSTD_DICTIONARY_SAMPLES_SIZE (1 << 24)
+#endif
+
+enum TreeCodecType {
+    // Compress with the KC default (zlib) if the KC options contain TCOMPRESS
+    TREE_CODEC_DEFAULT,
+    TREE_CODEC_NONE,
+    TREE_CODEC_ZLIB,
+    TREE_CODEC_LZO,
+    TREE_CODEC_LZMA,
+    // Only available if compiled with USE_LZ4
+    TREE_CODEC_LZ4,
+    // Only available if compiled with USE_ZSTD
+    TREE_CODEC_ZSTD,
+};
+
+
+/**
+ * The block compression codec with which the pages of a tree are compressed.
+ * Codecs are plugged into KC trees through its Compressor interface.
+ */
+class TreeCodec {
+private:
+    TreeCodecType type;
+    int level;
+    bool dictionary;
+public:
+    /**
+     * @param type The codec type.
+     * @param level The compression level, only used by zstd.
+     * @param dictionary If a dictionary should be trained on the records of a tree when it is rewritten, only used by zstd.
+     */
+    explicit TreeCodec(TreeCodecType type = TREE_CODEC_DEFAULT, int level = ZSTD_DEFAULT_LEVEL, bool dictionary = false);
+    /**
+     * Parse a codec from its name.
+     * @param name One of 'default', 'none', 'zlib', 'lzo', 'lzma', 'lz4', 'zstd' or 'zstd-dict',
+     *             zstd codecs can be suffixed with a level, such as 'zstd:9'.
+     * @return The codec.
+     * @throws std::invalid_argument If the name is unknown, or if the codec is not available in this build.
+     */
+    static TreeCodec parse(const std::string& name);
+    /**
+     * @return The name of this codec, which can be parsed again.
+     */
+    std::string to_string() const;
+    TreeCodecType get_type() const;
+    /**
+     * @param type A codec type.
+     * @return If the codec type is available in this build.
+     */
+    static bool is_available(TreeCodecType type);
+    /**
+     * @param kc_opts The KC tree options that were requested.
+     * @return The KC tree options for a tree compressed with this codec.
+     */
+    int8_t get_options(int8_t kc_opts) const;
+    /**
+     * Create a compressor for this codec.
+     * @param trained_dictionary A dictionary that was trained for the tree, empty if none.
+     * @return The compressor, or null if the KC default compressor should be used, or if no compression is needed.
+     */
+    kyotocabinet::Compressor* create_compressor(const std::string& trained_dictionary = "") const;
+    /**
+     * Set the options and compressor of this codec on a tree that has not been opened yet.
+     * The trained dictionary of the tree, if any, is read from the file name with suffix '_dict'.
+     * @param db The tree.
+     * @param file_name The file of the tree.
+     * @param kc_opts The KC tree options that were requested.
+     * @return The compressor, which must be deleted after the tree is closed, can be null.
+     */
+    kyotocabinet::Compressor* tune(kyotocabinet::TreeDB* db, const std::string& file_name, int8_t kc_opts) const;
+    /**
+     * Copy all records of a tree in order into a new compact tree compressed with this codec.
+     * If this codec uses a dictionary, it is trained on the records, and written to the file name with suffix '_dict'.
+     * @param db The tree to copy.
+     * @param comparator The comparator of the tree.
+     * @param file_name The file of the new tree, which will be overwritten.
+     * @param page_size The page size of the new tree, 0 for the default KC page size.
+     * @param transform An optional function that determines the value of each copied record from its key and original value.
+     * @return If the copy succeeded.
+     */
+    bool copy_tree(kyotocabinet::TreeDB* db, kyotocabinet::Comparator* comparator, const std::string& file_name, int32_t page_size,
+                   const std::function<std::string(const char* kbp, size_t ksp, const char* vbp, size_t vsp)>& transform = nullptr) const;
+    /**
+     * Train a compression dictionary on a sample of the records of a tree.
+     * @param db The tree.
+     * @return The dictionary, empty if it could not be trained.
+     */
+    static std::string train_dictionary(kyotocabinet::TreeDB* db);
+    /**
+     * Read a persisted codec.
+     * @param file_name The codec file.
+     * @param codec The codec to read into.
+     * @return If the file existed.
+     */
+    static bool read(const std::string& file_name, TreeCodec* codec);
+    /**
+     * Persist this codec.
+     * @param file_name The codec file.
+     */
+    void write(const std::string& file_name) const;
+};
+
+
+#endif //OSTRICH_TREE_CODEC_H
@@ -49,47 +49,40 @@ string Triple::to_string(hdt::Dictionary& dict) const {
 }
 
 const char* Triple::serialize(size_t* size) const {
+    char* bytes = new char[max_serialization_size()];
+    *size = serialize(bytes);
+    return bytes;
+}
+
+size_t Triple::serialize(char* data) const {
 #ifdef USE_VSI_T
-    size_t alloc_size = get_ULEB128_size(std::numeric_limits<size_t>::max()) * 3;
+    size_t offset = encode_ULEB128(subject, (uint8_t*) data);
+    offset += encode_ULEB128(predicate, (uint8_t*) data + offset);
+    offset += encode_ULEB128(object, (uint8_t*) data + offset);
+    return offset;
 #else
-    size_t alloc_size = sizeof(subject) + sizeof(predicate) + sizeof(object);
+    std::memcpy(data, &subject, sizeof(subject));
+    std::memcpy(&data[sizeof(subject)], &predicate, sizeof(predicate));
+    std::memcpy(&data[sizeof(subject) + sizeof(predicate)], &object, sizeof(object));
+    return sizeof(subject) + sizeof(predicate) + sizeof(object);
 #endif
-    char* bytes = new char[alloc_size];
+}
+
+size_t Triple::max_serialization_size() {
 #ifdef USE_VSI_T
-    size_t offset = 0;
-    std::vector<uint8_t> buffer;
-
-    encode_ULEB128(subject, buffer);
-    std::memcpy(bytes, buffer.data(), buffer.size());
-    offset += buffer.size();
-    buffer.clear();
-
-    encode_ULEB128(predicate, buffer);
-    std::memcpy(bytes+offset, buffer.data(), buffer.size());
-    offset += buffer.size();
-    buffer.clear();
-
-    encode_ULEB128(object, buffer);
-    std::memcpy(bytes+offset, buffer.data(), buffer.size());
-    offset += buffer.size();
-    *size = offset;
+    return get_ULEB128_size(std::numeric_limits<size_t>::max()) * 3;
 #else
-    std::memcpy(bytes, &subject, sizeof(subject));
-    std::memcpy(&bytes[sizeof(subject)], &predicate, sizeof(predicate));
-    std::memcpy(&bytes[sizeof(subject) + sizeof(predicate)], &object, sizeof(object));
-    *size = alloc_size;
+    return sizeof(size_t) * 3;
 #endif
-    return bytes;
 }
 
 void Triple::deserialize(const char* data, size_t size) {
 #ifdef USE_VSI_T
-    size_t read_size, offset;
-    subject = decode_ULEB128((const uint8_t*) data, &read_size);
-    offset = read_size;
-    predicate = decode_ULEB128((const uint8_t*) data+offset, &read_size);
-    offset += read_size;
-    object = decode_ULEB128((const uint8_t*) data+offset, &read_size);
+    uint64_t components[3] = {0, 0, 0};
+    decode_ULEB128_block((const uint8_t*) data, size, components, 3);
+    subject = components[0];
+    predicate = components[1];
+    object = components[2];
 #else
     std::memcpy(&subject, data,  sizeof(subject));
     std::memcpy(&predicate, &data[sizeof(subject)],  sizeof(predicate));
@@ -138,31 +131,36 @@ TripleVersion::TripleVersion(): patch_id(0), triple(Triple()) {}
 
 TripleVersion::TripleVersion(int patch_id, const Triple& triple) : patch_id(patch_id), triple(triple) {}
 
+int TripleVersion::get_patch_id() const {
+    return patch_id;
+}
+
+const Triple& TripleVersion::get_triple() const {
+    return triple;
+}
+
 const char *TripleVersion::serialize(size_t *size) const {
-    *size = 0;
+    char* bytes = new char[max_serialization_size()];
+    *size = serialize(bytes);
+    return bytes;
+}
+
+size_t TripleVersion::serialize(char *data) const {
 #ifdef USE_VSI
-    size_t alloc_size = get_SLEB128_size(std::numeric_limits<int>::max()) + get_ULEB128_size(std::numeric_limits<size_t>::max()) * 3;
+    size_t size = encode_SLEB128(patch_id, (uint8_t*) data);
 #else
-    size_t alloc_size = sizeof(patch_id) + sizeof(size_t) * 3;
+    std::memcpy(data, &patch_id, sizeof(patch_id));
+    size_t size = sizeof(patch_id);
 #endif
-    char* bytes = new char[alloc_size];
+    return size + triple.serialize(data + size);
+}
+
+size_t TripleVersion::max_serialization_size() {
 #ifdef USE_VSI
-    std::vector<uint8_t> buffer;
-    encode_SLEB128(patch_id, buffer);
-    *size += buffer.size();
-    std::memcpy(bytes, buffer.data(), buffer.size());
+    return get_SLEB128_size(std::numeric_limits<int>::max()) + Triple::max_serialization_size();
 #else
-    std::memcpy(bytes, &patch_id, sizeof(patch_id));
-    *size += sizeof(patch_id);
+    return sizeof(int) + Triple::max_serialization_size();
 #endif
-    size_t ts;
-    const char* triple_data = triple.serialize(&ts);
-
-    std::memcpy(bytes+*size, triple_data, ts);
-    *size += ts;
-    delete[] triple_data;
-
-    return bytes;
 }
 
 void TripleVersion::deserialize(const char *data, size_t size) {
@@ -257,6 +255,25 @@ void TripleVersions::set_dictionary(std::shared_ptr<DictionaryManager> dictionar
 }
 
 
+TripleVersionsBitmap::TripleVersionsBitmap() : dict(nullptr) {}
+
+Triple* TripleVersionsBitmap::get_triple() {
+    return &triple;
+}
+
+std::vector<bool>* TripleVersionsBitmap::get_bitmap() {
+    return &bitmap;
+}
+
+std::shared_ptr<DictionaryManager> TripleVersionsBitmap::get_dictionary() const {
+    return dict;
+}
+
+void TripleVersionsBitmap::set_dictionary(std::shared_ptr<DictionaryManager> dictionary) {
+    dict = dictionary;
+}
+
+
 TripleVersionsString::TripleVersionsString() = default;
 
 TripleVersionsString::TripleVersionsString(StringTriple triple, std::vector<int> versions) : triple(
@@ -72,6 +72,18 @@ public:
      */
     const char *serialize(size_t *size) const;
 
+    /**
+     * Serialize this value into the given byte array
+     * @param data The byte array, of at least max_serialization_size() bytes
+     * @return The number of bytes written
+     */
+    size_t serialize(char *data) const;
+
+    /**
+     * @return An upper bound on the size of a serialized value
+     */
+    static size_t max_serialization_size();
+
     /**
      * Deserialize the given byte array to this object.
      * @param data The data to deserialize from.
@@ -110,6 +122,8 @@ protected:
 public:
     TripleVersion();
     TripleVersion(int patch_id, const Triple &triple);
+    int get_patch_id() const;
+    const Triple& get_triple() const;
 
     /**
      * Serialize this value to a byte array
@@ -117,6 +131,18 @@ public:
      * @return The byte array
      */
     const char *serialize(size_t *size) const;
+
+    /**
+     * Serialize this value into the given byte array
+     * @param data The byte array, of at least max_serialization_size() bytes
+     * @return The number of bytes written
+     */
+    size_t serialize(char *data) const;
+
+    /**
+     * @return An upper bound on the size of a serialized value
+     */
+    static size_t max_serialization_size();
     /**
      * Deserialize the given byte array to this object.
      * @param data The data to deserialize from.
@@ -181,6 +207,21 @@ public:
     void set_dictionary(std::shared_ptr<DictionaryManager> dictionary);
 };
 
+// Triple annotated with a bitmap over a list of requested versions,
+// where bit i is set if the triple exists in the i-th requested version.
+class TripleVersionsBitmap {
+protected:
+    Triple triple;
+    std::vector<bool> bitmap;
+    std::shared_ptr<DictionaryManager> dict;
+public:
+    TripleVersionsBitmap();
+    Triple* get_triple();
+    std::vector<bool>* get_bitmap();
+    std::shared_ptr<DictionaryManager> get_dictionary() const;
+    void set_dictionary(std::shared_ptr<DictionaryManager> dictionary);
+};
+
 class TripleVersionsString {
 protected:
     StringTriple triple;
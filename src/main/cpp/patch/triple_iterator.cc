@@ -9,6 +9,20 @@ bool EmptyTripleIterator::next(Triple *triple) {
     return false;
 }
 
+LimitTripleIterator::LimitTripleIterator(TripleIterator* it, size_t limit) : it(it), limit(limit) {}
+
+LimitTripleIterator::~LimitTripleIterator() {
+    delete it;
+}
+
+bool LimitTripleIterator::next(Triple* triple) {
+    if (limit == 0) {
+        return false;
+    }
+    limit--;
+    return it->next(triple);
+}
+
 #ifdef COMPRESSED_ADD_VALUES
 PatchTreeTripleIterator::PatchTreeTripleIterator(PatchTreeIterator* it, Triple triple_pattern, int max_patch_id)
         : it(it), triple_pattern(triple_pattern), max_patch_id(max_patch_id) {}
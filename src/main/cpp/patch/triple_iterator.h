@@ -17,6 +17,17 @@ public:
     bool next(Triple* triple);
 };
 
+// Emits at most a given number of triples from another iterator.
+class LimitTripleIterator : public TripleIterator {
+protected:
+    TripleIterator* it;
+    size_t limit;
+public:
+    LimitTripleIterator(TripleIterator* it, size_t limit);
+    ~LimitTripleIterator();
+    bool next(Triple* triple);
+};
+
 class PatchTreeTripleIterator : public TripleIterator {
 protected:
     PatchTreeIterator* it;
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <dirent.h>
+#include "triple_runs.h"
+
+
+// Sequential reader over the records of a run file, or over sorted records in memory.
+class TripleRunReader {
+private:
+    std::ifstream in;
+    std::vector<TripleRunRecord>* records;
+    size_t index;
+public:
+    TripleRunRecord current;
+    explicit TripleRunReader(const std::string& run_file) : in(run_file, std::ios::binary), records(nullptr), index(0) {}
+    explicit TripleRunReader(std::vector<TripleRunRecord>* records) : records(records), index(0) {}
+    bool next() {
+        if (records != nullptr) {
+            if (index >= records->size()) {
+                return false;
+            }
+            current = std::move((*records)[index++]);
+            return true;
+        }
+        uint32_t ksp, vsp;
+        if (!in.read((char*) &ksp, sizeof(uint32_t))) {
+            return false;
+        }
+        current.first.resize(ksp);
+        if (!in.read(&current.first[0], ksp) || !in.read((char*) &vsp, sizeof(uint32_t))) {
+            return false;
+        }
+        current.second.resize(vsp);
+        return (bool) in.read(&current.second[0], vsp);
+    }
+};
+
+
+TripleRuns::TripleRuns(std::string file_name, kyotocabinet::TreeDB* db, kyotocabinet::Comparator* comparator, size_t buffer_size)
+        : file_name(std::move(file_name)), db(db), comparator(comparator), buffer_size(buffer_size), buffer_bytes(0),
+          run_counter(0), pending_runs(0), compacting(false) {
+    // Find the runs that have not been merged by an earlier process
+    size_t slash = this->file_name.find_last_of('/');
+    std::string dir_name = slash == std::string::npos ? "." : this->file_name.substr(0, slash + 1);
+    std::string prefix = (slash == std::string::npos ? this->file_name : this->file_name.substr(slash + 1)) + "_run_";
+    std::vector<int> runs;
+    DIR *dir;
+    struct dirent *ent;
+    if ((dir = opendir(dir_name.c_str())) != nullptr) {
+        while ((ent = readdir(dir)) != nullptr) {
+            std::string entry_name = std::string(ent->d_name);
+            if (entry_name.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            std::string suffix = entry_name.substr(prefix.size());
+            if (!suffix.empty() && std::all_of(suffix.begin(), suffix.end(), ::isdigit)) {
+                runs.push_back(std::stoi(suffix));
+            } else {
+                // Runs that were not completely written are never merged
+                std::remove((this->file_name + "_run_" + suffix).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(runs.begin(), runs.end());
+    for (int run : runs) {
+        run_files[run] = this->file_name + "_run_" + std::to_string(run);
+        run_counter = run + 1;
+    }
+}
+
+TripleRuns::~TripleRuns() {
+    compact(false);
+}
+
+void TripleRuns::sort_records(std::vector<TripleRunRecord>& records) const {
+    std::stable_sort(records.begin(), records.end(), [this](const TripleRunRecord& a, const TripleRunRecord& b) {
+        return comparator->compare(a.first.data(), a.first.size(), b.first.data(), b.first.size()) < 0;
+    });
+    // The sort is stable, so the last record of a key is the one that was added last
+    size_t size = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (i + 1 < records.size() && comparator->compare(records[i].first.data(), records[i].first.size(),
+                                                          records[i + 1].first.data(), records[i + 1].first.size()) == 0) {
+            continue;
+        }
+        if (size != i) {
+            records[size] = std::move(records[i]);
+        }
+        size++;
+    }
+    records.resize(size);
+}
+
+void TripleRuns::write_run(std::vector<TripleRunRecord> records, int run) {
+    sort_records(records);
+    std::string run_file = file_name + "_run_" + std::to_string(run);
+    std::ofstream out(run_file + ".tmp", std::ios::binary | std::ios::trunc);
+    for (const TripleRunRecord& record : records) {
+        uint32_t ksp = (uint32_t) record.first.size();
+        uint32_t vsp = (uint32_t) record.second.size();
+        out.write((const char*) &ksp, sizeof(uint32_t));
+        out.write(record.first.data(), ksp);
+        out.write((const char*) &vsp, sizeof(uint32_t));
+        out.write(record.second.data(), vsp);
+    }
+    out.close();
+    bool written = !out.fail();
+    if (!written) {
+        std::cerr << "write run " << run_file << " error, inserting directly" << std::endl;
+        std::remove((run_file + ".tmp").c_str());
+        for (const TripleRunRecord& record : records) {
+            db->set(record.first.data(), record.first.size(), record.second.data(), record.second.size());
+        }
+    } else {
+        std::rename((run_file + ".tmp").c_str(), run_file.c_str());
+    }
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+    if (written) {
+        // Runs can finish in a different order than they were started, so they are ordered by their number
+        run_files[run] = run_file;
+    }
+    pending_runs--;
+    runs_written.notify_all();
+}
+
+void TripleRuns::merge(std::vector<std::string> runs, std::vector<TripleRunRecord> records) {
+    std::vector<std::unique_ptr<TripleRunReader>> readers;
+    for (const std::string& run : runs) {
+        readers.emplace_back(new TripleRunReader(run));
+    }
+    readers.emplace_back(new TripleRunReader(&records));
+
+    // The heap top is the reader with the lowest key, and for equal keys the newest reader, which has the highest index
+    auto lower_priority = [this, &readers](size_t a, size_t b) {
+        const std::string& key_a = readers[a]->current.first;
+        const std::string& key_b = readers[b]->current.first;
+        int32_t c = comparator->compare(key_a.data(), key_a.size(), key_b.data(), key_b.size());
+        return c != 0 ? c > 0 : a < b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(lower_priority)> heap(lower_priority);
+    for (size_t i = 0; i < readers.size(); i++) {
+        if (readers[i]->next()) {
+            heap.push(i);
+        }
+    }
+    while (!heap.empty()) {
+        size_t newest = heap.top();
+        heap.pop();
+        TripleRunRecord record = std::move(readers[newest]->current);
+        db->set(record.first.data(), record.first.size(), record.second.data(), record.second.size());
+        // Skip the older records for the same key
+        while (!heap.empty()) {
+            const std::string& key = readers[heap.top()]->current.first;
+            if (comparator->compare(key.data(), key.size(), record.first.data(), record.first.size()) != 0) {
+                break;
+            }
+            size_t older = heap.top();
+            heap.pop();
+            if (readers[older]->next()) {
+                heap.push(older);
+            }
+        }
+        if (readers[newest]->next()) {
+            heap.push(newest);
+        }
+    }
+    db->synchronize();
+
+    // Runs are only removed once their records are persisted in the tree
+    readers.clear();
+    for (const std::string& run : runs) {
+        std::remove(run.c_str());
+    }
+}
+
+void TripleRuns::add(const char* kbp, size_t ksp, const char* vbp, size_t vsp) {
+    std::vector<TripleRunRecord> records;
+    int run;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        buffer.emplace_back(std::string(kbp, ksp), std::string(vbp, vsp));
+        buffer_bytes += ksp + vsp;
+        if (buffer_bytes < buffer_size) {
+            return;
+        }
+        // Only the full buffer is swapped out under the lock, it is sorted and written without blocking other threads
+        records.swap(buffer);
+        buffer_bytes = 0;
+        run = run_counter++;
+        pending_runs++;
+    }
+    write_run(std::move(records), run);
+}
+
+void TripleRuns::compact(bool background) {
+    {
+        std::lock_guard<std::mutex> lock(compaction_mutex);
+        if (compaction_thread.joinable()) {
+            compaction_thread.join();
+        }
+    }
+    std::vector<std::string> runs;
+    std::vector<TripleRunRecord> records;
+    {
+        std::unique_lock<std::mutex> lock(buffer_mutex);
+        runs_written.wait(lock, [this]() { return pending_runs == 0; });
+        for (const auto& run_file : run_files) {
+            runs.push_back(run_file.second);
+        }
+        run_files.clear();
+        records.swap(buffer);
+        buffer_bytes = 0;
+    }
+    sort_records(records);
+    if (runs.empty() && records.empty()) {
+        return;
+    }
+    if (background) {
+        std::lock_guard<std::mutex> lock(compaction_mutex);
+        compacting = true;
+        compaction_thread = std::thread([this, runs = std::move(runs), records = std::move(records)]() mutable {
+            merge(std::move(runs), std::move(records));
+            compacting = false;
+        });
+    } else {
+        merge(std::move(runs), std::move(records));
+    }
+}
+
+void TripleRuns::wait() {
+    if (compacting) {
+        std::lock_guard<std::mutex> lock(compaction_mutex);
+        if (compaction_thread.joinable()) {
+            compaction_thread.join();
+        }
+    }
+}
+
+size_t TripleRuns::get_run_count() const {
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+    return run_files.size();
+}
+
+size_t TripleRuns::get_buffer_bytes() const {
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+    return buffer_bytes;
+}
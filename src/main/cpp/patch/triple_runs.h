@@ -0,0 +1,109 @@
+#ifndef OSTRICH_TRIPLE_RUNS_H
+#define OSTRICH_TRIPLE_RUNS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <kchashdb.h>
+
+// The number of bytes of records that are buffered per tree before they are written to disk as a sorted run (32MB)
+#ifndef TRIPLE_RUN_BUFFER_SIZE
+#define TRIPLE_RUN_BUFFER_SIZE (1LL << 25)
+#endif
+// If the POS and OSP trees should be written through sorted runs instead of by random inserts
+#ifndef SECONDARY_TREE_RUNS
+#define SECONDARY_TREE_RUNS true
+#endif
+
+typedef std::pair<std::string, std::string> TripleRunRecord;
+
+
+/**
+ * Write buffer for a tree in which records arrive in a different order than the tree order.
+ * Records are buffered in memory, and written to disk as immutable runs sorted in tree order once the buffer is full.
+ * On compaction, all runs are merged into the tree in a single pass in key order,
+ * so that each page of the tree is written at most once, instead of once per record.
+ * When a key occurs multiple times, the record that was added last wins.
+ * Runs that were left behind by an interrupted process are merged into the tree on the next compaction.
+ */
+class TripleRuns {
+private:
+    std::string file_name;
+    kyotocabinet::TreeDB* db;
+    kyotocabinet::Comparator* comparator;
+    size_t buffer_size;
+    std::vector<TripleRunRecord> buffer;
+    size_t buffer_bytes;
+    mutable std::mutex buffer_mutex;
+    // The runs on disk by run number, a higher number contains newer records
+    std::map<int, std::string> run_files;
+    int run_counter;
+    // The number of full buffers that are being written outside the buffer lock
+    size_t pending_runs;
+    std::condition_variable runs_written;
+    std::thread compaction_thread;
+    std::atomic<bool> compacting;
+    std::mutex compaction_mutex;
+protected:
+    /**
+     * Sort the given records in tree order, and only keep the last record for each key.
+     */
+    void sort_records(std::vector<TripleRunRecord>& records) const;
+    /**
+     * Sort the given records, and write them as a new run to disk.
+     * This does not require the buffer lock, so other threads can keep adding records meanwhile.
+     * @param records The records of a full buffer.
+     * @param run The run number that was reserved for the records.
+     */
+    void write_run(std::vector<TripleRunRecord> records, int run);
+    /**
+     * Merge the given runs and the given sorted records into the tree, and remove the runs.
+     * @param runs The run files, from oldest to newest.
+     * @param records Sorted records that are newer than all runs.
+     */
+    void merge(std::vector<std::string> runs, std::vector<TripleRunRecord> records);
+public:
+    /**
+     * @param file_name The file name of the tree, runs are stored next to it.
+     * @param db The tree to merge into.
+     * @param comparator The comparator of the tree.
+     * @param buffer_size The number of bytes of records to buffer before writing a run.
+     */
+    TripleRuns(std::string file_name, kyotocabinet::TreeDB* db, kyotocabinet::Comparator* comparator,
+               size_t buffer_size = TRIPLE_RUN_BUFFER_SIZE);
+    /**
+     * Merges all pending records into the tree.
+     */
+    ~TripleRuns();
+    /**
+     * Add a record, this will overwrite the value of the key in the tree once it is compacted.
+     * Records can be added from multiple threads, as long as each key is only added from a single thread.
+     * The thread that fills the buffer writes it as a run, while the others continue in a new buffer.
+     */
+    void add(const char* kbp, size_t ksp, const char* vbp, size_t vsp);
+    /**
+     * Merge all pending records into the tree.
+     * This waits for any earlier compaction and any run that is being written to finish first.
+     * @param background If the merge should run in a separate thread, use wait() before reading from the tree.
+     */
+    void compact(bool background);
+    /**
+     * Wait until the running compaction, if any, has finished.
+     */
+    void wait();
+    /**
+     * @return The number of runs that are on disk and not yet merged.
+     */
+    size_t get_run_count() const;
+    /**
+     * @return The number of bytes of the records in the buffer, which are not yet written as a run.
+     */
+    size_t get_buffer_bytes() const;
+};
+
+
+#endif //OSTRICH_TRIPLE_RUNS_H
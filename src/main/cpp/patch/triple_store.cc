@@ -1,10 +1,20 @@
+#include <algorithm>
+#include <fstream>
+#include <tuple>
+#include <sys/stat.h>
 #include "triple_store.h"
 #include "patch_tree_addition_value.h"
 #include "patch_tree_key_comparator.h"
+#include "serialization_arena.h"
 #include "../simpleprogresslistener.h"
 
 
-TripleStore::TripleStore(string base_file_name, std::shared_ptr<DictionaryManager> dict, int8_t kc_opts, bool readonly) : dict(dict) {
+TripleStore::TripleStore(string base_file_name, std::shared_ptr<DictionaryManager> dict, int8_t kc_opts, bool readonly,
+                         const TreeCodec& addition_codec, const TreeCodec& deletion_codec)
+        : base_file_name(base_file_name), frozen(is_frozen(base_file_name)), dict(dict) {
+    // Frozen stores can not be modified anymore
+    readonly = readonly || frozen;
+
     // Construct trees
     index_spo_deletions = new kyotocabinet::TreeDB();
     index_pos_deletions = new kyotocabinet::TreeDB();
@@ -14,6 +24,7 @@ TripleStore::TripleStore(string base_file_name, std::shared_ptr<DictionaryManage
     index_osp_additions = new kyotocabinet::TreeDB();
     count_additions = new kyotocabinet::HashDB();
     temp_count_additions = readonly ? nullptr : new kyotocabinet::HashDB();
+    count_sketches = new kyotocabinet::HashDB();
 
     // Set the triple comparators
     index_spo_deletions->tune_comparator(spo_comparator = new PatchTreeKeyComparator(comp_s, comp_p, comp_o, dict));
@@ -24,12 +35,16 @@ TripleStore::TripleStore(string base_file_name, std::shared_ptr<DictionaryManage
     index_osp_additions->tune_comparator(osp_comparator);
     element_comparator = new PatchElementComparator(spo_comparator);
 
-    index_spo_deletions->tune_options(kc_opts);
-    index_pos_deletions->tune_options(kc_opts);
-    index_osp_deletions->tune_options(kc_opts);
-    index_spo_additions->tune_options(kc_opts);
-    index_pos_additions->tune_options(kc_opts);
-    index_osp_additions->tune_options(kc_opts);
+    // Set the options and compressors of the trees
+    this->addition_codec = resolve_codec("additions", addition_codec, readonly);
+    this->deletion_codec = resolve_codec("deletions", deletion_codec, readonly);
+    deletion_summaries = resolve_deletion_summaries(readonly);
+    compressors.push_back(this->deletion_codec.tune(index_spo_deletions, base_file_name + "_spo_deletions", kc_opts));
+    compressors.push_back(this->deletion_codec.tune(index_pos_deletions, base_file_name + "_pos_deletions", kc_opts));
+    compressors.push_back(this->deletion_codec.tune(index_osp_deletions, base_file_name + "_osp_deletions", kc_opts));
+    compressors.push_back(this->addition_codec.tune(index_spo_additions, base_file_name + "_spo_additions", kc_opts));
+    compressors.push_back(this->addition_codec.tune(index_pos_additions, base_file_name + "_pos_additions", kc_opts));
+    compressors.push_back(this->addition_codec.tune(index_osp_additions, base_file_name + "_osp_additions", kc_opts));
 
     // Open the databases
     open(index_spo_deletions, base_file_name + "_spo_deletions", readonly);
@@ -38,7 +53,20 @@ TripleStore::TripleStore(string base_file_name, std::shared_ptr<DictionaryManage
     open(index_spo_additions, base_file_name + "_spo_additions", readonly);
     open(index_pos_additions, base_file_name + "_pos_additions", readonly);
     open(index_osp_additions, base_file_name + "_osp_additions", readonly);
-    if (!count_additions->open(base_file_name + "_count_additions", (readonly ? kyotocabinet::HashDB::OREADER : (kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE)) | kyotocabinet::HashDB::ONOREPAIR)) {
+    if (!readonly && SECONDARY_TREE_RUNS) {
+        // Insertions happen in SPO order, so the other trees are only written through sorted runs
+        runs_pos_deletions = new TripleRuns(base_file_name + "_pos_deletions", index_pos_deletions, pos_comparator);
+        runs_osp_deletions = new TripleRuns(base_file_name + "_osp_deletions", index_osp_deletions, osp_comparator);
+        runs_pos_additions = new TripleRuns(base_file_name + "_pos_additions", index_pos_additions, pos_comparator);
+        runs_osp_additions = new TripleRuns(base_file_name + "_osp_additions", index_osp_additions, osp_comparator);
+        // Merge the runs that were left behind by an interrupted insertion
+        compact_runs(false);
+    } else {
+        runs_pos_deletions = runs_osp_deletions = runs_pos_additions = runs_osp_additions = nullptr;
+    }
+    // Frozen stores are never modified, so they do not have to be locked
+    uint32_t lock_mode = frozen ? kyotocabinet::HashDB::ONOLOCK : 0;
+    if (!count_additions->open(base_file_name + "_count_additions", (readonly ? kyotocabinet::HashDB::OREADER : (kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE)) | kyotocabinet::HashDB::ONOREPAIR | lock_mode)) {
         cerr << "Open addition count tree error: " << count_additions->error().name() << endl;
     }
     if (temp_count_additions != nullptr) {
@@ -48,9 +76,23 @@ TripleStore::TripleStore(string base_file_name, std::shared_ptr<DictionaryManage
             cerr << "Open addition count tree error: " << temp_count_additions->error().name() << endl;
         }
     }
+    if (!count_sketches->open(base_file_name + "_count_sketches", (readonly ? kyotocabinet::HashDB::OREADER : (kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE)) | kyotocabinet::HashDB::ONOREPAIR | lock_mode)) {
+        cerr << "Open count sketches error: " << count_sketches->error().name() << endl;
+    } else {
+        std::string raw_sketch;
+        if (count_sketches->get("additions", &raw_sketch)) {
+            additions_sketch.deserialize(raw_sketch.data(), raw_sketch.size());
+        }
+    }
 }
 
 TripleStore::~TripleStore() {
+    // Merge all pending runs before closing the trees
+    delete runs_pos_deletions;
+    delete runs_osp_deletions;
+    delete runs_pos_additions;
+    delete runs_osp_additions;
+
     // Close the databases
     close(index_spo_deletions, "spo_deletions");
     close(index_pos_deletions, "pos_deletions");
@@ -58,11 +100,18 @@ TripleStore::~TripleStore() {
     close(index_spo_additions, "spo_additions");
     close(index_pos_additions, "pos_additions");
     close(index_osp_additions, "osp_additions");
+    for (kyotocabinet::Compressor* compressor : compressors) {
+        delete compressor;
+    }
 
     if (!count_additions->close()) {
         cerr << "Close addition count tree error: " << count_additions->error().name() << endl;
     }
     delete count_additions;
+    if (!count_sketches->close()) {
+        cerr << "Close count sketches error: " << count_sketches->error().name() << endl;
+    }
+    delete count_sketches;
     if (temp_count_additions != nullptr) {
         string path = temp_count_additions->path();
         if (!temp_count_additions->close()) {
@@ -79,11 +128,19 @@ TripleStore::~TripleStore() {
 }
 
 void TripleStore::open(kyotocabinet::TreeDB* db, string name, bool readonly) {
-    db->tune_map(KC_MEMORY_MAP_SIZE);
-    //db->tune_buckets(1LL * 1000 * 1000);
-    db->tune_page_cache(KC_PAGE_CACHE_SIZE);
-    db->tune_defrag(8);
-    if (!db->open(name, (readonly ? kyotocabinet::TreeDB::OREADER : (kyotocabinet::TreeDB::OWRITER | kyotocabinet::TreeDB::OCREATE)) | kyotocabinet::TreeDB::ONOREPAIR)) {
+    if (frozen) {
+        // Frozen trees are never modified, so the memory map only has to span the file
+        struct stat sb{};
+        db->tune_map(stat(name.c_str(), &sb) == 0 ? std::min((long long) sb.st_size, KC_MEMORY_MAP_SIZE) : 0);
+        db->tune_page_cache(FROZEN_PAGE_CACHE_SIZE);
+    } else {
+        db->tune_map(KC_MEMORY_MAP_SIZE);
+        //db->tune_buckets(1LL * 1000 * 1000);
+        db->tune_page_cache(KC_PAGE_CACHE_SIZE);
+        db->tune_defrag(8);
+    }
+    if (!db->open(name, (readonly ? kyotocabinet::TreeDB::OREADER : (kyotocabinet::TreeDB::OWRITER | kyotocabinet::TreeDB::OCREATE)) | kyotocabinet::TreeDB::ONOREPAIR
+                        | (frozen ? kyotocabinet::TreeDB::ONOLOCK : 0))) {
         cerr << "open " << name << " error: " << db->error().name() << endl;
     }
 }
@@ -95,6 +152,203 @@ void TripleStore::close(kyotocabinet::TreeDB* db, string name) {
     delete db;
 }
 
+void TripleStore::set(kyotocabinet::TreeDB* db, TripleRuns* runs, const char* kbp, size_t ksp, const char* vbp, size_t vsp) {
+    if (runs != nullptr) {
+        runs->add(kbp, ksp, vbp, vsp);
+    } else {
+        db->set(kbp, ksp, vbp, vsp);
+    }
+}
+
+void TripleStore::compact_runs(bool background) {
+    for (TripleRuns* runs : {runs_pos_deletions, runs_osp_deletions, runs_pos_additions, runs_osp_additions}) {
+        if (runs != nullptr) {
+            runs->compact(background);
+        }
+    }
+}
+
+void TripleStore::wait_for_runs() {
+    for (TripleRuns* runs : {runs_pos_deletions, runs_osp_deletions, runs_pos_additions, runs_osp_additions}) {
+        if (runs != nullptr) {
+            runs->wait();
+        }
+    }
+}
+
+TreeCodec TripleStore::resolve_codec(const string& family, const TreeCodec& requested, bool readonly) const {
+    TreeCodec codec;
+    if (TreeCodec::read(base_file_name + "_" + family + "_codec", &codec)) {
+        return codec;
+    }
+    // Trees that were created without persisted codec use the default one
+    std::ifstream existing(base_file_name + "_spo_" + family);
+    if (requested.get_type() == TREE_CODEC_DEFAULT || existing.good() || readonly) {
+        return TreeCodec();
+    }
+    requested.write(base_file_name + "_" + family + "_codec");
+    return requested;
+}
+
+bool TripleStore::resolve_deletion_summaries(bool readonly) const {
+    std::ifstream marker(base_file_name + "_deletion_summaries");
+    if (marker.good()) {
+        return true;
+    }
+    // Existing trees keep the reduced values until they are migrated
+    std::ifstream existing(base_file_name + "_spo_deletions");
+    if (!SECONDARY_DELETION_SUMMARIES || existing.good() || readonly) {
+        return false;
+    }
+    std::ofstream created(base_file_name + "_deletion_summaries");
+    return true;
+}
+
+bool TripleStore::get_deletion_summary(const char* raw_key, size_t key_size, kyotocabinet::DB::Cursor* cursor, PatchTreeDeletionSummary* summary) const {
+    size_t value_size;
+    const char* raw_value = cursor != nullptr ? cursor->get_value(&value_size, false) : index_spo_deletions->get(raw_key, key_size, &value_size);
+    if (raw_value == nullptr) {
+        return false;
+    }
+    // The summary does not depend on the patch limit of the view
+#ifdef COMPRESSED_DEL_VALUES
+    PatchTreeDeletionValueView value(0);
+#else
+    PatchTreeDeletionValueView value;
+#endif
+    value.wrap(raw_value, value_size);
+    *summary = value.get_summary();
+    delete[] raw_value;
+    return true;
+}
+
+bool TripleStore::has_deletion_summaries() const {
+    return deletion_summaries;
+}
+
+bool TripleStore::migrate_deletion_summaries() {
+    if (deletion_summaries) {
+        return true;
+    }
+    // Read-only stores have no temporary counts, and can not be rewritten
+    if (frozen || temp_count_additions == nullptr) {
+        return false;
+    }
+    compact_runs(false);
+    index_spo_deletions->synchronize();
+    // The keys of the POS and OSP trees are the same as in the SPO tree, so each value is replaced by the summary of its SPO value
+    auto summarize = [this](const char* kbp, size_t ksp, const char* vbp, size_t vsp) {
+        PatchTreeDeletionSummary summary;
+        get_deletion_summary(kbp, ksp, nullptr, &summary);
+        SerializationArena& arena = SerializationArena::local();
+        SerializationArena::Scope scope(arena);
+        size_t summary_size;
+        const char* raw_summary = arena.serialize(summary, &summary_size);
+        return std::string(raw_summary, summary_size);
+    };
+    std::vector<std::pair<kyotocabinet::TreeDB*, PatchTreeKeyComparator*>> trees = {
+            std::make_pair(index_pos_deletions, pos_comparator),
+            std::make_pair(index_osp_deletions, osp_comparator),
+    };
+    std::vector<string> names = {base_file_name + "_pos_deletions", base_file_name + "_osp_deletions"};
+    for (size_t i = 0; i < trees.size(); i++) {
+        if (!deletion_codec.copy_tree(trees[i].first, trees[i].second, names[i] + ".migrated", 0, summarize)) {
+            for (const string& name : names) {
+                std::remove((name + ".migrated").c_str());
+                std::remove((name + ".migrated_dict").c_str());
+            }
+            return false;
+        }
+    }
+    // Only replace the trees once both have been copied, the open trees keep referring to the original files
+    for (const string& name : names) {
+        std::rename((name + ".migrated").c_str(), name.c_str());
+        std::remove((name + "_dict").c_str());
+        std::rename((name + ".migrated_dict").c_str(), (name + "_dict").c_str());
+    }
+    std::ofstream marker(base_file_name + "_deletion_summaries");
+    return true;
+}
+
+bool TripleStore::freeze_tree(kyotocabinet::TreeDB* db, PatchTreeKeyComparator* comparator, const TreeCodec& codec, const string& name) {
+    return codec.copy_tree(db, comparator, name + ".frozen", FROZEN_PAGE_SIZE);
+}
+
+bool TripleStore::freeze() {
+    // Read-only stores have no temporary counts, and can not be rewritten
+    if (frozen || temp_count_additions == nullptr) {
+        return false;
+    }
+    compact_runs(false);
+    std::vector<std::tuple<kyotocabinet::TreeDB*, PatchTreeKeyComparator*, const TreeCodec*, string>> trees = {
+            std::make_tuple(index_spo_deletions, spo_comparator, &deletion_codec, base_file_name + "_spo_deletions"),
+            std::make_tuple(index_pos_deletions, pos_comparator, &deletion_codec, base_file_name + "_pos_deletions"),
+            std::make_tuple(index_osp_deletions, osp_comparator, &deletion_codec, base_file_name + "_osp_deletions"),
+            std::make_tuple(index_spo_additions, spo_comparator, &addition_codec, base_file_name + "_spo_additions"),
+            std::make_tuple(index_pos_additions, pos_comparator, &addition_codec, base_file_name + "_pos_additions"),
+            std::make_tuple(index_osp_additions, osp_comparator, &addition_codec, base_file_name + "_osp_additions"),
+    };
+    for (const auto& tree : trees) {
+        if (!freeze_tree(std::get<0>(tree), std::get<1>(tree), *std::get<2>(tree), std::get<3>(tree))) {
+            for (const auto& tree_cleanup : trees) {
+                std::remove((std::get<3>(tree_cleanup) + ".frozen").c_str());
+                std::remove((std::get<3>(tree_cleanup) + ".frozen_dict").c_str());
+            }
+            return false;
+        }
+    }
+    count_additions->synchronize();
+    count_sketches->synchronize();
+    // Only replace the trees once all of them have been copied, the open trees keep referring to the original files
+    for (const auto& tree : trees) {
+        std::rename((std::get<3>(tree) + ".frozen").c_str(), std::get<3>(tree).c_str());
+        // Trees with a trained dictionary are opened with it from now on
+        std::rename((std::get<3>(tree) + ".frozen_dict").c_str(), (std::get<3>(tree) + "_dict").c_str());
+    }
+    std::ofstream marker(base_file_name + "_frozen");
+    frozen = true;
+    return true;
+}
+
+const TreeCodec& TripleStore::get_addition_codec() const {
+    return addition_codec;
+}
+
+const TreeCodec& TripleStore::get_deletion_codec() const {
+    return deletion_codec;
+}
+
+bool TripleStore::is_frozen() const {
+    return frozen;
+}
+
+size_t TripleStore::get_memory_cost() const {
+    size_t page_cache_size = frozen ? FROZEN_PAGE_CACHE_SIZE : KC_PAGE_CACHE_SIZE;
+    size_t cost = 0;
+    for (kyotocabinet::TreeDB* db : {index_spo_deletions, index_pos_deletions, index_osp_deletions,
+                                     index_spo_additions, index_pos_additions, index_osp_additions}) {
+        size_t size = (size_t) std::max((int64_t) 0, db->size());
+        cost += std::min(size, (size_t) KC_MEMORY_MAP_SIZE) + std::min(size, page_cache_size);
+    }
+    for (kyotocabinet::HashDB* db : {count_additions, temp_count_additions, count_sketches}) {
+        if (db != nullptr) {
+            cost += (size_t) std::max((int64_t) 0, db->size());
+        }
+    }
+    // The records that are buffered for the sorted runs, up to TRIPLE_RUN_BUFFER_SIZE per tree
+    for (TripleRuns* runs : {runs_pos_deletions, runs_osp_deletions, runs_pos_additions, runs_osp_additions}) {
+        if (runs != nullptr) {
+            cost += runs->get_buffer_bytes();
+        }
+    }
+    return cost;
+}
+
+bool TripleStore::is_frozen(const string& base_file_name) {
+    std::ifstream marker(base_file_name + "_frozen");
+    return marker.good();
+}
+
 kyotocabinet::TreeDB* TripleStore::getAdditionsTree(Triple triple_pattern) {
     hdt::TripleComponentOrder order = get_query_order(triple_pattern);
 
@@ -120,20 +374,20 @@ kyotocabinet::TreeDB* TripleStore::getDefaultDeletionsTree() {
 }
 
 void TripleStore::insertAdditionSingle(const PatchTreeKey* key, const PatchTreeAdditionValue* value, kyotocabinet::DB::Cursor* cursor) {
+    // KC copies the records, so they can be serialized into temporary buffers
+    SerializationArena& arena = SerializationArena::local();
+    SerializationArena::Scope scope(arena);
     size_t key_size, value_size;
-    const char *raw_key = key->serialize(&key_size);
-    const char *raw_value = value->serialize(&value_size);
+    const char *raw_key = arena.serialize(*key, &key_size);
+    const char *raw_value = arena.serialize(*value, &value_size);
 
     if (cursor != nullptr) {
         cursor->set_value(raw_value, value_size, false);
     } else {
         index_spo_additions->set(raw_key, key_size, raw_value, value_size);
     }
-    index_pos_additions->set(raw_key, key_size, raw_value, value_size);
-    index_osp_additions->set(raw_key, key_size, raw_value, value_size);
-
-    delete[] raw_key;
-    delete[] raw_value;
+    set(index_pos_additions, runs_pos_additions, raw_key, key_size, raw_value, value_size);
+    set(index_osp_additions, runs_osp_additions, raw_key, key_size, raw_value, value_size);
 
     // Flush db to disk
     if (++flush_counter_additions > FLUSH_TRIPLES_COUNT) {
@@ -153,14 +407,14 @@ void TripleStore::insertAdditionSingle(const PatchTreeKey* key, int patch_id, bo
 #endif
     if (!ignore_existing) {
         // We assume that are indexes are sane, we only check one of them
+        SerializationArena::Scope scope;
         size_t key_size, value_size;
-        const char *raw_key = key->serialize(&key_size);
+        const char *raw_key = SerializationArena::local().serialize(*key, &key_size);
         const char *raw_value = cursor == nullptr ? index_spo_additions->get(raw_key, key_size, &value_size) : cursor->get_value(&value_size, false);
         if (raw_value) {
             value.deserialize(raw_value, value_size);
             delete[] raw_value;
         }
-        free((char*) raw_key);
     }
     value.add(patch_id);
     if (local_change) {
@@ -172,22 +426,32 @@ void TripleStore::insertAdditionSingle(const PatchTreeKey* key, int patch_id, bo
 }
 
 void TripleStore::insertDeletionSingle(const PatchTreeKey* key, const PatchTreeDeletionValue* value, const PatchTreeDeletionValueReduced* value_reduced, kyotocabinet::DB::Cursor* cursor) {
+    // KC copies the records, so they can be serialized into temporary buffers
+    SerializationArena& arena = SerializationArena::local();
+    SerializationArena::Scope scope(arena);
     size_t key_size, value_size, value_reduced_size;
-    const char *raw_key = key->serialize(&key_size);
-    const char *raw_value = value->serialize(&value_size);
-    const char *raw_value_reduced = value_reduced->serialize(&value_reduced_size);
-
+    const char *raw_key = arena.serialize(*key, &key_size);
+    const char *raw_value = arena.serialize(*value, &value_size);
+
+    if (deletion_summaries) {
+        // The summary in the POS and OSP trees only has to be rewritten if it has changed
+        PatchTreeDeletionSummary summary = value->get_summary();
+        PatchTreeDeletionSummary previous_summary;
+        if (!get_deletion_summary(raw_key, key_size, cursor, &previous_summary) || previous_summary != summary) {
+            const char *raw_summary = arena.serialize(summary, &value_reduced_size);
+            set(index_pos_deletions, runs_pos_deletions, raw_key, key_size, raw_summary, value_reduced_size);
+            set(index_osp_deletions, runs_osp_deletions, raw_key, key_size, raw_summary, value_reduced_size);
+        }
+    } else {
+        const char *raw_value_reduced = arena.serialize(*value_reduced, &value_reduced_size);
+        set(index_pos_deletions, runs_pos_deletions, raw_key, key_size, raw_value_reduced, value_reduced_size);
+        set(index_osp_deletions, runs_osp_deletions, raw_key, key_size, raw_value_reduced, value_reduced_size);
+    }
     if (cursor != nullptr) {
         cursor->set_value(raw_value, value_size, false);
     } else {
         index_spo_deletions->set(raw_key, key_size, raw_value, value_size);
     }
-    index_pos_deletions->set(raw_key, key_size, raw_value_reduced, value_reduced_size);
-    index_osp_deletions->set(raw_key, key_size, raw_value_reduced, value_reduced_size);
-
-    delete[] raw_key;
-    delete[] raw_value;
-    delete[] raw_value_reduced;
 
     // Flush db to disk
     if (++flush_counter_deletions > FLUSH_TRIPLES_COUNT) {
@@ -198,6 +462,14 @@ void TripleStore::insertDeletionSingle(const PatchTreeKey* key, const PatchTreeD
     }
 }
 
+void TripleStore::updateDeletionPositions(const PatchTreeDeletionValue* value, kyotocabinet::DB::Cursor* cursor) {
+    SerializationArena& arena = SerializationArena::local();
+    SerializationArena::Scope scope(arena);
+    size_t value_size;
+    const char *raw_value = arena.serialize(*value, &value_size);
+    cursor->set_value(raw_value, value_size, false);
+}
+
 void TripleStore::insertDeletionSingle(const PatchTreeKey* key, const PatchPositions& patch_positions, int patch_id, bool local_change, bool ignore_existing, kyotocabinet::DB::Cursor* cursor) {
 #ifdef COMPRESSED_DEL_VALUES
     PatchTreeDeletionValue deletion_value(patch_id);
@@ -205,14 +477,14 @@ void TripleStore::insertDeletionSingle(const PatchTreeKey* key, const PatchPosit
     PatchTreeDeletionValue deletion_value;
 #endif
     if (!ignore_existing) {
+        SerializationArena::Scope scope;
         size_t key_size, value_size;
-        const char *raw_key = key->serialize(&key_size);
+        const char *raw_key = SerializationArena::local().serialize(*key, &key_size);
         const char *raw_value = cursor == nullptr ? index_spo_deletions->get(raw_key, key_size, &value_size) : cursor->get_value(&value_size, false);
         if (raw_value) {
             deletion_value.deserialize(raw_value, value_size);
             delete[] raw_value;
         }
-        free((char*) raw_key);
     }
     PatchTreeDeletionValueElement element = PatchTreeDeletionValueElement(patch_id, patch_positions);
     if (local_change) {
@@ -247,42 +519,124 @@ void TripleStore::increment_addition_counts(const int patch_id, const Triple &tr
     increment_addition_count(TripleVersion(patch_id, Triple(0                   , 0                     , triple.get_object())));
 }
 
-void TripleStore::increment_addition_count(const TripleVersion& triple_version) {
-    size_t _, tv_size;
-    char* raw_value;
-    const char* raw_key = triple_version.serialize(&tv_size);
-    raw_value = temp_count_additions->get(raw_key, tv_size, &_);
-    PatchPosition pos = 0;
-    if (raw_value != nullptr) {
-        std::memcpy(&pos, raw_value, sizeof(PatchPosition));
-    } else {
-        raw_value = new char[sizeof(PatchPosition)];
+// Increments a count in place, so that concurrent increments of the same count are not lost
+class CountIncrementVisitor : public kyotocabinet::DB::Visitor {
+private:
+    PatchPosition count;
+public:
+    const char* visit_full(const char* kbuf, size_t ksiz, const char* vbuf, size_t vsiz, size_t* sp) override {
+        std::memcpy(&count, vbuf, sizeof(PatchPosition));
+        count++;
+        *sp = sizeof(PatchPosition);
+        return (const char*) &count;
     }
-    pos++;
-    std::memcpy(raw_value, &pos, sizeof(PatchPosition));
-    temp_count_additions->set(raw_key, tv_size, raw_value, sizeof(PatchPosition));
+    const char* visit_empty(const char* kbuf, size_t ksiz, size_t* sp) override {
+        count = 1;
+        *sp = sizeof(PatchPosition);
+        return (const char*) &count;
+    }
+};
 
-    delete[] raw_key;
-    delete[] raw_value;
+void TripleStore::increment_addition_count(const TripleVersion& triple_version) {
+    SerializationArena::Scope scope;
+    size_t tv_size;
+    const char* raw_key = SerializationArena::local().serialize(triple_version, &tv_size);
+    CountIncrementVisitor visitor;
+    temp_count_additions->accept(raw_key, tv_size, &visitor, true);
 }
 
 PatchPosition TripleStore::get_addition_count(const int patch_id, const Triple &triple) {
+    SerializationArena::Scope scope;
     size_t ksp, vsp;
     TripleVersion key(patch_id, triple);
-    const char* kbp = key.serialize(&ksp);
+    const char* kbp = SerializationArena::local().serialize(key, &ksp);
     const char* vbp = count_additions->get(kbp, ksp, &vsp);
     PatchPosition count = 0;
     if (vbp != nullptr) {
         std::memcpy(&count, vbp, sizeof(PatchPosition));
     }
-    delete[] kbp;
     delete[] vbp;
     return count;
 }
 
+std::shared_ptr<CountMinSketch> TripleStore::get_count_sketch(int patch_id) {
+    std::lock_guard<std::mutex> lock(count_sketches_mutex);
+    auto it = loaded_count_sketches.find(patch_id);
+    if (it != loaded_count_sketches.end()) {
+        return it->second;
+    }
+    std::shared_ptr<CountMinSketch> sketch = nullptr;
+    std::string raw_sketch;
+    if (count_sketches->get("cm_" + std::to_string(patch_id), &raw_sketch)) {
+        sketch = std::make_shared<CountMinSketch>();
+        if (!sketch->deserialize(raw_sketch.data(), raw_sketch.size())) {
+            sketch = nullptr;
+        }
+    }
+    loaded_count_sketches[patch_id] = sketch;
+    return sketch;
+}
+
+bool TripleStore::get_addition_count_estimate(int patch_id, const Triple& triple, PatchPosition* count) {
+    if (triple.get_subject() > 0 && triple.get_predicate() > 0 && triple.get_object() > 0) {
+        // Fully bound patterns are not counted
+        return false;
+    }
+    *count = get_addition_count(patch_id, triple);
+    if (*count) {
+        return true;
+    }
+    std::shared_ptr<CountMinSketch> sketch = get_count_sketch(patch_id);
+    if (sketch == nullptr) {
+        return false;
+    }
+    *count = std::min((PatchPosition) sketch->estimate(patch_id, triple.get_subject(), triple.get_predicate(), triple.get_object()),
+                      (PatchPosition) MIN_ADDITION_COUNT - 1);
+    return true;
+}
+
+void TripleStore::add_to_additions_sketch(const Triple& triple) {
+    // The terms are hashed by their string so that the sketches of different delta chains can be merged,
+    // but each term is only decoded once, outside the lock so that parallel appends can decode concurrently.
+    size_t ids[3] = {triple.get_subject(), triple.get_predicate(), triple.get_object()};
+    uint64_t term_hashes[3];
+    bool cached[3];
+    {
+        std::lock_guard<std::mutex> lock(count_sketches_mutex);
+        for (int position = 0; position < 3; position++) {
+            cached[position] = additions_term_hashes.find(ids[position], position, &term_hashes[position]);
+        }
+    }
+    std::string terms[3];
+    if (!cached[0]) {
+        terms[0] = triple.get_subject(*dict);
+    }
+    if (!cached[1]) {
+        terms[1] = triple.get_predicate(*dict);
+    }
+    if (!cached[2]) {
+        terms[2] = triple.get_object(*dict);
+    }
+    std::lock_guard<std::mutex> lock(count_sketches_mutex);
+    for (int position = 0; position < 3; position++) {
+        if (!cached[position]) {
+            term_hashes[position] = additions_term_hashes.insert(ids[position], position, terms[position]);
+        }
+    }
+    additions_sketch.add(TermHashCache::combine(term_hashes[0], term_hashes[1], term_hashes[2]));
+}
+
+HyperLogLog TripleStore::get_additions_sketch() {
+    std::lock_guard<std::mutex> lock(count_sketches_mutex);
+    return additions_sketch;
+}
+
 long TripleStore::flush_addition_counts() {
     size_t ksp, vsp;
     PatchPosition count = 0;
+    // The temporary counts are complete for every patch id they contain,
+    // so the sketches of those patch ids are rebuilt from the counts that are too low to be stored.
+    std::map<int, CountMinSketch> sketches;
     kyotocabinet::HashDB::Cursor* cursor = temp_count_additions->cursor();
     cursor->jump();
     long added = 0;
@@ -290,9 +644,15 @@ long TripleStore::flush_addition_counts() {
         const char* vbp;
         const char* kbp = cursor->get(&ksp, &vbp, &vsp, false);
         std::memcpy(&count, vbp, sizeof(PatchPosition));
+        TripleVersion triple_version;
+        triple_version.deserialize(kbp, ksp);
+        CountMinSketch& sketch = sketches[triple_version.get_patch_id()];
         if (count >= MIN_ADDITION_COUNT) {
             count_additions->set(kbp, ksp, vbp, vsp);
             added++;
+        } else {
+            const Triple& triple = triple_version.get_triple();
+            sketch.add(triple_version.get_patch_id(), triple.get_subject(), triple.get_predicate(), triple.get_object(), (uint32_t) count);
         }
         delete[] kbp;
     }
@@ -300,5 +660,22 @@ long TripleStore::flush_addition_counts() {
     count_additions->synchronize();
     temp_count_additions->clear();
 
+    {
+        std::lock_guard<std::mutex> lock(count_sketches_mutex);
+        for (auto& it : sketches) {
+            size_t size;
+            const char* data = it.second.serialize(&size);
+            std::string key = "cm_" + std::to_string(it.first);
+            count_sketches->set(key.data(), key.size(), data, size);
+            delete[] data;
+            loaded_count_sketches.erase(it.first);
+        }
+        size_t size;
+        const char* data = additions_sketch.serialize(&size);
+        count_sketches->set("additions", 9, data, size);
+        delete[] data;
+        count_sketches->synchronize();
+    }
+
     return added;
 }
@@ -1,13 +1,20 @@
 #ifndef TPFPATCH_STORE_TRIPLE_STORE_H
 #define TPFPATCH_STORE_TRIPLE_STORE_H
 
+#include <atomic>
 #include <iterator>
+#include <map>
+#include <mutex>
+#include <memory>
 #include <kchashdb.h>
 #include "triple.h"
 #include "patch.h"
 #include "../dictionary/dictionary_manager.h"
 #include "patch_tree_key_comparator.h"
 #include "patch_tree_addition_value.h"
+#include "count_sketch.h"
+#include "triple_runs.h"
+#include "tree_codec.h"
 
 
 // The amount of triples after which the store should be flushed to disk, to avoid memory issues
@@ -22,6 +29,19 @@
 #ifndef KC_PAGE_CACHE_SIZE
 #define KC_PAGE_CACHE_SIZE (1LL << 25)
 #endif
+// The KC page size of the trees of a frozen store, larger pages compress better and need fewer page records (64KB)
+#ifndef FROZEN_PAGE_SIZE
+#define FROZEN_PAGE_SIZE (1 << 16)
+#endif
+// The KC page cache size per tree of a frozen store (8MB)
+#ifndef FROZEN_PAGE_CACHE_SIZE
+#define FROZEN_PAGE_CACHE_SIZE (1LL << 23)
+#endif
+// If the POS and OSP deletion trees of new stores should only contain summaries of the deletion values,
+// instead of the values without patch positions
+#ifndef SECONDARY_DELETION_SUMMARIES
+#define SECONDARY_DELETION_SUMMARIES true
+#endif
 // The minimum addition triple count so that it will be stored in the db
 #ifndef MIN_ADDITION_COUNT
 #define MIN_ADDITION_COUNT 100
@@ -29,28 +49,91 @@
 
 class TripleStore {
 private:
+    string base_file_name;
+    bool frozen;
+    // If the POS and OSP deletion trees contain summaries of the SPO deletion values, instead of reduced values
+    bool deletion_summaries;
     kyotocabinet::TreeDB* index_spo_deletions;
     kyotocabinet::TreeDB* index_pos_deletions;
     kyotocabinet::TreeDB* index_osp_deletions;
     kyotocabinet::TreeDB* index_spo_additions;
     kyotocabinet::TreeDB* index_pos_additions;
     kyotocabinet::TreeDB* index_osp_additions;
+    // Write buffers for the trees that are not written in key order during insertion, null if they are written directly
+    TripleRuns* runs_pos_deletions;
+    TripleRuns* runs_osp_deletions;
+    TripleRuns* runs_pos_additions;
+    TripleRuns* runs_osp_additions;
+    // The codecs of the addition and deletion trees, and the compressors that are plugged into the trees
+    TreeCodec addition_codec;
+    TreeCodec deletion_codec;
+    std::vector<kyotocabinet::Compressor*> compressors;
     kyotocabinet::HashDB* count_additions;
     kyotocabinet::HashDB* temp_count_additions;
+    // Count-min sketches per patch id for the addition counts that are too low to be stored,
+    // and a HyperLogLog sketch over all added triples.
+    kyotocabinet::HashDB* count_sketches;
+    std::map<int, std::shared_ptr<CountMinSketch>> loaded_count_sketches;
+    HyperLogLog additions_sketch;
+    TermHashCache additions_term_hashes;
+    std::mutex count_sketches_mutex;
     //TreeDB index_ops; // We don't need this one if we maintain our s,p,o order priorites
     std::shared_ptr<DictionaryManager> dict;
     PatchTreeKeyComparator* spo_comparator;
     PatchTreeKeyComparator* pos_comparator;
     PatchTreeKeyComparator* osp_comparator;
     PatchElementComparator* element_comparator;
-    int flush_counter_additions = 0;
-    int flush_counter_deletions = 0;
+    // Insertions can happen from multiple threads when a patch is appended in partitions
+    std::atomic<int> flush_counter_additions{0};
+    std::atomic<int> flush_counter_deletions{0};
 protected:
     void open(kyotocabinet::TreeDB* db, string name, bool readonly);
     void close(kyotocabinet::TreeDB* db, string name);
+    /**
+     * Set a record in a tree, or add it to the runs of that tree if they exist.
+     */
+    static void set(kyotocabinet::TreeDB* db, TripleRuns* runs, const char* kbp, size_t ksp, const char* vbp, size_t vsp);
+    /**
+     * Determine the codec of a tree family.
+     * The codec of existing trees is persisted when they are created, and can not be changed anymore.
+     * @param family 'additions' or 'deletions'.
+     * @param requested The codec to use if the trees of the family do not exist yet.
+     * @param readonly If the store is read-only.
+     * @return The codec of the trees of the family.
+     */
+    TreeCodec resolve_codec(const string& family, const TreeCodec& requested, bool readonly) const;
+    /**
+     * Copy all records of the given tree in order into a new compact tree, with the codec of the tree.
+     * @return If the copy succeeded.
+     */
+    bool freeze_tree(kyotocabinet::TreeDB* db, PatchTreeKeyComparator* comparator, const TreeCodec& codec, const string& name);
+    /**
+     * Determine if the POS and OSP deletion trees contain summaries.
+     * This is persisted when the trees are created, and can only be changed afterwards by migrating them.
+     * @param readonly If the store is read-only.
+     * @return If the trees contain summaries.
+     */
+    bool resolve_deletion_summaries(bool readonly) const;
+    /**
+     * Read the summary of the value of the given key in the SPO deletion tree.
+     * @param cursor An optional cursor that points to the key in the SPO deletion tree.
+     * @param summary This will contain the summary.
+     * @return If the key exists.
+     */
+    bool get_deletion_summary(const char* raw_key, size_t key_size, kyotocabinet::DB::Cursor* cursor, PatchTreeDeletionSummary* summary) const;
     void increment_addition_count(const TripleVersion& triple_version);
+    std::shared_ptr<CountMinSketch> get_count_sketch(int patch_id);
 public:
-    TripleStore(string base_file_name, std::shared_ptr<DictionaryManager> dict, int8_t kc_opts = 0, bool readonly = false);
+    /**
+     * @param base_file_name The base file name of all trees of this store.
+     * @param dict The dictionary of this store.
+     * @param kc_opts Options for KC trees.
+     * @param readonly If the store is read-only.
+     * @param addition_codec The codec to compress the addition trees with, if they are created.
+     * @param deletion_codec The codec to compress the deletion trees with, if they are created.
+     */
+    TripleStore(string base_file_name, std::shared_ptr<DictionaryManager> dict, int8_t kc_opts = 0, bool readonly = false,
+                const TreeCodec& addition_codec = TreeCodec(), const TreeCodec& deletion_codec = TreeCodec());
     ~TripleStore();
     kyotocabinet::TreeDB* getAdditionsTree(Triple triple_pattern);
     kyotocabinet::TreeDB* getDefaultAdditionsTree();
@@ -60,9 +143,93 @@ public:
     void insertAdditionSingle(const PatchTreeKey* key, int patch_id, bool local_change, bool ignore_existing, kyotocabinet::DB::Cursor* cursor = nullptr);
     void increment_addition_counts(int patch_id, const Triple& triple);
     PatchPosition get_addition_count(int patch_id, const Triple& triple);
+    /**
+     * Estimate the number of additions for the given triple pattern in constant time.
+     * Counts that are too low to be stored are estimated with the count-min sketch of the patch id,
+     * which never underestimates, and is capped to MIN_ADDITION_COUNT - 1.
+     * @param patch_id The patch id, 0 for all patches.
+     * @param triple The triple pattern.
+     * @param count This will contain the estimated count.
+     * @return If an estimate could be made, this is false if no sketch is available or if the pattern has no variables.
+     */
+    bool get_addition_count_estimate(int patch_id, const Triple& triple, PatchPosition* count);
+    /**
+     * Add the given triple to the HyperLogLog sketch of all added triples.
+     * @param triple A triple encoded with the dictionary of this store.
+     */
+    void add_to_additions_sketch(const Triple& triple);
+    /**
+     * @return The HyperLogLog sketch of all triples that were ever added in this store.
+     */
+    HyperLogLog get_additions_sketch();
+    /**
+     * Rewrite all trees of this store into a compact read-only form.
+     * Each tree is copied in key order into a new compressed tree with large pages and no free space,
+     * which replaces the original once all trees have been copied.
+     * Frozen stores are opened read-only with a memory map that only spans the file, so they load instantly.
+     * This may only be done once no more patches will be added to this store.
+     * The trees that are currently open keep working on the original data, which must not be modified anymore.
+     * @return If the store has been frozen.
+     */
+    bool freeze();
+    /**
+     * @return The codec of the addition trees.
+     */
+    const TreeCodec& get_addition_codec() const;
+    /**
+     * @return The codec of the deletion trees.
+     */
+    const TreeCodec& get_deletion_codec() const;
+    /**
+     * @return If this store has been frozen.
+     */
+    bool is_frozen() const;
+    /**
+     * @return If the POS and OSP deletion trees only contain summaries of the values in the SPO deletion tree.
+     */
+    bool has_deletion_summaries() const;
+    /**
+     * The memory map and page cache of each tree are counted up to the size of its file,
+     * as they only occupy memory once the corresponding parts of the file have been read.
+     * The records that are buffered for the sorted runs of the POS and OSP trees are counted as well.
+     * @return An estimate of the number of bytes this store occupies in memory.
+     */
+    size_t get_memory_cost() const;
+    /**
+     * Replace the POS and OSP deletion trees with copies that contain summaries of the values in the SPO deletion tree.
+     * The copies replace the files of the trees once they are complete, while this store keeps reading the original trees,
+     * so it can be queried during the migration, and must be reopened to use the summaries.
+     * Nothing may be inserted into this store during or after the migration.
+     * Frozen stores can not be migrated anymore.
+     * @return If the files of the deletion trees only contain summaries after this call.
+     */
+    bool migrate_deletion_summaries();
+    /**
+     * @param base_file_name The base file name of a store.
+     * @return If the store with the given base file name has been frozen.
+     */
+    static bool is_frozen(const string& base_file_name);
     long flush_addition_counts();
+    /**
+     * Merge all records that were written to sorted runs into the POS and OSP trees.
+     * Until this is called, insertions are not visible in these trees.
+     * @param background If the merge should run in a separate thread, use wait_for_runs() to wait for it.
+     *                   Readers do not wait for the merge, as they only read the patches that were appended before.
+     */
+    void compact_runs(bool background = true);
+    /**
+     * Wait until the merges of all runs have finished, so that the POS and OSP trees are complete.
+     */
+    void wait_for_runs();
     void insertDeletionSingle(const PatchTreeKey* key, const PatchTreeDeletionValue* value, const PatchTreeDeletionValueReduced* value_reduced, kyotocabinet::DB::Cursor* cursor = nullptr);
     void insertDeletionSingle(const PatchTreeKey* key, const PatchPositions& patch_positions, int patch_id, bool local_change, bool ignore_existing, kyotocabinet::DB::Cursor* cursor = nullptr);
+    /**
+     * Overwrite the deletion value at the given cursor in the SPO deletion tree only.
+     * This may only be used for changes to the patch positions, as these are not stored in the POS and OSP deletion trees.
+     * @param value The new deletion value.
+     * @param cursor A cursor that points to the key in the SPO deletion tree.
+     */
+    void updateDeletionPositions(const PatchTreeDeletionValue* value, kyotocabinet::DB::Cursor* cursor);
     /**
      * @return The comparator for this patch tree in SPO order.
      */
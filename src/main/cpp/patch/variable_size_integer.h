@@ -1,9 +1,17 @@
 #ifndef OSTRICH_VARIABLE_SIZE_INTEGER_H
 #define OSTRICH_VARIABLE_SIZE_INTEGER_H
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The number of bytes in which the LEB128 block decoders find the value boundaries at once
+#define LEB128_BLOCK_SIZE 16
 
 
 inline size_t get_ULEB128_size(uint64_t value) {
@@ -59,6 +67,43 @@ inline void encode_SLEB128(int64_t value, std::vector<uint8_t>& p) {
     } while (is_more);
 }
 
+/**
+ * Encode an unsigned integer into a LEB128 value
+ * @param value the value to encode
+ * @param p the destination buffer, with room for at least get_ULEB128_size(value) bytes
+ * @return the amount of bytes encoded
+ */
+inline size_t encode_ULEB128(uint64_t value, uint8_t* p) {
+    size_t size = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value != 0)
+            byte |= 0x80;
+        p[size++] = byte;
+    } while (value);
+    return size;
+}
+
+/**
+ * Encode a signed integer into a LEB128 value
+ * @param value the value to encode
+ * @param p the destination buffer, with room for at least get_SLEB128_size(value) bytes
+ * @return the amount of bytes encoded
+ */
+inline size_t encode_SLEB128(int64_t value, uint8_t* p) {
+    size_t size = 0;
+    bool is_more;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        is_more = !((((value == 0 ) && ((byte & 0x40) == 0)) || ((value == -1) && ((byte & 0x40) != 0))));
+        if (is_more)
+            byte |= 0x80;
+        p[size++] = byte;
+    } while (is_more);
+    return size;
+}
 
 
 /**
@@ -116,4 +161,128 @@ inline int64_t decode_SLEB128(const uint8_t *p, size_t* decode_size = nullptr) {
     return value;
 }
 
+/**
+ * Find the bytes that end a LEB128 value, which are the bytes without continuation bit.
+ * @param block LEB128_BLOCK_SIZE bytes of LEB128 encoded data
+ * @return A bitmask with bit i set if byte i of the block ends a value
+ */
+inline uint32_t get_LEB128_terminators(const uint8_t* block) {
+#if defined(__SSE2__)
+    return ~(uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) block)) & 0xffff;
+#else
+    uint32_t continuations = 0;
+    for (int i = 0; i < 2; i++) {
+        uint64_t word;
+        std::memcpy(&word, block + 8 * i, sizeof(uint64_t));
+        // Gather the continuation bit of every byte into the highest byte
+        uint64_t bits = ((word >> 7) & 0x0101010101010101ULL) * 0x0102040810204080ULL;
+        continuations |= (uint32_t) (bits >> 56) << (8 * i);
+    }
+    return ~continuations & 0xffff;
+#endif
+}
+
+/**
+ * @param p LEB128 encoded data
+ * @param size the amount of bytes available
+ * @return If a LEB128 value ends within the available bytes
+ */
+inline bool is_LEB128_terminated(const uint8_t* p, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (p[i] < 128) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Decode a LEB128 value of at most 8 bytes without looping over its bytes.
+ * @param word The bytes of the value, in little endian order, the bytes after the value must be zero
+ * @return The decoded unsigned value
+ */
+inline uint64_t compact_LEB128_groups(uint64_t word) {
+    word &= 0x7f7f7f7f7f7f7f7fULL;
+    word = ((word & 0x7f007f007f007f00ULL) >> 1) | (word & 0x007f007f007f007fULL);
+    word = ((word & 0x3fff00003fff0000ULL) >> 2) | (word & 0x00003fff00003fffULL);
+    word = ((word & 0x0fffffff00000000ULL) >> 4) | (word & 0x000000000fffffffULL);
+    return word;
+}
+
+/**
+ * Decode multiple consecutive LEB128 values.
+ * The value boundaries are found for a full block of bytes at once, and values of at most 8 bytes are decoded branch-free.
+ * Longer values, and platforms that are not little endian, use the regular decoders.
+ * @tparam is_signed If the values are SLEB128 encoded, otherwise they are ULEB128 encoded
+ * @param p the data to decode
+ * @param size the amount of bytes available, no bytes after this are read
+ * @param values the array to decode into, for signed values these are two's complement
+ * @param count the maximum amount of values to decode
+ * @param decode_size the amount of bytes decoded
+ * @return the amount of values decoded, this is less than count if the data ends
+ */
+template<bool is_signed>
+inline size_t decode_LEB128_block(const uint8_t* p, size_t size, uint64_t* values, size_t count, size_t* decode_size) {
+    size_t offset = 0;
+    size_t decoded = 0;
+    while (decoded < count && offset < size) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // Pad the block, so that every value in it can be read as a full word
+        uint8_t block[LEB128_BLOCK_SIZE + sizeof(uint64_t)] = {0};
+        size_t block_size = std::min(size - offset, (size_t) LEB128_BLOCK_SIZE);
+        std::memcpy(block, p + offset, block_size);
+        uint32_t terminators = get_LEB128_terminators(block) & ((1u << block_size) - 1);
+        size_t start = 0;
+        while (decoded < count && terminators != 0) {
+            size_t end = __builtin_ctz(terminators);
+            size_t length = end - start + 1;
+            if (length > sizeof(uint64_t)) {
+                break;
+            }
+            uint64_t word;
+            std::memcpy(&word, block + start, sizeof(uint64_t));
+            if (length < sizeof(uint64_t)) {
+                word &= (1ULL << (8 * length)) - 1;
+            }
+            uint64_t value = compact_LEB128_groups(word);
+            if (is_signed && (value >> (7 * length - 1)) & 1) {
+                value |= ~0ULL << (7 * length);
+            }
+            values[decoded++] = value;
+            terminators &= terminators - 1;
+            start = end + 1;
+        }
+        offset += start;
+        if (start > 0 || decoded == count) {
+            continue;
+        }
+#endif
+        // The next value does not fit in a word, or is not terminated within the block
+        if (!is_LEB128_terminated(p + offset, size - offset)) {
+            throw std::runtime_error("LEB128 encoded value is truncated");
+        }
+        size_t value_size;
+        values[decoded++] = is_signed ? (uint64_t) decode_SLEB128(p + offset, &value_size) : decode_ULEB128(p + offset, &value_size);
+        offset += value_size;
+    }
+    if (decode_size) {
+        *decode_size = offset;
+    }
+    return decoded;
+}
+
+/**
+ * Decode multiple consecutive ULEB128 values, see decode_LEB128_block.
+ */
+inline size_t decode_ULEB128_block(const uint8_t* p, size_t size, uint64_t* values, size_t count, size_t* decode_size = nullptr) {
+    return decode_LEB128_block<false>(p, size, values, count, decode_size);
+}
+
+/**
+ * Decode multiple consecutive SLEB128 values, see decode_LEB128_block.
+ */
+inline size_t decode_SLEB128_block(const uint8_t* p, size_t size, int64_t* values, size_t count, size_t* decode_size = nullptr) {
+    return decode_LEB128_block<true>(p, size, reinterpret_cast<uint64_t*>(values), count, decode_size);
+}
+
 #endif //OSTRICH_VARIABLE_SIZE_INTEGER_H
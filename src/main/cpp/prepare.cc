@@ -0,0 +1,40 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../../main/cpp/snapshot/snapshot_manager.h"
+
+
+int main(int argc, char** argv) {
+    if (argc > 2) {
+        std::cerr << "ERROR: Prepare command must be invoked as '[nr_threads]' " << std::endl;
+        return 1;
+    }
+    unsigned nr_threads = argc == 2 ? std::stoul(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+
+    // Load the snapshots
+    SnapshotManager snapshotManager("./");
+    std::vector<int> snapshot_ids = snapshotManager.get_snapshots_ids();
+
+    // Build the HDT index and the sketch of every snapshot, so that the first queries do not have to
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < std::min((size_t) nr_threads, snapshot_ids.size()); i++) {
+        threads.emplace_back([&]() {
+            size_t index;
+            while ((index = next++) < snapshot_ids.size()) {
+                int snapshot_id = snapshot_ids[index];
+                snapshotManager.build_index(snapshot_id, false);
+                snapshotManager.get_snapshot_sketch(snapshot_id);
+                std::cerr << "Prepared snapshot " << snapshot_id << std::endl;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return 0;
+}
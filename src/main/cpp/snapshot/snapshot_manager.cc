@@ -1,17 +1,39 @@
 #include <HDTManager.hpp>
+#include <algorithm>
 #include <regex>
 #include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
 #include <hdt/BasicHDT.hpp>
 #include "snapshot_manager.h"
 #include "../patch/triple_store.h"
 #include "sorted_triple_iterator.h"
 
 
-SnapshotManager::SnapshotManager(std::string basePath, bool readonly, size_t cache_size) : basePath(basePath), max_loaded_snapshots(std::max((size_t)2,cache_size)), readonly(readonly) {
-    detect_snapshots();
+SnapshotManager::SnapshotManager(std::string basePath, bool readonly, size_t cache_size, std::shared_ptr<MemoryBudget> budget,
+                                 std::shared_ptr<StoreManifest> manifest)
+        : basePath(basePath), max_loaded_snapshots(std::max((size_t)2,cache_size)),
+          budget(budget != nullptr ? budget : std::make_shared<MemoryBudget>()), manifest(manifest), readonly(readonly) {
+    if (!read_manifest()) {
+        detect_snapshots();
+        if (manifest != nullptr) {
+            for (const auto& kv : loaded_snapshots) {
+                record_snapshot(kv.first);
+            }
+            manifest->write();
+        }
+    }
 }
 
-SnapshotManager::~SnapshotManager() = default;
+SnapshotManager::~SnapshotManager() {
+    budget->release_all(this);
+    // Index files must not be left half-written
+    std::lock_guard<std::mutex> lock(index_mutex);
+    for (auto& build : index_builds) {
+        build.second.wait();
+    }
+}
 
 int SnapshotManager::get_latest_snapshot(int patch_id) {
     std::shared_lock<std::shared_mutex> lock(mutex);
@@ -35,6 +57,7 @@ int SnapshotManager::get_latest_snapshot(int patch_id) {
 }
 
 std::shared_ptr<hdt::HDT> SnapshotManager::load_snapshot(int snapshot_id) {
+    wait_for_index(snapshot_id);
     std::unique_lock<std::shared_mutex> lock(mutex);
     std::shared_ptr<hdt::HDT> snapshot = nullptr;
     // We check if a snapshot is already loaded for the given snapshot_id
@@ -59,7 +82,6 @@ std::shared_ptr<hdt::HDT> SnapshotManager::load_snapshot(int snapshot_id) {
 
 std::shared_ptr<hdt::HDT> SnapshotManager::get_snapshot(int snapshot_id) {
     std::shared_ptr<hdt::HDT> snapshot = nullptr;
-    int sid = 0;
     if(snapshot_id < 0) {
         return snapshot;
     }
@@ -73,31 +95,54 @@ std::shared_ptr<hdt::HDT> SnapshotManager::get_snapshot(int snapshot_id) {
             it--;
         }
         snapshot = it->second;
-        sid = it->first;
-    }
-    if(snapshot == nullptr) {
-        return load_snapshot(snapshot_id);
+        if (snapshot != nullptr) {
+            // Cache hit, we only have to record the access, which does not require an exclusive lock
+            touch(it->first);
+            return snapshot;
+        }
     }
-    std::unique_lock<std::shared_mutex> x_lock(mutex);
-    update_cache(sid);
-    return snapshot;
+    return load_snapshot(snapshot_id);
 }
 
 std::shared_ptr<hdt::HDT> SnapshotManager::create_snapshot(int snapshot_id, hdt::IteratorTripleString* triples, std::string base_uri, hdt::ProgressListener* listener) {
+    write_snapshot(snapshot_id, triples, base_uri, listener);
+    return load_snapshot(snapshot_id);
+}
+
+size_t SnapshotManager::write_snapshot(int snapshot_id, hdt::IteratorTripleString* triples, std::string base_uri, hdt::ProgressListener* listener) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (loaded_snapshots.find(snapshot_id) != loaded_snapshots.end()) {
+            lock.unlock();
+            return get_snapshot(snapshot_id)->getTriples()->getNumberOfElements();
+        }
+    }
+
+    // The HDT file is generated without holding the lock, so that other snapshots can be written and queried meanwhile
+    auto *basicHdt = new hdt::BasicHDT();
+    basicHdt->loadFromTriples(triples, base_uri, listener);
+    basicHdt->saveToHDT((basePath + SNAPSHOT_FILENAME_BASE(snapshot_id)).c_str());
+    size_t triple_count = basicHdt->getTriples()->getNumberOfElements();
+    // The sketch is built from the triples that are still in memory, so that it never has to be calculated at query time
+    store_sketch(snapshot_id, compute_sketch(basicHdt));
+    delete basicHdt;
     {
         std::unique_lock<std::shared_mutex> lock(mutex);
-        auto it = loaded_snapshots.find(snapshot_id);
-        if (it == loaded_snapshots.end()) {
-            auto *basicHdt = new hdt::BasicHDT();
-            basicHdt->loadFromTriples(triples, base_uri, listener);
-            basicHdt->saveToHDT((basePath + SNAPSHOT_FILENAME_BASE(snapshot_id)).c_str());
-            delete basicHdt;
+        // The snapshot is loaded lazily, once its index is ready
+        loaded_snapshots[snapshot_id] = nullptr;
+        loaded_dictionaries[snapshot_id] = nullptr;
+        if (manifest != nullptr) {
+            record_snapshot(snapshot_id);
+            manifest->write();
         }
     }
-    return load_snapshot(snapshot_id);
+    build_index(snapshot_id, SNAPSHOT_INDEX_BACKGROUND);
+    return triple_count;
 }
 
 std::shared_ptr<hdt::HDT> SnapshotManager::create_snapshot(int snapshot_id, std::string triples_file, std::string base_uri, hdt::RDFNotation notation) {
+    HyperLogLog sketch;
+    bool created = false;
     {
         std::unique_lock<std::shared_mutex> lock(mutex);
         auto it = loaded_snapshots.find(snapshot_id);
@@ -105,9 +150,19 @@ std::shared_ptr<hdt::HDT> SnapshotManager::create_snapshot(int snapshot_id, std:
             auto *basicHdt = new hdt::BasicHDT();
             basicHdt->loadFromRDF(triples_file.c_str(), base_uri, notation);
             basicHdt->saveToHDT((basePath + SNAPSHOT_FILENAME_BASE(snapshot_id)).c_str());
+            sketch = compute_sketch(basicHdt);
+            created = true;
             delete basicHdt;
+            if (manifest != nullptr) {
+                record_snapshot(snapshot_id);
+                manifest->write();
+            }
         }
     }
+    if (created) {
+        store_sketch(snapshot_id, sketch);
+    }
+    build_index(snapshot_id, false);
     return load_snapshot(snapshot_id);
 }
 
@@ -137,6 +192,79 @@ const std::map<int, std::shared_ptr<hdt::HDT>>& SnapshotManager::detect_snapshot
     return loaded_snapshots;
 }
 
+bool SnapshotManager::read_manifest() {
+    if (manifest == nullptr || !manifest->is_loaded()) {
+        return false;
+    }
+    std::map<int, size_t> snapshots = manifest->get_snapshots();
+    if (snapshots.empty()) {
+        return false;
+    }
+    // Only the newest snapshot is checked, as older ones are never rewritten
+    struct stat sb{};
+    auto newest = snapshots.rbegin();
+    if (stat((basePath + SNAPSHOT_FILENAME_BASE(newest->first)).c_str(), &sb) != 0 || (size_t) sb.st_size != newest->second) {
+        return false;
+    }
+    // A snapshot that was created after the manifest was last written directly follows the newest version in there
+    int newest_version = newest->first;
+    std::map<int, StoreManifest::PatchTreeEntry> patch_trees = manifest->get_patch_trees();
+    if (!patch_trees.empty()) {
+        newest_version = std::max(newest_version, patch_trees.rbegin()->second.max_patch_id);
+    }
+    if (stat((basePath + SNAPSHOT_FILENAME_BASE(newest_version + 1)).c_str(), &sb) == 0) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    for (const auto& kv : snapshots) {
+        loaded_snapshots[kv.first] = nullptr; // Don't load the actual file, we do this lazily
+        loaded_dictionaries[kv.first] = nullptr; // We create a slot for the snapshot's dictionary
+    }
+    return true;
+}
+
+void SnapshotManager::record_snapshot(int snapshot_id) {
+    struct stat sb{};
+    if (stat((basePath + SNAPSHOT_FILENAME_BASE(snapshot_id)).c_str(), &sb) == 0) {
+        manifest->set_snapshot(snapshot_id, sb.st_size);
+    }
+}
+
+void SnapshotManager::build_index(int snapshot_id, bool background) {
+    std::string file_name = basePath + SNAPSHOT_FILENAME_BASE(snapshot_id);
+    struct stat sb;
+    std::shared_future<void> build;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        if (index_builds.find(snapshot_id) != index_builds.end()
+            || stat((basePath + SNAPSHOT_INDEX_FILENAME(snapshot_id)).c_str(), &sb) == 0
+            || stat(file_name.c_str(), &sb) != 0) {
+            return;
+        }
+        // Mapping the snapshot with index creates the index file, the mapping itself is discarded
+        build = std::async(std::launch::async, [file_name]() {
+            delete hdt::HDTManager::mapIndexedHDT(file_name.c_str());
+        }).share();
+        index_builds[snapshot_id] = build;
+    }
+    if (!background) {
+        build.wait();
+    }
+}
+
+void SnapshotManager::wait_for_index(int snapshot_id) {
+    std::shared_future<void> build;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        auto it = index_builds.find(snapshot_id);
+        if (it == index_builds.end()) {
+            return;
+        }
+        build = it->second;
+    }
+    build.wait();
+}
+
 std::vector<int> SnapshotManager::get_snapshots_ids() {
     std::shared_lock<std::shared_mutex> lock(mutex);
     std::vector<int> ids;
@@ -146,7 +274,67 @@ std::vector<int> SnapshotManager::get_snapshots_ids() {
     return ids;
 }
 
-hdt::IteratorTripleID* SnapshotManager::search_with_offset(std::shared_ptr<hdt::HDT> hdt, const Triple& triple_pattern, long offset, std::shared_ptr<DictionaryManager> dict, bool sort) {
+HyperLogLog SnapshotManager::get_snapshot_sketch(int snapshot_id) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = loaded_sketches.find(snapshot_id);
+        if (it != loaded_sketches.end()) {
+            return it->second;
+        }
+    }
+
+    HyperLogLog sketch;
+    std::ifstream in(basePath + SNAPSHOT_SKETCH_FILENAME(snapshot_id), std::ios::binary);
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string data = buffer.str();
+    if (!in.is_open() || !sketch.deserialize(data.data(), data.size())) {
+        // Snapshots of older stores do not have a sketch yet
+        std::shared_ptr<hdt::HDT> snapshot = get_snapshot(snapshot_id);
+        if (snapshot == nullptr) {
+            return sketch;
+        }
+        sketch = compute_sketch(snapshot.get());
+        store_sketch(snapshot_id, sketch);
+        return sketch;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    loaded_sketches[snapshot_id] = sketch;
+    return sketch;
+}
+
+HyperLogLog SnapshotManager::compute_sketch(hdt::HDT* hdt) {
+    HyperLogLog sketch;
+    TermHashCache term_hashes;
+    hdt::Dictionary* dictionary = hdt->getDictionary();
+    auto decode = [dictionary](size_t id, int position) {
+        return dictionary->idToString(id, position == 0 ? hdt::SUBJECT : (position == 1 ? hdt::PREDICATE : hdt::OBJECT));
+    };
+    // The triples are iterated by id, so the terms that are shared by consecutive triples are only decoded once
+    hdt::IteratorTripleID* it = hdt->getTriples()->searchAll();
+    while (it->hasNext()) {
+        hdt::TripleID* triple = it->next();
+        sketch.add(term_hashes.hash(triple->getSubject(), triple->getPredicate(), triple->getObject(), decode));
+    }
+    delete it;
+    return sketch;
+}
+
+void SnapshotManager::store_sketch(int snapshot_id, const HyperLogLog& sketch) {
+    if (!readonly) {
+        size_t size;
+        const char* raw_sketch = sketch.serialize(&size);
+        std::ofstream out(basePath + SNAPSHOT_SKETCH_FILENAME(snapshot_id), std::ios::binary | std::ios::trunc);
+        out.write(raw_sketch, size);
+        delete[] raw_sketch;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    loaded_sketches[snapshot_id] = sketch;
+}
+
+hdt::IteratorTripleID* SnapshotManager::search_with_offset(std::shared_ptr<hdt::HDT> hdt, const Triple& triple_pattern, long offset, std::shared_ptr<DictionaryManager> dict, bool sort,
+                                                           size_t limit) {
     size_t subject = triple_pattern.get_subject();
     size_t predicate = triple_pattern.get_predicate();
     size_t object = triple_pattern.get_object();
@@ -166,7 +354,8 @@ hdt::IteratorTripleID* SnapshotManager::search_with_offset(std::shared_ptr<hdt::
         hdt::TripleComponentOrder qr_order = TripleStore::get_query_order(triple_pattern);
         hdt::IteratorTripleID* it = hdt->getTriples()->search(tripleId);
         if (sort && qr_order != hdt::SPO) {
-            it = new SortedTripleIterator(it, qr_order, dict);
+            size_t sort_limit = limit > std::numeric_limits<size_t>::max() - (size_t) offset ? std::numeric_limits<size_t>::max() : (size_t) offset + limit;
+            it = new SortedTripleIterator(it, qr_order, dict, sort_limit);
         }
         if(it->canGoTo()) {
             try {
@@ -195,28 +384,39 @@ std::shared_ptr<DictionaryManager> SnapshotManager::get_dictionary_manager(int s
         return nullptr;
     }
     std::shared_ptr<DictionaryManager> dict = nullptr;
-    std::shared_lock<std::shared_mutex> s_lock(mutex);
-    auto it = loaded_dictionaries.find(snapshot_id);
-    if(it == loaded_dictionaries.end()) {
-        if(it == loaded_dictionaries.begin()) {
-            return nullptr; // We have an empty map
+    {
+        std::shared_lock<std::shared_mutex> s_lock(mutex);
+        auto it = loaded_dictionaries.find(snapshot_id);
+        if(it == loaded_dictionaries.end()) {
+            if(it == loaded_dictionaries.begin()) {
+                return nullptr; // We have an empty map
+            }
+            it--;
+        }
+        dict = it->second;
+        auto it_snapshot = loaded_snapshots.find(snapshot_id);
+        if (dict != nullptr && it_snapshot != loaded_snapshots.end() && it_snapshot->second != nullptr) {
+            // Cache hit, we only have to record the access, which does not require an exclusive lock
+            touch(snapshot_id);
+            return dict;
         }
-        it--;
     }
-    dict = it->second;
-    s_lock.unlock();
-    std::unique_lock<std::shared_mutex> u_lock(mutex);
-    if (dict == nullptr || loaded_snapshots[snapshot_id] == nullptr) {
+    {
+        std::unique_lock<std::shared_mutex> u_lock(mutex);
+        // Another thread may have loaded the snapshot in the meantime
+        if (loaded_dictionaries[snapshot_id] != nullptr && loaded_snapshots[snapshot_id] != nullptr) {
+            update_cache(snapshot_id);
+            return loaded_dictionaries[snapshot_id];
+        }
         // we make sure both the snapshot and dictionary are unloaded
         loaded_snapshots[snapshot_id] = nullptr;
         loaded_dictionaries[snapshot_id] = nullptr;
-        // we load the snapshot
-        u_lock.unlock();
-        auto s_ptr = load_snapshot(snapshot_id);
-        return loaded_dictionaries[snapshot_id];
+        budget->release(this, snapshot_id);
     }
-    update_cache(snapshot_id);
-    return dict;
+    // we load the snapshot
+    auto s_ptr = load_snapshot(snapshot_id);
+    std::shared_lock<std::shared_mutex> s_lock(mutex);
+    return loaded_dictionaries[snapshot_id];
 }
 
 int SnapshotManager::get_max_snapshot_id() {
@@ -231,33 +431,90 @@ int SnapshotManager::get_max_snapshot_id() {
     return it->first;
 }
 
-void SnapshotManager::update_cache(int accessed_snapshot_id) {
-    update_cache_internal(accessed_snapshot_id, lru_map.size());
+void SnapshotManager::touch(int snapshot_id) {
+    auto it = last_access.find(snapshot_id);
+    if (it != last_access.end()) {
+        it->second.store(budget->tick(), std::memory_order_relaxed);
+    }
 }
 
-void SnapshotManager::update_cache_internal(int accessed_id, int iterations) {
-    if (lru_map.size() >= max_loaded_snapshots) {
-        if (iterations >= 0) {
-            int lru_snapshot_id = lru_list.back();
-            lru_list.pop_back();
-            lru_map.erase(lru_snapshot_id);
-            if (!loaded_snapshots[lru_snapshot_id].unique() || !loaded_dictionaries[lru_snapshot_id].unique() || lru_snapshot_id == accessed_id) {
-                // the snapshot or dictionary we want to unload is still used somewhere
-                // so we push it to the front of the list
-                lru_list.push_front(lru_snapshot_id);
-                lru_map[lru_snapshot_id] = lru_list.begin();
-                update_cache_internal(accessed_id, --iterations);
-            } else {
-                loaded_snapshots[lru_snapshot_id] = nullptr;
-                loaded_dictionaries[lru_snapshot_id] = nullptr;
+void SnapshotManager::update_cache(int accessed_snapshot_id) {
+    std::atomic<uint64_t>& accessed = last_access[accessed_snapshot_id];
+    accessed.store(budget->tick(), std::memory_order_relaxed);
+    budget->charge(this, accessed_snapshot_id, get_memory_cost(accessed_snapshot_id), &accessed);
+    size_t loaded_count = 0;
+    for (const auto& kv: loaded_snapshots) {
+        if (kv.second != nullptr) {
+            loaded_count++;
+        }
+    }
+    while (loaded_count > max_loaded_snapshots) {
+        // Find the least recently used snapshot that is not used anywhere else anymore
+        int lru_snapshot_id = -1;
+        uint64_t lru_time = std::numeric_limits<uint64_t>::max();
+        for (const auto& kv: loaded_snapshots) {
+            if (kv.first == accessed_snapshot_id || kv.second == nullptr || !kv.second.unique()) {
+                continue;
+            }
+            auto it_dict = loaded_dictionaries.find(kv.first);
+            if (it_dict != loaded_dictionaries.end() && it_dict->second != nullptr && !it_dict->second.unique()) {
+                continue;
             }
+            auto it_access = last_access.find(kv.first);
+            uint64_t time = it_access != last_access.end() ? it_access->second.load(std::memory_order_relaxed) : 0;
+            if (time < lru_time) {
+                lru_time = time;
+                lru_snapshot_id = kv.first;
+            }
+        }
+        if (lru_snapshot_id < 0) {
+            // All other snapshots are still in use, so we temporarily exceed the cache size
+            break;
         }
+        unload(lru_snapshot_id);
+        loaded_count--;
     }
-    if (lru_map.find(accessed_id) != lru_map.end()) {
-        lru_list.erase(lru_map[accessed_id]);
+    budget->enforce(this, accessed_snapshot_id, [this](int snapshot_id) { return unload(snapshot_id); });
+}
+
+bool SnapshotManager::unload(int snapshot_id) {
+    auto it = loaded_snapshots.find(snapshot_id);
+    if (it == loaded_snapshots.end() || it->second == nullptr || !it->second.unique()) {
+        return false;
+    }
+    auto it_dict = loaded_dictionaries.find(snapshot_id);
+    if (it_dict != loaded_dictionaries.end() && it_dict->second != nullptr && !it_dict->second.unique()) {
+        return false;
+    }
+    it->second = nullptr;
+    loaded_dictionaries[snapshot_id] = nullptr;
+    budget->release(this, snapshot_id);
+    return true;
+}
+
+bool SnapshotManager::try_evict(int snapshot_id) {
+    std::unique_lock<std::shared_mutex> lock(mutex, std::try_to_lock);
+    return lock.owns_lock() && unload(snapshot_id);
+}
+
+size_t SnapshotManager::get_memory_cost(int snapshot_id) {
+    size_t cost = 0;
+    struct stat sb{};
+    for (const std::string& file_name : {SNAPSHOT_FILENAME_BASE(snapshot_id), SNAPSHOT_INDEX_FILENAME(snapshot_id)}) {
+        if (stat((basePath + file_name).c_str(), &sb) == 0) {
+            cost += sb.st_size;
+        }
     }
-    lru_list.push_front(accessed_id);
-    lru_map[accessed_id] = lru_list.begin();
+    auto it_dict = loaded_dictionaries.find(snapshot_id);
+    if (it_dict != loaded_dictionaries.end() && it_dict->second != nullptr) {
+        // The HDT dictionary is part of the mapped file, so only the dictionary of the patches is added
+        cost += it_dict->second->getPatchDict()->size();
+    }
+    return cost;
+}
+
+std::shared_ptr<MemoryBudget> SnapshotManager::get_memory_budget() const {
+    return budget;
 }
 
 void SnapshotManager::set_cache_max_size(size_t new_size) {
@@ -2,34 +2,98 @@
 #define TPFPATCH_STORE_SNAPSHOT_MANAGER_H
 
 #define SNAPSHOT_FILENAME_BASE(id) ("snapshot_" + std::to_string(id) + ".hdt")
+#define SNAPSHOT_SKETCH_FILENAME(id) (SNAPSHOT_FILENAME_BASE(id) + ".hll")
+#define SNAPSHOT_INDEX_FILENAME(id) (SNAPSHOT_FILENAME_BASE(id) + ".index.v1-1")
+
+// If the HDT index of a new snapshot is built in a background thread as soon as it is written,
+// instead of synchronously when it is first loaded
+#ifndef SNAPSHOT_INDEX_BACKGROUND
+#define SNAPSHOT_INDEX_BACKGROUND true
+#endif
 
 #include <memory>
+#include <atomic>
+#include <future>
+#include <limits>
+#include <mutex>
 #include <shared_mutex>
 #include <HDT.hpp>
 #include "../patch/patch.h"
 #include <Dictionary.hpp>
 #include "../dictionary/dictionary_manager.h"
+#include "../patch/count_sketch.h"
+#include "../patch/memory_budget.h"
+#include "../patch/store_manifest.h"
 
 
-class SnapshotManager {
+class SnapshotManager : public MemoryBudget::Cache {
 private:
     std::string basePath;
 
     size_t max_loaded_snapshots;
-    std::list<int> lru_list;
-    std::map<int, std::list<int>::iterator> lru_map;
+    // The memory budget that loaded snapshots and their dictionaries are charged to, which may be shared with other caches
+    std::shared_ptr<MemoryBudget> budget;
+    // The manifest that lists the snapshots of the store, can be null
+    std::shared_ptr<StoreManifest> manifest;
+    // Last access time per snapshot id on the clock of the budget, used for LRU eviction.
+    // Access times are atomics, so cache hits only need to take a shared lock.
+    std::map<int, std::atomic<uint64_t>> last_access;
 
     std::map<int, std::shared_ptr<hdt::HDT>> loaded_snapshots;
     std::map<int, std::shared_ptr<DictionaryManager>> loaded_dictionaries;
+    std::map<int, HyperLogLog> loaded_sketches;
     bool readonly;
 
     std::shared_mutex mutex;
 
-    void update_cache_internal(int accessed_id, int iterations);
+    // Index builds per snapshot id that were started, a snapshot must not be mapped before its build has finished
+    std::map<int, std::shared_future<void>> index_builds;
+    std::mutex index_mutex;
+
+    /**
+     * Mark the given snapshot as accessed.
+     * This only requires a shared lock on the manager.
+     */
+    void touch(int snapshot_id);
+    /**
+     * Unload the given snapshot and its dictionary if they are not in use anymore.
+     * @note The caller must hold an exclusive lock on this manager.
+     * @return If the snapshot has been unloaded.
+     */
+    bool unload(int snapshot_id);
+    /**
+     * The mapped HDT file and index are counted completely, as their pages are shared with the page cache of the OS.
+     * @note The caller must hold a lock on this manager.
+     * @return An estimate of the number of bytes the given loaded snapshot and its dictionary occupy in memory.
+     */
+    size_t get_memory_cost(int snapshot_id);
+    /**
+     * Find all snapshots in the manifest, if the newest one still matches its file,
+     * and no snapshot exists directly after the newest version in the manifest.
+     * @return If the snapshots have been found, otherwise they must be detected.
+     */
+    bool read_manifest();
+    /**
+     * Calculate the HyperLogLog sketch of the triples in the given HDT file.
+     * @param hdt A HDT file.
+     * @return The sketch.
+     */
+    static HyperLogLog compute_sketch(hdt::HDT* hdt);
+    /**
+     * Persist the given sketch next to the given snapshot, unless this manager is read-only, and keep it in memory.
+     * @param snapshot_id The snapshot id.
+     * @param sketch The sketch of the snapshot.
+     */
+    void store_sketch(int snapshot_id, const HyperLogLog& sketch);
+    /**
+     * Add the given snapshot to the manifest, without writing it.
+     */
+    void record_snapshot(int snapshot_id);
 
 public:
-    explicit SnapshotManager(string basePath, bool readonly = false, size_t cache_size = 4);
-    ~SnapshotManager();
+    explicit SnapshotManager(string basePath, bool readonly = false, size_t cache_size = 4, std::shared_ptr<MemoryBudget> budget = nullptr,
+                             std::shared_ptr<StoreManifest> manifest = nullptr);
+    ~SnapshotManager() override;
     /**
      * Get the id of the snapshot that is smaller or equal than the given patch id.
      * @param patch_id The patch id to look up.
@@ -57,6 +121,17 @@ public:
      * @return The created snapshot
      */
     std::shared_ptr<hdt::HDT> create_snapshot(int snapshot_id, hdt::IteratorTripleString* triples, string base_uri, hdt::ProgressListener* listener = NULL);
+    /**
+     * Create a HDT file for the given snapshot id, without loading it.
+     * Its index is built right away, in a background thread if SNAPSHOT_INDEX_BACKGROUND is true,
+     * so that other work can be done until the snapshot is loaded for the first time.
+     * Snapshots with different ids can be written concurrently, the same id must only be written by a single thread.
+     * @param snapshot_id The id for the new snapshot
+     * @param triples The stream of triples to create a snapshot from.
+     * @param base_uri The base uri for the triples graph.
+     * @return The number of triples in the snapshot.
+     */
+    size_t write_snapshot(int snapshot_id, hdt::IteratorTripleString* triples, string base_uri, hdt::ProgressListener* listener = NULL);
     /**
      * Create a HDT file for the given snapshot id.
      * It will automatically be persisted in this manager.
@@ -73,12 +148,34 @@ public:
      */
     const std::map<int, std::shared_ptr<hdt::HDT>>& detect_snapshots();
 
+    /**
+     * Build the HDT index file of the given snapshot if it does not exist yet.
+     * Loading the snapshot waits until the build has finished.
+     * @param snapshot_id The snapshot id.
+     * @param background If the index should be built in a separate thread, use wait_for_index() to wait for it.
+     */
+    void build_index(int snapshot_id, bool background = true);
+    /**
+     * Wait until the index build of the given snapshot, if any, has finished.
+     * @param snapshot_id The snapshot id.
+     */
+    void wait_for_index(int snapshot_id);
+
     /**
      * Get the ids of the available snapshots
      * @return the ids
      */
     std::vector<int> get_snapshots_ids();
 
+    /**
+     * Get the HyperLogLog sketch of the triples in the given snapshot.
+     * The sketch is persisted next to the snapshot when it is created,
+     * it is only calculated on first use for snapshots of older stores.
+     * @param snapshot_id The snapshot id.
+     * @return The sketch, empty if the snapshot does not exist.
+     */
+    HyperLogLog get_snapshot_sketch(int snapshot_id);
+
     /**
      * Search the given triple pattern in the given hdt file with a certain offset.
      * @param hdt A hdt file
@@ -86,9 +183,11 @@ public:
      * @param offset The offset the iterator should start from.
      * @param dict optional dict to help translating triple_pattern to HDT with correct ID (i.e. use max ID when unknown by HDT)
      * @param sort whether the HDT iterator should be sorted
+     * @param limit If sorted, only the first offset + limit triples will be sorted and kept.
      * @return the iterator.
      */
-    static hdt::IteratorTripleID* search_with_offset(std::shared_ptr<hdt::HDT> hdt, const Triple& triple_pattern, long offset, std::shared_ptr<DictionaryManager> dict = nullptr, bool sort = false);
+    static hdt::IteratorTripleID* search_with_offset(std::shared_ptr<hdt::HDT> hdt, const Triple& triple_pattern, long offset, std::shared_ptr<DictionaryManager> dict = nullptr, bool sort = false,
+                                                     size_t limit = std::numeric_limits<size_t>::max());
 
     /**
      * @return The DictionaryManager file for the given snapshot id.
@@ -96,9 +195,16 @@ public:
     std::shared_ptr<DictionaryManager> get_dictionary_manager(int snapshot_id);
 
     /**
-     * Update the state of the patch cache
+     * Update the state of the snapshot cache, unloading the least recently used snapshots that are not in use anymore,
+     * until both the maximum number of snapshots and the memory budget are respected.
+     * @note The caller must hold an exclusive lock on this manager.
      */
     void update_cache(int accessed_snapshot_id);
+    bool try_evict(int snapshot_id) override;
+    /**
+     * @return The memory budget that loaded snapshots and their dictionaries are charged to.
+     */
+    std::shared_ptr<MemoryBudget> get_memory_budget() const;
 
     void set_cache_max_size(size_t new_size);
 
@@ -1,13 +1,32 @@
+#include <algorithm>
 #include "sorted_triple_iterator.h"
 
 
-SortedTripleIterator::SortedTripleIterator(hdt::IteratorTripleID *source_it, hdt::TripleComponentOrder order, std::shared_ptr<DictionaryManager> dict) : order(order) {
-    while (source_it->hasNext()) {
-        hdt::TripleID* tmp_t = source_it->next();
-        triples.emplace_back(tmp_t->getSubject(), tmp_t->getPredicate(), tmp_t->getObject());
-    }
+SortedTripleIterator::SortedTripleIterator(hdt::IteratorTripleID *source_it, hdt::TripleComponentOrder order, std::shared_ptr<DictionaryManager> dict,
+                                           size_t limit) : order(order) {
     std::unique_ptr<TripleComparator> comparator = std::unique_ptr<TripleComparator>(TripleComparator::get_triple_comparator(order, dict, dict));
-    std::sort(triples.begin(), triples.end(), *comparator);
+    if (limit == std::numeric_limits<size_t>::max()) {
+        while (source_it->hasNext()) {
+            hdt::TripleID* tmp_t = source_it->next();
+            triples.emplace_back(tmp_t->getSubject(), tmp_t->getPredicate(), tmp_t->getObject());
+        }
+        std::sort(triples.begin(), triples.end(), *comparator);
+    } else if (limit > 0) {
+        // Top-K: keep a max-heap of the smallest triples seen so far
+        while (source_it->hasNext()) {
+            hdt::TripleID* tmp_t = source_it->next();
+            if (triples.size() == limit) {
+                if (!(*comparator)(*tmp_t, triples.front())) {
+                    continue;
+                }
+                std::pop_heap(triples.begin(), triples.end(), *comparator);
+                triples.pop_back();
+            }
+            triples.emplace_back(tmp_t->getSubject(), tmp_t->getPredicate(), tmp_t->getObject());
+            std::push_heap(triples.begin(), triples.end(), *comparator);
+        }
+        std::sort_heap(triples.begin(), triples.end(), *comparator);
+    }
     pos = triples.begin();
     delete source_it;
 }
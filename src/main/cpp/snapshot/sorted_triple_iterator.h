@@ -3,6 +3,7 @@
 
 #include "../patch/triple_comparator.h"
 #include <Triples.hpp>
+#include <limits>
 
 
 class SortedTripleIterator: public hdt::IteratorTripleID {
@@ -13,7 +14,15 @@ private:
     hdt::TripleComponentOrder order;
 
 public:
-    SortedTripleIterator(hdt::IteratorTripleID* source_it, hdt::TripleComponentOrder order, std::shared_ptr<DictionaryManager> dict);
+    /**
+     * @param source_it The iterator to sort, this will be deleted.
+     * @param order The order to sort in.
+     * @param dict The dictionary of the triples.
+     * @param limit Only the first limit triples in the given order are kept,
+     *              these are selected with a bounded heap so that the full source is never kept in memory.
+     */
+    SortedTripleIterator(hdt::IteratorTripleID* source_it, hdt::TripleComponentOrder order, std::shared_ptr<DictionaryManager> dict,
+                         size_t limit = std::numeric_limits<size_t>::max());
 
     bool hasNext() override;
     hdt::TripleID* next() override;
@@ -67,15 +67,33 @@ void test_lookups_for_queries_ms(BearEvaluatorMS &evaluator, const string& queri
     std::cout << "---QUERIES END---" << std::endl;
 }
 
+void test_concurrent_lookups_for_queries_ms(BearEvaluatorMS &evaluator, const string& queriesFilePath, int replications, int max_threads) {
+    std::ifstream queriesFile(queriesFilePath);
+    std::string line;
+    std::vector<StringTriple> triple_patterns;
+    while (std::getline(queriesFile, line)) {
+        std::vector<string> line_split = split(line, " ");
+        triple_patterns.emplace_back(
+                remove_brackets(line_split[0]),
+                remove_brackets(line_split[1]),
+                remove_brackets(line_split[2])
+        );
+    }
+    std::cout << "---QUERIES START: " << queriesFilePath << "---" << std::endl;
+    evaluator.test_concurrent_lookup(triple_patterns, replications, max_threads);
+    std::cout << "---QUERIES END---" << std::endl;
+}
+
 
 int main(int argc, char *argv[]) {
     if (argc < 4 || argc > 9) {
-        std::cerr << "Usage: " << argv[0] << " ingest|ingest-query|query|stats " << std::endl;
+        std::cerr << "Usage: " << argv[0] << " ingest|ingest-query|query|query-concurrent|stats " << std::endl;
         std::cerr << "\tcmd \"ingest\": strategy strategy_parameter path_to_patches start_index end_index" << std::endl;
         std::cerr
                 << "\tcmd \"ingest-query\": strategy strategy_parameter path_to_patches start_index end_index path_to_queries_file replications"
                 << std::endl;
         std::cerr << "\tcmd \"query\": path_to_queries_file replications" << std::endl;
+        std::cerr << "\tcmd \"query-concurrent\": path_to_queries_file replications max_threads" << std::endl;
         return 1;
     }
 
@@ -94,6 +112,9 @@ int main(int argc, char *argv[]) {
     } else if (std::strcmp("query", argv[1]) == 0) {
         evaluator.init_readonly("./", false);
         test_lookups_for_queries_ms(evaluator, ((std::string) argv[2]), stoi(argv[3]));
+    } else if (std::strcmp("query-concurrent", argv[1]) == 0) {
+        evaluator.init_readonly("./", false);
+        test_concurrent_lookups_for_queries_ms(evaluator, ((std::string) argv[2]), stoi(argv[3]), stoi(argv[4]));
     } else if (std::strcmp("stats", argv[1]) == 0) {
         evaluator.init_readonly("./", false);
         evaluator.compute_statistics();
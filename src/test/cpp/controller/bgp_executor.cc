@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+#include <regex>
+#include <set>
+#include <memory>
+#include <dirent.h>
+
+#include "../../../main/cpp/controller/bgp_executor.h"
+
+#define TESTPATH "./"
+
+// Patch trees can be deleted after their controller, so their meta files have to be removed separately
+static void clean_bgp_meta_files() {
+    std::regex r("meta_([0-9]+).dat");
+    std::smatch base_match;
+    DIR *dir;
+    struct dirent *ent;
+    if ((dir = opendir(TESTPATH)) != nullptr) {
+        while ((ent = readdir(dir)) != nullptr) {
+            std::string dir_name = std::string(ent->d_name);
+            if(std::regex_match(dir_name, base_match, r)) {
+                std::remove(base_match.str().c_str());
+            }
+        }
+        closedir(dir);
+    }
+}
+
+// The fixture for testing class BGPExecutor.
+class BGPExecutorTest : public ::testing::Test {
+protected:
+    Controller* controller;
+    SnapshotCreationStrategy* strategy;
+    std::vector<StringTriple> patterns;
+
+    BGPExecutorTest() {
+        // 0 (snapshot), 1 (patch), 2 (patch), 3 (snapshot)
+        strategy = new CreateSnapshotEveryN(3);
+        controller = new Controller(TESTPATH, strategy);
+    }
+
+    virtual void SetUp() {
+        clean_bgp_meta_files();
+
+        // Version 0
+        controller->new_patch_bulk()
+                ->addition(hdt::TripleString("<a>", "<knows>", "<b>"))
+                ->addition(hdt::TripleString("<b>", "<knows>", "<c>"))
+                ->addition(hdt::TripleString("<b>", "<name>", "\"B\""))
+                ->addition(hdt::TripleString("<c>", "<name>", "\"C\""))
+                ->commit();
+        // Version 1, <d> only occurs in the patch, so its subject and object ids differ
+        controller->new_patch_bulk()
+                ->addition(hdt::TripleString("<c>", "<knows>", "<d>"))
+                ->addition(hdt::TripleString("<d>", "<name>", "\"D\""))
+                ->commit();
+        // Version 2
+        controller->new_patch_bulk()
+                ->deletion(hdt::TripleString("<b>", "<knows>", "<c>"))
+                ->commit();
+        // Version 3
+        controller->new_patch_bulk()
+                ->addition(hdt::TripleString("<a>", "<name>", "\"A\""))
+                ->commit();
+
+        patterns = {
+                StringTriple("?x", "<knows>", "?y"),
+                StringTriple("?y", "<name>", "?n"),
+        };
+    }
+
+    virtual void TearDown() {
+        Controller::cleanup(TESTPATH, controller);
+        clean_bgp_meta_files();
+    }
+
+    static std::set<std::vector<std::string>> get_values(BGPSolutionIterator* it) {
+        std::set<std::vector<std::string>> values;
+        BGPSolution solution;
+        while (it->next(&solution)) {
+            values.insert(solution.get_values());
+        }
+        delete it;
+        return values;
+    }
+};
+
+TEST_F(BGPExecutorTest, VersionMaterialized) {
+    BGPExecutor executor(controller, patterns);
+    ASSERT_EQ(std::vector<std::string>({"?x", "?y", "?n"}), executor.get_projection()) << "Projection is incorrect";
+
+    std::set<std::vector<std::string>> expected0 = {
+            {"<a>", "<b>", "\"B\""},
+            {"<b>", "<c>", "\"C\""},
+    };
+    ASSERT_EQ(expected0, get_values(executor.get_version_materialized(0))) << "Solutions are incorrect";
+
+    std::set<std::vector<std::string>> expected1 = {
+            {"<a>", "<b>", "\"B\""},
+            {"<b>", "<c>", "\"C\""},
+            {"<c>", "<d>", "\"D\""},
+    };
+    ASSERT_EQ(expected1, get_values(executor.get_version_materialized(1))) << "Solutions are incorrect";
+
+    std::set<std::vector<std::string>> expected2 = {
+            {"<a>", "<b>", "\"B\""},
+            {"<c>", "<d>", "\"D\""},
+    };
+    ASSERT_EQ(expected2, get_values(executor.get_version_materialized(2))) << "Solutions are incorrect";
+    ASSERT_EQ(expected2, get_values(executor.get_version_materialized(3))) << "Solutions are incorrect";
+}
+
+TEST_F(BGPExecutorTest, VersionMaterializedJoinStrategies) {
+    for (int version = 0; version < 4; version++) {
+        BGPExecutor executor_auto(controller, patterns);
+        BGPExecutor executor_bind(controller, patterns);
+        executor_bind.set_join_strategy(BGP_JOIN_BIND);
+        BGPExecutor executor_hash(controller, patterns);
+        executor_hash.set_join_strategy(BGP_JOIN_HASH);
+
+        std::set<std::vector<std::string>> expected = get_values(executor_auto.get_version_materialized(version));
+        ASSERT_EQ(expected, get_values(executor_bind.get_version_materialized(version))) << "Bind join differs at version " << version;
+        ASSERT_EQ(expected, get_values(executor_hash.get_version_materialized(version))) << "Hash join differs at version " << version;
+    }
+}
+
+TEST_F(BGPExecutorTest, VersionMaterializedProjection) {
+    BGPExecutor executor(controller, patterns, {"?n"});
+    std::set<std::vector<std::string>> expected = {{"\"B\""}, {"\"C\""}, {"\"D\""}};
+    ASSERT_EQ(expected, get_values(executor.get_version_materialized(1))) << "Solutions are incorrect";
+
+    ASSERT_THROW(BGPExecutor(controller, patterns, {"?z"}), std::invalid_argument) << "Unknown variables can not be projected";
+}
+
+TEST_F(BGPExecutorTest, VersionMaterializedUnknownTerm) {
+    BGPExecutor executor(controller, {StringTriple("?x", "<unknown>", "?y")});
+    ASSERT_EQ(0, std::unique_ptr<BGPSolutionIterator>(executor.get_version_materialized(0))->get_count()) << "Count is incorrect";
+}
+
+TEST_F(BGPExecutorTest, DeltaMaterialized) {
+    BGPExecutor executor(controller, patterns);
+
+    BGPSolutionIterator* it = executor.get_delta_materialized(0, 2);
+    std::set<std::vector<std::string>> additions;
+    std::set<std::vector<std::string>> deletions;
+    BGPSolution solution;
+    while (it->next(&solution)) {
+        (solution.is_addition() ? additions : deletions).insert(solution.get_values());
+    }
+    delete it;
+    ASSERT_EQ(std::set<std::vector<std::string>>({{"<c>", "<d>", "\"D\""}}), additions) << "Additions are incorrect";
+    ASSERT_EQ(std::set<std::vector<std::string>>({{"<b>", "<c>", "\"C\""}}), deletions) << "Deletions are incorrect";
+
+    ASSERT_EQ(1, std::unique_ptr<BGPSolutionIterator>(executor.get_delta_materialized(0, 1))->get_count()) << "Count is incorrect";
+    ASSERT_EQ(1, std::unique_ptr<BGPSolutionIterator>(executor.get_delta_materialized(1, 3))->get_count()) << "Count is incorrect";
+    ASSERT_EQ(0, std::unique_ptr<BGPSolutionIterator>(executor.get_delta_materialized(2, 3))->get_count()) << "Count is incorrect";
+}
+
+TEST_F(BGPExecutorTest, DeltaMaterializedDuplicateValues) {
+    // Version 4
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<knows>", "<c>"))
+            ->addition(hdt::TripleString("<a>", "<knows>", "<d>"))
+            ->commit();
+
+    // Both added triples lead to a solution with the same values, which must not be merged, like in version materialized queries
+    BGPExecutor executor_anonymous(controller, {StringTriple("?x", "<knows>", "")});
+    ASSERT_EQ(2, std::unique_ptr<BGPSolutionIterator>(executor_anonymous.get_delta_materialized(3, 4))->get_count())
+                                << "Solutions of different anonymous values must all be emitted";
+    ASSERT_EQ(4, std::unique_ptr<BGPSolutionIterator>(executor_anonymous.get_version_materialized(4))->get_count())
+                                << "Count is incorrect";
+
+    BGPExecutor executor_projection(controller, {StringTriple("?x", "<knows>", "?y")}, {"?x"});
+    ASSERT_EQ(2, std::unique_ptr<BGPSolutionIterator>(executor_projection.get_delta_materialized(3, 4))->get_count())
+                                << "Solutions of different non-projected values must all be emitted";
+}
+
+TEST_F(BGPExecutorTest, Version) {
+    BGPExecutor executor(controller, patterns, {"?x", "?y"});
+    BGPSolutionIterator* it = executor.get_version();
+    std::map<std::vector<std::string>, std::vector<int>> solutions;
+    BGPSolution solution;
+    while (it->next(&solution)) {
+        solutions[solution.get_values()] = solution.get_versions();
+    }
+    delete it;
+
+    std::map<std::vector<std::string>, std::vector<int>> expected = {
+            {{"<a>", "<b>"}, {0, 1, 2, 3}},
+            {{"<b>", "<c>"}, {0, 1}},
+            {{"<c>", "<d>"}, {1, 2, 3}},
+    };
+    ASSERT_EQ(expected, solutions) << "Solutions are incorrect";
+}
+
+TEST_F(BGPExecutorTest, VersionAnonymous) {
+    // Version 4
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<knows>", "<c>"))
+            ->commit();
+
+    // Solutions of both delta chains are merged, but only if they match the same triples through the anonymous variable
+    BGPExecutor executor(controller, {StringTriple("?x", "<knows>", "")});
+    BGPSolutionIterator* it = executor.get_version();
+    std::multiset<std::pair<std::vector<std::string>, std::vector<int>>> solutions;
+    BGPSolution solution;
+    while (it->next(&solution)) {
+        solutions.insert(std::make_pair(solution.get_values(), solution.get_versions()));
+    }
+    delete it;
+
+    std::multiset<std::pair<std::vector<std::string>, std::vector<int>>> expected = {
+            {{"<a>"}, {0, 1, 2, 3, 4}},
+            {{"<a>"}, {4}},
+            {{"<b>"}, {0, 1}},
+            {{"<c>"}, {1, 2, 3, 4}},
+    };
+    ASSERT_EQ(expected, solutions) << "Solutions are incorrect";
+}
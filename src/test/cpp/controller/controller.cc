@@ -1,6 +1,13 @@
 #include <gtest/gtest.h>
 #include <regex>
 #include <dirent.h>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <atomic>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "../../../main/cpp/controller/controller.h"
 #include "../../../main/cpp/snapshot/vector_triple_iterator.h"
@@ -3502,3 +3509,933 @@ TEST_F(ControllerMSTest2, GetVersionMS3) {
 
     ASSERT_EQ(false, it0->next(&t)) << "Iterator should be finished";
 }
+
+TEST_F(ControllerMSTest2, ConcurrentReads) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5, 6 (snapshot), 7
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<e>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+
+    // Force evictions while querying
+    controller->get_snapshot_manager()->set_cache_max_size(2);
+    controller->get_patch_tree_manager()->set_cache_max_size(2);
+
+    std::vector<size_t> expected_vm = {2, 1, 2, 3, 2, 1, 2, 3};
+    std::vector<size_t> expected_dm = {0, 1, 2, 5, 4, 3, 2, 3};
+
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int thread_id = 0; thread_id < 8; thread_id++) {
+        threads.emplace_back([&, thread_id]() {
+            for (int replication = 0; replication < 20; replication++) {
+                for (int i = 0; i < 8; i++) {
+                    // Different threads walk over the versions in a different order
+                    int version = (i + thread_id) % 8;
+                    TripleIterator* it_vm = controller->get_version_materialized(StringTriple("", "", ""), 0, version);
+                    Triple t;
+                    size_t count_vm = 0;
+                    while (it_vm->next(&t)) count_vm++;
+                    delete it_vm;
+                    if (count_vm != expected_vm[version]) errors++;
+
+                    if (version > 0) {
+                        TripleDeltaIterator* it_dm = controller->get_delta_materialized(StringTriple("", "", ""), 0, 0, version);
+                        TripleDelta td;
+                        size_t count_dm = 0;
+                        while (it_dm->next(&td)) count_dm++;
+                        delete it_dm;
+                        if (count_dm != expected_dm[version]) errors++;
+                    }
+                }
+                TripleVersionsIterator* it_vq = controller->get_version(StringTriple("", "", ""), 0);
+                TripleVersions tv;
+                size_t count_vq = 0;
+                while (it_vq->next(&tv)) count_vq++;
+                delete it_vq;
+                if (count_vq != 5) errors++;
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(0, errors.load()) << "Concurrent reads returned incorrect results";
+}
+
+TEST_F(ControllerMSTest2, GetVersionMaterializedCountSeries) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+
+    std::vector<StringTriple> patterns = {
+            StringTriple("", "", ""),
+            StringTriple("<a>", "", ""),
+            StringTriple("", "<b>", ""),
+            StringTriple("", "", "<a>"),
+    };
+    for (const StringTriple& pattern : patterns) {
+        std::vector<size_t> expected;
+        for (int version = 0; version <= 4; version++) {
+            expected.push_back(controller->get_version_materialized_count(pattern, version).first);
+        }
+        ASSERT_EQ(expected, controller->get_version_materialized_count_series(pattern, 0, 4)) << "Series is incorrect for " << pattern.to_string();
+
+        std::vector<size_t> expected_sub(expected.begin() + 1, expected.begin() + 4);
+        ASSERT_EQ(expected_sub, controller->get_version_materialized_count_series(pattern, 1, 3)) << "Series is incorrect for " << pattern.to_string();
+    }
+
+    std::vector<size_t> expected_all = {2, 2, 4, 3, 4};
+    ASSERT_EQ(expected_all, controller->get_version_materialized_count_series(StringTriple("", "", ""), 0, 4)) << "Series is incorrect";
+}
+
+TEST_F(ControllerMSTest2, GetVersionMaterializedMulti) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<b>", "<b>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->deletion(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+
+    std::vector<StringTriple> patterns = {
+            StringTriple("", "", ""),
+            StringTriple("<a>", "", ""),
+            StringTriple("", "<b>", ""),
+            StringTriple("", "", "<a>"),
+    };
+    std::vector<std::vector<int>> version_lists = {{0, 1, 2}, {2, 1}, {1}, {3, 4}};
+    for (const StringTriple& pattern : patterns) {
+        for (const std::vector<int>& versions : version_lists) {
+            // Materialize each version separately
+            std::map<std::string, std::vector<bool>> expected;
+            for (size_t i = 0; i < versions.size(); i++) {
+                std::shared_ptr<DictionaryManager> dict = controller->get_dictionary_manager(versions[i]);
+                TripleIterator* it = controller->get_version_materialized(pattern, 0, versions[i]);
+                Triple t;
+                while (it->next(&t)) {
+                    std::vector<bool>& bitmap = expected[t.to_string(*dict)];
+                    bitmap.resize(versions.size(), false);
+                    bitmap[i] = true;
+                }
+                delete it;
+            }
+
+            std::map<std::string, std::vector<bool>> actual;
+            TripleVersionsBitmapIterator* it = controller->get_version_materialized_multi(pattern, versions);
+            TripleVersionsBitmap t;
+            while (it->next(&t)) {
+                actual[t.get_triple()->to_string(*t.get_dictionary())] = *t.get_bitmap();
+            }
+            delete it;
+            ASSERT_EQ(expected, actual) << "Bitmaps are incorrect for " << pattern.to_string();
+        }
+    }
+
+    ASSERT_THROW(controller->get_version_materialized_multi(StringTriple("", "", ""), {2, 3}), std::invalid_argument) << "Versions of different delta chains can not be combined";
+}
+
+TEST_F(ControllerMSTest2, GetDeltaMaterializedCountExact) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<b>", "<b>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->deletion(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->deletion(hdt::TripleString("<b>", "<b>", "<b>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+
+    std::vector<StringTriple> patterns = {
+            StringTriple("", "", ""),
+            StringTriple("<a>", "", ""),
+            StringTriple("", "<b>", ""),
+            StringTriple("", "", "<a>"),
+            StringTriple("<a>", "<b>", "<a>"),
+    };
+    for (const StringTriple& pattern : patterns) {
+        for (int start = 0; start <= 5; start++) {
+            for (int end = start; end <= 5; end++) {
+                TripleDeltaIterator* it = controller->get_delta_materialized(pattern, 0, start, end);
+                size_t expected = it->get_count();
+                delete it;
+                std::pair<size_t, hdt::ResultEstimationType> count = controller->get_delta_materialized_count(pattern, start, end);
+                ASSERT_EQ(expected, count.first) << "Count is incorrect for " << pattern.to_string() << " between " << start << " and " << end;
+                ASSERT_EQ(hdt::EXACT, count.second) << "Count must be exact";
+            }
+        }
+    }
+}
+
+TEST_F(ControllerMSTest2, GetCountEstimates) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<b>", "<b>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+
+    std::vector<StringTriple> patterns = {
+            StringTriple("", "", ""),
+            StringTriple("<a>", "", ""),
+            StringTriple("", "", "<a>"),
+    };
+    for (const StringTriple& pattern : patterns) {
+        for (int version = 0; version <= 5; version++) {
+            size_t exact = controller->get_version_materialized_count(pattern, version, false).first;
+            size_t estimate = controller->get_version_materialized_count(pattern, version, true).first;
+            ASSERT_LE(exact, estimate) << "Estimate must not be lower than the count for " << pattern.to_string() << " in " << version;
+        }
+    }
+
+    // <a> <a> <a>, <a> <b> <a>, <b> <b> <b>, <b> <a> <a>, <a> <c> <a>, <a> <d> <a>
+    ASSERT_EQ(6, controller->get_version_count(StringTriple("", "", ""), false).first) << "Count is incorrect";
+    std::pair<size_t, hdt::ResultEstimationType> estimate = controller->get_version_count(StringTriple("", "", ""), true);
+    ASSERT_EQ(hdt::APPROXIMATE, estimate.second) << "Estimation type is incorrect";
+    ASSERT_NEAR(6, estimate.first, 1) << "Triples in multiple delta chains must only be counted once";
+}
+
+TEST_F(ControllerMSTest2, GetDeltaMaterializedSnapshotDiff) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5, 6 (snapshot), 7
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<b>", "<b>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<c>", "<c>", "<c>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<b>", "<b>", "<b>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->addition(hdt::TripleString("<d>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->commit();
+
+    std::vector<StringTriple> patterns = {
+            StringTriple("", "", ""),
+            StringTriple("<a>", "", ""),
+            StringTriple("", "<a>", ""),
+            StringTriple("", "", "<a>"),
+            StringTriple("<d>", "<a>", "<a>"),
+    };
+    auto get_deltas = [&](const StringTriple& pattern, int start, int end) {
+        std::set<std::pair<std::string, bool>> deltas;
+        TripleDeltaIterator* it = controller->get_delta_materialized(pattern, 0, start, end);
+        TripleDelta t;
+        while (it->next(&t)) {
+            deltas.emplace(t.get_triple()->to_string(*t.get_dictionary()), t.is_addition());
+        }
+        delete it;
+        return deltas;
+    };
+
+    std::map<std::tuple<int, int, int>, std::set<std::pair<std::string, bool>>> expected;
+    for (int i = 0; i < patterns.size(); i++) {
+        for (int start = 0; start <= 7; start++) {
+            for (int end = start + 1; end <= 7; end++) {
+                expected[std::make_tuple(i, start, end)] = get_deltas(patterns[i], start, end);
+            }
+        }
+    }
+
+    ASSERT_FALSE(controller->build_snapshot_diff(1, 3)) << "Diffs can only be built between snapshots";
+    ASSERT_TRUE(controller->build_snapshot_diff(0, 3)) << "Diff could not be built";
+    ASSERT_TRUE(controller->build_snapshot_diff(0, 6)) << "Diff could not be built";
+    ASSERT_TRUE(controller->build_snapshot_diff(3, 6)) << "Diff could not be built";
+
+    for (int i = 0; i < patterns.size(); i++) {
+        for (int start = 0; start <= 7; start++) {
+            for (int end = start + 1; end <= 7; end++) {
+                ASSERT_EQ(expected[std::make_tuple(i, start, end)], get_deltas(patterns[i], start, end))
+                                            << "Deltas are incorrect for " << patterns[i].to_string() << " between " << start << " and " << end;
+            }
+        }
+    }
+}
+
+TEST_F(ControllerMSTest2, GetWithLimit) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<b>"))
+            ->addition(hdt::TripleString("<c>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<d>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<e>", "<a>", "<e>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->deletion(hdt::TripleString("<b>", "<a>", "<b>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->commit();
+
+    std::vector<StringTriple> patterns = {
+            StringTriple("", "", ""),
+            StringTriple("<a>", "", ""),
+            StringTriple("", "<a>", ""),
+            StringTriple("", "", "<a>"),
+    };
+    auto vm = [&](const StringTriple& pattern, int offset, int patch_id, int limit) {
+        std::vector<std::string> triples;
+        TripleIterator* it = controller->get_version_materialized(pattern, offset, patch_id, limit);
+        Triple t;
+        while (it->next(&t)) {
+            triples.push_back(t.to_string(*controller->get_snapshot_manager()->get_dictionary_manager(
+                    controller->get_snapshot_manager()->get_latest_snapshot(patch_id))));
+        }
+        delete it;
+        return triples;
+    };
+    auto dm = [&](const StringTriple& pattern, int offset, int start, int end, int limit) {
+        std::vector<std::string> triples;
+        TripleDeltaIterator* it = controller->get_delta_materialized(pattern, offset, start, end, limit);
+        TripleDelta t;
+        while (it->next(&t)) {
+            triples.push_back(t.get_triple()->to_string(*t.get_dictionary()) + (t.is_addition() ? "+" : "-"));
+        }
+        delete it;
+        return triples;
+    };
+    auto vq = [&](const StringTriple& pattern, int offset, int limit) {
+        std::vector<std::string> triples;
+        TripleVersionsIterator* it = controller->get_version(pattern, offset, limit);
+        TripleVersions t;
+        while (it->next(&t)) {
+            std::string triple = t.get_triple()->to_string(*t.get_dictionary());
+            for (int version : *t.get_versions()) {
+                triple += " " + std::to_string(version);
+            }
+            triples.push_back(triple);
+        }
+        delete it;
+        return triples;
+    };
+    auto slice = [](const std::vector<std::string>& triples, int limit) {
+        return std::vector<std::string>(triples.begin(), triples.begin() + std::min((size_t) limit, triples.size()));
+    };
+
+    for (const StringTriple& pattern : patterns) {
+        for (int offset = 0; offset <= 3; offset++) {
+            for (int limit = 0; limit <= 4; limit++) {
+                for (int patch_id = 0; patch_id <= 5; patch_id++) {
+                    ASSERT_EQ(slice(vm(pattern, offset, patch_id, -1), limit), vm(pattern, offset, patch_id, limit))
+                                                << "VM is incorrect for " << pattern.to_string() << " in " << patch_id
+                                                << " with offset " << offset << " and limit " << limit;
+                }
+                for (int start = 0; start <= 5; start++) {
+                    for (int end = start + 1; end <= 5; end++) {
+                        ASSERT_EQ(slice(dm(pattern, offset, start, end, -1), limit), dm(pattern, offset, start, end, limit))
+                                                    << "DM is incorrect for " << pattern.to_string() << " between " << start << " and " << end
+                                                    << " with offset " << offset << " and limit " << limit;
+                    }
+                }
+                ASSERT_EQ(slice(vq(pattern, offset, -1), limit), vq(pattern, offset, limit))
+                                            << "VQ is incorrect for " << pattern.to_string()
+                                            << " with offset " << offset << " and limit " << limit;
+            }
+        }
+    }
+}
+
+TEST_F(ControllerMSTest2, GetVersionCountDistinct) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5, 6 (snapshot), 7
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<b>", "<b>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->deletion(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<c>", "<c>", "<c>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<b>", "<b>", "<b>"))
+            ->addition(hdt::TripleString("<d>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<e>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<b>", "<b>"))
+            ->commit();
+
+    std::vector<StringTriple> patterns = {
+            StringTriple("", "", ""),
+            StringTriple("<a>", "", ""),
+            StringTriple("", "<a>", ""),
+            StringTriple("", "", "<a>"),
+            StringTriple("<b>", "<a>", "<a>"),
+            StringTriple("<z>", "", ""),
+    };
+    auto get_expected_count = [&](const StringTriple& pattern) {
+        TripleVersionsIterator* it = controller->get_version(pattern, 0);
+        size_t count = it->get_count();
+        delete it;
+        return count;
+    };
+
+    ASSERT_EQ(8, get_expected_count(StringTriple("", "", ""))) << "Count is incorrect";
+    for (const StringTriple& pattern : patterns) {
+        ASSERT_EQ(get_expected_count(pattern), controller->get_version_count(pattern).first) << "Count is incorrect for " << pattern.to_string();
+    }
+
+    // Without persisted indexes, all delta chains are compared at query time
+    delete controller;
+    std::remove((TESTPATH + CHAIN_DISTINCT_FILENAME(0, CHAIN_DISTINCT_ADDITIONS, "complete")).c_str());
+    std::remove((TESTPATH + CHAIN_DISTINCT_FILENAME(3, CHAIN_DISTINCT_SNAPSHOT, "complete")).c_str());
+    std::remove((TESTPATH + CHAIN_DISTINCT_FILENAME(3, CHAIN_DISTINCT_ADDITIONS, "complete")).c_str());
+    std::remove((TESTPATH + CHAIN_DISTINCT_FILENAME(6, CHAIN_DISTINCT_SNAPSHOT, "complete")).c_str());
+    controller = new Controller(TESTPATH, strategy);
+    for (const StringTriple& pattern : patterns) {
+        ASSERT_EQ(get_expected_count(pattern), controller->get_version_count(pattern).first) << "Count is incorrect for " << pattern.to_string();
+    }
+
+    ASSERT_TRUE(controller->build_chain_distinct_index(0)) << "Index could not be built";
+    ASSERT_TRUE(controller->build_chain_distinct_index(3)) << "Index could not be built";
+    ASSERT_TRUE(controller->build_chain_distinct_index(6)) << "Index could not be built";
+    for (const StringTriple& pattern : patterns) {
+        ASSERT_EQ(get_expected_count(pattern), controller->get_version_count(pattern).first) << "Count is incorrect for " << pattern.to_string();
+    }
+}
+
+TEST_F(ControllerTest, Recompact) {
+    // 0 (snapshot), 1, 2, 3, 4
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->deletion(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<c>", "<c>", "<c>"))
+            ->commit();
+
+    auto get_version = [](Controller* c, int patch_id) {
+        std::shared_ptr<DictionaryManager> dict = c->get_dictionary_manager(patch_id);
+        std::vector<std::string> triples;
+        TripleIterator* it = c->get_version_materialized(StringTriple("", "", ""), 0, patch_id);
+        Triple t;
+        while (it->next(&t)) {
+            triples.push_back(t.to_string(*dict));
+        }
+        delete it;
+        std::sort(triples.begin(), triples.end());
+        return triples;
+    };
+
+    std::string target_path = TESTPATH "recompact/";
+    mkdir(target_path.c_str(), 0755);
+    // 0 (snapshot), 1, 2 (snapshot), 3, 4 (snapshot)
+    CreateSnapshotEveryN strategy(2);
+    ASSERT_TRUE(controller->recompact(target_path, &strategy)) << "Recompaction failed";
+    ASSERT_FALSE(controller->recompact(target_path, &strategy)) << "Recompaction into an existing store must fail";
+
+    Controller* target = new Controller(target_path, &strategy);
+    ASSERT_EQ(std::vector<int>({0, 2, 4}), target->get_snapshot_manager()->get_snapshots_ids()) << "Snapshots are incorrect";
+    ASSERT_EQ(4, target->get_max_patch_id()) << "Max patch id is incorrect";
+    for (int patch_id = 0; patch_id <= 4; patch_id++) {
+        ASSERT_EQ(get_version(controller, patch_id), get_version(target, patch_id)) << "Version " << patch_id << " is incorrect";
+    }
+
+    Controller::cleanup(target_path, target);
+    rmdir(target_path.c_str());
+}
+
+TEST_F(ControllerTest, BulkLoad) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5, 6 (snapshot), 7
+    auto triples = [](std::vector<hdt::TripleString> triples) {
+        return new VectorTripleIterator(triples);
+    };
+    std::vector<Controller::DeltaChainInput> chains = {
+            {0, triples({hdt::TripleString("<a>", "<a>", "<a>"), hdt::TripleString("<a>", "<b>", "<a>")}),
+                    {{{triples({hdt::TripleString("<a>", "<b>", "<a>")}), false}},
+                     {{triples({hdt::TripleString("<a>", "<c>", "<a>")}), true}}}},
+            {3, triples({hdt::TripleString("<a>", "<c>", "<a>"), hdt::TripleString("<a>", "<d>", "<a>"), hdt::TripleString("<a>", "<e>", "<a>")}),
+                    {{{triples({hdt::TripleString("<a>", "<c>", "<a>")}), false}},
+                     {{triples({hdt::TripleString("<a>", "<d>", "<a>")}), false}}}},
+            {6, triples({hdt::TripleString("<a>", "<e>", "<a>"), hdt::TripleString("<a>", "<b>", "<a>")}),
+                    {{{triples({hdt::TripleString("<a>", "<c>", "<a>")}), true}}}},
+    };
+    ASSERT_TRUE(controller->bulk_load(chains, false, 3)) << "Bulk load failed";
+
+    ASSERT_EQ(std::vector<int>({0, 3, 6}), controller->get_snapshot_manager()->get_snapshots_ids()) << "Snapshots are incorrect";
+    ASSERT_EQ(std::vector<int>({1, 4, 7}), controller->get_patch_tree_manager()->get_patch_trees_ids()) << "Patch trees are incorrect";
+    ASSERT_EQ(7, controller->get_max_patch_id()) << "Max patch id is incorrect";
+    std::vector<size_t> expected_vm = {2, 1, 2, 3, 2, 1, 2, 3};
+    for (int version = 0; version < 8; version++) {
+        TripleIterator* it = controller->get_version_materialized(StringTriple("", "", ""), 0, version);
+        Triple t;
+        size_t count = 0;
+        while (it->next(&t)) count++;
+        delete it;
+        ASSERT_EQ(expected_vm[version], count) << "Version " << version << " is incorrect";
+    }
+
+    // The metadata of the last delta chain is left as if its versions had been appended
+    CreationStrategyMetadata* metadata = controller->get_strategy_metadata();
+    ASSERT_EQ(7, metadata->patch_id) << "Patch id is incorrect";
+    ASSERT_EQ(std::vector<uint64_t>({1}), metadata->delta_sizes) << "Delta sizes are incorrect";
+    ASSERT_EQ(std::vector<uint64_t>({3}), metadata->version_sizes) << "Version sizes are incorrect";
+    ASSERT_EQ(2, metadata->ingestion_times.size()) << "Snapshot and patch ingestion times must be stored";
+
+    // The iterators of rejected delta chains are deleted as well
+    std::vector<Controller::DeltaChainInput> overlapping = {
+            {7, triples({hdt::TripleString("<a>", "<a>", "<a>")}), {{{triples({hdt::TripleString("<a>", "<b>", "<a>")}), true}}}},
+    };
+    ASSERT_FALSE(controller->bulk_load(overlapping)) << "Delta chains that overlap with the store must be rejected";
+}
+
+TEST_F(ControllerTest, MigrateDeletionSummaries) {
+    // 0 (snapshot), 1, 2, 3, 4
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<a>", "<b>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->commit();
+    {
+        // An existing deletion tree keeps the layout without summaries, like the patch trees of older stores
+        std::ofstream existing(std::string(TESTPATH) + PATCHTREE_FILENAME(1, "spo_deletions"));
+    }
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<b>"))
+            ->addition(hdt::TripleString("<b>", "<a>", "<b>"))
+            ->addition(hdt::TripleString("<c>", "<a>", "<c>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->deletion(hdt::TripleString("<b>", "<a>", "<b>"))
+            ->addition(hdt::TripleString("<a>", "<a>", "<b>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<b>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<c>", "<a>", "<c>"))
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<d>", "<d>", "<d>"))
+            ->commit();
+    std::shared_ptr<DictionaryManager> dict = controller->get_dictionary_manager(0);
+    ASSERT_FALSE(controller->get_patch_tree_manager()->get_patch_tree(1, dict)->has_deletion_summaries())
+                                << "The patch tree must not contain summaries before the migration";
+
+    // The patterns cover the SPO, POS and OSP trees
+    std::vector<StringTriple> patterns = {StringTriple("", "", ""), StringTriple("<a>", "", ""), StringTriple("", "<a>", ""),
+                                          StringTriple("", "", "<b>"), StringTriple("", "<b>", "<a>"), StringTriple("<a>", "", "<a>")};
+    auto query_all = [&]() {
+        std::vector<std::string> results;
+        for (const StringTriple& pattern : patterns) {
+            for (int version = 0; version <= 4; version++) {
+                std::vector<std::string> triples;
+                TripleIterator* it_vm = controller->get_version_materialized(pattern, 0, version);
+                Triple t;
+                while (it_vm->next(&t)) {
+                    triples.push_back(t.to_string(*dict));
+                }
+                delete it_vm;
+                for (int version_start = 0; version_start < version; version_start++) {
+                    TripleDeltaIterator* it_dm = controller->get_delta_materialized(pattern, 0, version_start, version);
+                    TripleDelta td;
+                    while (it_dm->next(&td)) {
+                        triples.push_back(std::to_string(version_start) + (td.is_addition() ? "+" : "-") + td.get_triple()->to_string(*dict));
+                    }
+                    delete it_dm;
+                    triples.push_back(std::to_string(controller->get_delta_materialized_count(pattern, version_start, version).first));
+                }
+                std::sort(triples.begin(), triples.end());
+                triples.push_back(std::to_string(controller->get_version_materialized_count(pattern, version).first));
+                results.insert(results.end(), triples.begin(), triples.end());
+            }
+            std::vector<std::string> triples;
+            TripleVersionsIterator* it_vq = controller->get_version(pattern, 0);
+            TripleVersions tv;
+            while (it_vq->next(&tv)) {
+                std::string versions;
+                for (int version : *tv.get_versions()) {
+                    versions += " " + std::to_string(version);
+                }
+                triples.push_back(tv.get_triple()->to_string(*dict) + versions);
+            }
+            delete it_vq;
+            std::sort(triples.begin(), triples.end());
+            triples.push_back(std::to_string(controller->get_version_count(pattern).first));
+            results.insert(results.end(), triples.begin(), triples.end());
+        }
+        return results;
+    };
+    std::vector<std::string> expected = query_all();
+
+    // Queries during the migration keep returning the same results
+    std::atomic<bool> migrated(false);
+    std::atomic<int> errors(0);
+    std::thread reader([&]() {
+        while (!migrated) {
+            if (query_all() != expected) errors++;
+        }
+    });
+    ASSERT_TRUE(controller->migrate_deletion_summaries(0)) << "Migration failed";
+    migrated = true;
+    reader.join();
+    ASSERT_EQ(0, errors.load()) << "Queries during the migration returned incorrect results";
+
+    ASSERT_TRUE(controller->get_patch_tree_manager()->get_patch_tree(1, dict)->has_deletion_summaries())
+                                << "The patch tree must contain summaries after the migration";
+    ASSERT_EQ(expected, query_all()) << "Queries after the migration returned incorrect results";
+
+    // Patches can still be appended to the migrated patch tree
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<d>", "<d>", "<d>"))
+            ->commit();
+    ASSERT_EQ(2, controller->get_version_materialized_count(StringTriple("", "", ""), 5).first) << "Count after the migration is incorrect";
+}
+
+TEST_F(ControllerMSTest2, ReopenFromManifest) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5, 6 (snapshot), 7
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<e>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+
+    delete controller;
+    controller = new Controller(TESTPATH, strategy);
+
+    ASSERT_EQ(std::vector<int>({0, 3, 6}), controller->get_snapshot_manager()->get_snapshots_ids()) << "Snapshots are incorrect";
+    ASSERT_EQ(std::vector<int>({1, 4, 7}), controller->get_patch_tree_manager()->get_patch_trees_ids()) << "Patch trees are incorrect";
+    ASSERT_EQ(7, controller->get_max_patch_id()) << "Max patch id is incorrect";
+    std::vector<size_t> expected_vm = {2, 1, 2, 3, 2, 1, 2, 3};
+    for (int version = 0; version < 8; version++) {
+        ASSERT_EQ(expected_vm[version], controller->get_version_materialized_count(StringTriple("", "", ""), version).first)
+                                    << "Count of version " << version << " is incorrect";
+    }
+}
+
+TEST_F(ControllerMSTest2, ReopenFromStaleManifest) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5, 6 (snapshot), 7
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<e>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+
+    // The manifest of version 5 does not know about the snapshot and patch tree that are created afterwards,
+    // like when a process that does not maintain the manifest wrote to the store
+    std::string manifest_file_name = std::string(TESTPATH) + STORE_MANIFEST_FILENAME;
+    std::string stale_manifest;
+    {
+        std::ifstream file(manifest_file_name);
+        stale_manifest.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    delete controller;
+    {
+        std::ofstream file(manifest_file_name, std::ios::trunc);
+        file << stale_manifest;
+    }
+    controller = new Controller(TESTPATH, strategy);
+
+    ASSERT_EQ(std::vector<int>({0, 3, 6}), controller->get_snapshot_manager()->get_snapshots_ids()) << "Snapshots are incorrect";
+    ASSERT_EQ(std::vector<int>({1, 4, 7}), controller->get_patch_tree_manager()->get_patch_trees_ids()) << "Patch trees are incorrect";
+    ASSERT_EQ(7, controller->get_max_patch_id()) << "Max patch id is incorrect";
+    ASSERT_EQ(3, controller->get_version_materialized_count(StringTriple("", "", ""), 7).first) << "Count of version 7 is incorrect";
+}
+
+TEST_F(ControllerTest, ReopenFromStaleManifest) {
+    // 0 (snapshot), 1, 2, 3
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+
+    // The manifest of version 2 does not know about the append to the same patch tree afterwards
+    std::string manifest_file_name = std::string(TESTPATH) + STORE_MANIFEST_FILENAME;
+    std::string stale_manifest;
+    {
+        std::ifstream file(manifest_file_name);
+        stale_manifest.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->commit();
+    delete controller;
+    {
+        std::ofstream file(manifest_file_name, std::ios::trunc);
+        file << stale_manifest;
+    }
+    controller = new Controller(TESTPATH);
+
+    ASSERT_EQ(3, controller->get_max_patch_id()) << "Max patch id is incorrect";
+    ASSERT_EQ(2, controller->get_version_materialized_count(StringTriple("", "", ""), 3).first) << "Count of version 3 is incorrect";
+}
+
+TEST_F(ControllerTest, CountsDuringAppend) {
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<s0>", "<p>", "<o>"))
+            ->commit();
+
+    // Each patch adds a single triple, so version i contains i + 1 triples
+    std::atomic<bool> appending(true);
+    std::atomic<int> reads(0);
+    std::atomic<int> errors(0);
+    std::thread reader([&]() {
+        while (appending || reads == 0) {
+            // A version after the newest one is pinned to the newest patch of which the append has finished
+            size_t before = controller->get_version_materialized_count(StringTriple("", "", ""), 1000).first;
+            size_t estimated = controller->get_delta_materialized_count(StringTriple("", "", ""), 0, 1000, true).first;
+            size_t exact = controller->get_delta_materialized_count(StringTriple("", "", ""), 0, 1000, false).first;
+            size_t after = controller->get_version_materialized_count(StringTriple("", "", ""), 1000).first;
+            if (before > after || exact + 1 < before || exact + 1 > after || estimated + 1 < before) errors++;
+            reads++;
+        }
+    });
+    for (int i = 1; i <= 20; i++) {
+        controller->new_patch_bulk()
+                ->addition(hdt::TripleString("<s" + std::to_string(i) + ">", "<p>", "<o>"))
+                ->commit();
+    }
+    appending = false;
+    reader.join();
+
+    ASSERT_EQ(0, errors.load()) << "Counts during an append must only include finished patches";
+    ASSERT_EQ(20, controller->get_delta_materialized_count(StringTriple("", "", ""), 0, 20, false).first) << "Count is incorrect";
+}
+
+TEST_F(ControllerMSTest2, EvictWithinMemoryBudget) {
+    // 0 (snapshot), 1, 2, 3 (snapshot), 4, 5, 6 (snapshot), 7
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<a>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->addition(hdt::TripleString("<a>", "<e>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->deletion(hdt::TripleString("<a>", "<d>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<b>", "<a>"))
+            ->commit();
+    controller->new_patch_bulk()
+            ->addition(hdt::TripleString("<a>", "<c>", "<a>"))
+            ->commit();
+
+    std::vector<size_t> expected_vm = {2, 1, 2, 3, 2, 1, 2, 3};
+    std::vector<size_t> expected_dm = {0, 1, 2, 5, 4, 3, 2, 3};
+    auto query_all = [&]() {
+        for (int version = 0; version < 8; version++) {
+            TripleIterator* it_vm = controller->get_version_materialized(StringTriple("", "", ""), 0, version);
+            Triple t;
+            size_t count_vm = 0;
+            while (it_vm->next(&t)) count_vm++;
+            delete it_vm;
+            ASSERT_EQ(expected_vm[version], count_vm) << "VM count of version " << version << " is incorrect";
+            ASSERT_EQ(expected_dm[version], controller->get_delta_materialized_count(StringTriple("", "", ""), 0, version).first)
+                                        << "DM count of version " << version << " is incorrect";
+        }
+    };
+    query_all();
+    size_t unlimited_usage = controller->get_memory_budget()->get_usage();
+
+    // Every snapshot or patch tree that is loaded evicts all others that are not in use
+    controller->get_memory_budget()->set_max_size(1);
+    query_all();
+    query_all();
+    ASSERT_GT(unlimited_usage, controller->get_memory_budget()->get_usage()) << "Entries must be evicted to stay within the budget";
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include "../../../main/cpp/patch/count_sketch.h"
+
+
+TEST(CountMinSketchTest, EstimateUpperBound) {
+    CountMinSketch sketch(64, 4);
+    for (uint64_t i = 1; i <= 1000; i++) {
+        sketch.add(1, i, 0, 0, (uint32_t) (i % 10));
+    }
+    ASSERT_EQ(4500, sketch.get_total()) << "Total is incorrect";
+    for (uint64_t i = 1; i <= 1000; i++) {
+        ASSERT_LE(i % 10, sketch.estimate(1, i, 0, 0)) << "Estimate must not be lower than the count";
+    }
+}
+
+TEST(CountMinSketchTest, EstimateExactWhenSparse) {
+    CountMinSketch sketch;
+    sketch.add(1, 2, 3, 0, 5);
+    sketch.add(1, 2, 4, 0, 7);
+    ASSERT_EQ(5, sketch.estimate(1, 2, 3, 0)) << "Estimate is incorrect";
+    ASSERT_EQ(7, sketch.estimate(1, 2, 4, 0)) << "Estimate is incorrect";
+    ASSERT_EQ(0, sketch.estimate(1, 2, 5, 0)) << "Estimate is incorrect";
+}
+
+TEST(CountMinSketchTest, Serialization) {
+    CountMinSketch sketch;
+    for (uint64_t i = 0; i < 100; i++) {
+        sketch.add(0, i, i + 1, i + 2, 3);
+    }
+    size_t size;
+    const char* data = sketch.serialize(&size);
+    CountMinSketch sketch_deserialized(1, 1);
+    ASSERT_TRUE(sketch_deserialized.deserialize(data, size)) << "Deserialization failed";
+    delete[] data;
+    ASSERT_EQ(sketch.get_total(), sketch_deserialized.get_total()) << "Total is incorrect";
+    for (uint64_t i = 0; i < 100; i++) {
+        ASSERT_EQ(sketch.estimate(0, i, i + 1, i + 2), sketch_deserialized.estimate(0, i, i + 1, i + 2)) << "Estimate is incorrect";
+    }
+    ASSERT_FALSE(sketch_deserialized.deserialize(data, 3)) << "Invalid data must be rejected";
+}
+
+TEST(HyperLogLogTest, EstimateSmall) {
+    HyperLogLog sketch;
+    ASSERT_EQ(0, sketch.estimate()) << "Estimate is incorrect";
+    for (int i = 0; i < 10; i++) {
+        sketch.add(sketch_hash::hash_string("a" + std::to_string(i)));
+        sketch.add(sketch_hash::hash_string("a" + std::to_string(i)));
+    }
+    ASSERT_EQ(10, sketch.estimate()) << "Duplicates must not be counted";
+}
+
+TEST(HyperLogLogTest, EstimateLarge) {
+    HyperLogLog sketch;
+    for (int i = 0; i < 100000; i++) {
+        sketch.add(sketch_hash::hash_ids(i, 0, 0, 0));
+    }
+    double estimate = sketch.estimate();
+    ASSERT_NEAR(100000, estimate, 100000 * 0.05) << "Estimate is not within the error bound";
+}
+
+TEST(HyperLogLogTest, Merge) {
+    HyperLogLog sketch1;
+    HyperLogLog sketch2;
+    for (int i = 0; i < 20000; i++) {
+        sketch1.add(sketch_hash::hash_terms("<s" + std::to_string(i) + ">", "<p>", "<o>"));
+    }
+    for (int i = 10000; i < 30000; i++) {
+        sketch2.add(sketch_hash::hash_terms("<s" + std::to_string(i) + ">", "<p>", "<o>"));
+    }
+    sketch1.merge(sketch2);
+    double estimate = sketch1.estimate();
+    ASSERT_NEAR(30000, estimate, 30000 * 0.05) << "Triples in both sketches must only be counted once";
+}
+
+TEST(HyperLogLogTest, Serialization) {
+    HyperLogLog sketch;
+    for (int i = 0; i < 1000; i++) {
+        sketch.add(sketch_hash::hash_ids(i, 1, 2, 3));
+    }
+    size_t size;
+    const char* data = sketch.serialize(&size);
+    HyperLogLog sketch_deserialized(4);
+    ASSERT_TRUE(sketch_deserialized.deserialize(data, size)) << "Deserialization failed";
+    delete[] data;
+    ASSERT_EQ(sketch.estimate(), sketch_deserialized.estimate()) << "Estimate is incorrect";
+}
+
+TEST(TermHashCacheTest, HashEqualsTermHash) {
+    std::vector<std::string> terms = {"<a>", "<b>", "<c>", "\"a\""};
+    size_t decoded = 0;
+    auto decode = [&](size_t id, int) {
+        decoded++;
+        return terms[id];
+    };
+    // The cache is smaller than the number of terms, so terms are decoded again after it has been cleared
+    TermHashCache cache(2);
+    for (int replication = 0; replication < 2; replication++) {
+        for (size_t s = 0; s < terms.size(); s++) {
+            for (size_t o = 0; o < terms.size(); o++) {
+                ASSERT_EQ(sketch_hash::hash_terms(terms[s], terms[1], terms[o]), cache.hash(s, 1, o, decode))
+                                            << "Hash must not depend on the cache";
+            }
+        }
+    }
+    ASSERT_LT(decoded, 2 * 3 * terms.size() * terms.size()) << "Cached terms must not be decoded again";
+}
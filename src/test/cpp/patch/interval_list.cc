@@ -187,6 +187,41 @@ TEST(IntervalListTest, EmptyDeletion) {
 // DeletionValue Interval List tests
 
 
+TEST(IntervalListTest, AdditionBeforeFirstInterval) {
+    IntervalList<int> list(10);
+    list.addition(4);
+    list.deletion(6);
+    ASSERT_TRUE(list.addition(2)) << "Adding before the first interval must change the list";
+    ASSERT_EQ("(2,6) ", list.to_string()) << "The first interval must start at the added element";
+    ASSERT_FALSE(list.deletion(0)) << "Deleting before the first interval must not change the list";
+}
+
+TEST(IntervalListTest, IndexAndElements) {
+    IntervalList<int> list(100);
+    list.addition(1);
+    list.deletion(3);
+    list.addition(5);
+    list.deletion(6);
+    list.addition(8);
+    std::vector<int> elements = {1, 2, 5, 8, 9};
+    ASSERT_EQ(5, list.get_size(10)) << "Size is incorrect";
+    for (long i = 0; i < (long) elements.size(); i++) {
+        ASSERT_EQ(elements[i], list.get_element_at(i, 10)) << "Element is incorrect at " << i;
+        ASSERT_EQ(i, list.get_index(elements[i], 10)) << "Index is incorrect for " << elements[i];
+    }
+    ASSERT_EQ(-1, list.get_index(4, 10)) << "Missing elements must have no index";
+    ASSERT_EQ(-1, list.get_index(10, 10)) << "Elements after the outer limit must have no index";
+    ASSERT_EQ(100, list.get_element_at(5, 10)) << "Elements after the end must be the max value";
+
+    // Deserializing into a used list must replace its intervals
+    auto data = list.serialize();
+    IntervalList<int> list2(100);
+    list2.addition(50);
+    list2.deserialize(data.first, data.second);
+    ASSERT_EQ(list.to_string(), list2.to_string()) << "Deserialized list is incorrect";
+    delete[] data.first;
+}
+
 TEST(DVIntervalListTest, SimpleAddition1) {
     DVIntervalList<PatchTreeDeletionValueElement> dvl;
     PatchTreeDeletionValueElement pe(1);
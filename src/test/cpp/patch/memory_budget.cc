@@ -0,0 +1,95 @@
+#include <map>
+#include <memory>
+#include <gtest/gtest.h>
+
+#include "../../../main/cpp/patch/memory_budget.h"
+
+// A cache of which the entries can be marked as in use.
+class TestCache : public MemoryBudget::Cache {
+public:
+    MemoryBudget& budget;
+    std::map<int, std::atomic<uint64_t>> last_access;
+    std::map<int, bool> in_use;
+
+    explicit TestCache(MemoryBudget& budget) : budget(budget) {}
+
+    void load(int id, size_t cost) {
+        std::atomic<uint64_t>& accessed = last_access[id];
+        accessed.store(budget.tick());
+        in_use[id] = false;
+        budget.charge(this, id, cost, &accessed);
+        budget.enforce(this, id, [this](int id) { return try_evict(id); });
+    }
+
+    void touch(int id) {
+        last_access[id].store(budget.tick());
+    }
+
+    bool is_loaded(int id) const {
+        return in_use.find(id) != in_use.end();
+    }
+
+    bool try_evict(int id) override {
+        auto it = in_use.find(id);
+        if (it == in_use.end() || it->second) {
+            return false;
+        }
+        in_use.erase(it);
+        budget.release(this, id);
+        return true;
+    }
+};
+
+TEST(MemoryBudgetTest, Usage) {
+    MemoryBudget budget(0);
+    TestCache cache1(budget);
+    TestCache cache2(budget);
+    cache1.load(0, 100);
+    cache1.load(1, 50);
+    cache2.load(0, 10);
+    ASSERT_EQ(160, budget.get_usage()) << "Usage is incorrect";
+    ASSERT_EQ(150, budget.get_usage(&cache1)) << "Usage of a cache is incorrect";
+    ASSERT_EQ(10, budget.get_usage(&cache2)) << "Usage of a cache is incorrect";
+    ASSERT_FALSE(budget.is_exceeded()) << "A budget without limit must never be exceeded";
+
+    cache1.load(1, 70);
+    ASSERT_EQ(180, budget.get_usage()) << "Charging an entry again must replace its cost";
+    budget.release(&cache1, 0);
+    ASSERT_EQ(80, budget.get_usage()) << "Usage after release is incorrect";
+    budget.release_all(&cache2);
+    ASSERT_EQ(70, budget.get_usage()) << "Usage after releasing a cache is incorrect";
+}
+
+TEST(MemoryBudgetTest, EvictLargeAndOld) {
+    MemoryBudget budget(1000);
+    TestCache cache1(budget);
+    TestCache cache2(budget);
+    cache1.load(0, 600);
+    cache2.load(0, 100);
+    cache2.load(1, 100);
+    cache2.touch(0);
+    cache2.touch(1);
+    cache1.load(1, 300);
+    ASSERT_FALSE(cache1.is_loaded(0)) << "The large entry that was not accessed recently must be evicted";
+    ASSERT_TRUE(cache1.is_loaded(1)) << "The loaded entry must not be evicted";
+    ASSERT_TRUE(cache2.is_loaded(0)) << "Small entries must not be evicted";
+    ASSERT_TRUE(cache2.is_loaded(1)) << "Small entries must not be evicted";
+    ASSERT_EQ(500, budget.get_usage()) << "Usage is incorrect";
+}
+
+TEST(MemoryBudgetTest, SkipInUse) {
+    MemoryBudget budget(1000);
+    TestCache cache(budget);
+    cache.load(0, 600);
+    cache.in_use[0] = true;
+    cache.load(1, 300);
+    cache.load(2, 300);
+    ASSERT_TRUE(cache.is_loaded(0)) << "Entries in use must not be evicted";
+    ASSERT_FALSE(cache.is_loaded(1)) << "Entries that are not in use must be evicted instead";
+    ASSERT_TRUE(cache.is_loaded(2)) << "The loaded entry must not be evicted";
+
+    cache.in_use[2] = true;
+    cache.load(3, 300);
+    ASSERT_TRUE(budget.is_exceeded()) << "The budget is temporarily exceeded if all other entries are in use";
+    ASSERT_TRUE(cache.is_loaded(3)) << "The loaded entry must not be evicted";
+}
@@ -1,3 +1,4 @@
+#include <tuple>
 #include <gtest/gtest.h>
 
 #include "../../../main/cpp/patch/patch_tree.h"
@@ -35,6 +36,11 @@ protected:
         std::remove((TESTPATH + PATCHTREE_FILENAME(0, "sop_additions")).c_str());
         std::remove((TESTPATH + PATCHTREE_FILENAME(0, "osp_additions")).c_str());
         std::remove((TESTPATH + PATCHTREE_FILENAME(0, "count_additions")).c_str());
+        std::remove((TESTPATH + PATCHTREE_FILENAME(0, "count_sketches")).c_str());
+        std::remove((TESTPATH + PATCHTREE_FILENAME(0, "frozen")).c_str());
+        std::remove((TESTPATH + PATCHTREE_FILENAME(0, "deletion_summaries")).c_str());
+        std::remove((TESTPATH + PATCHTREE_FILENAME(0, "additions_codec")).c_str());
+        std::remove((TESTPATH + PATCHTREE_FILENAME(0, "deletions_codec")).c_str());
         std::remove((TESTPATH + METADATA_FILENAME_BASE(0)).c_str());
 
         DictionaryManager::cleanup(TESTPATH, 0);
@@ -947,6 +953,49 @@ TEST_F(PatchTreeTest, DeletionCount) {
     ASSERT_EQ(4, patchTree->deletion_count(Triple("", "", "", dict), 4).first) << "Deletion count is incorrect";
 }
 
+TEST_F(PatchTreeTest, DeletionPatchPositions) {
+    PatchSorted patch1(dict);
+    patch1.add(PatchElement(Triple("g", "p", "o", dict), false));
+    patch1.add(PatchElement(Triple("a", "p", "o", dict), true));
+    patch1.add(PatchElement(Triple("s", "z", "o", dict), false));
+    patch1.add(PatchElement(Triple("s", "p", "a", dict), false));
+    patch1.add(PatchElement(Triple("h", "p", "b", dict), false));
+    patchTree->append(patch1, 1);
+
+    PatchSorted patch2(dict);
+    patch2.add(PatchElement(Triple("g", "p", "o", dict), false));
+    patch2.add(PatchElement(Triple("h", "z", "o", dict), false));
+    patch2.add(PatchElement(Triple("s", "p", "a", dict), true));
+    patchTree->append(patch2, 2);
+
+    std::vector<Triple> triples = {
+            Triple("a", "p", "o", dict),
+            Triple("g", "p", "o", dict),
+            Triple("h", "z", "b", dict),
+            Triple("s", "p", "a", dict),
+            Triple("s", "z", "o", dict),
+            Triple("x", "y", "z", dict),
+    };
+    for (int patch_id = 1; patch_id <= 2; patch_id++) {
+        for (size_t i = 0; i < triples.size(); i++) {
+            size_t s = triples[i].get_subject();
+            size_t p = triples[i].get_predicate();
+            size_t o = triples[i].get_object();
+            PatchPositions expected(
+                    patchTree->deletion_count(Triple(s, p, 0), patch_id).first,
+                    patchTree->deletion_count(Triple(s, 0, o), patch_id).first,
+                    patchTree->deletion_count(Triple(s, 0, 0), patch_id).first,
+                    patchTree->deletion_count(Triple(0, p, o), patch_id).first,
+                    patchTree->deletion_count(Triple(0, p, 0), patch_id).first,
+                    patchTree->deletion_count(Triple(0, 0, o), patch_id).first,
+                    patchTree->deletion_count(Triple(0, 0, 0), patch_id).first
+            );
+            ASSERT_EQ(expected.to_string(), patchTree->get_deletion_patch_positions(triples[i], patch_id).to_string())
+                                        << "Patch positions of triple " << i << " in patch " << patch_id << " are incorrect";
+        }
+    }
+}
+
 TEST_F(PatchTreeTest, DeletionIterator) {
     PatchSorted patch1(dict);
     patch1.add(PatchElement(Triple("g", "p", "o", dict), false));
@@ -1483,6 +1532,158 @@ TEST_F(PatchTreeTest, Metadata) {
     ASSERT_EQ(1, patchTree->get_max_patch_id()) << "Max patch id is incorrect";
 }
 
+TEST_F(PatchTreeTest, PinPatchId) {
+    ASSERT_EQ(-1, patchTree->pin_patch_id(0)) << "No patch must be visible before the first append has finished";
+
+    PatchSorted patch1(dict);
+    patch1.add(PatchElement(Triple("s1", "p1", "o1", dict), true));
+    patchTree->append(patch1, 0);
+
+    ASSERT_EQ(0, patchTree->pin_patch_id(0)) << "A finished patch must be visible";
+    ASSERT_EQ(0, patchTree->pin_patch_id(5)) << "Unfinished patches must not be visible";
+
+    PatchSorted patch2(dict);
+    patch2.add(PatchElement(Triple("s2", "p1", "o1", dict), true));
+    patchTree->append(patch2, 1);
+
+    ASSERT_EQ(0, patchTree->pin_patch_id(0)) << "Older patches must remain visible";
+    ASSERT_EQ(1, patchTree->pin_patch_id(5)) << "Unfinished patches must not be visible";
+
+    delete patchTree;
+    patchTree = new PatchTree(TESTPATH, 0, dict);
+
+    ASSERT_EQ(1, patchTree->pin_patch_id(5)) << "Stored patches must be visible after reopening";
+}
+
+TEST_F(PatchTreeTest, AppendPartitioned) {
+    // Patch 0 deletes half of the triples, patch 1 deletes some more and adds new triples for every subject
+    std::vector<std::tuple<int, int, int>> deleted;
+    PatchSorted patch0(dict);
+    PatchSorted patch1(dict);
+    for (int s = 0; s < 40; s++) {
+        for (int p = 0; p < 3; p++) {
+            for (int o = 0; o < 3; o++) {
+                Triple triple("s" + std::to_string(s), "p" + std::to_string(p), "o" + std::to_string(o), dict);
+                if ((s + p + o) % 2 == 0) {
+                    patch0.add(PatchElement(triple, false));
+                    deleted.emplace_back(s, p, o);
+                } else if ((s + p + o) % 3 == 0) {
+                    patch1.add(PatchElement(triple, false));
+                    deleted.emplace_back(s, p, o);
+                }
+            }
+            patch1.add(PatchElement(Triple("s" + std::to_string(s), "p" + std::to_string(p), "o9", dict), true));
+        }
+    }
+    patchTree->append_unsafe(patch0, 0, 4);
+    patchTree->append_unsafe(patch1, 1, 4);
+
+    // The last position of each pattern must count the deletions of all ranges
+    for (int s = -1; s < 40; s++) {
+        for (int p = -1; p < 3; p++) {
+            for (int o = -1; o < 3; o++) {
+                PatchPosition expected = 0;
+                for (const auto& triple : deleted) {
+                    expected += (s < 0 || std::get<0>(triple) == s) && (p < 0 || std::get<1>(triple) == p)
+                                && (o < 0 || std::get<2>(triple) == o);
+                }
+                Triple triple_pattern(s < 0 ? "" : "s" + std::to_string(s), p < 0 ? "" : "p" + std::to_string(p),
+                                      o < 0 ? "" : "o" + std::to_string(o), dict);
+                ASSERT_EQ(expected, patchTree->deletion_count(triple_pattern, 1).first)
+                                            << "Deletion count of " << triple_pattern.to_string(*dict) << " is incorrect";
+            }
+        }
+    }
+    ASSERT_EQ((PatchPosition) 120, patchTree->addition_count(1, Triple("", "", "", dict))) << "Addition count is incorrect";
+    ASSERT_EQ((PatchPosition) 40, patchTree->addition_count(1, Triple("", "p1", "", dict))) << "Addition count is incorrect";
+    ASSERT_EQ(1, patchTree->pin_patch_id(5)) << "A partitioned append must publish its patch";
+}
+
+TEST_F(PatchTreeTest, Freeze) {
+    PatchSorted patch1(dict);
+    patch1.add(PatchElement(Triple("s1", "p1", "o1", dict), true));
+    patch1.add(PatchElement(Triple("s2", "p1", "o1", dict), false));
+    patch1.add(PatchElement(Triple("s3", "p2", "o2", dict), false));
+    patchTree->append(patch1, 0);
+
+    PatchSorted patch2(dict);
+    patch2.add(PatchElement(Triple("s1", "p1", "o1", dict), false));
+    patch2.add(PatchElement(Triple("s4", "p2", "o1", dict), true));
+    patchTree->append(patch2, 1);
+
+    PatchSorted patch3(dict);
+    patch3.add(PatchElement(Triple("s1", "p1", "o1", dict), true));
+    patch3.add(PatchElement(Triple("s5", "p3", "o3", dict), true));
+    patchTree->append(patch3, 2);
+
+    std::vector<std::string> patches;
+    for (int patch_id = 0; patch_id <= 2; patch_id++) {
+        Patch* patch = patchTree->reconstruct_patch(patch_id);
+        patches.push_back(patch->to_string(*dict));
+        delete patch;
+    }
+    Triple pattern("", "p1", "", dict);
+    PatchPosition deletion_count = patchTree->deletion_count(pattern, 2).first;
+    PatchPosition addition_count = patchTree->addition_count(2, pattern);
+
+    ASSERT_FALSE(patchTree->is_frozen()) << "Tree must not be frozen yet";
+    ASSERT_TRUE(patchTree->freeze()) << "Tree could not be frozen";
+    ASSERT_TRUE(patchTree->is_frozen()) << "Tree must be frozen";
+    ASSERT_FALSE(patchTree->freeze()) << "Tree can only be frozen once";
+
+    delete patchTree;
+    patchTree = new PatchTree(TESTPATH, 0, dict);
+    ASSERT_TRUE(patchTree->is_frozen()) << "Tree must be loaded as frozen";
+    ASSERT_EQ(2, patchTree->get_max_patch_id()) << "Max patch id is incorrect";
+    for (int patch_id = 0; patch_id <= 2; patch_id++) {
+        Patch* patch = patchTree->reconstruct_patch(patch_id);
+        ASSERT_EQ(patches[patch_id], patch->to_string(*dict)) << "Patch " << patch_id << " is incorrect";
+        delete patch;
+    }
+    ASSERT_EQ(deletion_count, patchTree->deletion_count(pattern, 2).first) << "Deletion count is incorrect";
+    ASSERT_EQ(addition_count, patchTree->addition_count(2, pattern)) << "Addition count is incorrect";
+
+    PatchSorted patch4(dict);
+    patch4.add(PatchElement(Triple("s6", "p1", "o1", dict), true));
+    ASSERT_THROW(patchTree->append(patch4, 3), std::invalid_argument) << "Frozen trees must not be modified";
+}
+
+TEST_F(PatchTreeTest, Codecs) {
+    delete patchTree;
+    patchTree = new PatchTree(TESTPATH, 0, dict, kyotocabinet::TreeDB::TCOMPRESS, false, TreeCodec::parse("lzma"), TreeCodec::parse("lzo"));
+
+    PatchSorted patch1(dict);
+    patch1.add(PatchElement(Triple("s1", "p1", "o1", dict), true));
+    patch1.add(PatchElement(Triple("s2", "p1", "o1", dict), false));
+    patchTree->append(patch1, 0);
+
+    PatchSorted patch2(dict);
+    patch2.add(PatchElement(Triple("s1", "p1", "o1", dict), false));
+    patch2.add(PatchElement(Triple("s3", "p2", "o1", dict), true));
+    patchTree->append(patch2, 1);
+
+    std::vector<std::string> patches;
+    for (int patch_id = 0; patch_id <= 1; patch_id++) {
+        Patch* patch = patchTree->reconstruct_patch(patch_id);
+        patches.push_back(patch->to_string(*dict));
+        delete patch;
+    }
+
+    // The persisted codecs must be used when reopening, regardless of the requested codecs
+    delete patchTree;
+    patchTree = new PatchTree(TESTPATH, 0, dict, kyotocabinet::TreeDB::TCOMPRESS, false, TreeCodec::parse("zlib"), TreeCodec::parse("none"));
+    TreeCodec codec;
+    ASSERT_TRUE(TreeCodec::read(TESTPATH + PATCHTREE_FILENAME(0, "additions_codec"), &codec)) << "Addition codec must be persisted";
+    ASSERT_EQ("lzma", codec.to_string()) << "Addition codec is incorrect";
+    ASSERT_TRUE(TreeCodec::read(TESTPATH + PATCHTREE_FILENAME(0, "deletions_codec"), &codec)) << "Deletion codec must be persisted";
+    ASSERT_EQ("lzo", codec.to_string()) << "Deletion codec is incorrect";
+    for (int patch_id = 0; patch_id <= 1; patch_id++) {
+        Patch* patch = patchTree->reconstruct_patch(patch_id);
+        ASSERT_EQ(patches[patch_id], patch->to_string(*dict)) << "Patch " << patch_id << " is incorrect";
+        delete patch;
+    }
+}
+
 TEST_F(PatchTreeTest, DeletionValue) {
     PatchSorted patch1(dict);
     patch1.add(PatchElement(Triple("g", "p", "o", dict), false));
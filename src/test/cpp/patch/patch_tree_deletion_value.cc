@@ -86,6 +86,59 @@ TEST(PatchTreeDeletionValueTest, SerializationComplex) {
     }
 }
 
+TEST(PatchTreeDeletionValueTest, View) {
+    PatchTreeDeletionValue value(20);
+    value.add(PatchTreeDeletionValueElement(0, PatchPositions(1, 2, 3, 4, 5, 6, 7)));
+    value.add(PatchTreeDeletionValueElement(1, true, PatchPositions(82, 83, 84, 85, 86, 87, 88)));
+    value.add(PatchTreeDeletionValueElement(10, PatchPositions(742, 743, 744, 745, 746, 747, 748)));
+    value.add(PatchTreeDeletionValueElement(20, PatchPositions(3, 4, 5, 6, 7, 8, 9)));
+    size_t size;
+    const char* data = value.serialize(&size);
+
+    PatchTreeDeletionValueView view = value.create_view();
+    view.wrap(data, size);
+    ASSERT_EQ(value.get_size(), view.get_size()) << "View size is incorrect";
+    for (long i = 0; i < value.get_size(); i++) {
+        ASSERT_EQ(value.get_patch_at(i).get_patch_id(), view.get_patch_id_at(i)) << "View patch id at " << i << " is incorrect";
+    }
+    ASSERT_EQ(std::numeric_limits<int>::max(), view.get_patch_id_at(value.get_size())) << "View patch id out of range is incorrect";
+    for (int patch_id = 0; patch_id <= 20; patch_id++) {
+        ASSERT_EQ(value.get_patchvalue_index(patch_id), view.get_patchvalue_index(patch_id)) << "View index of " << patch_id << " is incorrect";
+        ASSERT_EQ(value.is_local_change(patch_id), view.is_local_change(patch_id)) << "View local change of " << patch_id << " is incorrect";
+        ASSERT_EQ(value.get(patch_id).to_string(), view.get(patch_id).to_string()) << "View element of " << patch_id << " is incorrect";
+    }
+    delete[] data;
+}
+
+TEST(PatchTreeDeletionValueTest, Summary) {
+    PatchTreeDeletionValue value(20);
+    ASSERT_EQ(PatchTreeDeletionSummary(), value.get_summary()) << "Summary of an empty value is incorrect";
+    value.add(PatchTreeDeletionValueElement(2, PatchPositions(1, 2, 3, 4, 5, 6, 7)));
+    value.add(PatchTreeDeletionValueElement(5, true, PatchPositions(82, 83, 84, 85, 86, 87, 88)));
+    value.del(8);
+    PatchTreeDeletionSummary summary = value.get_summary();
+    ASSERT_EQ(2, summary.get_first_patch_id()) << "First patch id is incorrect";
+    ASSERT_EQ(7, summary.get_last_patch_id()) << "Last patch id is incorrect";
+    ASSERT_FALSE(summary.may_contain(1)) << "Summary must not contain patches before the first one";
+    ASSERT_TRUE(summary.may_contain(2)) << "Summary must contain the first patch";
+    ASSERT_TRUE(summary.may_contain(7)) << "Summary must contain the last patch";
+    ASSERT_FALSE(summary.may_contain(8)) << "Summary must not contain patches after the last one";
+
+    size_t size;
+    const char* data = value.serialize(&size);
+    PatchTreeDeletionValueView view = value.create_view();
+    view.wrap(data, size);
+    ASSERT_EQ(summary, view.get_summary()) << "View summary is incorrect";
+    delete[] data;
+
+    char* summary_data = new char[PatchTreeDeletionSummary::max_serialization_size()];
+    size_t summary_size = summary.serialize(summary_data);
+    PatchTreeDeletionSummary summary_out;
+    summary_out.deserialize(summary_data, summary_size);
+    ASSERT_EQ(summary, summary_out) << "Summary serialization failed";
+    delete[] summary_data;
+}
+
 #else
 
 TEST(PatchTreeDeletionValueTest, Fields) {
@@ -149,6 +202,59 @@ TEST(PatchTreeDeletionValueTest, Serialization) {
     delete[] data;
 }
 
+TEST(PatchTreeDeletionValueTest, View) {
+    PatchTreeDeletionValue value;
+    value.add(PatchTreeDeletionValueElement(0, PatchPositions(1, 2, 3, 4, 5, 6, 7)));
+    value.add(PatchTreeDeletionValueElement(1, true, PatchPositions(82, 83, 84, 85, 86, 87, 88)));
+    value.add(PatchTreeDeletionValueElement(10, PatchPositions(742, 743, 744, 745, 746, 747, 748)));
+    value.add(PatchTreeDeletionValueElement(20, PatchPositions(3, 4, 5, 6, 7, 8, 9)));
+    size_t size;
+    const char* data = value.serialize(&size);
+
+    PatchTreeDeletionValueView view = value.create_view();
+    view.wrap(data, size);
+    ASSERT_EQ(value.get_size(), view.get_size()) << "View size is incorrect";
+    for (long i = 0; i < value.get_size(); i++) {
+        ASSERT_EQ(value.get_patch_at(i).get_patch_id(), view.get_patch_id_at(i)) << "View patch id at " << i << " is incorrect";
+    }
+    ASSERT_EQ(std::numeric_limits<int>::max(), view.get_patch_id_at(value.get_size())) << "View patch id out of range is incorrect";
+    for (int patch_id = 0; patch_id <= 20; patch_id++) {
+        ASSERT_EQ(value.get_patchvalue_index(patch_id), view.get_patchvalue_index(patch_id)) << "View index of " << patch_id << " is incorrect";
+        ASSERT_EQ(value.is_local_change(patch_id), view.is_local_change(patch_id)) << "View local change of " << patch_id << " is incorrect";
+        ASSERT_EQ(value.get(patch_id).to_string(), view.get(patch_id).to_string()) << "View element of " << patch_id << " is incorrect";
+    }
+    delete[] data;
+}
+
+TEST(PatchTreeDeletionValueTest, Summary) {
+    PatchTreeDeletionValue value;
+    ASSERT_EQ(PatchTreeDeletionSummary(), value.get_summary()) << "Summary of an empty value is incorrect";
+    value.add(PatchTreeDeletionValueElement(2, PatchPositions(1, 2, 3, 4, 5, 6, 7)));
+    value.add(PatchTreeDeletionValueElement(7, PatchPositions(3, 4, 5, 6, 7, 8, 9)));
+    value.add(PatchTreeDeletionValueElement(5, true, PatchPositions(82, 83, 84, 85, 86, 87, 88)));
+    PatchTreeDeletionSummary summary = value.get_summary();
+    ASSERT_EQ(2, summary.get_first_patch_id()) << "First patch id is incorrect";
+    ASSERT_EQ(7, summary.get_last_patch_id()) << "Last patch id is incorrect";
+    ASSERT_FALSE(summary.may_contain(1)) << "Summary must not contain patches before the first one";
+    ASSERT_TRUE(summary.may_contain(2)) << "Summary must contain the first patch";
+    ASSERT_TRUE(summary.may_contain(7)) << "Summary must contain the last patch";
+    ASSERT_FALSE(summary.may_contain(8)) << "Summary must not contain patches after the last one";
+
+    size_t size;
+    const char* data = value.serialize(&size);
+    PatchTreeDeletionValueView view = value.create_view();
+    view.wrap(data, size);
+    ASSERT_EQ(summary, view.get_summary()) << "View summary is incorrect";
+    delete[] data;
+
+    char* summary_data = new char[PatchTreeDeletionSummary::max_serialization_size()];
+    size_t summary_size = summary.serialize(summary_data);
+    PatchTreeDeletionSummary summary_out;
+    summary_out.deserialize(summary_data, summary_size);
+    ASSERT_EQ(summary, summary_out) << "Summary serialization failed";
+    delete[] summary_data;
+}
+
 //TEST(PatchTreeDeletionValueTest, SerializationSize) {
 //    PatchTreeDeletionValue valueIn;
 //    valueIn.add(PatchTreeDeletionValueElement(0, PatchPositions(1, 2, 3, 4, 5, 6, 7)));
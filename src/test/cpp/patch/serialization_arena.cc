@@ -0,0 +1,63 @@
+#include <cstring>
+#include <gtest/gtest.h>
+
+#include "../../../main/cpp/patch/serialization_arena.h"
+#include "../../../main/cpp/patch/triple.h"
+
+
+TEST(SerializationArenaTest, AllocateDistinct) {
+    SerializationArena arena;
+    SerializationArena::Scope scope(arena);
+    char* a = arena.allocate(16);
+    char* b = arena.allocate(16);
+    ASSERT_NE(a, b) << "Buffers in the same scope must not overlap";
+    ASSERT_GE(b - a, 16) << "Buffers in the same scope must not overlap";
+}
+
+TEST(SerializationArenaTest, ScopeReuse) {
+    SerializationArena arena;
+    char* first;
+    {
+        SerializationArena::Scope scope(arena);
+        first = arena.allocate(16);
+    }
+    long long allocations = SerializationArena::get_heap_allocations();
+    for (int i = 0; i < 1000; i++) {
+        SerializationArena::Scope scope(arena);
+        ASSERT_EQ(first, arena.allocate(16)) << "Buffers must be reused after their scope ended";
+    }
+    ASSERT_EQ(allocations, SerializationArena::get_heap_allocations()) << "A reused arena must not allocate";
+}
+
+TEST(SerializationArenaTest, NestedScopes) {
+    SerializationArena arena;
+    SerializationArena::Scope scope(arena);
+    char* outer = arena.allocate(SERIALIZATION_ARENA_BLOCK_SIZE - 8);
+    std::memset(outer, 'a', SERIALIZATION_ARENA_BLOCK_SIZE - 8);
+    {
+        SerializationArena::Scope inner_scope(arena);
+        char* inner = arena.allocate(SERIALIZATION_ARENA_BLOCK_SIZE * 2);
+        std::memset(inner, 'b', SERIALIZATION_ARENA_BLOCK_SIZE * 2);
+    }
+    char* next = arena.allocate(SERIALIZATION_ARENA_BLOCK_SIZE);
+    std::memset(next, 'c', SERIALIZATION_ARENA_BLOCK_SIZE);
+    for (size_t i = 0; i < SERIALIZATION_ARENA_BLOCK_SIZE - 8; i++) {
+        ASSERT_EQ('a', outer[i]) << "Buffers of an outer scope must remain valid";
+    }
+}
+
+TEST(SerializationArenaTest, Serialize) {
+    SerializationArena arena;
+    SerializationArena::Scope scope(arena);
+    Triple triple(1, 2, 3);
+    size_t size, size_arena;
+    const char* data = triple.serialize(&size);
+    const char* data_arena = arena.serialize(triple, &size_arena);
+    ASSERT_EQ(size, size_arena) << "Serialized sizes must be equal";
+    ASSERT_EQ(0, std::memcmp(data, data_arena, size)) << "Serialized data must be equal";
+    delete[] data;
+
+    Triple triple_deserialized;
+    triple_deserialized.deserialize(data_arena, size_arena);
+    ASSERT_EQ(triple, triple_deserialized) << "Deserialized triple is incorrect";
+}
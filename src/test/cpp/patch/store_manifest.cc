@@ -0,0 +1,59 @@
+#include <fstream>
+#include <gtest/gtest.h>
+
+#include "../../../main/cpp/patch/store_manifest.h"
+
+#define TESTPATH "./"
+
+// The fixture to test the store manifest
+class StoreManifestTest : public ::testing::Test {
+protected:
+    virtual void TearDown() {
+        StoreManifest::cleanup(TESTPATH);
+    }
+};
+
+TEST_F(StoreManifestTest, Roundtrip) {
+    StoreManifest manifest(TESTPATH, false);
+    ASSERT_FALSE(manifest.is_loaded()) << "A store without manifest must be detected";
+    manifest.set_snapshot(0, 1000);
+    manifest.set_snapshot(5, 2000);
+    manifest.set_patch_tree(1, 4, 300);
+    manifest.set_patch_tree(6, 8, 400);
+    manifest.set_patch_tree(1, 4, 350);
+    ASSERT_TRUE(manifest.write()) << "The manifest of a writable store must be written";
+
+    StoreManifest read_manifest(TESTPATH, true);
+    ASSERT_TRUE(read_manifest.is_loaded()) << "The written manifest must be read";
+    std::map<int, size_t> snapshots = read_manifest.get_snapshots();
+    ASSERT_EQ(2, snapshots.size()) << "Number of snapshots is incorrect";
+    ASSERT_EQ(1000, snapshots[0]) << "Snapshot size is incorrect";
+    ASSERT_EQ(2000, snapshots[5]) << "Snapshot size is incorrect";
+    std::map<int, StoreManifest::PatchTreeEntry> patch_trees = read_manifest.get_patch_trees();
+    ASSERT_EQ(2, patch_trees.size()) << "Number of patch trees is incorrect";
+    ASSERT_EQ(4, patch_trees[1].max_patch_id) << "Max patch id is incorrect";
+    ASSERT_EQ(350, patch_trees[1].size) << "Updated patch tree size is incorrect";
+    ASSERT_EQ(8, patch_trees[6].max_patch_id) << "Max patch id is incorrect";
+    ASSERT_EQ(400, patch_trees[6].size) << "Patch tree size is incorrect";
+}
+
+TEST_F(StoreManifestTest, Readonly) {
+    StoreManifest manifest(TESTPATH, true);
+    manifest.set_snapshot(0, 1000);
+    ASSERT_FALSE(manifest.write()) << "The manifest of a read-only store must not be written";
+    ASSERT_FALSE(StoreManifest(TESTPATH, true).is_loaded()) << "No manifest must exist";
+}
+
+TEST_F(StoreManifestTest, Incomplete) {
+    std::ofstream file(TESTPATH STORE_MANIFEST_FILENAME);
+    file << "ostrich-manifest " << STORE_MANIFEST_VERSION << "\n";
+    file << "snapshot 0 1000\n";
+    file.close();
+    ASSERT_FALSE(StoreManifest(TESTPATH, true).is_loaded()) << "A manifest that was not written completely must be ignored";
+
+    file.open(TESTPATH STORE_MANIFEST_FILENAME);
+    file << "ostrich-manifest " << (STORE_MANIFEST_VERSION + 1) << "\n";
+    file << "end\n";
+    file.close();
+    ASSERT_FALSE(StoreManifest(TESTPATH, true).is_loaded()) << "A manifest of another version must be ignored";
+}
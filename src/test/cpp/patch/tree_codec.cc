@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+
+#include "../../../main/cpp/patch/tree_codec.h"
+
+
+TEST(TreeCodecTest, Parse) {
+    ASSERT_EQ(TREE_CODEC_DEFAULT, TreeCodec::parse("default").get_type()) << "Codec type is incorrect";
+    ASSERT_EQ(TREE_CODEC_NONE, TreeCodec::parse("none").get_type()) << "Codec type is incorrect";
+    ASSERT_EQ(TREE_CODEC_ZLIB, TreeCodec::parse("zlib").get_type()) << "Codec type is incorrect";
+    ASSERT_EQ(TREE_CODEC_LZO, TreeCodec::parse("lzo").get_type()) << "Codec type is incorrect";
+    ASSERT_EQ(TREE_CODEC_LZMA, TreeCodec::parse("lzma").get_type()) << "Codec type is incorrect";
+    for (std::string name : {"default", "none", "zlib", "lzo", "lzma"}) {
+        ASSERT_EQ(name, TreeCodec::parse(name).to_string()) << "Codec name must be parsed again";
+    }
+    if (TreeCodec::is_available(TREE_CODEC_ZSTD)) {
+        ASSERT_EQ("zstd:" + std::to_string(ZSTD_DEFAULT_LEVEL), TreeCodec::parse("zstd").to_string()) << "Default level is incorrect";
+        ASSERT_EQ("zstd-dict:9", TreeCodec::parse("zstd-dict:9").to_string()) << "Level is incorrect";
+    } else {
+        ASSERT_THROW(TreeCodec::parse("zstd"), std::invalid_argument) << "Unavailable codecs must be rejected";
+    }
+    ASSERT_THROW(TreeCodec::parse("snappy"), std::invalid_argument) << "Unknown codecs must be rejected";
+}
+
+TEST(TreeCodecTest, Options) {
+    int8_t kc_opts = kyotocabinet::TreeDB::TLINEAR;
+    ASSERT_EQ(kc_opts, TreeCodec().get_options(kc_opts)) << "The default codec must not change options";
+    ASSERT_EQ(kc_opts | kyotocabinet::TreeDB::TCOMPRESS, TreeCodec(TREE_CODEC_LZO).get_options(kc_opts)) << "Codecs must enable compression";
+    ASSERT_EQ(kc_opts, TreeCodec(TREE_CODEC_NONE).get_options(kc_opts | kyotocabinet::TreeDB::TCOMPRESS)) << "No codec must disable compression";
+}
+
+TEST(TreeCodecTest, CompressorRoundtrip) {
+    std::string data;
+    for (int i = 0; i < 1000; i++) {
+        data += "<http://example.org/s" + std::to_string(i % 17) + ">";
+    }
+    for (TreeCodecType type : {TREE_CODEC_ZLIB, TREE_CODEC_LZO, TREE_CODEC_LZMA, TREE_CODEC_LZ4, TREE_CODEC_ZSTD}) {
+        if (!TreeCodec::is_available(type)) {
+            continue;
+        }
+        kyotocabinet::Compressor* compressor = TreeCodec(type).create_compressor();
+        ASSERT_NE(nullptr, compressor) << "Compressor must exist for codec " << type;
+        size_t compressed_size;
+        char* compressed = compressor->compress(data.data(), data.size(), &compressed_size);
+        ASSERT_NE(nullptr, compressed) << "Compression failed for codec " << type;
+        ASSERT_LT(compressed_size, data.size()) << "Data must be compressed by codec " << type;
+        size_t decompressed_size;
+        char* decompressed = compressor->decompress(compressed, compressed_size, &decompressed_size);
+        ASSERT_NE(nullptr, decompressed) << "Decompression failed for codec " << type;
+        ASSERT_EQ(data, std::string(decompressed, decompressed_size)) << "Roundtrip is incorrect for codec " << type;
+        delete[] compressed;
+        delete[] decompressed;
+        delete compressor;
+    }
+    ASSERT_EQ(nullptr, TreeCodec().create_compressor()) << "The default codec uses the KC compressor";
+}
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "../../../main/cpp/patch/triple_runs.h"
+#include "../../../main/cpp/patch/patch_tree_key_comparator.h"
+#include "../../../main/cpp/dictionary/dictionary_manager.h"
+
+#define TESTPATH "./"
+
+// Fixture for a POS tree that is written through sorted runs
+class TripleRunsTest : public ::testing::Test {
+protected:
+    std::shared_ptr<DictionaryManager> dict;
+    PatchTreeKeyComparator* comparator;
+    kyotocabinet::TreeDB* db;
+
+    TripleRunsTest() : dict(), comparator(), db() {}
+
+    virtual void SetUp() {
+        dict = std::make_shared<DictionaryManager>(TESTPATH, 0);
+        comparator = new PatchTreeKeyComparator(comp_p, comp_o, comp_s, dict);
+        db = new kyotocabinet::TreeDB();
+        db->tune_comparator(comparator);
+        db->open(TESTPATH "triple_runs_test", kyotocabinet::TreeDB::OWRITER | kyotocabinet::TreeDB::OCREATE | kyotocabinet::TreeDB::OTRUNCATE);
+    }
+
+    virtual void TearDown() {
+        db->close();
+        delete db;
+        delete comparator;
+        std::remove(TESTPATH "triple_runs_test");
+        DictionaryManager::cleanup(TESTPATH, 0);
+    }
+
+    void add(TripleRuns& runs, const Triple& triple, const std::string& value) {
+        size_t size;
+        const char* data = triple.serialize(&size);
+        runs.add(data, size, value.data(), value.size());
+        delete[] data;
+    }
+
+    std::string get_contents() {
+        std::string contents;
+        kyotocabinet::DB::Cursor* cursor = db->cursor();
+        cursor->jump();
+        const char* kbp;
+        const char* vbp;
+        size_t ksp, vsp;
+        while ((kbp = cursor->get(&ksp, &vbp, &vsp, true)) != nullptr) {
+            Triple triple;
+            triple.deserialize(kbp, ksp);
+            contents += triple.to_string(*dict) + "=" + std::string(vbp, vsp) + "\n";
+            delete[] kbp;
+        }
+        delete cursor;
+        return contents;
+    }
+};
+
+TEST_F(TripleRunsTest, MergeRuns) {
+    // Every record is written as a separate run
+    TripleRuns runs(TESTPATH "triple_runs_test", db, comparator, 1);
+    add(runs, Triple("a", "c", "a", dict), "1");
+    add(runs, Triple("b", "a", "a", dict), "2");
+    add(runs, Triple("a", "b", "b", dict), "3");
+    add(runs, Triple("b", "a", "a", dict), "4");
+    add(runs, Triple("c", "b", "a", dict), "5");
+    ASSERT_EQ(5, runs.get_run_count()) << "Run count is incorrect";
+    ASSERT_EQ(0, db->count()) << "Runs must not be in the tree before compaction";
+
+    runs.compact(false);
+    ASSERT_EQ(0, runs.get_run_count()) << "Runs must be removed after compaction";
+    ASSERT_EQ("b a a.=4\n"
+              "c b a.=5\n"
+              "a b b.=3\n"
+              "a c a.=1\n", get_contents()) << "The last record of each key must be merged in POS order";
+}
+
+TEST_F(TripleRunsTest, MergeBufferInBackground) {
+    TripleRuns runs(TESTPATH "triple_runs_test", db, comparator);
+    add(runs, Triple("a", "c", "a", dict), "1");
+    add(runs, Triple("a", "a", "c", dict), "2");
+    add(runs, Triple("a", "c", "a", dict), "3");
+    ASSERT_EQ(0, runs.get_run_count()) << "Small buffers must not be written as runs";
+
+    runs.compact(true);
+    add(runs, Triple("b", "b", "b", dict), "4");
+    runs.wait();
+    ASSERT_EQ("a a c.=2\n"
+              "a c a.=3\n", get_contents()) << "Only the records before the compaction must be merged";
+
+    runs.compact(false);
+    ASSERT_EQ("a a c.=2\n"
+              "b b b.=4\n"
+              "a c a.=3\n", get_contents()) << "All records must be merged";
+}
+
+TEST_F(TripleRunsTest, ConcurrentAdds) {
+    // The buffer fills after a few records, so the threads write runs while the others keep adding
+    TripleRuns runs(TESTPATH "triple_runs_test", db, comparator, 64);
+    std::vector<std::vector<Triple>> thread_triples(4);
+    for (int thread_id = 0; thread_id < 4; thread_id++) {
+        for (int i = 0; i < 50; i++) {
+            thread_triples[thread_id].emplace_back("s" + std::to_string(thread_id), "p", "o" + std::to_string(i), dict);
+        }
+    }
+    std::vector<std::thread> threads;
+    for (int thread_id = 0; thread_id < 4; thread_id++) {
+        threads.emplace_back([&, thread_id]() {
+            // Each key is overwritten by the same thread, so its last value must win
+            for (int value = 0; value < 3; value++) {
+                for (const Triple& triple : thread_triples[thread_id]) {
+                    add(runs, triple, std::to_string(value));
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    runs.compact(false);
+
+    ASSERT_EQ(0, runs.get_run_count()) << "Runs must be removed after compaction";
+    ASSERT_EQ(200, db->count()) << "All keys must be merged";
+    kyotocabinet::DB::Cursor* cursor = db->cursor();
+    cursor->jump();
+    const char* kbp;
+    const char* vbp;
+    size_t ksp, vsp;
+    while ((kbp = cursor->get(&ksp, &vbp, &vsp, true)) != nullptr) {
+        ASSERT_EQ("2", std::string(vbp, vsp)) << "The last record of each key must be merged";
+        delete[] kbp;
+    }
+    delete cursor;
+}
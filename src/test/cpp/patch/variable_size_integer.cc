@@ -187,3 +187,60 @@ TEST(VariableSizeInteger, UnsignedMiddleInt64) {
         buffer.clear();
     }
 }
+
+TEST(VariableSizeInteger, UnsignedBlock) {
+    std::vector<uint64_t> values;
+    for (uint64_t i = 0; i < 64; i++) {
+        values.push_back(i);
+        values.push_back((1ULL << i) - 1);
+        values.push_back(1ULL << i);
+    }
+    values.push_back(std::numeric_limits<uint64_t>::max());
+    std::vector<uint8_t> buffer;
+    for (uint64_t value : values) {
+        encode_ULEB128(value, buffer);
+    }
+    std::vector<uint64_t> decoded(values.size() + 1);
+    size_t size;
+    ASSERT_EQ(values.size(), decode_ULEB128_block(buffer.data(), buffer.size(), decoded.data(), decoded.size(), &size))
+        << "The amount of decoded values is incorrect";
+    ASSERT_EQ(buffer.size(), size) << "The encoded size and the decoded size are not equal";
+    for (size_t i = 0; i < values.size(); i++) {
+        ASSERT_EQ(values[i], decoded[i]);
+    }
+}
+
+TEST(VariableSizeInteger, SignedBlock) {
+    std::vector<int64_t> values;
+    for (int64_t i = -1000; i < 1000; i += 7) {
+        values.push_back(i);
+        values.push_back(i * 1000003);
+    }
+    values.push_back(std::numeric_limits<int64_t>::min());
+    values.push_back(std::numeric_limits<int64_t>::max());
+    std::vector<uint8_t> buffer;
+    for (int64_t value : values) {
+        encode_SLEB128(value, buffer);
+    }
+    // Decode in parts, so that the parts do not start at a block boundary
+    std::vector<int64_t> decoded(values.size());
+    size_t offset = 0, count = 0, size;
+    while (count < values.size()) {
+        count += decode_SLEB128_block(buffer.data() + offset, buffer.size() - offset, decoded.data() + count,
+                                      std::min((size_t) 5, values.size() - count), &size);
+        offset += size;
+    }
+    ASSERT_EQ(buffer.size(), offset) << "The encoded size and the decoded size are not equal";
+    for (size_t i = 0; i < values.size(); i++) {
+        ASSERT_EQ(values[i], decoded[i]);
+    }
+}
+
+TEST(VariableSizeInteger, BlockTruncated) {
+    std::vector<uint8_t> buffer;
+    encode_ULEB128(1, buffer);
+    encode_ULEB128(1ULL << 40, buffer);
+    uint64_t decoded[2];
+    ASSERT_THROW(decode_ULEB128_block(buffer.data(), buffer.size() - 1, decoded, 2), std::runtime_error)
+        << "Values that do not end within the data must be rejected";
+}
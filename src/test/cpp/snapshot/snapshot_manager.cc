@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <fstream>
 
 #include "../../../main/cpp/snapshot/snapshot_manager.h"
 #include "../../../main/cpp/snapshot/vector_triple_iterator.h"
@@ -30,8 +31,9 @@ protected:
         std::list<int> patchDictsToDelete;
         while(it != patches.end()) {
             int id = *it;
+            snapshotManager->wait_for_index(id);
             std::remove((TESTPATH + SNAPSHOT_FILENAME_BASE(id)).c_str());
-            std::remove((TESTPATH + SNAPSHOT_FILENAME_BASE(id) + ".index.v1-1").c_str());
+            std::remove((TESTPATH + SNAPSHOT_INDEX_FILENAME(id)).c_str());
             patchDictsToDelete.push_back(id);
             it++;
         }
@@ -64,6 +66,18 @@ TEST_F(SnapshotManagerTest, GetSnapshot) {
     ASSERT_EQ(snapshot, snapshotManager->get_snapshot(100));
 }
 
+TEST_F(SnapshotManagerTest, WriteSnapshot) {
+    ASSERT_EQ(3, snapshotManager->write_snapshot(100, it, BASEURI)) << "Triple count is incorrect";
+    ASSERT_EQ(100, snapshotManager->get_latest_snapshot(100)) << "Written snapshot must be detected";
+    snapshotManager->wait_for_index(100);
+    std::ifstream index(TESTPATH + SNAPSHOT_INDEX_FILENAME(100));
+    ASSERT_TRUE(index.good()) << "Index must be built when a snapshot is written";
+    std::shared_ptr<hdt::HDT> snapshot = snapshotManager->get_snapshot(100);
+    ASSERT_NE(nullptr, snapshot) << "Written snapshot must be loaded lazily";
+    ASSERT_EQ(3, snapshot->getTriples()->getNumberOfElements()) << "Triple count is incorrect";
+    ASSERT_EQ(3, snapshotManager->write_snapshot(100, it, BASEURI)) << "Existing snapshots must not be overwritten";
+}
+
 TEST_F(SnapshotManagerTest, GetByPatchId) {
     snapshotManager->create_snapshot(0, it, BASEURI);
     snapshotManager->create_snapshot(10, it, BASEURI);